@@ -34,13 +34,16 @@
 int sortedtable_module_init()
 {
     redisLog(REDIS_WARNING, "\033[31mlibsortedtable.so initialize ...\033[0m");
-    return 0;
+    return tableInit();
 }
 
 START_FUNCTIONS(sortedtable_module_functions)
-    FUNCTION("hcreate", hcreateCommand, 2, "w", REDIS_CMD_WRITE),
-    FUNCTION("hadd", haddCommand, 2, "wm", REDIS_CMD_WRITE|REDIS_CMD_DENYOOM),
-    FUNCTION("hrem", hremCommand, 2, "w", REDIS_CMD_WRITE),
+    FUNCTION("hcreate", hcreateCommand, -4, "w", REDIS_CMD_WRITE),
+    FUNCTION("hadd", haddCommand, -5, "wm", REDIS_CMD_WRITE|REDIS_CMD_DENYOOM),
+    FUNCTION("hrem", hremCommand, -5, "w", REDIS_CMD_WRITE),
+    FUNCTION("hrange", hrangeCommand, -3, "r", REDIS_CMD_READONLY),
+    FUNCTION("hrank", hrankCommand, -5, "r", REDIS_CMD_READONLY),
+    FUNCTION("hcount", hcountCommand, -3, "r", REDIS_CMD_READONLY),
 END_FUNCTIONS()
 
 redisModule sortedtable_module = {
@@ -35,11 +35,29 @@
 
 #define REDIS_TABLE 5
 
-robj* createTableObject();
+/* A table schema, as declared by HCREATE. Every row of a table is sorted by
+ * the composite key made of the 'columns' key fields, each one in ascending
+ * or descending order. Schemas are never released. */
+typedef struct tableSchema {
+    sds name;
+    int columns;        /* Number of key columns. */
+    sds *fields;        /* Key column names, in key order. */
+    int *desc;          /* Non zero if the column is sorted descending. */
+} tableSchema;
+
+/* Encoding of a single key column inside the row composite key. */
+#define TABLE_KEY_NUMBER 1
+#define TABLE_KEY_STRING 2
+
+int tableInit(void);
+robj* createTableObject(tableSchema *schema);
 
 // sortedtable Command
 void hcreateCommand(redisClient *c);
 void haddCommand(redisClient *c);
 void hremCommand(redisClient *c);
+void hrangeCommand(redisClient *c);
+void hrankCommand(redisClient *c);
+void hcountCommand(redisClient *c);
 
 #endif /* __SORTEDTABLE_H__ */
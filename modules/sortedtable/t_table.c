@@ -31,14 +31,587 @@
  * Sorted Table API
  *----------------------------------------------------------------------------*/
 
+/* A table is a red-black tree of rows, stored as string objects with the
+ * following layout:
+ *
+ * <keylen><key><nfields><flen><field><vlen><value>...
+ *
+ * All the lengths are 32 bit little endian unsigned integers. <key> is the
+ * composite key of the row: the key columns encoded one after the other so
+ * that comparing two keys with memcmp() gives the table order, and so that
+ * the key of the first N columns is a prefix of the full key. This makes a
+ * range of rows sharing the first N key columns a contiguous range of the
+ * tree. The key is followed by all the fields of the row, key columns
+ * first, as given by the user. */
+
 #include "redis.h"
 #include "sortedtable.h"
-#include <math.h>
+#include "endianconv.h"
+#include <ctype.h>
+
+/* Schemas declared with HCREATE, by table name. */
+static dict *tables;
+
+static unsigned int tableSchemaHash(const void *key) {
+    return dictGenHashFunction(key, sdslen((sds)key));
+}
+
+static int tableSchemaKeyCompare(void *privdata, const void *key1,
+        const void *key2)
+{
+    DICT_NOTUSED(privdata);
+    return sdscmp((sds)key1, (sds)key2) == 0;
+}
+
+static dictType tableSchemaDictType = {
+    tableSchemaHash,            /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    tableSchemaKeyCompare,      /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+static tableSchema *tableSchemaCreate(sds name, int columns) {
+    tableSchema *schema = zmalloc(sizeof(*schema));
+
+    schema->name = sdsdup(name);
+    schema->columns = columns;
+    schema->fields = zcalloc(sizeof(sds)*columns);
+    schema->desc = zcalloc(sizeof(int)*columns);
+    return schema;
+}
+
+static void tableSchemaRelease(tableSchema *schema) {
+    int j;
+
+    for (j = 0; j < schema->columns; j++) sdsfree(schema->fields[j]);
+    zfree(schema->fields);
+    zfree(schema->desc);
+    sdsfree(schema->name);
+    zfree(schema);
+}
+
+/* Add a new schema to the declared tables. If a table with the same name
+ * already exists the new schema is released, and the existing one is
+ * returned if it has the same key, otherwise NULL is returned. */
+static tableSchema *tableSchemaRegister(tableSchema *schema) {
+    tableSchema *existing = dictFetchValue(tables, schema->name);
+    int j, same;
+
+    if (existing == NULL) {
+        dictAdd(tables, schema->name, schema);
+        return schema;
+    }
+
+    same = existing->columns == schema->columns;
+    for (j = 0; same && j < schema->columns; j++) {
+        same = sdscmp(existing->fields[j], schema->fields[j]) == 0 &&
+               existing->desc[j] == schema->desc[j];
+    }
+    tableSchemaRelease(schema);
+    return same ? existing : NULL;
+}
+
+static sds tableAppendLength(sds s, uint32_t len) {
+    len = intrev32ifbe(len);
+    return sdscatlen(s, &len, sizeof(len));
+}
+
+static uint32_t tableReadLength(const unsigned char *p) {
+    uint32_t len;
+    memcpy(&len, p, sizeof(len));
+    return intrev32ifbe(len);
+}
+
+/* Values that look like numbers are sorted numerically, before any other
+ * value. Returns 1 and sets '*d' if the string is a number.
+ *
+ * Only the canonical spelling of a number is accepted, that is an optional
+ * minus sign, an integer part without leading zeros and an optional
+ * fractional part, exactly as printed by "%.*f" with the fewest digits that
+ * give back the same double. Otherwise "1.0" and "1", or "0x10" and "16",
+ * would be the same key while being different strings. Numbers that can't
+ * be represented exactly, such as integers above 2^53, are not canonical
+ * either and are sorted as strings. */
+static int tableParseNumber(const char *s, size_t len, double *d) {
+    char buf[128], fmt[128], *eptr;
+    size_t j = 0, digits, decimals = 0;
+    int fmtlen;
+
+    if (len == 0 || len >= sizeof(buf)) return 0;
+    if (s[j] == '-') j++;
+    digits = j;
+    while (j < len && isdigit((unsigned char)s[j])) j++;
+    if (j == digits) return 0;
+    if (j < len && s[j] == '.') {
+        decimals = ++j;
+        while (j < len && isdigit((unsigned char)s[j])) j++;
+        if (j == decimals) return 0;
+        decimals = j-decimals;
+    }
+    if (j != len) return 0;
+
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    errno = 0;
+    *d = strtod(buf, &eptr);
+    if (eptr[0] != '\0' || errno == ERANGE) return 0;
+    if (*d == 0) *d = 0; /* -0 and 0 are the same key. */
+
+    /* The string must be what we print for this double... */
+    fmtlen = snprintf(fmt, sizeof(fmt), "%.*f", (int)decimals, *d);
+    if ((size_t)fmtlen != len || memcmp(fmt, s, len) != 0) return 0;
+    /* ...and no shorter spelling must give the same double. */
+    if (decimals) {
+        snprintf(fmt, sizeof(fmt), "%.*f", (int)decimals-1, *d);
+        if (strtod(fmt, NULL) == *d) return 0;
+    }
+    return 1;
+}
+
+/* Append to 'key' the encoding of a key column value. Descending columns
+ * are encoded inverting all the bits, so that memcmp() sorts them in
+ * reverse order. */
+static sds tableEncodeColumn(sds key, robj *value, int desc) {
+    size_t start = sdslen(key), len, j;
+    unsigned char *p;
+    double d;
+
+    value = getDecodedObject(value);
+    p = value->ptr;
+    len = sdslen(value->ptr);
+    if (tableParseNumber((char*)p, len, &d)) {
+        unsigned char buf[9];
+        uint64_t bits;
+
+        /* Flip the sign bit of positive numbers and all the bits of the
+         * negative ones: the big endian representation of the result sorts
+         * as the numbers do. */
+        memcpy(&bits, &d, sizeof(bits));
+        bits = (bits & (1ULL<<63)) ? ~bits : (bits | (1ULL<<63));
+        buf[0] = TABLE_KEY_NUMBER;
+        for (j = 0; j < 8; j++) buf[1+j] = (bits >> (56-j*8)) & 0xff;
+        key = sdscatlen(key, buf, sizeof(buf));
+    } else {
+        /* Zero bytes are escaped as 00 ff and the string is terminated by
+         * 00 01, so that no encoded string is a prefix of another one. */
+        key = sdscatlen(key, "\x02", 1);
+        while (len) {
+            unsigned char *zero = memchr(p, 0, len);
+            size_t run = zero ? (size_t)(zero-p) : len;
+
+            key = sdscatlen(key, p, run);
+            p += run;
+            len -= run;
+            if (zero) {
+                key = sdscatlen(key, "\x00\xff", 2);
+                p++;
+                len--;
+            }
+        }
+        key = sdscatlen(key, "\x00\x01", 2);
+    }
+    decrRefCount(value);
+
+    if (desc) {
+        for (j = start; j < sdslen(key); j++) key[j] = ~key[j];
+    }
+    return key;
+}
+
+/* Encode the composite key of the first 'count' key columns. */
+static sds tableEncodeKey(tableSchema *schema, robj **vals, int count) {
+    sds key = sdsempty();
+    int j;
+
+    for (j = 0; j < count; j++)
+        key = tableEncodeColumn(key, vals[j], schema->desc[j]);
+    return key;
+}
+
+/* Rows are compared by composite key only. */
+static int tableRowCompare(robj *r1, robj *r2) {
+    unsigned char *p1 = r1->ptr, *p2 = r2->ptr;
+    uint32_t l1 = tableReadLength(p1), l2 = tableReadLength(p2);
+    int cmp = memcmp(p1+4, p2+4, (l1 < l2) ? l1 : l2);
+
+    if (cmp == 0) return (l1 < l2) ? -1 : (l1 > l2);
+    return cmp;
+}
+
+static int tableRowHasPrefix(robj *row, sds prefix) {
+    unsigned char *p = row->ptr;
+
+    return tableReadLength(p) >= sdslen(prefix) &&
+           memcmp(p+4, prefix, sdslen(prefix)) == 0;
+}
+
+/* Create a row object carrying just the composite key, to be used as a
+ * search key in the tree. */
+static robj *tableCreateProbe(sds key) {
+    sds s = tableAppendLength(sdsempty(), sdslen(key));
+    return createObject(REDIS_STRING, sdscatsds(s, key));
+}
+
+static sds tableAppendField(sds row, robj *field) {
+    field = getDecodedObject(field);
+    row = tableAppendLength(row, sdslen(field->ptr));
+    row = sdscatsds(row, field->ptr);
+    decrRefCount(field);
+    return row;
+}
+
+static int tableColumnIndex(tableSchema *schema, sds field) {
+    int j;
+
+    for (j = 0; j < schema->columns; j++)
+        if (sdscmp(schema->fields[j], field) == 0) return j;
+    return -1;
+}
+
+/* Create the row of the HADD field/value pairs starting at argv[first].
+ * 'vals' are the values of the key columns, already parsed. */
+static robj *tableCreateRow(redisClient *c, tableSchema *schema, sds key,
+        robj **vals, int first)
+{
+    sds row = tableAppendLength(sdsempty(), sdslen(key));
+    robj *field;
+    int j;
+
+    row = sdscatsds(row, key);
+    row = tableAppendLength(row, (c->argc-first)/2);
+    for (j = 0; j < schema->columns; j++) {
+        field = createStringObject(schema->fields[j], sdslen(schema->fields[j]));
+        row = tableAppendField(row, field);
+        row = tableAppendField(row, vals[j]);
+        decrRefCount(field);
+    }
+    for (j = first; j < c->argc; j += 2) {
+        if (tableColumnIndex(schema, c->argv[j]->ptr) != -1) continue;
+        row = tableAppendField(row, c->argv[j]);
+        row = tableAppendField(row, c->argv[j+1]);
+    }
+    return createObject(REDIS_STRING, row);
+}
+
+static void addReplyTableRow(redisClient *c, robj *row) {
+    unsigned char *p = row->ptr;
+    uint32_t len, nfields, j;
+
+    p += 4 + tableReadLength(p);
+    nfields = tableReadLength(p);
+    p += 4;
+    addReplyMultiBulkLen(c, nfields*2);
+    for (j = 0; j < nfields*2; j++) {
+        len = tableReadLength(p);
+        addReplyBulkCBuffer(c, p+4, len);
+        p += 4 + len;
+    }
+}
+
+/* Returns the first row starting with 'prefix', or NULL. */
+static rbNode *tableFirstWithPrefix(rbtree *tree, sds prefix) {
+    robj *probe = tableCreateProbe(prefix);
+    rbNode *n = rbtreeNearby(tree, probe);
+
+    decrRefCount(probe);
+    if (n && !tableRowHasPrefix(n->obj, prefix)) n = NULL;
+    return n;
+}
+
+/* Count the rows starting with 'prefix', that are the rows between the
+ * prefix and its successor, without visiting them. */
+static unsigned long tableCountWithPrefix(rbtree *tree, sds prefix) {
+    robj *min = tableCreateProbe(prefix), *max = NULL;
+    sds next = sdsdup(prefix);
+    size_t len = sdslen(next);
+    unsigned long count;
+
+    while (len && (unsigned char)next[len-1] == 0xff) len--;
+    if (len) {
+        next[len-1]++;
+        sdsrange(next, 0, len-1);
+        max = tableCreateProbe(next);
+    }
+    count = rbtreeCountRange(tree, min, max);
+    decrRefCount(min);
+    if (max) decrRefCount(max);
+    sdsfree(next);
+    return count;
+}
+
+robj* createTableObject(tableSchema *schema) {
+    rbtree *tree = rbtreeCreateWithCompare(tableRowCompare);
+    robj *o = createObject(REDIS_TABLE, tree);
+
+    tree->privdata = schema;
+    o->encoding = REDIS_ENCODING_RBTREE;
+    return o;
+}
+
+static tableSchema *tableLookupSchemaOrReply(redisClient *c, robj *name) {
+    tableSchema *schema = dictFetchValue(tables, name->ptr);
+
+    if (schema == NULL)
+        addReplyErrorFormat(c, "no such table '%s'", (char*)name->ptr);
+    return schema;
+}
+
+/* Like checkType(), also making sure the key holds a table of 'schema'. */
+static int tableCheckTypeOrReply(redisClient *c, robj *o, tableSchema *schema) {
+    if (checkType(c, o, REDIS_TABLE)) return 1;
+    if (((rbtree*)o->ptr)->privdata != schema) {
+        addReplyErrorFormat(c, "key is not a '%s' table", schema->name);
+        return 1;
+    }
+    return 0;
+}
+
+/* Parse the field/value pairs in argv[first..last-1], storing in 'vals' the
+ * value of every key column given (NULL for the others). Fields that are
+ * not key columns are only accepted if 'extra' is true. The key columns
+ * given must be a prefix of the table key: their number is returned, or
+ * -1 after replying with an error. */
+static int tableParseFields(redisClient *c, tableSchema *schema, int first,
+        int last, robj **vals, int extra)
+{
+    int j, k, idx, count;
+
+    if ((last-first) % 2) {
+        addReply(c, shared.syntaxerr);
+        return -1;
+    }
+    for (j = 0; j < schema->columns; j++) vals[j] = NULL;
+    for (j = first; j < last; j += 2) {
+        for (k = first; k < j; k += 2) {
+            if (sdscmp(c->argv[j]->ptr, c->argv[k]->ptr) == 0) {
+                addReplyErrorFormat(c, "duplicate field '%s'",
+                    (char*)c->argv[j]->ptr);
+                return -1;
+            }
+        }
+        idx = tableColumnIndex(schema, c->argv[j]->ptr);
+        if (idx != -1) {
+            vals[idx] = c->argv[j+1];
+        } else if (!extra) {
+            addReplyErrorFormat(c, "'%s' is not a key column of table '%s'",
+                (char*)c->argv[j]->ptr, schema->name);
+            return -1;
+        }
+    }
+    for (count = 0; count < schema->columns && vals[count]; count++);
+    for (j = count; j < schema->columns; j++) {
+        if (vals[j]) {
+            addReplyErrorFormat(c, "missing value for key column '%s'",
+                schema->fields[count]);
+            return -1;
+        }
+    }
+    return count;
+}
+
+/* Like tableParseFields() but requires all the key columns. */
+static int tableParseKey(redisClient *c, tableSchema *schema, int first,
+        int last, robj **vals, int extra)
+{
+    int count = tableParseFields(c, schema, first, last, vals, extra);
+
+    if (count == -1) return REDIS_ERR;
+    if (count != schema->columns) {
+        addReplyErrorFormat(c, "missing value for key column '%s'",
+            schema->fields[count]);
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+ * Sorted Table type
+ *----------------------------------------------------------------------------*/
+
+static void tableFree(robj *o) {
+    rbtreeRelease(o->ptr);
+}
+
+/* Tables are saved as the table schema followed by the rows in key order:
+ *
+ * <name><columns><field><desc>...<rows><row>...
+ *
+ * The schema is saved with every key, so that a table can be loaded even
+ * if HCREATE was never called in the loading server. */
+static int tableRdbSave(rio *rdb, robj *o) {
+    rbtree *tree = o->ptr;
+    tableSchema *schema = tree->privdata;
+    rbNode *n;
+    int nwritten = 0, len, j;
+
+    if ((len = rdbSaveRawString(rdb, (unsigned char*)schema->name,
+                                sdslen(schema->name))) == -1) return -1;
+    nwritten += len;
+    if ((len = rdbSaveLen(rdb, schema->columns)) == -1) return -1;
+    nwritten += len;
+    for (j = 0; j < schema->columns; j++) {
+        if ((len = rdbSaveRawString(rdb, (unsigned char*)schema->fields[j],
+                                    sdslen(schema->fields[j]))) == -1) return -1;
+        nwritten += len;
+        if ((len = rdbSaveLen(rdb, schema->desc[j])) == -1) return -1;
+        nwritten += len;
+    }
+
+    if ((len = rdbSaveLen(rdb, rbtreeLength(tree))) == -1) return -1;
+    nwritten += len;
+    for (n = rbtreeMinimun(tree->root); n; n = rbtreeNext(n)) {
+        if ((len = rdbSaveStringObject(rdb, n->obj)) == -1) return -1;
+        nwritten += len;
+    }
+    return nwritten;
+}
+
+/* Check that a loaded row has the layout described at the top of this
+ * file, so that a corrupted payload can't make us access memory outside
+ * of the row later. */
+static int tableRowIsValid(robj *row) {
+    unsigned char *p = row->ptr;
+    size_t len = sdslen(row->ptr), pos, flen;
+    uint32_t nfields, j;
+
+    if (len < 4 || (size_t)tableReadLength(p) + 8 > len) return 0;
+    pos = 4 + tableReadLength(p);
+    nfields = tableReadLength(p+pos);
+    pos += 4;
+    for (j = 0; j < nfields*2; j++) {
+        if (pos + 4 > len) return 0;
+        flen = tableReadLength(p+pos);
+        if (pos + 4 + flen > len) return 0;
+        pos += 4 + flen;
+    }
+    return pos == len;
+}
+
+static robj *tableRdbLoad(rio *rdb) {
+    tableSchema *schema;
+    robj *name, *field, *o, **rows = NULL;
+    uint32_t columns, len, desc, j, loaded = 0;
+
+    if ((name = rdbLoadStringObject(rdb)) == NULL) return NULL;
+    columns = rdbLoadLen(rdb, NULL);
+    if (columns == REDIS_RDB_LENERR || columns == 0) {
+        decrRefCount(name);
+        return NULL;
+    }
+    schema = tableSchemaCreate(name->ptr, columns);
+    decrRefCount(name);
+    for (j = 0; j < columns; j++) {
+        if ((field = rdbLoadStringObject(rdb)) == NULL ||
+            (desc = rdbLoadLen(rdb, NULL)) == REDIS_RDB_LENERR)
+        {
+            if (field) decrRefCount(field);
+            tableSchemaRelease(schema);
+            return NULL;
+        }
+        schema->fields[j] = sdsdup(field->ptr);
+        schema->desc[j] = desc != 0;
+        decrRefCount(field);
+    }
+    if ((schema = tableSchemaRegister(schema)) == NULL) {
+        redisLog(REDIS_WARNING, "Table loaded with a key different from "
+                                "the declared one");
+        return NULL;
+    }
+
+    /* Rows are saved in key order: collect them and build the tree in
+     * O(N), checking that they are really sorted. */
+    if ((len = rdbLoadLen(rdb, NULL)) == REDIS_RDB_LENERR) return NULL;
+    for (j = 0; j < len; j++) {
+        robj *row = rdbLoadStringObject(rdb);
 
-robj* createTableObject() {
+        if (row == NULL || !tableRowIsValid(row) ||
+            (loaded && tableRowCompare(rows[loaded-1], row) >= 0))
+        {
+            if (row) decrRefCount(row);
+            goto loaderr;
+        }
+        /* Grow the array as rows are read, not trusting the length. */
+        if ((loaded & (loaded-1)) == 0)
+            rows = zrealloc(rows, sizeof(robj*)*(loaded ? loaded*2 : 1));
+        rows[loaded++] = row;
+    }
 
-    robj *o = NULL;
+    o = createTableObject(schema);
+    rbtreeBulkLoad(o->ptr, rows, loaded);
+    for (j = 0; j < loaded; j++) decrRefCount(rows[j]);
+    zfree(rows);
     return o;
+
+loaderr:
+    for (j = 0; j < loaded; j++) decrRefCount(rows[j]);
+    zfree(rows);
+    return NULL;
+}
+
+/* Rewrite a table as HCREATE followed by one HADD per row. */
+static int tableAofRewrite(rio *aof, robj *key, robj *o) {
+    rbtree *tree = o->ptr;
+    tableSchema *schema = tree->privdata;
+    rbNode *n;
+    int j;
+
+    if (rioWriteBulkCount(aof, '*', 2+schema->columns*2) == 0) return 0;
+    if (rioWriteBulkString(aof, "HCREATE", 7) == 0) return 0;
+    if (rioWriteBulkString(aof, schema->name, sdslen(schema->name)) == 0) return 0;
+    for (j = 0; j < schema->columns; j++) {
+        char *order = schema->desc[j] ? "DESC" : "ASC";
+
+        if (rioWriteBulkString(aof, schema->fields[j],
+                               sdslen(schema->fields[j])) == 0) return 0;
+        if (rioWriteBulkString(aof, order, strlen(order)) == 0) return 0;
+    }
+
+    for (n = rbtreeMinimun(tree->root); n; n = rbtreeNext(n)) {
+        unsigned char *p = n->obj->ptr;
+        uint32_t nfields, len;
+
+        p += 4 + tableReadLength(p);
+        nfields = tableReadLength(p);
+        p += 4;
+        if (rioWriteBulkCount(aof, '*', 3+nfields*2) == 0) return 0;
+        if (rioWriteBulkString(aof, "HADD", 4) == 0) return 0;
+        if (rioWriteBulkObject(aof, key) == 0) return 0;
+        if (rioWriteBulkString(aof, schema->name, sdslen(schema->name)) == 0) return 0;
+        for (j = 0; j < (int)nfields*2; j++) {
+            len = tableReadLength(p);
+            if (rioWriteBulkString(aof, (char*)p+4, len) == 0) return 0;
+            p += 4 + len;
+        }
+    }
+    return 1;
+}
+
+static size_t tableMemUsage(robj *o) {
+    rbtree *tree = o->ptr;
+    size_t mem = sizeof(*o) + sizeof(*tree);
+    rbNode *n;
+
+    for (n = rbtreeMinimun(tree->root); n; n = rbtreeNext(n))
+        mem += sizeof(*n) + sizeof(robj) + sdsAllocSize(n->obj->ptr);
+    return mem;
+}
+
+static redisModuleType tableType = {
+    "table",                    /* name */
+    REDIS_TABLE,                /* type */
+    tableFree,                  /* free */
+    tableRdbSave,               /* rdb_save */
+    tableRdbLoad,               /* rdb_load */
+    tableAofRewrite,            /* aof_rewrite */
+    NULL,                       /* encoding */
+    tableMemUsage               /* mem_usage */
+};
+
+int tableInit(void) {
+    tables = dictCreate(&tableSchemaDictType, NULL);
+    return redisModuleRegisterType(&tableType);
 }
 
 /*-----------------------------------------------------------------------------
@@ -47,31 +620,250 @@ robj* createTableObject() {
 
 // hcreate table field ASC|DESC [field ASC|DESC ...]
 void hcreateCommand(redisClient *c) {
+    tableSchema *schema;
+    int columns = (c->argc-2)/2, j, k;
+
+    if ((c->argc-2) % 2) {
+        addReply(c, shared.syntaxerr);
+        return;
+    }
+    for (j = 0; j < columns; j++) {
+        char *order = c->argv[3+j*2]->ptr;
+
+        if (strcasecmp(order, "asc") && strcasecmp(order, "desc")) {
+            addReply(c, shared.syntaxerr);
+            return;
+        }
+        for (k = 0; k < j; k++) {
+            if (sdscmp(c->argv[2+j*2]->ptr, c->argv[2+k*2]->ptr) == 0) {
+                addReplyErrorFormat(c, "duplicate column '%s'",
+                    (char*)c->argv[2+j*2]->ptr);
+                return;
+            }
+        }
+    }
 
+    schema = tableSchemaCreate(c->argv[1]->ptr, columns);
+    for (j = 0; j < columns; j++) {
+        schema->fields[j] = sdsdup(c->argv[2+j*2]->ptr);
+        schema->desc[j] = !strcasecmp(c->argv[3+j*2]->ptr, "desc");
+    }
+    if (dictFind(tables, schema->name) == NULL) server.dirty++;
+
+    /* Declaring again an existing table with the same key is not an error,
+     * so that HCREATE can be replayed from the AOF. */
+    if (tableSchemaRegister(schema) == NULL) {
+        addReplyErrorFormat(c, "table '%s' already exists with a different key",
+            (char*)c->argv[1]->ptr);
+    } else {
+        addReply(c, shared.ok);
+    }
 }
 
 // hadd key table field value [field value ...]
 void haddCommand(redisClient *c) {
-    robj *set;
+    tableSchema *schema;
+    robj *o, *row, **vals;
+    rbNode *n;
+    sds key;
+    int added;
 
-    set = lookupKeyWrite(c->db,c->argv[1]);
-    if (set == NULL) {
-        set = createTableObject();
-        dbAdd(c->db,c->argv[1],set);
-    } else {
-        if (set->type != REDIS_TABLE) {
-            addReply(c,shared.wrongtypeerr);
-            return;
-        }
+    if ((schema = tableLookupSchemaOrReply(c, c->argv[2])) == NULL) return;
+    o = lookupKeyWrite(c->db, c->argv[1]);
+    if (o != NULL && tableCheckTypeOrReply(c, o, schema)) return;
+
+    vals = zmalloc(sizeof(robj*)*schema->columns);
+    if (tableParseKey(c, schema, 3, c->argc, vals, 1) == REDIS_ERR) {
+        zfree(vals);
+        return;
     }
+    key = tableEncodeKey(schema, vals, schema->columns);
+    row = tableCreateRow(c, schema, key, vals, 3);
+    sdsfree(key);
+    zfree(vals);
 
+    if (o == NULL) {
+        o = createTableObject(schema);
+        dbAdd(c->db, c->argv[1], o);
+    }
 
+    /* A row with the same key is replaced, keeping its place in the tree. */
+    n = rbtreeInsert(o->ptr, row);
+    added = (n->obj == row);
+    if (!added) {
+        decrRefCount(n->obj);
+        n->obj = row;
+        incrRefCount(row);
+    }
+    decrRefCount(row);
 
+    signalModifiedKey(c->db, c->argv[1]);
+    notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC, "hadd", c->argv[1], c->db->id);
+    server.dirty++;
+    addReply(c, added ? shared.cone : shared.czero);
 }
 
 // hrem key table field value [field value ...]
 void hremCommand(redisClient *c) {
+    tableSchema *schema;
+    robj *o, **vals;
+    rbtree *tree;
+    rbNode *n;
+    sds prefix;
+    long deleted = 0;
+    int count;
+
+    if ((schema = tableLookupSchemaOrReply(c, c->argv[2])) == NULL) return;
+    vals = zmalloc(sizeof(robj*)*schema->columns);
+    count = tableParseFields(c, schema, 3, c->argc, vals, 0);
+    if (count == -1) {
+        zfree(vals);
+        return;
+    }
+    prefix = tableEncodeKey(schema, vals, count);
+    zfree(vals);
+
+    if ((o = lookupKeyWriteOrReply(c, c->argv[1], shared.czero)) == NULL ||
+        tableCheckTypeOrReply(c, o, schema))
+    {
+        sdsfree(prefix);
+        return;
+    }
+
+    /* Remove all the rows having the given key columns. */
+    tree = o->ptr;
+    while ((n = tableFirstWithPrefix(tree, prefix)) != NULL) {
+        rbtreeReleaseNode(rbtreeDelete(tree, n->obj));
+        deleted++;
+    }
+    sdsfree(prefix);
+
+    if (deleted) {
+        signalModifiedKey(c->db, c->argv[1]);
+        notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC, "hrem", c->argv[1], c->db->id);
+        if (tree->root == NULL) {
+            dbDelete(c->db, c->argv[1]);
+            notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC, "del", c->argv[1], c->db->id);
+        }
+        server.dirty += deleted;
+    }
+    addReplyLongLong(c, deleted);
+}
+
+// hrange key table [field value ...] [LIMIT offset count]
+void hrangeCommand(redisClient *c) {
+    tableSchema *schema;
+    robj *o, **vals;
+    rbNode *n;
+    sds prefix;
+    long offset = 0, limit = -1, rangelen = 0;
+    void *replylen;
+    int last = c->argc, count;
 
+    if ((schema = tableLookupSchemaOrReply(c, c->argv[2])) == NULL) return;
+    if (c->argc >= 6 && (c->argc-3) % 2 &&
+        !strcasecmp(c->argv[c->argc-3]->ptr, "limit"))
+    {
+        if ((getLongFromObjectOrReply(c, c->argv[c->argc-2], &offset, NULL) != REDIS_OK) ||
+            (getLongFromObjectOrReply(c, c->argv[c->argc-1], &limit, NULL) != REDIS_OK))
+            return;
+        last -= 3;
+    }
+
+    vals = zmalloc(sizeof(robj*)*schema->columns);
+    count = tableParseFields(c, schema, 3, last, vals, 0);
+    if (count == -1) {
+        zfree(vals);
+        return;
+    }
+    prefix = tableEncodeKey(schema, vals, count);
+    zfree(vals);
+
+    if ((o = lookupKeyReadOrReply(c, c->argv[1], shared.emptymultibulk)) == NULL ||
+        tableCheckTypeOrReply(c, o, schema))
+    {
+        sdsfree(prefix);
+        return;
+    }
+
+    /* Like ZRANGEBYSCORE, a negative offset returns no rows and a negative
+     * count returns all the rows from the offset. The offset is reached in
+     * O(log(N)) selecting the row by rank. */
+    n = (offset < 0) ? NULL : tableFirstWithPrefix(o->ptr, prefix);
+    if (n && offset) {
+        n = rbtreeSelect(o->ptr, rbtreeRank(o->ptr, n->obj) + offset);
+        if (n && !tableRowHasPrefix(n->obj, prefix)) n = NULL;
+    }
+
+    replylen = addDeferredMultiBulkLength(c);
+    while (n && limit--) {
+        addReplyTableRow(c, n->obj);
+        rangelen++;
+        n = rbtreeNext(n);
+        if (n && !tableRowHasPrefix(n->obj, prefix)) n = NULL;
+    }
+    setDeferredMultiBulkLength(c, replylen, rangelen);
+    sdsfree(prefix);
+}
+
+// hrank key table field value [field value ...]
+void hrankCommand(redisClient *c) {
+    tableSchema *schema;
+    robj *o, *probe, **vals;
+    unsigned long rank;
+    sds key;
+
+    if ((schema = tableLookupSchemaOrReply(c, c->argv[2])) == NULL) return;
+    vals = zmalloc(sizeof(robj*)*schema->columns);
+    if (tableParseKey(c, schema, 3, c->argc, vals, 0) == REDIS_ERR) {
+        zfree(vals);
+        return;
+    }
+    key = tableEncodeKey(schema, vals, schema->columns);
+    zfree(vals);
+
+    if ((o = lookupKeyReadOrReply(c, c->argv[1], shared.nullbulk)) == NULL ||
+        tableCheckTypeOrReply(c, o, schema))
+    {
+        sdsfree(key);
+        return;
+    }
+
+    probe = tableCreateProbe(key);
+    rank = rbtreeRank(o->ptr, probe);
+    decrRefCount(probe);
+    sdsfree(key);
+
+    if (rank == 0) {
+        addReply(c, shared.nullbulk);
+    } else {
+        addReplyLongLong(c, rank-1);
+    }
 }
 
+// hcount key table [field value ...]
+void hcountCommand(redisClient *c) {
+    tableSchema *schema;
+    robj *o, **vals;
+    sds prefix;
+    int count;
+
+    if ((schema = tableLookupSchemaOrReply(c, c->argv[2])) == NULL) return;
+    vals = zmalloc(sizeof(robj*)*schema->columns);
+    count = tableParseFields(c, schema, 3, c->argc, vals, 0);
+    if (count == -1) {
+        zfree(vals);
+        return;
+    }
+    prefix = tableEncodeKey(schema, vals, count);
+    zfree(vals);
 
+    if ((o = lookupKeyReadOrReply(c, c->argv[1], shared.czero)) == NULL ||
+        tableCheckTypeOrReply(c, o, schema))
+    {
+        sdsfree(prefix);
+        return;
+    }
+    addReplyLongLong(c, tableCountWithPrefix(o->ptr, prefix));
+    sdsfree(prefix);
+}
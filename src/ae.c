@@ -30,6 +30,8 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "fmacros.h"
+
 #include <stdio.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -44,12 +46,22 @@
 #include "zmalloc.h"
 #include "config.h"
 
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+/* Headers older than Linux 5.11 lack what we need. */
+#if !defined(IORING_FEAT_EXT_ARG) || !defined(IORING_FEAT_NODROP)
+#undef HAVE_IO_URING
+#endif
+#endif
+
 /* Include the best multiplexing layer supported by this system.
  * The following should be ordered by performances, descending. */
 #ifdef HAVE_EVPORT
 #include "ae_evport.c"
 #else
-    #ifdef HAVE_EPOLL
+    #if defined(HAVE_IO_URING)
+    #include "ae_iouring.c"
+    #elif defined(HAVE_EPOLL)
     #include "ae_epoll.c"
     #else
         #ifdef HAVE_KQUEUE
@@ -67,10 +79,16 @@ aeEventLoop *aeCreateEventLoop(int setsize) {
     if ((eventLoop = zmalloc(sizeof(*eventLoop))) == NULL) goto err;
     eventLoop->events = zmalloc(sizeof(aeFileEvent)*setsize);
     eventLoop->fired = zmalloc(sizeof(aeFiredEvent)*setsize);
-    if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
+    eventLoop->timeEventsById = zcalloc(sizeof(aeTimeEvent*)*16);
+    if (eventLoop->events == NULL || eventLoop->fired == NULL ||
+        eventLoop->timeEventsById == NULL) goto err;
     eventLoop->setsize = setsize;
     eventLoop->lastTime = time(NULL);
-    eventLoop->timeEventHead = NULL;
+    eventLoop->timeEvents = NULL;
+    eventLoop->timeEventsCount = 0;
+    eventLoop->timeEventsSize = 0;
+    eventLoop->timeEventsByIdMask = 15;
+    eventLoop->timeEventRunning = NULL;
     eventLoop->timeEventNextId = 0;
     eventLoop->stop = 0;
     eventLoop->maxfd = -1;
@@ -86,6 +104,7 @@ err:
     if (eventLoop) {
         zfree(eventLoop->events);
         zfree(eventLoop->fired);
+        zfree(eventLoop->timeEventsById);
         zfree(eventLoop);
     }
     return NULL;
@@ -122,7 +141,13 @@ int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
 }
 
 void aeDeleteEventLoop(aeEventLoop *eventLoop) {
+    int j;
+
     aeApiFree(eventLoop);
+    for (j = 0; j < eventLoop->timeEventsCount; j++)
+        zfree(eventLoop->timeEvents[j]);
+    zfree(eventLoop->timeEvents);
+    zfree(eventLoop->timeEventsById);
     zfree(eventLoop->events);
     zfree(eventLoop->fired);
     zfree(eventLoop);
@@ -200,6 +225,127 @@ static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms)
     *ms = when_ms;
 }
 
+/* Time events ordering: by deadline, then by id so that the timers with the
+ * same deadline fire in creation order. */
+static int aeTimeEventBefore(aeTimeEvent *a, aeTimeEvent *b) {
+    if (a->when_sec != b->when_sec) return a->when_sec < b->when_sec;
+    if (a->when_ms != b->when_ms) return a->when_ms < b->when_ms;
+    return a->id < b->id;
+}
+
+static void aeTimeHeapSet(aeEventLoop *eventLoop, int index, aeTimeEvent *te) {
+    eventLoop->timeEvents[index] = te;
+    te->heapIndex = index;
+}
+
+/* Move the event at 'index' towards the root of the heap while it fires
+ * before its parent. */
+static void aeTimeHeapUp(aeEventLoop *eventLoop, int index) {
+    aeTimeEvent *te = eventLoop->timeEvents[index];
+
+    while (index > 0) {
+        int parent = (index-1)/2;
+
+        if (!aeTimeEventBefore(te,eventLoop->timeEvents[parent])) break;
+        aeTimeHeapSet(eventLoop,index,eventLoop->timeEvents[parent]);
+        index = parent;
+    }
+    aeTimeHeapSet(eventLoop,index,te);
+}
+
+/* Move the event at 'index' towards the leaves of the heap while one of its
+ * children fires before it. */
+static void aeTimeHeapDown(aeEventLoop *eventLoop, int index) {
+    aeTimeEvent *te = eventLoop->timeEvents[index];
+    int count = eventLoop->timeEventsCount;
+
+    while (1) {
+        int child = index*2+1;
+
+        if (child >= count) break;
+        if (child+1 < count &&
+            aeTimeEventBefore(eventLoop->timeEvents[child+1],
+                              eventLoop->timeEvents[child])) child++;
+        if (!aeTimeEventBefore(eventLoop->timeEvents[child],te)) break;
+        aeTimeHeapSet(eventLoop,index,eventLoop->timeEvents[child]);
+        index = child;
+    }
+    aeTimeHeapSet(eventLoop,index,te);
+}
+
+/* Restore the heap property after the deadline of 'te' changed. */
+static void aeTimeHeapUpdate(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    aeTimeHeapUp(eventLoop,te->heapIndex);
+    aeTimeHeapDown(eventLoop,te->heapIndex);
+}
+
+static void aeTimeHeapInsert(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    if (eventLoop->timeEventsCount == eventLoop->timeEventsSize) {
+        eventLoop->timeEventsSize = eventLoop->timeEventsSize ?
+                                    eventLoop->timeEventsSize*2 : 16;
+        eventLoop->timeEvents = zrealloc(eventLoop->timeEvents,
+            sizeof(aeTimeEvent*)*eventLoop->timeEventsSize);
+    }
+    aeTimeHeapSet(eventLoop,eventLoop->timeEventsCount++,te);
+    aeTimeHeapUp(eventLoop,te->heapIndex);
+}
+
+/* Remove 'te' from the heap replacing it with the last event. */
+static void aeTimeHeapRemove(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    aeTimeEvent *last = eventLoop->timeEvents[--eventLoop->timeEventsCount];
+
+    if (last != te) {
+        aeTimeHeapSet(eventLoop,te->heapIndex,last);
+        aeTimeHeapUpdate(eventLoop,last);
+    }
+}
+
+/* The ids are sequential, so the low bits are a perfect hash function. The
+ * table is doubled every time the number of events exceeds its size. */
+static void aeTimeIdAdd(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    aeTimeEvent **table = eventLoop->timeEventsById;
+    long long j;
+
+    if (eventLoop->timeEventsCount > eventLoop->timeEventsByIdMask+1) {
+        long long mask = (eventLoop->timeEventsByIdMask+1)*2-1;
+
+        eventLoop->timeEventsById = zcalloc(sizeof(aeTimeEvent*)*(mask+1));
+        for (j = 0; j <= eventLoop->timeEventsByIdMask; j++) {
+            aeTimeEvent *e = table[j], *next;
+
+            while (e) {
+                next = e->hnext;
+                e->hnext = eventLoop->timeEventsById[e->id & mask];
+                eventLoop->timeEventsById[e->id & mask] = e;
+                e = next;
+            }
+        }
+        eventLoop->timeEventsByIdMask = mask;
+        zfree(table);
+        table = eventLoop->timeEventsById;
+    }
+    j = te->id & eventLoop->timeEventsByIdMask;
+    te->hnext = table[j];
+    table[j] = te;
+}
+
+static aeTimeEvent *aeTimeIdFind(aeEventLoop *eventLoop, long long id) {
+    aeTimeEvent *te;
+
+    if (id < 0) return NULL;
+    te = eventLoop->timeEventsById[id & eventLoop->timeEventsByIdMask];
+    while (te && te->id != id) te = te->hnext;
+    return te;
+}
+
+static void aeTimeIdRemove(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    aeTimeEvent **pe =
+        &eventLoop->timeEventsById[te->id & eventLoop->timeEventsByIdMask];
+
+    while (*pe != te) pe = &(*pe)->hnext;
+    *pe = te->hnext;
+}
+
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
         aeTimeProc *proc, void *clientData,
         aeEventFinalizerProc *finalizerProc)
@@ -214,31 +360,29 @@ long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
     te->timeProc = proc;
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
-    te->next = eventLoop->timeEventHead;
-    eventLoop->timeEventHead = te;
+    te->deleted = 0;
+    aeTimeHeapInsert(eventLoop,te);
+    aeTimeIdAdd(eventLoop,te);
     return id;
 }
 
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
 {
-    aeTimeEvent *te, *prev = NULL;
-
-    te = eventLoop->timeEventHead;
-    while(te) {
-        if (te->id == id) {
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
-            if (te->finalizerProc)
-                te->finalizerProc(eventLoop, te->clientData);
-            zfree(te);
-            return AE_OK;
-        }
-        prev = te;
-        te = te->next;
+    aeTimeEvent *te = aeTimeIdFind(eventLoop,id);
+
+    if (te == NULL) return AE_ERR; /* NO event with the specified ID found */
+    aeTimeIdRemove(eventLoop,te);
+    if (te == eventLoop->timeEventRunning) {
+        /* A timer deleting itself: processTimeEvents() will release it
+         * when the timeProc returns. */
+        te->deleted = 1;
+        return AE_OK;
     }
-    return AE_ERR; /* NO event with the specified ID found */
+    aeTimeHeapRemove(eventLoop,te);
+    if (te->finalizerProc)
+        te->finalizerProc(eventLoop, te->clientData);
+    zfree(te);
+    return AE_OK;
 }
 
 /* Search the first timer to fire.
@@ -246,32 +390,17 @@ int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
  * put in sleep without to delay any event.
  * If there are no timers NULL is returned.
  *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
+ * This is O(1) as the time events are kept in a heap. */
 static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    aeTimeEvent *nearest = NULL;
-
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
-    }
-    return nearest;
+    return eventLoop->timeEventsCount ? eventLoop->timeEvents[0] : NULL;
 }
 
 /* Process time events */
 static int processTimeEvents(aeEventLoop *eventLoop) {
-    int processed = 0;
-    aeTimeEvent *te;
+    int processed = 0, pending, j;
     long long maxId;
+    long now_sec, now_ms;
     time_t now = time(NULL);
 
     /* If the system clock is moved to the future, and then set back to the
@@ -283,54 +412,48 @@ static int processTimeEvents(aeEventLoop *eventLoop) {
      * processing events earlier is less dangerous than delaying them
      * indefinitely, and practice suggests it is. */
     if (now < eventLoop->lastTime) {
-        te = eventLoop->timeEventHead;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
+        for (j = 0; j < eventLoop->timeEventsCount; j++) {
+            eventLoop->timeEvents[j]->when_sec = 0;
+            eventLoop->timeEvents[j]->when_ms = 0;
         }
+        /* Now the events are ordered just by id: rebuild the heap. */
+        for (j = eventLoop->timeEventsCount/2-1; j >= 0; j--)
+            aeTimeHeapDown(eventLoop,j);
     }
     eventLoop->lastTime = now;
 
-    te = eventLoop->timeEventHead;
+    /* Fire the events at the top of the heap as long as they are due.
+     * We make sure to don't process events registered by event handlers
+     * itself, and to don't fire more events than the ones we had when
+     * starting, in order to don't loop forever when timers are rescheduled
+     * with a zero delay. Due events left behind are processed in the next
+     * iteration, that will not sleep since the nearest timer is due. */
     maxId = eventLoop->timeEventNextId-1;
-    while(te) {
-        long now_sec, now_ms;
-        long long id;
-
-        if (te->id > maxId) {
-            te = te->next;
-            continue;
-        }
-        aeGetTime(&now_sec, &now_ms);
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms))
-        {
-            int retval;
-
-            id = te->id;
-            retval = te->timeProc(eventLoop, id, te->clientData);
-            processed++;
-            /* After an event is processed our time event list may
-             * no longer be the same, so we restart from head.
-             * Still we make sure to don't process events registered
-             * by event handlers itself in order to don't loop forever.
-             * To do so we saved the max ID we want to handle.
-             *
-             * FUTURE OPTIMIZATIONS:
-             * Note that this is NOT great algorithmically. Redis uses
-             * a single time event so it's not a problem but the right
-             * way to do this is to add the new elements on head, and
-             * to flag deleted elements in a special way for later
-             * deletion (putting references to the nodes to delete into
-             * another linked list). */
-            if (retval != AE_NOMORE) {
-                aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
-            } else {
-                aeDeleteTimeEvent(eventLoop, id);
-            }
-            te = eventLoop->timeEventHead;
+    pending = eventLoop->timeEventsCount;
+    aeGetTime(&now_sec, &now_ms);
+    while (eventLoop->timeEventsCount && pending--) {
+        aeTimeEvent *te = eventLoop->timeEvents[0];
+        int retval;
+
+        if (te->id > maxId) break;
+        if (now_sec < te->when_sec ||
+            (now_sec == te->when_sec && now_ms < te->when_ms)) break;
+
+        eventLoop->timeEventRunning = te;
+        retval = te->timeProc(eventLoop, te->id, te->clientData);
+        eventLoop->timeEventRunning = NULL;
+        processed++;
+        if (te->deleted || retval == AE_NOMORE) {
+            if (!te->deleted) aeTimeIdRemove(eventLoop,te);
+            aeTimeHeapRemove(eventLoop,te);
+            if (te->finalizerProc)
+                te->finalizerProc(eventLoop, te->clientData);
+            zfree(te);
         } else {
-            te = te->next;
+            /* The handler may have added or removed events, so the event
+             * is not necessarily at the top of the heap anymore. */
+            aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
+            aeTimeHeapUpdate(eventLoop,te);
         }
     }
     return processed;
@@ -370,20 +493,21 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
             shortest = aeSearchNearestTimer(eventLoop);
         if (shortest) {
             long now_sec, now_ms;
+            long long ms;
 
             /* Calculate the time missing for the nearest
-             * timer to fire. */
+             * timer to fire. A timer already due doesn't wait at all. */
             aeGetTime(&now_sec, &now_ms);
+            ms = (shortest->when_sec - now_sec)*1000LL +
+                 shortest->when_ms - now_ms;
             tvp = &tv;
-            tvp->tv_sec = shortest->when_sec - now_sec;
-            if (shortest->when_ms < now_ms) {
-                tvp->tv_usec = ((shortest->when_ms+1000) - now_ms)*1000;
-                tvp->tv_sec --;
+            if (ms > 0) {
+                tvp->tv_sec = ms/1000;
+                tvp->tv_usec = (ms % 1000)*1000;
             } else {
-                tvp->tv_usec = (shortest->when_ms - now_ms)*1000;
+                tvp->tv_sec = 0;
+                tvp->tv_usec = 0;
             }
-            if (tvp->tv_sec < 0) tvp->tv_sec = 0;
-            if (tvp->tv_usec < 0) tvp->tv_usec = 0;
         } else {
             /* If we have to check for events but need to return
              * ASAP because of AE_DONT_WAIT we need to set the timeout
@@ -463,3 +587,81 @@ char *aeGetApiName(void) {
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
     eventLoop->beforesleep = beforesleep;
 }
+
+#ifdef AE_BENCHMARK_MAIN
+/* Time events microbenchmark:
+ *
+ * cc -O2 -DAE_BENCHMARK_MAIN -o ae-benchmark ae.c zmalloc.c
+ *
+ * Registers many timers far in the future, then a timer firing at every
+ * iteration, and measures aeProcessEvents() and aeDeleteTimeEvent(). */
+#define AE_BENCH_TIMERS 100000
+#define AE_BENCH_LOOPS 1000
+#define AE_BENCH_DELETES 10000
+
+static long long aeBenchUstime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+static int aeBenchIdleProc(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(id);
+    AE_NOTUSED(clientData);
+    return AE_NOMORE;
+}
+
+static int aeBenchTickProc(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(id);
+    (*(long*)clientData)++;
+    return AE_NOMORE;
+}
+
+int main(int argc, char **argv) {
+    int timers = argc > 1 ? atoi(argv[1]) : AE_BENCH_TIMERS;
+    aeEventLoop *el = aeCreateEventLoop(64);
+    long long *ids = zmalloc(sizeof(long long)*timers);
+    long long start, elapsed;
+    long ticks = 0;
+    int j;
+
+    srand(1234);
+    start = aeBenchUstime();
+    for (j = 0; j < timers; j++)
+        ids[j] = aeCreateTimeEvent(el,3600000+rand()%3600000,aeBenchIdleProc,
+                                   NULL,NULL);
+    elapsed = aeBenchUstime()-start;
+    setvbuf(stdout,NULL,_IONBF,0);
+    printf("create %d timers: %.3f usec/op\n", timers, (double)elapsed/timers);
+
+    start = aeBenchUstime();
+    for (j = 0; j < AE_BENCH_LOOPS; j++) {
+        aeCreateTimeEvent(el,0,aeBenchTickProc,&ticks,NULL);
+        aeProcessEvents(el,AE_TIME_EVENTS);
+    }
+    elapsed = aeBenchUstime()-start;
+    printf("aeProcessEvents with %d timers: %.3f usec/call (%ld fired)\n",
+        timers+1, (double)elapsed/AE_BENCH_LOOPS, ticks);
+
+    start = aeBenchUstime();
+    for (j = 0; j < AE_BENCH_DELETES && j < timers; j++) {
+        int k = rand()%(timers-j);
+        long long id = ids[k];
+
+        ids[k] = ids[timers-j-1];
+        if (aeDeleteTimeEvent(el,id) != AE_OK) {
+            printf("aeDeleteTimeEvent failed\n");
+            return 1;
+        }
+    }
+    elapsed = aeBenchUstime()-start;
+    printf("delete %d random timers: %.3f usec/op\n", j, (double)elapsed/j);
+
+    aeDeleteEventLoop(el);
+    zfree(ids);
+    return 0;
+}
+#endif
@@ -74,7 +74,9 @@ typedef struct aeTimeEvent {
     aeTimeProc *timeProc;
     aeEventFinalizerProc *finalizerProc;
     void *clientData;
-    struct aeTimeEvent *next;
+    int heapIndex; /* position in the timeEvents heap */
+    int deleted; /* deleted by its own timeProc, freed on return */
+    struct aeTimeEvent *hnext; /* next event in the same id bucket */
 } aeTimeEvent;
 
 /* A fired event */
@@ -91,7 +93,15 @@ typedef struct aeEventLoop {
     time_t lastTime;     /* Used to detect system clock skew */
     aeFileEvent *events; /* Registered events */
     aeFiredEvent *fired; /* Fired events */
-    aeTimeEvent *timeEventHead;
+    /* Time events are kept in a binary min-heap ordered by deadline, so the
+     * nearest timer is timeEvents[0]. The events are also indexed by id in
+     * a hash table in order to delete them in O(log(N)). */
+    aeTimeEvent **timeEvents;   /* Heap of the time events */
+    int timeEventsCount;        /* Number of time events in the heap */
+    int timeEventsSize;         /* Allocated slots of the heap */
+    aeTimeEvent **timeEventsById; /* Hash table: id -> time event */
+    long long timeEventsByIdMask; /* Hash table size minus one */
+    aeTimeEvent *timeEventRunning; /* Event whose timeProc is running */
     int stop;
     void *apidata; /* This is used for polling API specific data */
     aeBeforeSleepProc *beforesleep;
@@ -0,0 +1,396 @@
+/* Linux io_uring based ae.c module, falling back to epoll when io_uring is
+ * not available (old kernels, or io_uring disabled by the administrator).
+ *
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <linux/io_uring.h>
+#include <poll.h>
+
+/* The epoll implementation is compiled with different names, and used by
+ * the event loops that can't get an io_uring instance. */
+#define aeApiState aeEpollState
+#define aeApiCreate aeEpollCreate
+#define aeApiResize aeEpollResize
+#define aeApiFree aeEpollFree
+#define aeApiAddEvent aeEpollAddEvent
+#define aeApiDelEvent aeEpollDelEvent
+#define aeApiPoll aeEpollPoll
+#define aeApiName aeEpollName
+#include "ae_epoll.c"
+#undef aeApiState
+#undef aeApiCreate
+#undef aeApiResize
+#undef aeApiFree
+#undef aeApiAddEvent
+#undef aeApiDelEvent
+#undef aeApiPoll
+#undef aeApiName
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* File events are implemented with one shot IORING_OP_POLL_ADD requests.
+ * The requests of every event loop iteration, including the ones re-arming
+ * the descriptors that fired in the previous iteration, are submitted with
+ * a single io_uring_enter() call that also waits for the completions, so
+ * the poll requests cost no system call at all.
+ *
+ * Being one shot, a request re-armed on a descriptor still ready completes
+ * at once: this gives the same level triggered semantics of epoll, which
+ * the rest of the code relies on.
+ *
+ * Changing the events of a descriptor cancels the pending request, and adds
+ * a new one. The user_data of the requests is the fd and a generation
+ * number, so that the completions of canceled requests are recognized and
+ * dropped. */
+
+#define AE_URING_ENTRIES 1024
+#define AE_URING_IGNORE ((__u64)-1) /* user_data of the remove requests */
+
+typedef struct aeUringFd {
+    unsigned int gen;   /* Generation of the last poll request. */
+    int mask;           /* Events of the pending request, or AE_NONE. */
+} aeUringFd;
+
+typedef struct aeApiState {
+    aeEpollState *epoll;    /* Not NULL if using the epoll fallback. */
+    int ringfd;
+    /* Submission queue */
+    unsigned *sq_khead, *sq_ktail, sq_mask, sq_entries;
+    unsigned sq_tail;       /* Local tail, published at submission. */
+    struct io_uring_sqe *sqes;
+    /* Completion queue */
+    unsigned *cq_khead, *cq_ktail, cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Mappings */
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+    aeUringFd *fds;         /* Poll request state of every fd. */
+    int *rearm;             /* Fds fired in the last poll, to re-arm. */
+    int rearm_count;
+} aeApiState;
+
+static int aeUringInUse = 0; /* Reported by aeApiName(). */
+
+static int aeUringSetup(aeApiState *state) {
+    struct io_uring_params p;
+    unsigned j, *sq_array;
+
+    memset(&p,0,sizeof(p));
+#ifdef IORING_SETUP_CLAMP
+    p.flags = IORING_SETUP_CLAMP;
+#endif
+    state->ringfd = syscall(__NR_io_uring_setup,AE_URING_ENTRIES,&p);
+    if (state->ringfd == -1) return -1;
+
+    /* We need to wait with a timeout in io_uring_enter(), and to never
+     * lose completions if there are more than the CQ ring can hold. */
+    if (!(p.features & IORING_FEAT_EXT_ARG) ||
+        !(p.features & IORING_FEAT_NODROP)) goto err;
+
+    state->sq_ring_sz = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    state->cq_ring_sz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cq_ring_sz > state->sq_ring_sz)
+            state->sq_ring_sz = state->cq_ring_sz;
+        state->cq_ring_sz = 0;
+    }
+    state->sq_ring = mmap(NULL,state->sq_ring_sz,PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE,state->ringfd,IORING_OFF_SQ_RING);
+    if (state->sq_ring == MAP_FAILED) goto err;
+    if (state->cq_ring_sz) {
+        state->cq_ring = mmap(NULL,state->cq_ring_sz,PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE,state->ringfd,IORING_OFF_CQ_RING);
+        if (state->cq_ring == MAP_FAILED) goto err_sq;
+    } else {
+        state->cq_ring = state->sq_ring;
+    }
+    state->sqes_sz = p.sq_entries*sizeof(struct io_uring_sqe);
+    state->sqes = mmap(NULL,state->sqes_sz,PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE,state->ringfd,IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) goto err_cq;
+
+    state->sq_khead = (unsigned*)((char*)state->sq_ring+p.sq_off.head);
+    state->sq_ktail = (unsigned*)((char*)state->sq_ring+p.sq_off.tail);
+    state->sq_mask = *(unsigned*)((char*)state->sq_ring+p.sq_off.ring_mask);
+    state->sq_entries = p.sq_entries;
+    state->sq_tail = *state->sq_ktail;
+    /* SQE j is always in slot j of the indirection array. */
+    sq_array = (unsigned*)((char*)state->sq_ring+p.sq_off.array);
+    for (j = 0; j < p.sq_entries; j++) sq_array[j] = j;
+
+    state->cq_khead = (unsigned*)((char*)state->cq_ring+p.cq_off.head);
+    state->cq_ktail = (unsigned*)((char*)state->cq_ring+p.cq_off.tail);
+    state->cq_mask = *(unsigned*)((char*)state->cq_ring+p.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe*)((char*)state->cq_ring+p.cq_off.cqes);
+    return 0;
+
+err_cq:
+    if (state->cq_ring != state->sq_ring)
+        munmap(state->cq_ring,state->cq_ring_sz);
+err_sq:
+    munmap(state->sq_ring,state->sq_ring_sz);
+err:
+    close(state->ringfd);
+    return -1;
+}
+
+/* Submit the queued requests, and wait for at least 'wait' completions
+ * or until the timeout expires (NULL waits forever). */
+static int aeUringEnter(aeApiState *state, unsigned wait, struct timeval *tvp) {
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned submit, flags = 0;
+
+    __atomic_store_n(state->sq_ktail,state->sq_tail,__ATOMIC_RELEASE);
+    submit = state->sq_tail - __atomic_load_n(state->sq_khead,__ATOMIC_ACQUIRE);
+    if (wait) {
+        flags |= IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG;
+        memset(&arg,0,sizeof(arg));
+        if (tvp) {
+            ts.tv_sec = tvp->tv_sec;
+            ts.tv_nsec = tvp->tv_usec*1000;
+            arg.ts = (__u64)(uintptr_t)&ts;
+        }
+        return syscall(__NR_io_uring_enter,state->ringfd,submit,wait,flags,
+            &arg,sizeof(arg));
+    }
+    if (submit == 0) return 0;
+    return syscall(__NR_io_uring_enter,state->ringfd,submit,0,0,NULL,0);
+}
+
+/* Return a zeroed SQE, submitting the queued ones if the ring is full. */
+static struct io_uring_sqe *aeUringGetSqe(aeApiState *state) {
+    struct io_uring_sqe *sqe;
+
+    while (state->sq_tail -
+           __atomic_load_n(state->sq_khead,__ATOMIC_ACQUIRE) ==
+           state->sq_entries)
+    {
+        if (aeUringEnter(state,0,NULL) == -1 && errno != EINTR &&
+            errno != EAGAIN && errno != EBUSY) return NULL;
+    }
+    sqe = &state->sqes[state->sq_tail & state->sq_mask];
+    state->sq_tail++;
+    memset(sqe,0,sizeof(*sqe));
+    return sqe;
+}
+
+static __u64 aeUringUserData(int fd, unsigned int gen) {
+    return ((__u64)fd << 32) | gen;
+}
+
+/* Add a poll request for 'fd', that must not have one pending. */
+static int aeUringArm(aeApiState *state, int fd, int mask) {
+    struct io_uring_sqe *sqe = aeUringGetSqe(state);
+    unsigned int events = 0;
+
+    if (sqe == NULL) return -1;
+    if (mask & AE_READABLE) events |= POLLIN;
+    if (mask & AE_WRITABLE) events |= POLLOUT;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16);
+#endif
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = aeUringUserData(fd,++state->fds[fd].gen);
+    state->fds[fd].mask = mask;
+    return 0;
+}
+
+/* Cancel the pending poll request of 'fd', if any. */
+static int aeUringDisarm(aeApiState *state, int fd) {
+    struct io_uring_sqe *sqe;
+
+    if (state->fds[fd].mask == AE_NONE) return 0;
+    if ((sqe = aeUringGetSqe(state)) == NULL) return -1;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = aeUringUserData(fd,state->fds[fd].gen);
+    sqe->user_data = AE_URING_IGNORE;
+    state->fds[fd].mask = AE_NONE;
+    return 0;
+}
+
+static int aeApiCreate(aeEventLoop *eventLoop) {
+    aeApiState *state = zmalloc(sizeof(aeApiState));
+
+    if (!state) return -1;
+    memset(state,0,sizeof(*state));
+    if (aeUringSetup(state) == -1) {
+        if (aeEpollCreate(eventLoop) == -1) {
+            zfree(state);
+            return -1;
+        }
+        state->epoll = eventLoop->apidata;
+    } else {
+        state->fds = zcalloc(sizeof(aeUringFd)*eventLoop->setsize);
+        state->rearm = zmalloc(sizeof(int)*eventLoop->setsize);
+        aeUringInUse = 1;
+    }
+    eventLoop->apidata = state;
+    return 0;
+}
+
+/* The epoll functions find their state in eventLoop->apidata. */
+#define aeUringCallEpoll(eventLoop,state,call) do { \
+    (eventLoop)->apidata = (state)->epoll; \
+    call; \
+    (eventLoop)->apidata = (state); \
+} while(0)
+
+static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
+    aeApiState *state = eventLoop->apidata;
+    int j, retval;
+
+    if (state->epoll) {
+        aeUringCallEpoll(eventLoop,state,
+            retval = aeEpollResize(eventLoop,setsize));
+        return retval;
+    }
+    state->fds = zrealloc(state->fds,sizeof(aeUringFd)*setsize);
+    for (j = eventLoop->setsize; j < setsize; j++) {
+        state->fds[j].gen = 0;
+        state->fds[j].mask = AE_NONE;
+    }
+    state->rearm = zrealloc(state->rearm,sizeof(int)*setsize);
+    return 0;
+}
+
+static void aeApiFree(aeEventLoop *eventLoop) {
+    aeApiState *state = eventLoop->apidata;
+
+    if (state->epoll) {
+        aeUringCallEpoll(eventLoop,state,aeEpollFree(eventLoop));
+    } else {
+        munmap(state->sqes,state->sqes_sz);
+        if (state->cq_ring != state->sq_ring)
+            munmap(state->cq_ring,state->cq_ring_sz);
+        munmap(state->sq_ring,state->sq_ring_sz);
+        close(state->ringfd);
+        zfree(state->fds);
+        zfree(state->rearm);
+    }
+    zfree(state);
+}
+
+static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeApiState *state = eventLoop->apidata;
+    int retval;
+
+    if (state->epoll) {
+        aeUringCallEpoll(eventLoop,state,
+            retval = aeEpollAddEvent(eventLoop,fd,mask));
+        return retval;
+    }
+    mask |= eventLoop->events[fd].mask; /* Merge old events */
+    if (state->fds[fd].mask == mask) return 0;
+    if (aeUringDisarm(state,fd) == -1) return -1;
+    return aeUringArm(state,fd,mask);
+}
+
+static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
+    aeApiState *state = eventLoop->apidata;
+    int mask = eventLoop->events[fd].mask & (~delmask);
+
+    if (state->epoll) {
+        aeUringCallEpoll(eventLoop,state,aeEpollDelEvent(eventLoop,fd,delmask));
+        return;
+    }
+    if (state->fds[fd].mask == mask) return;
+    aeUringDisarm(state,fd);
+    if (mask != AE_NONE) {
+        aeUringArm(state,fd,mask);
+    } else {
+        /* The fd is likely about to be closed: cancel the request now, so
+         * that the kernel drops its reference to the file. */
+        aeUringEnter(state,0,NULL);
+    }
+}
+
+static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeApiState *state = eventLoop->apidata;
+    unsigned head, tail, wait = 1;
+    int j, numevents = 0;
+
+    if (state->epoll) {
+        aeUringCallEpoll(eventLoop,state,
+            numevents = aeEpollPoll(eventLoop,tvp));
+        return numevents;
+    }
+
+    /* Re-arm the fds that fired in the previous iteration, unless the
+     * handlers already did it, or removed their events. */
+    for (j = 0; j < state->rearm_count; j++) {
+        int fd = state->rearm[j];
+
+        if (state->fds[fd].mask == AE_NONE &&
+            eventLoop->events[fd].mask != AE_NONE)
+            aeUringArm(state,fd,eventLoop->events[fd].mask);
+    }
+    state->rearm_count = 0;
+
+    /* Don't wait if there are already completions to process. */
+    if ((tvp && tvp->tv_sec == 0 && tvp->tv_usec == 0) ||
+        *state->cq_khead != __atomic_load_n(state->cq_ktail,__ATOMIC_ACQUIRE))
+        wait = 0;
+    aeUringEnter(state,wait,tvp);
+
+    head = *state->cq_khead;
+    tail = __atomic_load_n(state->cq_ktail,__ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &state->cqes[head & state->cq_mask];
+        __u64 ud = cqe->user_data;
+        int fd = ud >> 32, res = cqe->res, mask = 0;
+
+        head++;
+        if (ud == AE_URING_IGNORE || fd >= eventLoop->setsize ||
+            state->fds[fd].gen != (unsigned int)ud ||
+            state->fds[fd].mask == AE_NONE) continue;
+        if (res < 0) {
+            /* Let the handlers find out about the error. */
+            mask = state->fds[fd].mask;
+        } else {
+            if (res & POLLIN) mask |= AE_READABLE;
+            if (res & (POLLOUT|POLLERR|POLLHUP)) mask |= AE_WRITABLE;
+        }
+        state->fds[fd].mask = AE_NONE;
+        state->rearm[state->rearm_count++] = fd;
+        eventLoop->fired[numevents].fd = fd;
+        eventLoop->fired[numevents].mask = mask;
+        numevents++;
+    }
+    __atomic_store_n(state->cq_khead,head,__ATOMIC_RELEASE);
+    return numevents;
+}
+
+static char *aeApiName(void) {
+    return aeUringInUse ? "io_uring" : aeEpollName();
+}
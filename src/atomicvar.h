@@ -0,0 +1,59 @@
+/* Atomic counters shared between the main thread and the background threads.
+ *
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ATOMIC_VAR_H
+#define __ATOMIC_VAR_H
+
+#include "config.h"
+
+/* atomicIncr() and atomicDecr() return the new value of 'var'. The decrement
+ * also orders the memory accesses, so that the thread dropping the last
+ * reference of an object sees every write done by the other owners.
+ *
+ * When the compiler has no atomic builtins HAVE_ATOMIC_VARS is not defined
+ * and the operations are plain ones: the callers must then avoid sharing the
+ * variables between threads. */
+#if defined(__ATOMIC_RELAXED)
+#define HAVE_ATOMIC_VARS
+#define atomicIncr(var,count) __atomic_add_fetch(&(var),(count),__ATOMIC_RELAXED)
+#define atomicDecr(var,count) __atomic_sub_fetch(&(var),(count),__ATOMIC_ACQ_REL)
+#define atomicGet(var) __atomic_load_n(&(var),__ATOMIC_RELAXED)
+#elif defined(HAVE_ATOMIC)
+#define HAVE_ATOMIC_VARS
+#define atomicIncr(var,count) __sync_add_and_fetch(&(var),(count))
+#define atomicDecr(var,count) __sync_sub_and_fetch(&(var),(count))
+#define atomicGet(var) __sync_add_and_fetch(&(var),0)
+#else
+#define atomicIncr(var,count) ((var) += (count))
+#define atomicDecr(var,count) ((var) -= (count))
+#define atomicGet(var) (var)
+#endif
+
+#endif /* __ATOMIC_VAR_H */
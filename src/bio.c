@@ -176,6 +176,13 @@ void *bioProcessBackgroundJobs(void *arg) {
             close((long)job->arg1);
         } else if (type == REDIS_BIO_AOF_FSYNC) {
             aof_fsync((long)job->arg1);
+        } else if (type == REDIS_BIO_LAZY_FREE) {
+            /* The job frees either an object (arg1), or the main and the
+             * expires dictionaries of a database (arg2 and arg3). */
+            if (job->arg1)
+                lazyfreeFreeObjectFromBioThread(job->arg1);
+            else
+                lazyfreeFreeDatabaseFromBioThread(job->arg2,job->arg3);
         } else {
             redisPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
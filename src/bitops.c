@@ -30,22 +30,158 @@
 
 #include "redis.h"
 
+#ifdef HAVE_X86_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
+/* -----------------------------------------------------------------------------
+ * SIMD kernels selected at runtime.
+ *
+ * The kernels are compiled for the POPCNT and AVX2 extensions using target
+ * attributes, so that they are available even if the server is built for a
+ * generic x86 CPU, and are only called if the CPU running the server
+ * supports them. "DEBUG set-bitops-simd 0" switches to the portable code,
+ * in order to test and benchmark it on any CPU.
+ * -------------------------------------------------------------------------- */
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+#define BITOPS_CPU_POPCNT (1<<0)
+#define BITOPS_CPU_AVX2 (1<<1)
+
+/* Return the BITOPS_CPU_* flags of the extensions that can be used. */
+static int bitopsCPU(void) {
+    static int cpu = -1;
+
+    if (cpu == -1) {
+        __builtin_cpu_init();
+        cpu = 0;
+        if (__builtin_cpu_supports("popcnt")) cpu |= BITOPS_CPU_POPCNT;
+        if (__builtin_cpu_supports("avx2")) cpu |= BITOPS_CPU_AVX2;
+    }
+    return server.bitops_simd ? cpu : 0;
+}
+
+/* Count the bits set in the 'count' bytes at 'p' with the POPCNT
+ * instruction, 64 bits at a time. */
+__attribute__((target("popcnt")))
+static size_t redisPopcountPOPCNT(unsigned char *p, long count) {
+    size_t bits = 0;
+    uint64_t w[4];
+
+    while(count >= 32) {
+        memcpy(w,p,sizeof(w));
+        bits += __builtin_popcountll(w[0]) + __builtin_popcountll(w[1]) +
+                __builtin_popcountll(w[2]) + __builtin_popcountll(w[3]);
+        p += 32;
+        count -= 32;
+    }
+    while(count >= 8) {
+        memcpy(w,p,sizeof(w[0]));
+        bits += __builtin_popcountll(w[0]);
+        p += 8;
+        count -= 8;
+    }
+    while(count--) bits += __builtin_popcount(*p++);
+    return bits;
+}
+
+/* Count the bits set in the 'count' bytes at 'p' with AVX2: the bits of
+ * every nibble are counted with a 16 entries lookup table using a byte
+ * shuffle, the per-byte counts of 8 vectors are accumulated, and then
+ * summed horizontally into four 64 bit counters. */
+__attribute__((target("avx2,popcnt")))
+static size_t redisPopcountAVX2(unsigned char *p, long count) {
+    const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    uint64_t t[4];
+    int k;
+
+    while(count >= 256) {
+        __m256i acc = _mm256_setzero_si256();
+
+        /* Every byte of 'acc' grows by 8 at most per step. */
+        for (k = 0; k < 8; k++) {
+            __m256i v = _mm256_loadu_si256((__m256i*)(p+k*32));
+            __m256i lo = _mm256_and_si256(v,low);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v,4),low);
+
+            acc = _mm256_add_epi8(acc,_mm256_shuffle_epi8(lut,lo));
+            acc = _mm256_add_epi8(acc,_mm256_shuffle_epi8(lut,hi));
+        }
+        total = _mm256_add_epi64(total,
+                    _mm256_sad_epu8(acc,_mm256_setzero_si256()));
+        p += 256;
+        count -= 256;
+    }
+    _mm256_storeu_si256((__m256i*)t,total);
+    return t[0]+t[1]+t[2]+t[3]+redisPopcountPOPCNT(p,count);
+}
+
+/* Return the number of bytes, a multiple of 32, at the start of the 'count'
+ * bytes at 'p' that are all equal to 'skipval'. */
+__attribute__((target("avx2")))
+static unsigned long redisBitposSkipAVX2(unsigned char *p,
+                                         unsigned long count, int skipval)
+{
+    const __m256i skip = _mm256_set1_epi8((char)skipval);
+    unsigned long j = 0;
+
+    while(count-j >= 128) {
+        __m256i eq = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(p+j)),skip),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(p+j+32)),skip)),
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(p+j+64)),skip),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(p+j+96)),skip)));
+        if (_mm256_movemask_epi8(eq) != -1) break;
+        j += 128;
+    }
+    while(count-j >= 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(p+j)),skip);
+        if (_mm256_movemask_epi8(eq) != -1) break;
+        j += 32;
+    }
+    return j;
+}
+#endif /* HAVE_X86_SIMD_DISPATCH */
+
 /* -----------------------------------------------------------------------------
  * Helpers and low level bit functions.
  * -------------------------------------------------------------------------- */
 
-/* This helper function used by GETBIT / SETBIT parses the bit offset argument
- * making sure an error is returned if it is negative or if it overflows
- * Redis 512 MB limit for the string value. */
-static int getBitOffsetFromArgument(redisClient *c, robj *o, size_t *offset) {
+/* This helper function used by GETBIT / SETBIT / BITFIELD parses the bit
+ * offset argument making sure an error is returned if it is negative or if
+ * the 'bits' bits starting at the offset overflow Redis 512 MB limit for the
+ * string value.
+ *
+ * If 'hash' is true, the offset may be given as "#<index>", meaning the
+ * index-th integer of 'bits' bits in the string, as BITFIELD allows. */
+static int getBitOffsetFromArgument(redisClient *c, robj *o, size_t *offset,
+                                    int hash, int bits)
+{
     long long loffset;
     char *err = "bit offset is not an integer or out of range";
 
-    if (getLongLongFromObjectOrReply(c,o,&loffset,err) != REDIS_OK)
+    if (hash && sdsEncodedObject(o) && ((char*)o->ptr)[0] == '#') {
+        char *p = o->ptr;
+
+        if (string2ll(p+1,sdslen(p)-1,&loffset) == 0 ||
+            loffset < 0 || loffset > LLONG_MAX/bits)
+        {
+            addReplyError(c,err);
+            return REDIS_ERR;
+        }
+        loffset *= bits;
+    } else if (getLongLongFromObjectOrReply(c,o,&loffset,err) != REDIS_OK) {
         return REDIS_ERR;
+    }
 
     /* Limit offset to 512MB in bytes */
-    if ((loffset < 0) || ((unsigned long long)loffset >> 3) >= (512*1024*1024))
+    if ((loffset < 0) ||
+        (((unsigned long long)loffset+bits-1) >> 3) >= (512*1024*1024))
     {
         addReplyError(c,err);
         return REDIS_ERR;
@@ -64,6 +200,14 @@ size_t redisPopcount(void *s, long count) {
     uint32_t *p4;
     static const unsigned char bitsinbyte[256] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8};
 
+#ifdef HAVE_X86_SIMD_DISPATCH
+    int cpu = bitopsCPU();
+
+    if ((cpu & BITOPS_CPU_AVX2) && (cpu & BITOPS_CPU_POPCNT) && count >= 256)
+        return redisPopcountAVX2(p,count);
+    if (cpu & BITOPS_CPU_POPCNT) return redisPopcountPOPCNT(p,count);
+#endif
+
     /* Count initial bytes not aligned to 32 bit. */
     while((unsigned long)p & 3 && count) {
         bits += bitsinbyte[*p++];
@@ -133,6 +277,17 @@ long redisBitpos(void *s, unsigned long count, int bit) {
         pos += 8;
     }
 
+#ifdef HAVE_X86_SIMD_DISPATCH
+    /* Skip 32 bytes at a time if possible. */
+    if (bitopsCPU() & BITOPS_CPU_AVX2) {
+        unsigned long skipped = redisBitposSkipAVX2(c,count,skipval);
+
+        c += skipped;
+        count -= skipped;
+        pos += skipped*8;
+    }
+#endif
+
     /* Skip bits with full word step. */
     skipval = bit ? 0 : ULONG_MAX;
     l = (unsigned long*) c;
@@ -188,7 +343,128 @@ long redisBitpos(void *s, unsigned long count, int bit) {
 }
 
 /* -----------------------------------------------------------------------------
- * Bits related string commands: GETBIT, SETBIT, BITCOUNT, BITOP.
+ * Bitfields: integers of arbitrary width stored at arbitrary bit offsets.
+ *
+ * Integers are stored most significant bit first, starting from the most
+ * significant bit of the first byte, like the bits addressed by SETBIT.
+ * Signed integers use two's complement.
+ * -------------------------------------------------------------------------- */
+
+#define BFOVERFLOW_WRAP 0
+#define BFOVERFLOW_SAT  1
+#define BFOVERFLOW_FAIL 2
+
+/* Store the 'bits' bits wide unsigned integer 'value' at bit offset 'offset'
+ * of 'p', that must be already large enough to hold it. */
+static void setUnsignedBitfield(unsigned char *p, uint64_t offset,
+                                int bits, uint64_t value)
+{
+    uint64_t byte, bit, byteval, bitval;
+    int j;
+
+    for (j = 0; j < bits; j++) {
+        bitval = (value >> (bits-1-j)) & 1;
+        byte = offset >> 3;
+        bit = 7 - (offset & 0x7);
+        byteval = p[byte];
+        byteval &= ~(1 << bit);
+        byteval |= bitval << bit;
+        p[byte] = byteval & 0xff;
+        offset++;
+    }
+}
+
+static void setSignedBitfield(unsigned char *p, uint64_t offset,
+                              int bits, int64_t value)
+{
+    setUnsignedBitfield(p,offset,bits,(uint64_t)value);
+}
+
+/* Return the 'bits' bits wide unsigned integer at bit offset 'offset' of
+ * the 'len' bytes at 'p'. The bits past the end of the string are zero. */
+static uint64_t getUnsignedBitfield(unsigned char *p, size_t len,
+                                    uint64_t offset, int bits)
+{
+    uint64_t byte, bit, value = 0;
+    int j;
+
+    for (j = 0; j < bits; j++) {
+        byte = offset >> 3;
+        bit = 7 - (offset & 0x7);
+        value <<= 1;
+        if (byte < len) value |= (p[byte] >> bit) & 1;
+        offset++;
+    }
+    return value;
+}
+
+static int64_t getSignedBitfield(unsigned char *p, size_t len,
+                                 uint64_t offset, int bits)
+{
+    uint64_t value = getUnsignedBitfield(p,len,offset,bits);
+
+    /* Extend the sign bit. */
+    if (bits < 64 && (value & ((uint64_t)1 << (bits-1))))
+        value |= UINT64_MAX << bits;
+    return (int64_t)value;
+}
+
+/* Check if adding 'incr' to the 'bits' bits wide unsigned integer 'value'
+ * overflows. Returns 1 on overflow, -1 on underflow, 0 otherwise. On
+ * overflow or underflow, '*limit' is set to the value to store according to
+ * the 'owtype' policy (not touched for BFOVERFLOW_FAIL). With an increment
+ * of zero, this checks that 'value' itself fits in 'bits' bits. */
+static int checkUnsignedBitfieldOverflow(uint64_t value, int64_t incr,
+                                         int bits, int owtype,
+                                         uint64_t *limit)
+{
+    uint64_t max = ((uint64_t)1 << bits)-1; /* 'bits' is 63 at most. */
+    int retval;
+
+    if (value > max || (incr > 0 && (uint64_t)incr > max-value)) {
+        retval = 1;
+        if (owtype == BFOVERFLOW_SAT) *limit = max;
+    } else if (incr < 0 && (uint64_t)(-(incr+1))+1 > value) {
+        retval = -1;
+        if (owtype == BFOVERFLOW_SAT) *limit = 0;
+    } else {
+        return 0;
+    }
+    if (owtype == BFOVERFLOW_WRAP) *limit = (value+(uint64_t)incr) & max;
+    return retval;
+}
+
+/* Like checkUnsignedBitfieldOverflow() but for signed integers. */
+static int checkSignedBitfieldOverflow(int64_t value, int64_t incr,
+                                       int bits, int owtype, int64_t *limit)
+{
+    int64_t max = (bits == 64) ? INT64_MAX : (((int64_t)1 << (bits-1))-1);
+    int64_t min = -max-1;
+    int retval;
+
+    if (value > max || (incr > 0 && value > max-incr)) {
+        retval = 1;
+        if (owtype == BFOVERFLOW_SAT) *limit = max;
+    } else if (value < min || (incr < 0 && value < min-incr)) {
+        retval = -1;
+        if (owtype == BFOVERFLOW_SAT) *limit = min;
+    } else {
+        return 0;
+    }
+    if (owtype == BFOVERFLOW_WRAP) {
+        uint64_t msb = (uint64_t)1 << (bits-1);
+        uint64_t mask = (msb << 1)-1; /* All ones if 'bits' is 64. */
+        uint64_t res = ((uint64_t)value+(uint64_t)incr) & mask;
+
+        if (res & msb) res |= ~mask;
+        *limit = (int64_t)res;
+    }
+    return retval;
+}
+
+/* -----------------------------------------------------------------------------
+ * Bits related string commands: GETBIT, SETBIT, BITCOUNT, BITOP, BITPOS,
+ * BITFIELD.
  * -------------------------------------------------------------------------- */
 
 #define BITOP_AND   0
@@ -205,7 +481,7 @@ void setbitCommand(redisClient *c) {
     int byteval, bitval;
     long on;
 
-    if (getBitOffsetFromArgument(c,c->argv[2],&bitoffset) != REDIS_OK)
+    if (getBitOffsetFromArgument(c,c->argv[2],&bitoffset,0,1) != REDIS_OK)
         return;
 
     if (getLongFromObjectOrReply(c,c->argv[3],&on,err) != REDIS_OK)
@@ -253,7 +529,7 @@ void getbitCommand(redisClient *c) {
     size_t byte, bit;
     size_t bitval = 0;
 
-    if (getBitOffsetFromArgument(c,c->argv[2],&bitoffset) != REDIS_OK)
+    if (getBitOffsetFromArgument(c,c->argv[2],&bitoffset,0,1) != REDIS_OK)
         return;
 
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
@@ -261,7 +537,7 @@ void getbitCommand(redisClient *c) {
 
     byte = bitoffset >> 3;
     bit = 7 - (bitoffset & 0x7);
-    if (o->encoding != REDIS_ENCODING_RAW) {
+    if (!sdsEncodedObject(o)) {
         if (byte < (size_t)ll2string(llbuf,sizeof(llbuf),(long)o->ptr))
             bitval = llbuf[byte] & (1 << bit);
     } else {
@@ -272,6 +548,58 @@ void getbitCommand(redisClient *c) {
     addReply(c, bitval ? shared.cone : shared.czero);
 }
 
+#ifdef HAVE_X86_SIMD_DISPATCH
+/* Compute the operation 'op' over the first 'len' bytes of the 'numkeys'
+ * strings at 'src', storing the result at 'dst', 128 bytes at a time with
+ * AVX2. The number of bytes processed is returned: the caller handles the
+ * remaining ones, that are less than 128. */
+#define BITOP_AVX2_LOOP(vop) do { \
+    while(len-j >= 128) { \
+        __m256i r0 = _mm256_loadu_si256((__m256i*)(src[0]+j)); \
+        __m256i r1 = _mm256_loadu_si256((__m256i*)(src[0]+j+32)); \
+        __m256i r2 = _mm256_loadu_si256((__m256i*)(src[0]+j+64)); \
+        __m256i r3 = _mm256_loadu_si256((__m256i*)(src[0]+j+96)); \
+        for (i = 1; i < numkeys; i++) { \
+            r0 = vop(r0,_mm256_loadu_si256((__m256i*)(src[i]+j))); \
+            r1 = vop(r1,_mm256_loadu_si256((__m256i*)(src[i]+j+32))); \
+            r2 = vop(r2,_mm256_loadu_si256((__m256i*)(src[i]+j+64))); \
+            r3 = vop(r3,_mm256_loadu_si256((__m256i*)(src[i]+j+96))); \
+        } \
+        _mm256_storeu_si256((__m256i*)(dst+j),r0); \
+        _mm256_storeu_si256((__m256i*)(dst+j+32),r1); \
+        _mm256_storeu_si256((__m256i*)(dst+j+64),r2); \
+        _mm256_storeu_si256((__m256i*)(dst+j+96),r3); \
+        j += 128; \
+    } \
+} while(0)
+
+__attribute__((target("avx2")))
+static unsigned long bitopAVX2(int op, unsigned char *dst,
+                               unsigned char **src, unsigned long numkeys,
+                               unsigned long len)
+{
+    unsigned long i, j = 0;
+
+    /* Different branches per different operations for speed (sorry). */
+    if (op == BITOP_AND) {
+        BITOP_AVX2_LOOP(_mm256_and_si256);
+    } else if (op == BITOP_OR) {
+        BITOP_AVX2_LOOP(_mm256_or_si256);
+    } else if (op == BITOP_XOR) {
+        BITOP_AVX2_LOOP(_mm256_xor_si256);
+    } else if (op == BITOP_NOT) {
+        const __m256i ones = _mm256_set1_epi8((char)0xff);
+
+        while(len-j >= 32) {
+            __m256i r = _mm256_loadu_si256((__m256i*)(src[0]+j));
+            _mm256_storeu_si256((__m256i*)(dst+j),_mm256_xor_si256(r,ones));
+            j += 32;
+        }
+    }
+    return j;
+}
+#endif /* HAVE_X86_SIMD_DISPATCH */
+
 /* BITOP op_name target_key src_key1 src_key2 src_key3 ... src_keyN */
 void bitopCommand(redisClient *c) {
     char *opname = c->argv[1]->ptr;
@@ -348,7 +676,11 @@ void bitopCommand(redisClient *c) {
          * can take a fast path that performs much better than the
          * vanilla algorithm. */
         j = 0;
-        if (minlen && numkeys <= 16) {
+#ifdef HAVE_X86_SIMD_DISPATCH
+        if (minlen && (bitopsCPU() & BITOPS_CPU_AVX2))
+            j = bitopAVX2(op,res,src,numkeys,minlen);
+#endif
+        if (j == 0 && minlen && numkeys <= 16) {
             unsigned long *lp[16];
             unsigned long *lres = (unsigned long*) res;
 
@@ -586,3 +918,239 @@ void bitposCommand(redisClient *c) {
         addReplyLongLong(c,pos);
     }
 }
+
+/* BITFIELD key [GET type offset] [SET type offset value]
+ *              [INCRBY type offset increment] [OVERFLOW WRAP|SAT|FAIL] ...
+ *
+ * Types are "i<bits>" for signed integers of 1 to 64 bits, and "u<bits>" for
+ * unsigned integers of 1 to 63 bits. Offsets are in bits, or in units of the
+ * integer width when prefixed by "#". The OVERFLOW policy applies to the
+ * SET and INCRBY operations following it. All the operations are parsed
+ * first, so that on syntax errors nothing is modified, then executed in a
+ * single pass over the string, that is grown once if needed. */
+
+#define BITFIELDOP_GET 0
+#define BITFIELDOP_SET 1
+#define BITFIELDOP_INCRBY 2
+
+struct bitfieldOp {
+    uint64_t offset;    /* Bit offset. */
+    int64_t i64;        /* Increment amount (INCRBY) or SET value. */
+    int opcode;         /* BITFIELDOP_* */
+    int owtype;         /* BFOVERFLOW_* */
+    int bits;           /* Integer width. */
+    int sign;           /* True if the integer is signed. */
+};
+
+/* Parse a BITFIELD type argument, "i<bits>" or "u<bits>". */
+static int getBitfieldTypeFromArgument(redisClient *c, robj *o, int *sign,
+                                       int *bits)
+{
+    char *p = o->ptr;
+    char *err = "Invalid bitfield type. Use something like i16 u8. "
+                "Note that u64 is not supported but i64 is.";
+    long long llbits;
+
+    if (p[0] == 'i' || p[0] == 'I') {
+        *sign = 1;
+    } else if (p[0] == 'u' || p[0] == 'U') {
+        *sign = 0;
+    } else {
+        addReplyError(c,err);
+        return REDIS_ERR;
+    }
+
+    if (string2ll(p+1,sdslen(p)-1,&llbits) == 0 || llbits < 1 ||
+        (*sign == 1 && llbits > 64) || (*sign == 0 && llbits > 63))
+    {
+        addReplyError(c,err);
+        return REDIS_ERR;
+    }
+    *bits = llbits;
+    return REDIS_OK;
+}
+
+void bitfieldCommand(redisClient *c) {
+    robj *o;
+    struct bitfieldOp *ops = NULL;
+    int j, numops = 0, changes = 0, readonly = 1;
+    int owtype = BFOVERFLOW_WRAP;
+    size_t highest_write_offset = 0, strlen = 0;
+    unsigned char *p = NULL;
+    char llbuf[32];
+
+    for (j = 2; j < c->argc; j++) {
+        int remargs = c->argc-j-1;
+        char *subcmd = c->argv[j]->ptr;
+        int opcode, sign, bits;
+        long long i64 = 0;
+        size_t bitoffset;
+
+        if (!strcasecmp(subcmd,"get") && remargs >= 2)
+            opcode = BITFIELDOP_GET;
+        else if (!strcasecmp(subcmd,"set") && remargs >= 3)
+            opcode = BITFIELDOP_SET;
+        else if (!strcasecmp(subcmd,"incrby") && remargs >= 3)
+            opcode = BITFIELDOP_INCRBY;
+        else if (!strcasecmp(subcmd,"overflow") && remargs >= 1) {
+            char *owtypename = c->argv[++j]->ptr;
+
+            if (!strcasecmp(owtypename,"wrap")) {
+                owtype = BFOVERFLOW_WRAP;
+            } else if (!strcasecmp(owtypename,"sat")) {
+                owtype = BFOVERFLOW_SAT;
+            } else if (!strcasecmp(owtypename,"fail")) {
+                owtype = BFOVERFLOW_FAIL;
+            } else {
+                addReplyError(c,"Invalid OVERFLOW type specified");
+                zfree(ops);
+                return;
+            }
+            continue;
+        } else {
+            addReply(c,shared.syntaxerr);
+            zfree(ops);
+            return;
+        }
+
+        if (getBitfieldTypeFromArgument(c,c->argv[j+1],&sign,&bits)
+            != REDIS_OK ||
+            getBitOffsetFromArgument(c,c->argv[j+2],&bitoffset,1,bits)
+            != REDIS_OK)
+        {
+            zfree(ops);
+            return;
+        }
+
+        if (opcode != BITFIELDOP_GET) {
+            readonly = 0;
+            if (highest_write_offset < bitoffset+bits-1)
+                highest_write_offset = bitoffset+bits-1;
+            if (getLongLongFromObjectOrReply(c,c->argv[j+3],&i64,NULL)
+                != REDIS_OK)
+            {
+                zfree(ops);
+                return;
+            }
+        }
+
+        ops = zrealloc(ops,sizeof(*ops)*(numops+1));
+        ops[numops].offset = bitoffset;
+        ops[numops].i64 = i64;
+        ops[numops].opcode = opcode;
+        ops[numops].owtype = owtype;
+        ops[numops].bits = bits;
+        ops[numops].sign = sign;
+        numops++;
+
+        j += 2 + (opcode != BITFIELDOP_GET);
+    }
+
+    if (readonly) {
+        /* Only GET operations: a missing key reads as an empty string. */
+        o = lookupKeyRead(c->db,c->argv[1]);
+        if (o != NULL) {
+            if (checkType(c,o,REDIS_STRING)) {
+                zfree(ops);
+                return;
+            }
+            if (o->encoding == REDIS_ENCODING_INT) {
+                p = (unsigned char*) llbuf;
+                strlen = ll2string(llbuf,sizeof(llbuf),(long)o->ptr);
+            } else {
+                p = (unsigned char*) o->ptr;
+                strlen = sdslen(o->ptr);
+            }
+        }
+    } else {
+        o = lookupKeyWrite(c->db,c->argv[1]);
+        if (o == NULL) {
+            o = createObject(REDIS_STRING,sdsempty());
+            dbAdd(c->db,c->argv[1],o);
+            changes++;
+        } else {
+            if (checkType(c,o,REDIS_STRING)) {
+                zfree(ops);
+                return;
+            }
+            o = dbUnshareStringValue(c->db,c->argv[1],o);
+        }
+
+        /* Grow the string once to fit every write. Growing it is a
+         * modification even if all the writes fail. */
+        if (sdslen(o->ptr) <= (highest_write_offset >> 3)) {
+            o->ptr = sdsgrowzero(o->ptr,(highest_write_offset >> 3)+1);
+            changes++;
+        }
+        p = (unsigned char*) o->ptr;
+        strlen = sdslen(o->ptr);
+    }
+
+    addReplyMultiBulkLen(c,numops);
+    for (j = 0; j < numops; j++) {
+        struct bitfieldOp *thisop = ops+j;
+        int overflow;
+
+        if (thisop->opcode == BITFIELDOP_GET) {
+            if (thisop->sign)
+                addReplyLongLong(c,
+                    getSignedBitfield(p,strlen,thisop->offset,thisop->bits));
+            else
+                addReplyLongLong(c,
+                    getUnsignedBitfield(p,strlen,thisop->offset,thisop->bits));
+        } else if (thisop->sign) {
+            int64_t oldval, newval, retval, limit;
+
+            oldval = getSignedBitfield(p,strlen,thisop->offset,thisop->bits);
+            if (thisop->opcode == BITFIELDOP_INCRBY) {
+                overflow = checkSignedBitfieldOverflow(oldval,thisop->i64,
+                    thisop->bits,thisop->owtype,&limit);
+                newval = overflow ? limit : oldval+thisop->i64;
+                retval = newval;
+            } else {
+                overflow = checkSignedBitfieldOverflow(thisop->i64,0,
+                    thisop->bits,thisop->owtype,&limit);
+                newval = overflow ? limit : thisop->i64;
+                retval = oldval;
+            }
+
+            if (overflow && thisop->owtype == BFOVERFLOW_FAIL) {
+                addReply(c,shared.nullbulk);
+            } else {
+                setSignedBitfield(p,thisop->offset,thisop->bits,newval);
+                addReplyLongLong(c,retval);
+                changes++;
+            }
+        } else {
+            uint64_t oldval, newval, retval, limit;
+
+            oldval = getUnsignedBitfield(p,strlen,thisop->offset,thisop->bits);
+            if (thisop->opcode == BITFIELDOP_INCRBY) {
+                overflow = checkUnsignedBitfieldOverflow(oldval,thisop->i64,
+                    thisop->bits,thisop->owtype,&limit);
+                newval = overflow ? limit : oldval+thisop->i64;
+                retval = newval;
+            } else {
+                overflow = checkUnsignedBitfieldOverflow(thisop->i64,0,
+                    thisop->bits,thisop->owtype,&limit);
+                newval = overflow ? limit : (uint64_t)thisop->i64;
+                retval = oldval;
+            }
+
+            if (overflow && thisop->owtype == BFOVERFLOW_FAIL) {
+                addReply(c,shared.nullbulk);
+            } else {
+                setUnsignedBitfield(p,thisop->offset,thisop->bits,newval);
+                addReplyLongLong(c,retval);
+                changes++;
+            }
+        }
+    }
+
+    if (changes) {
+        signalModifiedKey(c->db,c->argv[1]);
+        notifyKeyspaceEvent(REDIS_NOTIFY_STRING,"setbit",c->argv[1],c->db->id);
+        server.dirty += changes;
+    }
+    zfree(ops);
+}
@@ -64,6 +64,13 @@
 /* Test for polling API */
 #ifdef __linux__
 #define HAVE_EPOLL 1
+/* io_uring is opt-in, build with "make USE_IO_URING=yes". It falls back to
+ * epoll at runtime if the kernel can't provide it. */
+#if defined(USE_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
 #endif
 
 #if (defined(__APPLE__) && defined(MAC_OS_X_VERSION_10_6)) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined (__NetBSD__)
@@ -77,6 +84,15 @@
 #endif
 #endif
 
+/* Test for x86 SIMD kernels compiled with target attributes and selected at
+ * runtime with __builtin_cpu_supports(). */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    ((defined(__clang__) && __clang_major__ >= 4) || \
+     (!defined(__clang__) && defined(__GNUC__) && \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_X86_SIMD_DISPATCH 1
+#endif
+
 /* Define aof_fsync to fdatasync() in Linux and fsync() for all the rest */
 #ifdef __linux__
 #define aof_fsync fdatasync
@@ -85,12 +85,12 @@ robj *lookupKeyWriteOrReply(redisClient *c, robj *key, robj *reply) {
 }
 
 /* Add the key to the DB. It's up to the caller to increment the reference
- * counter of the value if needed.
+ * counter of the value if needed. The dictionary stores a copy of the key
+ * in the same allocation of its entry.
  *
  * The program is aborted if the key already exists. */
 void dbAdd(redisDb *db, robj *key, robj *val) {
-    sds copy = sdsdup(key->ptr);
-    int retval = dictAdd(db->dict, copy, val);
+    int retval = dictAdd(db->dict, key->ptr, val);
 
     redisAssertWithInfo(NULL,key,retval == REDIS_OK);
     if (val->type == REDIS_LIST) signalListAsReady(db, key);
@@ -157,6 +157,7 @@ robj *dbRandomKey(redisDb *db) {
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
 int dbDelete(redisDb *db, robj *key) {
+    hllCountCacheTouchKey(key);
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
@@ -198,21 +199,37 @@ robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
     redisAssert(o->type == REDIS_STRING);
     if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
         robj *decoded = getDecodedObject(o);
-        o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
+        o = createRawStringObject(decoded->ptr, sdslen(decoded->ptr));
         decrRefCount(decoded);
         dbOverwrite(db,key,o);
     }
     return o;
 }
 
-long long emptyDb(void(callback)(void*)) {
+/* Create the main or the expires dictionary of a database, honoring the
+ * keyspace-open-addressing option. */
+dict *dbDictCreate(dictType *type) {
+    int flags = server.keyspace_open_addressing ? DICT_OPEN_ADDRESSING : 0;
+
+    return dictCreateWithFlags(type,NULL,flags);
+}
+
+/* Remove all the keys from all the databases, returning the number of keys
+ * removed. With the EMPTYDB_ASYNC flag the memory is reclaimed by a
+ * background thread, and the callback is not used. */
+long long emptyDb(int flags, void(callback)(void*)) {
     int j;
     long long removed = 0;
 
+    hllCountCacheFlush();
     for (j = 0; j < server.dbnum; j++) {
-        removed += dictSize(server.db[j].dict);
-        dictEmpty(server.db[j].dict,callback);
-        dictEmpty(server.db[j].expires,callback);
+        if (flags & EMPTYDB_ASYNC) {
+            removed += emptyDbAsync(&server.db[j]);
+        } else {
+            removed += dictSize(server.db[j].dict);
+            dictEmpty(server.db[j].dict,callback);
+            dictEmpty(server.db[j].expires,callback);
+        }
     }
     return removed;
 }
@@ -235,27 +252,56 @@ int selectDb(redisClient *c, int id) {
 
 void signalModifiedKey(redisDb *db, robj *key) {
     touchWatchedKey(db,key);
+    hllCountCacheTouchKey(key);
 }
 
 void signalFlushedDb(int dbid) {
     touchWatchedKeysOnFlush(dbid);
+    hllCountCacheFlush();
 }
 
 /*-----------------------------------------------------------------------------
  * Type agnostic commands operating on the key space
  *----------------------------------------------------------------------------*/
 
+/* Parse the optional ASYNC argument of FLUSHALL and FLUSHDB, setting the
+ * EMPTYDB_* flags. On syntax error a reply is sent and REDIS_ERR returned. */
+int getFlushCommandFlags(redisClient *c, int *flags) {
+    if (c->argc > 1) {
+        if (c->argc > 2 || strcasecmp(c->argv[1]->ptr,"async")) {
+            addReply(c,shared.syntaxerr);
+            return REDIS_ERR;
+        }
+        *flags = EMPTYDB_ASYNC;
+    } else {
+        *flags = EMPTYDB_NO_FLAGS;
+    }
+    return REDIS_OK;
+}
+
+/* FLUSHDB [ASYNC] */
 void flushdbCommand(redisClient *c) {
-    server.dirty += dictSize(c->db->dict);
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == REDIS_ERR) return;
     signalFlushedDb(c->db->id);
-    dictEmpty(c->db->dict,NULL);
-    dictEmpty(c->db->expires,NULL);
+    if (flags & EMPTYDB_ASYNC) {
+        server.dirty += emptyDbAsync(c->db);
+    } else {
+        server.dirty += dictSize(c->db->dict);
+        dictEmpty(c->db->dict,NULL);
+        dictEmpty(c->db->expires,NULL);
+    }
     addReply(c,shared.ok);
 }
 
+/* FLUSHALL [ASYNC] */
 void flushallCommand(redisClient *c) {
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == REDIS_ERR) return;
     signalFlushedDb(-1);
-    server.dirty += emptyDb(NULL);
+    server.dirty += emptyDb(flags,NULL);
     addReply(c,shared.ok);
     if (server.rdb_child_pid != -1) {
         kill(server.rdb_child_pid,SIGUSR1);
@@ -271,12 +317,15 @@ void flushallCommand(redisClient *c) {
     server.dirty++;
 }
 
-void delCommand(redisClient *c) {
+/* This command implements DEL and UNLINK. */
+void delGenericCommand(redisClient *c, int lazy) {
     int deleted = 0, j;
 
     for (j = 1; j < c->argc; j++) {
         expireIfNeeded(c->db,c->argv[j]);
-        if (dbDelete(c->db,c->argv[j])) {
+        if (lazy ? dbAsyncDelete(c->db,c->argv[j]) :
+                   dbDelete(c->db,c->argv[j]))
+        {
             signalModifiedKey(c->db,c->argv[j]);
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,
                 "del",c->argv[j],c->db->id);
@@ -287,6 +336,18 @@ void delCommand(redisClient *c) {
     addReplyLongLong(c,deleted);
 }
 
+void delCommand(redisClient *c) {
+    delGenericCommand(c,0);
+}
+
+/* UNLINK key [key ...]
+ *
+ * Like DEL, but big values are released by a background thread, so that the
+ * command returns in constant time. */
+void unlinkCommand(redisClient *c) {
+    delGenericCommand(c,1);
+}
+
 void existsCommand(redisClient *c) {
     expireIfNeeded(c->db,c->argv[1]);
     if (dbExists(c->db,c->argv[1])) {
@@ -380,6 +441,16 @@ void scanCallback(void *privdata, const dictEntry *de) {
     if (val) listAddNodeTail(keys, val);
 }
 
+/* Like scanCallback(), for the pairs of hashpack encoded hashes. */
+void scanHashpackCallback(void *privdata, unsigned char *f, uint32_t flen,
+                          unsigned char *v, uint32_t vlen)
+{
+    list *keys = privdata;
+
+    listAddNodeTail(keys, createStringObject((char*)f, flen));
+    listAddNodeTail(keys, createStringObject((char*)v, vlen));
+}
+
 /* Try to parse a SCAN cursor stored at object 'o':
  * if the cursor is valid, store it as unsigned integer into *cursor and
  * returns REDIS_OK. Otherwise return REDIS_ERR and send an error to the
@@ -460,11 +531,14 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
 
     /* Step 2: Iterate the collection.
      *
-     * Note that if the object is encoded with a ziplist, intset, or any other
+     * Note that if the object is encoded with a listpack, intset, or any other
      * representation that is not a hash table, we are sure that it is also
      * composed of a small number of elements. So to avoid taking state we
      * just return everything inside the object in a single call, setting the
-     * cursor to zero to signal the end of the iteration. */
+     * cursor to zero to signal the end of the iteration. Roaring bitmaps are
+     * the exception: they are ordered, so the cursor is simply the next
+     * integer to return. Hashpacks are the other one, since they can hold
+     * thousands of pairs: they are scanned like hash tables, by index slot. */
 
     /* Handle the case of a hash table. */
     ht = NULL;
@@ -499,6 +573,22 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         } while (cursor &&
               maxiterations-- &&
               listLength(keys) < (unsigned long)count);
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_ROARING) {
+        /* The sign bit of the integer is flipped, so that the cursor 0 is
+         * the start of the bitmap. */
+        roaringIterator it;
+        int64_t ll;
+
+        roaringInitIterator(o->ptr,&it);
+        roaringIteratorSeek(&it,(int64_t)(cursor ^ (1UL<<63)));
+        cursor = 0;
+        while(roaringIteratorNext(&it,&ll)) {
+            if (listLength(keys) == (unsigned long)count) {
+                cursor = (unsigned long)ll ^ (1UL<<63);
+                break;
+            }
+            listAddNodeTail(keys,createStringObjectFromLongLong(ll));
+        }
     } else if (o->type == REDIS_SET) {
         int pos = 0;
         int64_t ll;
@@ -506,18 +596,29 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         while(intsetGet(o->ptr,pos++,&ll))
             listAddNodeTail(keys,createStringObjectFromLongLong(ll));
         cursor = 0;
+    } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HASHPACK) {
+        /* Pairs move in the arena when it is compacted, but not in the
+         * index: the cursor is an index slot, see hpScan(). */
+        long maxiterations = count*10;
+
+        count *= 2; /* We return key / value for this type. */
+        do {
+            cursor = hpScan(o->ptr, cursor, scanHashpackCallback, keys);
+        } while (cursor &&
+              maxiterations-- &&
+              listLength(keys) < (unsigned long)count);
     } else if (o->type == REDIS_HASH || o->type == REDIS_ZSET) {
-        unsigned char *p = ziplistIndex(o->ptr,0);
+        unsigned char *p = lpIndex(o->ptr,0);
         unsigned char *vstr;
         unsigned int vlen;
         long long vll;
 
         while(p) {
-            ziplistGet(p,&vstr,&vlen,&vll);
+            lpGet(p,&vstr,&vlen,&vll);
             listAddNodeTail(keys,
                 (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
                                  createStringObjectFromLongLong(vll));
-            p = ziplistNext(o->ptr,p);
+            p = lpNext(o->ptr,p);
         }
         cursor = 0;
     } else {
@@ -603,6 +704,7 @@ void lastsaveCommand(redisClient *c) {
 }
 
 void typeCommand(redisClient *c) {
+    redisModuleType *mt;
     robj *o;
     char *type;
 
@@ -616,7 +718,10 @@ void typeCommand(redisClient *c) {
         case REDIS_SET: type = "set"; break;
         case REDIS_ZSET: type = "zset"; break;
         case REDIS_HASH: type = "hash"; break;
-        default: type = "unknown"; break;
+        default:
+            mt = redisModuleTypeLookup(o->type);
+            type = mt ? (char*)mt->name : "unknown";
+            break;
         }
     }
     addReplyStatus(c,type);
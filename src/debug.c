@@ -124,7 +124,7 @@ void computeDatasetDigest(unsigned char *final) {
         redisDb *db = server.db+j;
 
         if (dictSize(db->dict) == 0) continue;
-        di = dictGetIterator(db->dict);
+        di = dictGetSafeIterator(db->dict);
 
         /* hash the DB id, so the same dataset moved in a different
          * DB will lead to a different digest */
@@ -172,7 +172,7 @@ void computeDatasetDigest(unsigned char *final) {
             } else if (o->type == REDIS_ZSET) {
                 unsigned char eledigest[20];
 
-                if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+                if (o->encoding == REDIS_ENCODING_LISTPACK) {
                     unsigned char *zl = o->ptr;
                     unsigned char *eptr, *sptr;
                     unsigned char *vstr;
@@ -180,13 +180,13 @@ void computeDatasetDigest(unsigned char *final) {
                     long long vll;
                     double score;
 
-                    eptr = ziplistIndex(zl,0);
+                    eptr = lpIndex(zl,0);
                     redisAssert(eptr != NULL);
-                    sptr = ziplistNext(zl,eptr);
+                    sptr = lpNext(zl,eptr);
                     redisAssert(sptr != NULL);
 
                     while (eptr != NULL) {
-                        redisAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
+                        redisAssert(lpGet(eptr,&vstr,&vlen,&vll));
                         score = zzlGetScore(sptr);
 
                         memset(eledigest,0,20);
@@ -239,6 +239,15 @@ void computeDatasetDigest(unsigned char *final) {
                     xorDigest(digest,eledigest,20);
                 }
                 hashTypeReleaseIterator(hi);
+            } else if (redisModuleTypeLookup(o->type)) {
+                /* Module types are opaque: digest their serialization. */
+                rio payload;
+
+                rioInitWithBuffer(&payload,sdsempty());
+                redisAssert(rdbSaveObject(&payload,o) != -1);
+                mixDigest(digest,payload.io.buffer.ptr,
+                          sdslen(payload.io.buffer.ptr));
+                sdsfree(payload.io.buffer.ptr);
             } else {
                 redisPanic("Unknown object type");
             }
@@ -267,7 +276,7 @@ void debugCommand(redisClient *c) {
             addReply(c,shared.err);
             return;
         }
-        emptyDb(NULL);
+        emptyDb(EMPTYDB_NO_FLAGS,NULL);
         if (rdbLoad(server.rdb_filename) != REDIS_OK) {
             addReplyError(c,"Error trying to load the RDB dump");
             return;
@@ -275,7 +284,7 @@ void debugCommand(redisClient *c) {
         redisLog(REDIS_WARNING,"DB reloaded by DEBUG RELOAD");
         addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"loadaof")) {
-        emptyDb(NULL);
+        emptyDb(EMPTYDB_NO_FLAGS,NULL);
         if (loadAppendOnlyFile(server.aof_filename) != REDIS_OK) {
             addReply(c,shared.err);
             return;
@@ -287,21 +296,51 @@ void debugCommand(redisClient *c) {
         dictEntry *de;
         robj *val;
         char *strenc;
+        redisModuleType *mt;
+        char extra[128] = "";
 
         if ((de = dictFind(c->db->dict,c->argv[2]->ptr)) == NULL) {
             addReply(c,shared.nokeyerr);
             return;
         }
         val = dictGetVal(de);
-        strenc = strEncoding(val->encoding);
+        strenc = redisModuleObjectEncoding(val);
+        mt = redisModuleTypeLookup(val->type);
+        if (mt && mt->mem_usage)
+            snprintf(extra,sizeof(extra)," memory:%zu",mt->mem_usage(val));
+        if (val->type == REDIS_LIST &&
+            val->encoding == REDIS_ENCODING_QUICKLIST)
+        {
+            quicklist *ql = val->ptr;
+            quicklistNode *node;
+            unsigned long compressed = 0, used = 0;
+
+            /* Report how the list is split in nodes and how much the
+             * compression is saving. */
+            for (node = ql->head; node; node = node->next) {
+                if (quicklistNodeIsCompressed(node)) {
+                    void *data;
+
+                    compressed++;
+                    used += quicklistGetLzf(node,&data);
+                } else {
+                    used += node->sz;
+                }
+            }
+            snprintf(extra,sizeof(extra),
+                " ql_nodes:%u ql_avg_node:%.2f ql_listpack_max:%d"
+                " ql_compressed:%lu ql_used_bytes:%lu",
+                ql->len, ql->len ? (double)ql->count/ql->len : 0,
+                ql->fill, compressed, used);
+        }
 
         addReplyStatusFormat(c,
             "Value at:%p refcount:%d "
             "encoding:%s serializedlength:%lld "
-            "lru:%d lru_seconds_idle:%lu",
+            "lru:%d lru_seconds_idle:%lu%s",
             (void*)val, val->refcount,
             strenc, (long long) rdbSavedObjectLen(val),
-            val->lru, estimateObjectIdleTime(val));
+            val->lru, estimateObjectIdleTime(val), extra);
     } else if (!strcasecmp(c->argv[1]->ptr,"sdslen") && c->argc == 3) {
         dictEntry *de;
         robj *val;
@@ -314,7 +353,7 @@ void debugCommand(redisClient *c) {
         val = dictGetVal(de);
         key = dictGetKey(de);
 
-        if (val->type != REDIS_STRING || val->encoding != REDIS_ENCODING_RAW) {
+        if (val->type != REDIS_STRING || !sdsEncodedObject(val)) {
             addReplyError(c,"Not an sds encoded string.");
         } else {
             addReplyStatusFormat(c,
@@ -372,6 +411,11 @@ void debugCommand(redisClient *c) {
     {
         server.active_expire_enabled = atoi(c->argv[2]->ptr);
         addReply(c,shared.ok);
+    } else if (!strcasecmp(c->argv[1]->ptr,"set-bitops-simd") &&
+               c->argc == 3)
+    {
+        server.bitops_simd = atoi(c->argv[2]->ptr);
+        addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"error") && c->argc == 3) {
         sds errstr = sdsnewlen("-",1);
 
@@ -413,7 +457,7 @@ void _redisAssertPrintClientInfo(redisClient *c) {
         char *arg;
 
         if (c->argv[j]->type == REDIS_STRING &&
-            c->argv[j]->encoding == REDIS_ENCODING_RAW)
+            sdsEncodedObject(c->argv[j]))
         {
             arg = (char*) c->argv[j]->ptr;
         } else {
@@ -430,7 +474,7 @@ void redisLogObjectDebugInfo(robj *o) {
     redisLog(REDIS_WARNING,"Object type: %d", o->type);
     redisLog(REDIS_WARNING,"Object encoding: %d", o->encoding);
     redisLog(REDIS_WARNING,"Object refcount: %d", o->refcount);
-    if (o->type == REDIS_STRING && o->encoding == REDIS_ENCODING_RAW) {
+    if (o->type == REDIS_STRING && sdsEncodedObject(o)) {
         redisLog(REDIS_WARNING,"Object raw string len: %zu", sdslen(o->ptr));
         if (sdslen(o->ptr) < 4096) {
             sds repr = sdscatrepr(sdsempty(),o->ptr,sdslen(o->ptr));
@@ -47,6 +47,10 @@
 #include "zmalloc.h"
 #include "redisassert.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* Using dictEnableResize() / dictDisableResize() we make possible to
  * enable/disable resizing of the hash table as needed. This is very important
  * for Redis, as we use copy-on-write and don't want to move too much memory
@@ -64,6 +68,8 @@ static int _dictExpandIfNeeded(dict *ht);
 static unsigned long _dictNextPower(unsigned long size);
 static int _dictKeyIndex(dict *ht, const void *key);
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
+static int _dictOpenExpandIfNeeded(dict *d);
+static dictEntry *_dictCreateEntry(dict *d, void *key);
 
 /* -------------------------- hash functions -------------------------------- */
 
@@ -152,6 +158,171 @@ unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len) {
     return hash;
 }
 
+/* ------------------------- open addressing tables -------------------------
+ *
+ * Dictionaries created with DICT_OPEN_ADDRESSING don't chain the entries:
+ * the table is an array of groups of DICT_GROUP_WIDTH slots, every slot
+ * pointing to at most one entry, and every group starting with a control
+ * byte per slot that tells if the slot is EMPTY, DELETED or full. Full
+ * slots hold 7 bits of the hash of their key (H2), so that a lookup only
+ * compares the keys of the entries that are very likely to match, and the
+ * 16 control bytes of a group are probed with a single SSE2 compare (two
+ * 64 bit words elsewhere). The slots sit next to their control bytes, so
+ * a lookup costs about the same cache misses of a chained bucket.
+ *
+ * The home group of a key is hash & (groups-1), like the bucket of chained
+ * tables. Entries go in any free slot of the home group, or of the next
+ * groups if it is full, and a lookup stops at the first group having an
+ * EMPTY slot. A group that became full never gets EMPTY slots again (until
+ * the table is rehashed): deleted entries leave a DELETED slot behind,
+ * unless the group already has an EMPTY slot. So the entries with a given
+ * home group are always in the run of groups going from the home group to
+ * the first one with an EMPTY slot, and dictScan() can visit home groups
+ * with the reverse binary cursor exactly as it visits buckets in chained
+ * tables, keeping the same guarantees.
+ *
+ * Slots that are not full always point to NULL, so that iterators and
+ * random sampling work the same for both kinds of tables. The load (used
+ * plus deleted slots) is kept below 7/8. Unlike chained tables, open
+ * tables can't exceed their size, so they grow even when resizing is
+ * disabled by dictDisableResize(). */
+
+#define DICT_GROUP_WIDTH 16
+#define DICT_CTRL_EMPTY ((unsigned char)0x80)
+#define DICT_CTRL_DELETED ((unsigned char)0xFE)
+
+typedef struct dictGroup {
+    unsigned char ctrl[DICT_GROUP_WIDTH];
+    dictEntry *slots[DICT_GROUP_WIDTH];
+} dictGroup;
+
+#define _dictIsOpen(d) ((d)->flags & DICT_OPEN_ADDRESSING)
+#define _dictGroups(ht) ((dictGroup*)(ht)->table)
+#define _dictGroupMask(ht) (((ht)->size/DICT_GROUP_WIDTH)-1)
+#define _dictH2(h) ((unsigned char)(((unsigned int)(h)*2654435761U) >> 25))
+#define _dictOpenOverloaded(ht,add) \
+    (((ht)->used+(ht)->deleted+(add)) > (ht)->size-(ht)->size/8)
+
+/* Group matching: return a mask with bit N set if the Nth control byte of
+ * the group is respectively equal to 'h2', EMPTY, or not full. */
+#if defined(__SSE2__)
+static inline unsigned int _dictGroupMatch(const dictGroup *g,
+                                           unsigned char h2) {
+    __m128i c = _mm_loadu_si128((const __m128i*)g->ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(c,_mm_set1_epi8((char)h2)));
+}
+
+static inline unsigned int _dictGroupMatchEmpty(const dictGroup *g) {
+    __m128i c = _mm_loadu_si128((const __m128i*)g->ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(c,
+        _mm_set1_epi8((char)DICT_CTRL_EMPTY)));
+}
+
+static inline unsigned int _dictGroupMatchFree(const dictGroup *g) {
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g->ctrl));
+}
+#else
+static inline unsigned int _dictGroupMatch(const dictGroup *g,
+                                           unsigned char h2) {
+    unsigned int m = 0;
+    int j;
+
+    for (j = 0; j < DICT_GROUP_WIDTH; j++)
+        if (g->ctrl[j] == h2) m |= 1U << j;
+    return m;
+}
+
+static inline unsigned int _dictGroupMatchEmpty(const dictGroup *g) {
+    return _dictGroupMatch(g,DICT_CTRL_EMPTY);
+}
+
+static inline unsigned int _dictGroupMatchFree(const dictGroup *g) {
+    unsigned int m = 0;
+    int j;
+
+    for (j = 0; j < DICT_GROUP_WIDTH; j++)
+        if (g->ctrl[j] & 0x80) m |= 1U << j;
+    return m;
+}
+#endif
+
+/* Return the entry of the slot 'idx' of any kind of table, or NULL. */
+static inline dictEntry *_dictSlot(dict *d, dictht *ht, unsigned long idx) {
+    if (_dictIsOpen(d))
+        return _dictGroups(ht)[idx/DICT_GROUP_WIDTH].slots[idx%DICT_GROUP_WIDTH];
+    return ht->table[idx];
+}
+
+/* Allocate the groups of an open table of 'size' slots, all EMPTY. */
+static dictEntry **_dictOpenAllocTable(unsigned long size) {
+    unsigned long groups = size/DICT_GROUP_WIDTH, j;
+    dictGroup *g = zcalloc(groups*sizeof(dictGroup));
+
+    for (j = 0; j < groups; j++)
+        memset(g[j].ctrl,DICT_CTRL_EMPTY,DICT_GROUP_WIDTH);
+    return (dictEntry**)g;
+}
+
+/* Return the slot holding 'key' with hash 'h' in 'ht', or -1. */
+static long _dictOpenFind(dict *d, dictht *ht, const void *key,
+                          unsigned int h) {
+    unsigned char h2 = _dictH2(h);
+    unsigned long gmask, idx, probed;
+    dictGroup *g;
+    unsigned int m;
+
+    if (ht->used == 0) return -1;
+    gmask = _dictGroupMask(ht);
+    idx = h & gmask;
+    for (probed = 0; probed <= gmask; probed++) {
+        g = _dictGroups(ht)+idx;
+        m = _dictGroupMatch(g,h2);
+        while(m) {
+            int j = __builtin_ctz(m);
+
+            if (dictCompareKeys(d, key, g->slots[j]->key))
+                return idx*DICT_GROUP_WIDTH+j;
+            m &= m-1;
+        }
+        if (_dictGroupMatchEmpty(g)) break;
+        idx = (idx+1) & gmask;
+    }
+    return -1;
+}
+
+/* Store 'de', whose key has hash 'h', in the first free slot of its probe
+ * sequence. The caller makes sure the table is not full. */
+static void _dictOpenInsert(dictht *ht, dictEntry *de, unsigned int h) {
+    unsigned long gmask = _dictGroupMask(ht), idx = h & gmask;
+    dictGroup *g;
+    unsigned int m;
+    int j;
+
+    while((m = _dictGroupMatchFree(_dictGroups(ht)+idx)) == 0)
+        idx = (idx+1) & gmask;
+    g = _dictGroups(ht)+idx;
+    j = __builtin_ctz(m);
+    if (g->ctrl[j] == DICT_CTRL_DELETED) ht->deleted--;
+    g->ctrl[j] = _dictH2(h);
+    g->slots[j] = de;
+    ht->used++;
+}
+
+/* Remove the entry at slot 'idx' from the table (the entry is not freed). */
+static void _dictOpenErase(dictht *ht, unsigned long idx) {
+    dictGroup *g = _dictGroups(ht)+idx/DICT_GROUP_WIDTH;
+    int j = idx%DICT_GROUP_WIDTH;
+
+    g->slots[j] = NULL;
+    ht->used--;
+    if (_dictGroupMatchEmpty(g)) {
+        g->ctrl[j] = DICT_CTRL_EMPTY;
+    } else {
+        g->ctrl[j] = DICT_CTRL_DELETED;
+        ht->deleted++;
+    }
+}
+
 /* ----------------------------- API implementation ------------------------- */
 
 /* Reset a hash table already initialized with ht_init().
@@ -162,6 +333,7 @@ static void _dictReset(dictht *ht)
     ht->size = 0;
     ht->sizemask = 0;
     ht->used = 0;
+    ht->deleted = 0;
 }
 
 /* Create a new hash table */
@@ -174,6 +346,14 @@ dict *dictCreate(dictType *type,
     return d;
 }
 
+/* Create a new hash table with the specified DICT_* flags. */
+dict *dictCreateWithFlags(dictType *type, void *privDataPtr, int flags) {
+    dict *d = dictCreate(type,privDataPtr);
+
+    d->flags = flags;
+    return d;
+}
+
 /* Initialize the hash table */
 int _dictInit(dict *d, dictType *type,
         void *privDataPtr)
@@ -184,6 +364,7 @@ int _dictInit(dict *d, dictType *type,
     d->privdata = privDataPtr;
     d->rehashidx = -1;
     d->iterators = 0;
+    d->flags = 0;
     return DICT_OK;
 }
 
@@ -211,11 +392,29 @@ int dictExpand(dict *d, unsigned long size)
     if (dictIsRehashing(d) || d->ht[0].used > size)
         return DICT_ERR;
 
+    /* Open tables are at least a group, and can't be filled more than
+     * 7/8 of their size. */
+    if (_dictIsOpen(d)) {
+        if (realsize < DICT_GROUP_WIDTH) realsize = DICT_GROUP_WIDTH;
+        while(realsize-realsize/8 < size) realsize *= 2;
+    }
+
+    /* Rehashing to a table of the same size is only useful to get rid of
+     * the DELETED slots of an open table. Without this check dictResize()
+     * would rehash small tables again and again, since they can't shrink
+     * below their minimum size. */
+    if (realsize == d->ht[0].size && d->ht[0].deleted == 0)
+        return DICT_ERR;
+
     /* Allocate the new hash table and initialize all pointers to NULL */
     n.size = realsize;
     n.sizemask = realsize-1;
-    n.table = zcalloc(realsize*sizeof(dictEntry*));
+    if (_dictIsOpen(d))
+        n.table = _dictOpenAllocTable(realsize);
+    else
+        n.table = zcalloc(realsize*sizeof(dictEntry*));
     n.used = 0;
+    n.deleted = 0;
 
     /* Is this the first initialization? If so it's not really a rehashing
      * we just set the first hash table so that it can accept keys. */
@@ -233,7 +432,8 @@ int dictExpand(dict *d, unsigned long size)
 /* Performs N steps of incremental rehashing. Returns 1 if there are still
  * keys to move from the old to the new hash table, otherwise 0 is returned.
  * Note that a rehashing step consists in moving a bucket (that may have more
- * than one key as we use chaining) from the old to the new hash table. */
+ * than one key as we use chaining) from the old to the new hash table, or
+ * a single entry for open addressing tables. */
 int dictRehash(dict *d, int n) {
     if (!dictIsRehashing(d)) return 0;
 
@@ -252,6 +452,15 @@ int dictRehash(dict *d, int n) {
         /* Note that rehashidx can't overflow as we are sure there are more
          * elements because ht[0].used != 0 */
         assert(d->ht[0].size > (unsigned long)d->rehashidx);
+        if (_dictIsOpen(d)) {
+            /* Move a single entry: the rest of its group stays valid. */
+            while((de = _dictSlot(d,&d->ht[0],d->rehashidx)) == NULL)
+                d->rehashidx++;
+            _dictOpenErase(&d->ht[0],d->rehashidx);
+            _dictOpenInsert(&d->ht[1],de,dictHashKey(d, de->key));
+            d->rehashidx++;
+            continue;
+        }
         while(d->ht[0].table[d->rehashidx] == NULL) d->rehashidx++;
         de = d->ht[0].table[d->rehashidx];
         /* Move all the keys in this bucket from the old to the new hash HT */
@@ -301,7 +510,10 @@ int dictRehashMilliseconds(dict *d, int ms) {
  * dictionary so that the hash table automatically migrates from H1 to H2
  * while it is actively used. */
 static void _dictRehashStep(dict *d) {
-    if (d->iterators == 0) dictRehash(d,1);
+    /* Open tables move two entries per step, so that the new table, at
+     * least twice as big as the old one, can't be filled before the
+     * rehashing is done. */
+    if (d->iterators == 0) dictRehash(d,_dictIsOpen(d) ? 2 : 1);
 }
 
 /* Add an element to the target hash table */
@@ -337,6 +549,20 @@ dictEntry *dictAddRaw(dict *d, void *key)
 
     if (dictIsRehashing(d)) _dictRehashStep(d);
 
+    if (_dictIsOpen(d)) {
+        unsigned int h = dictHashKey(d, key);
+
+        if (_dictOpenExpandIfNeeded(d) == DICT_ERR) return NULL;
+        if (_dictOpenFind(d,&d->ht[0],key,h) != -1) return NULL;
+        if (dictIsRehashing(d) && _dictOpenFind(d,&d->ht[1],key,h) != -1)
+            return NULL;
+        ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
+        entry = _dictCreateEntry(d, key);
+        entry->next = NULL;
+        _dictOpenInsert(ht,entry,h);
+        return entry;
+    }
+
     /* Get the index of the new element, or -1 if
      * the element already exists. */
     if ((index = _dictKeyIndex(d, key)) == -1)
@@ -344,13 +570,25 @@ dictEntry *dictAddRaw(dict *d, void *key)
 
     /* Allocate the memory and store the new entry */
     ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
-    entry = zmalloc(sizeof(*entry));
+    entry = _dictCreateEntry(d, key);
     entry->next = ht->table[index];
     ht->table[index] = entry;
     ht->used++;
+    return entry;
+}
 
-    /* Set the hash entry fields. */
-    dictSetKey(d, entry, key);
+/* Allocate a new entry and set its key, embedding a copy of the key in
+ * the same allocation if the dict type supports it. */
+static dictEntry *_dictCreateEntry(dict *d, void *key) {
+    dictEntry *entry;
+
+    if (d->type->keyEmbed) {
+        entry = zmalloc(sizeof(*entry)+d->type->keyEmbedLen(key));
+        entry->key = d->type->keyEmbed(entry+1,key);
+    } else {
+        entry = zmalloc(sizeof(*entry));
+        dictSetKey(d, entry, key);
+    }
     return entry;
 }
 
@@ -403,6 +641,22 @@ static int dictGenericDelete(dict *d, const void *key, int nofree)
     h = dictHashKey(d, key);
 
     for (table = 0; table <= 1; table++) {
+        if (_dictIsOpen(d)) {
+            long slot = _dictOpenFind(d,&d->ht[table],key,h);
+
+            if (slot != -1) {
+                he = _dictSlot(d,&d->ht[table],slot);
+                _dictOpenErase(&d->ht[table],slot);
+                if (!nofree) {
+                    dictFreeKey(d, he);
+                    dictFreeVal(d, he);
+                }
+                zfree(he);
+                return DICT_OK;
+            }
+            if (!dictIsRehashing(d)) break;
+            continue;
+        }
         idx = h & d->ht[table].sizemask;
         he = d->ht[table].table[idx];
         prevHe = NULL;
@@ -447,7 +701,7 @@ int _dictClear(dict *d, dictht *ht, void(callback)(void *)) {
 
         if (callback && (i & 65535) == 0) callback(d->privdata);
 
-        if ((he = ht->table[i]) == NULL) continue;
+        if ((he = _dictSlot(d,ht,i)) == NULL) continue;
         while(he) {
             nextHe = he->next;
             dictFreeKey(d, he);
@@ -481,6 +735,13 @@ dictEntry *dictFind(dict *d, const void *key)
     if (dictIsRehashing(d)) _dictRehashStep(d);
     h = dictHashKey(d, key);
     for (table = 0; table <= 1; table++) {
+        if (_dictIsOpen(d)) {
+            long slot = _dictOpenFind(d,&d->ht[table],key,h);
+
+            if (slot != -1) return _dictSlot(d,&d->ht[table],slot);
+            if (!dictIsRehashing(d)) return NULL;
+            continue;
+        }
         idx = h & d->ht[table].sizemask;
         he = d->ht[table].table[idx];
         while(he) {
@@ -579,7 +840,7 @@ dictEntry *dictNext(dictIterator *iter)
                     break;
                 }
             }
-            iter->entry = ht->table[iter->index];
+            iter->entry = _dictSlot(iter->d,ht,iter->index);
         } else {
             iter->entry = iter->nextEntry;
         }
@@ -617,13 +878,14 @@ dictEntry *dictGetRandomKey(dict *d)
     if (dictIsRehashing(d)) {
         do {
             h = random() % (d->ht[0].size+d->ht[1].size);
-            he = (h >= d->ht[0].size) ? d->ht[1].table[h - d->ht[0].size] :
-                                      d->ht[0].table[h];
+            he = (h >= d->ht[0].size) ?
+                 _dictSlot(d,&d->ht[1],h - d->ht[0].size) :
+                 _dictSlot(d,&d->ht[0],h);
         } while(he == NULL);
     } else {
         do {
             h = random() & d->ht[0].sizemask;
-            he = d->ht[0].table[h];
+            he = _dictSlot(d,&d->ht[0],h);
         } while(he == NULL);
     }
 
@@ -687,7 +949,8 @@ static unsigned long rev(unsigned long v) {
  * use chaining, so the position of an element in a given table is given
  * by computing the bitwise AND between Hash(key) and SIZE-1
  * (where SIZE-1 is always the mask that is equivalent to taking the rest
- *  of the division between the Hash of the key and SIZE).
+ *  of the division between the Hash of the key and SIZE). Open addressing
+ * tables do the same with groups of slots instead of buckets.
  *
  * For example if the current hash table size is 16, the mask is
  * (in binary) 1111. The position of a key in the hash table will always be
@@ -739,27 +1002,61 @@ static unsigned long rev(unsigned long v) {
  * 3) The reverse cursor is somewhat hard to understand at first, but this
  *    comment is supposed to help.
  */
+/* Emit the entries of the bucket 'v' of the table 't'. For open addressing
+ * tables these are the entries having 'v' as home group, found in the run
+ * of groups starting there. Entries outside their home group can only
+ * follow a group without EMPTY slots, otherwise their home is not checked. */
+static void _dictScanBucket(dict *d, dictht *t, unsigned long v,
+                            dictScanFunction *fn, void *privdata)
+{
+    const dictEntry *de;
+
+    if (_dictIsOpen(d)) {
+        dictGroup *g = _dictGroups(t);
+        unsigned long gmask = _dictGroupMask(t), idx, n;
+        int j, check;
+
+        v &= gmask;
+        idx = v;
+        check = !_dictGroupMatchEmpty(g+((idx-1) & gmask));
+        for (n = 0; n <= gmask; n++) {
+            for (j = 0; j < DICT_GROUP_WIDTH; j++) {
+                de = g[idx].slots[j];
+                if (de && (!check || (dictHashKey(d, de->key) & gmask) == v))
+                    fn(privdata, de);
+            }
+            if (_dictGroupMatchEmpty(g+idx)) break;
+            idx = (idx+1) & gmask;
+            check = 1;
+        }
+        return;
+    }
+    de = t->table[v & t->sizemask];
+    while (de) {
+        fn(privdata, de);
+        de = de->next;
+    }
+}
+
+/* Open tables are scanned by group, so the cursor uses the group mask. */
+#define _dictScanMask(d,t) (_dictIsOpen(d) ? _dictGroupMask(t) : (t)->sizemask)
+
 unsigned long dictScan(dict *d,
                        unsigned long v,
                        dictScanFunction *fn,
                        void *privdata)
 {
     dictht *t0, *t1;
-    const dictEntry *de;
     unsigned long m0, m1;
 
     if (dictSize(d) == 0) return 0;
 
     if (!dictIsRehashing(d)) {
         t0 = &(d->ht[0]);
-        m0 = t0->sizemask;
+        m0 = _dictScanMask(d,t0);
 
         /* Emit entries at cursor */
-        de = t0->table[v & m0];
-        while (de) {
-            fn(privdata, de);
-            de = de->next;
-        }
+        _dictScanBucket(d, t0, v, fn, privdata);
 
     } else {
         t0 = &d->ht[0];
@@ -771,25 +1068,17 @@ unsigned long dictScan(dict *d,
             t1 = &d->ht[0];
         }
 
-        m0 = t0->sizemask;
-        m1 = t1->sizemask;
+        m0 = _dictScanMask(d,t0);
+        m1 = _dictScanMask(d,t1);
 
         /* Emit entries at cursor */
-        de = t0->table[v & m0];
-        while (de) {
-            fn(privdata, de);
-            de = de->next;
-        }
+        _dictScanBucket(d, t0, v, fn, privdata);
 
         /* Iterate over indices in larger table that are the expansion
          * of the index pointed to by the cursor in the smaller table */
         do {
             /* Emit entries at cursor */
-            de = t1->table[v & m1];
-            while (de) {
-                fn(privdata, de);
-                de = de->next;
-            }
+            _dictScanBucket(d, t1, v, fn, privdata);
 
             /* Increment bits not covered by the smaller mask */
             v = (((v | m0) + 1) & ~m0) | (v & m0);
@@ -834,6 +1123,23 @@ static int _dictExpandIfNeeded(dict *d)
     return DICT_OK;
 }
 
+/* Expand the open addressing table if needed. The table to fill is the new
+ * one when rehashing: if the rehashing was not able to keep up, because of
+ * safe iterators, it is completed here, since the new table can't be
+ * overloaded. */
+static int _dictOpenExpandIfNeeded(dict *d)
+{
+    if (dictIsRehashing(d)) {
+        if (!_dictOpenOverloaded(&d->ht[1],1)) return DICT_OK;
+        while(dictRehash(d,100));
+    }
+
+    if (d->ht[0].size == 0) return dictExpand(d, DICT_GROUP_WIDTH);
+    if (_dictOpenOverloaded(&d->ht[0],1))
+        return dictExpand(d, d->ht[0].used*2);
+    return DICT_OK;
+}
+
 /* Our hash table capability is a power of two */
 static unsigned long _dictNextPower(unsigned long size)
 {
@@ -1016,3 +1322,119 @@ dictType dictTypeHeapStringCopyKeyValue = {
     _dictStringDestructor,         /* val destructor */
 };
 #endif
+
+#ifdef DICT_BENCHMARK_MAIN
+/* Lookup and insert microbenchmark of chained and open addressing tables:
+ *
+ * cc -O2 -DDICT_BENCHMARK_MAIN -o dict-benchmark dict.c zmalloc.c
+ *
+ * Keys are preallocated strings, added to a dictionary with no key or value
+ * destructors, then looked up in random order. */
+#define DICT_BENCH_KEYS 1000000
+
+void _redisAssert(char *estr, char *file, int line) {
+    fprintf(stderr,"ASSERTION FAILED %s:%d '%s'\n",file,line,estr);
+}
+
+static long long dictBenchUstime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+static unsigned int dictBenchHash(const void *key) {
+    return dictGenHashFunction(key,strlen(key));
+}
+
+static int dictBenchCompare(void *privdata, const void *key1,
+                            const void *key2) {
+    DICT_NOTUSED(privdata);
+    return strcmp(key1,key2) == 0;
+}
+
+static dictType dictBenchType = {
+    dictBenchHash, NULL, NULL, dictBenchCompare, NULL, NULL, NULL, NULL
+};
+
+static void dictBenchScanCallback(void *privdata, const dictEntry *de) {
+    DICT_NOTUSED(de);
+    (*(long*)privdata)++;
+}
+
+#define DICT_BENCH(msg,count,code) do { \
+    long long _start = dictBenchUstime(); \
+    code; \
+    printf("  %-24s %.1f ns/op\n", msg, \
+        (double)(dictBenchUstime()-_start)*1000/(count)); \
+} while(0)
+
+/* Best of three runs, for the operations that don't change the dict. */
+#define DICT_BENCH_BEST(msg,count,code) do { \
+    long long _best = 0, _elapsed; \
+    int _run; \
+    for (_run = 0; _run < 3; _run++) { \
+        long long _start = dictBenchUstime(); \
+        code; \
+        _elapsed = dictBenchUstime()-_start; \
+        if (_run == 0 || _elapsed < _best) _best = _elapsed; \
+    } \
+    printf("  %-24s %.1f ns/op\n", msg, (double)_best*1000/(count)); \
+} while(0)
+
+static void dictBenchRun(char *name, int flags, char **keys, char **misses,
+                         long *order, long n) {
+    dict *d = dictCreateWithFlags(&dictBenchType,NULL,flags);
+    long j, found = 0, scanned = 0;
+    unsigned long cursor = 0;
+
+    printf("%s:\n", name);
+    DICT_BENCH("insert",n,
+        for (j = 0; j < n; j++) dictAdd(d,keys[j],NULL));
+    while(dictIsRehashing(d)) dictRehash(d,100);
+    DICT_BENCH_BEST("lookup (hit)",n,
+        for (j = 0; j < n; j++) found += dictFind(d,keys[order[j]]) != NULL);
+    DICT_BENCH_BEST("lookup (miss)",n,
+        for (j = 0; j < n; j++) found += dictFind(d,misses[order[j]]) != NULL);
+    DICT_BENCH("delete + insert",n,
+        for (j = 0; j < n; j++) {
+            dictDelete(d,keys[order[j]]);
+            dictAdd(d,misses[order[j]],NULL);
+        });
+    DICT_BENCH("scan",n,
+        do {
+            cursor = dictScan(d,cursor,dictBenchScanCallback,&scanned);
+        } while(cursor));
+    if (found != n*3 || scanned != n || (long)dictSize(d) != n)
+        printf("  ERROR: found %ld, scanned %ld, size %lu (expected %ld)\n",
+            found, scanned, dictSize(d), n);
+    dictRelease(d);
+}
+
+int main(int argc, char **argv) {
+    long n = argc > 1 ? atol(argv[1]) : DICT_BENCH_KEYS, j;
+    char **keys = zmalloc(sizeof(char*)*n);
+    char **misses = zmalloc(sizeof(char*)*n);
+    long *order = zmalloc(sizeof(long)*n);
+    char buf[64];
+
+    for (j = 0; j < n; j++) {
+        snprintf(buf,sizeof(buf),"key:%ld",j);
+        keys[j] = strdup(buf);
+        snprintf(buf,sizeof(buf),"miss:%ld",j);
+        misses[j] = strdup(buf);
+        order[j] = j;
+    }
+    srandom(1234);
+    for (j = n-1; j > 0; j--) {
+        long k = random()%(j+1), tmp = order[j];
+
+        order[j] = order[k];
+        order[k] = tmp;
+    }
+    printf("%ld keys\n", n);
+    dictBenchRun("chained",0,keys,misses,order,n);
+    dictBenchRun("open addressing",DICT_OPEN_ADDRESSING,keys,misses,order,n);
+    return 0;
+}
+#endif
@@ -62,6 +62,13 @@ typedef struct dictType {
     int (*keyCompare)(void *privdata, const void *key1, const void *key2);
     void (*keyDestructor)(void *privdata, void *key);
     void (*valDestructor)(void *privdata, void *obj);
+    /* Optional: store a copy of the key in the same allocation of the
+     * entry. keyEmbedLen() returns the bytes needed by the copy, and
+     * keyEmbed() writes it at 'buf' returning the pointer to use as key.
+     * Embedded keys are released with the entry, so types using them
+     * should not set a key dup or destructor. */
+    size_t (*keyEmbedLen)(const void *key);
+    void *(*keyEmbed)(void *buf, const void *key);
 } dictType;
 
 /* This is our hash table structure. Every dictionary has two of this as we
@@ -71,6 +78,7 @@ typedef struct dictht {
     unsigned long size;
     unsigned long sizemask;
     unsigned long used;
+    unsigned long deleted; /* deleted slots of open addressing tables */
 } dictht;
 
 typedef struct dict {
@@ -79,6 +87,7 @@ typedef struct dict {
     dictht ht[2];
     long rehashidx; /* rehashing not in progress if rehashidx == -1 */
     int iterators; /* number of iterators currently running */
+    int flags; /* DICT_OPEN_ADDRESSING */
 } dict;
 
 /* If safe is set to 1 this is a safe iterator, that means, you can call
@@ -99,6 +108,11 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 /* This is the initial size of every hash table */
 #define DICT_HT_INITIAL_SIZE     4
 
+/* Dictionary flags. With DICT_OPEN_ADDRESSING the entries are not chained,
+ * but stored in the table slots, found by probing a byte of metadata per
+ * slot (see the comment in dict.c). */
+#define DICT_OPEN_ADDRESSING 1
+
 /* ------------------------------- Macros ------------------------------------*/
 #define dictFreeVal(d, entry) \
     if ((d)->type->valDestructor) \
@@ -148,6 +162,7 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 
 /* API */
 dict *dictCreate(dictType *type, void *privDataPtr);
+dict *dictCreateWithFlags(dictType *type, void *privDataPtr, int flags);
 int dictExpand(dict *d, unsigned long size);
 int dictAdd(dict *d, void *key, void *val);
 dictEntry *dictAddRaw(dict *d, void *key);
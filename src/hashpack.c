@@ -0,0 +1,702 @@
+/* hashpack.c - Hash of strings packed in a single arena with an index
+ *
+ * Medium sized hashes are too big for a listpack, where every lookup is a
+ * linear scan, but a real hash table wastes a lot of memory on them: every
+ * field and value is a separate object plus a dictEntry. A hashpack keeps
+ * all the pairs in a single arena and only adds a 32 bit slot per pair,
+ * while lookups are still O(1).
+ *
+ * ARENA LAYOUT
+ * ============
+ *
+ * Pairs are appended to the arena and never moved while they are alive:
+ *
+ * <flen<<1|deleted><field><vlen><value>
+ *
+ * Both lengths are LEB128 varints, so the deleted flag is the lowest bit of
+ * the first byte of the pair. Updating a value in place is only possible
+ * if the new one has the same length, otherwise the old pair is flagged as
+ * deleted and a new one is appended. When deleted pairs use more than half
+ * of the arena the live pairs are moved together and the index is rebuilt.
+ *
+ * INDEX
+ * =====
+ *
+ * The index is an open addressing table with linear probing, with a power
+ * of two size and a load factor of at most 3/4, deleted slots included.
+ * A slot is 0 if empty, 1 if its pair was deleted, or the arena offset of
+ * the pair plus two.
+ *
+ * SERIALIZATION
+ * =============
+ *
+ * The blob is the number of pairs as a 32 bit little endian integer followed
+ * by the live pairs in the arena format, so loading it only requires to
+ * rebuild the index.
+ *
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hashpack.h"
+#include "dict.h"
+#include "zmalloc.h"
+#include "endianconv.h"
+
+#define HP_INDEX_MIN 8              /* Slots of the smallest index. */
+#define HP_EMPTY 0
+#define HP_DELETED 1
+#define HP_OFFSET(slot) ((slot)-2)
+#define HP_SLOT(offset) ((offset)+2)
+#define HP_GARBAGE_MIN 256          /* Don't compact for less than this. */
+
+/* ---------------------------------------------------------------------------
+ * Varints
+ * ------------------------------------------------------------------------ */
+
+/* Encode 'v' at 'p' (if not NULL) and return the number of bytes used. */
+static uint32_t hpEncodeVarint(unsigned char *p, uint32_t v) {
+    uint32_t len = 0;
+
+    do {
+        unsigned char byte = v & 0x7f;
+        v >>= 7;
+        if (v) byte |= 0x80;
+        if (p) p[len] = byte;
+        len++;
+    } while(v);
+    return len;
+}
+
+/* Decode the varint at 'p' into '*v' and return the number of bytes used,
+ * without reading past 'end'. Return 0 if the varint is not valid. */
+static uint32_t hpDecodeVarint(unsigned char *p, unsigned char *end, uint32_t *v) {
+    uint32_t len = 0, shift = 0;
+
+    *v = 0;
+    while(p+len < end && len < 5) {
+        unsigned char byte = p[len++];
+        *v |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return len;
+        shift += 7;
+    }
+    return 0;
+}
+
+/* Decode the pair at arena offset 'offset'. Return the total length of the
+ * pair, the field and value pointers and lengths, and the deleted flag. */
+static uint32_t hpPair(hashpack *hp, uint32_t offset, unsigned char **f,
+                       uint32_t *flen, unsigned char **v, uint32_t *vlen,
+                       int *deleted)
+{
+    unsigned char *p = hp->arena+offset, *end = hp->arena+hp->used;
+    uint32_t l;
+
+    p += hpDecodeVarint(p,end,&l);
+    *deleted = l & 1;
+    *flen = l >> 1;
+    *f = p;
+    p += *flen;
+    p += hpDecodeVarint(p,end,vlen);
+    *v = p;
+    p += *vlen;
+    return p-(hp->arena+offset);
+}
+
+static uint32_t hpPairLen(uint32_t flen, uint32_t vlen) {
+    return hpEncodeVarint(NULL,flen<<1)+flen+hpEncodeVarint(NULL,vlen)+vlen;
+}
+
+/* ---------------------------------------------------------------------------
+ * Index
+ * ------------------------------------------------------------------------ */
+
+/* Return the index position of the field, or -1 if it is not there. If
+ * 'insertpos' is not NULL it is set to the position where the field should
+ * be added: the first deleted slot met while probing, or the empty one that
+ * ended the search. */
+static int64_t hpLookup(hashpack *hp, unsigned char *f, uint32_t flen,
+                        uint32_t *insertpos)
+{
+    uint32_t mask = hp->size-1;
+    uint32_t i = dictGenHashFunction(f,flen) & mask;
+    int64_t firstdel = -1;
+
+    while(1) {
+        uint32_t slot = hp->index[i];
+
+        if (slot == HP_EMPTY) {
+            if (insertpos) *insertpos = (firstdel != -1) ? firstdel : i;
+            return -1;
+        } else if (slot == HP_DELETED) {
+            if (firstdel == -1) firstdel = i;
+        } else {
+            unsigned char *pf, *pv;
+            uint32_t pflen, pvlen;
+            int deleted;
+
+            hpPair(hp,HP_OFFSET(slot),&pf,&pflen,&pv,&pvlen,&deleted);
+            if (pflen == flen && memcmp(pf,f,flen) == 0) return i;
+        }
+        i = (i+1) & mask;
+    }
+}
+
+/* Rebuild the index from the live pairs of the arena, with 'size' slots. */
+static void hpRebuildIndex(hashpack *hp, uint32_t size) {
+    uint32_t offset = 0;
+
+    zfree(hp->index);
+    hp->index = zcalloc(sizeof(uint32_t)*size);
+    hp->size = size;
+    hp->filled = 0;
+    while(offset < hp->used) {
+        unsigned char *f, *v;
+        uint32_t flen, vlen, len, mask = size-1, i;
+        int deleted;
+
+        len = hpPair(hp,offset,&f,&flen,&v,&vlen,&deleted);
+        if (!deleted) {
+            i = dictGenHashFunction(f,flen) & mask;
+            while(hp->index[i] != HP_EMPTY) i = (i+1) & mask;
+            hp->index[i] = HP_SLOT(offset);
+            hp->filled++;
+        }
+        offset += len;
+    }
+}
+
+/* Return the index size needed for 'count' pairs. */
+static uint32_t hpIndexSize(uint32_t count) {
+    uint32_t size = HP_INDEX_MIN;
+
+    while((uint64_t)count*4 >= (uint64_t)size*3) size *= 2;
+    return size;
+}
+
+/* Move the live pairs together, dropping the deleted ones. */
+static void hpCompact(hashpack *hp) {
+    uint32_t src = 0, dst = 0;
+
+    while(src < hp->used) {
+        unsigned char *f, *v;
+        uint32_t flen, vlen, len;
+        int deleted;
+
+        len = hpPair(hp,src,&f,&flen,&v,&vlen,&deleted);
+        if (!deleted) {
+            if (dst != src) memmove(hp->arena+dst,hp->arena+src,len);
+            dst += len;
+        }
+        src += len;
+    }
+    hp->used = dst;
+    hp->garbage = 0;
+    if (hp->alloc > hp->used*2) {
+        hp->alloc = hp->used ? hp->used : 0;
+        if (hp->alloc) {
+            hp->arena = zrealloc(hp->arena,hp->alloc);
+        } else {
+            zfree(hp->arena);
+            hp->arena = NULL;
+        }
+    }
+    hpRebuildIndex(hp,hpIndexSize(hp->count));
+}
+
+/* Append a pair to the arena and return its offset. */
+static uint32_t hpAppend(hashpack *hp, unsigned char *f, uint32_t flen,
+                         unsigned char *v, uint32_t vlen)
+{
+    uint32_t len = hpPairLen(flen,vlen), offset = hp->used;
+    unsigned char *p;
+
+    if (hp->used+len > hp->alloc) {
+        uint32_t alloc = hp->alloc + hp->alloc/2;
+        if (alloc < hp->used+len) alloc = hp->used+len;
+        if (alloc < 64) alloc = 64;
+        hp->arena = zrealloc(hp->arena,alloc);
+        hp->alloc = alloc;
+    }
+    p = hp->arena+offset;
+    p += hpEncodeVarint(p,flen<<1);
+    memcpy(p,f,flen);
+    p += flen;
+    p += hpEncodeVarint(p,vlen);
+    memcpy(p,v,vlen);
+    hp->used += len;
+    return offset;
+}
+
+/* Flag the pair at 'offset' as deleted. */
+static void hpKill(hashpack *hp, uint32_t offset) {
+    unsigned char *f, *v;
+    uint32_t flen, vlen;
+    int deleted;
+
+    hp->garbage += hpPair(hp,offset,&f,&flen,&v,&vlen,&deleted);
+    hp->arena[offset] |= 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * API
+ * ------------------------------------------------------------------------ */
+
+hashpack *hpNew(void) {
+    hashpack *hp = zmalloc(sizeof(*hp));
+
+    hp->arena = NULL;
+    hp->index = zcalloc(sizeof(uint32_t)*HP_INDEX_MIN);
+    hp->count = 0;
+    hp->used = 0;
+    hp->alloc = 0;
+    hp->garbage = 0;
+    hp->size = HP_INDEX_MIN;
+    hp->filled = 0;
+    return hp;
+}
+
+void hpFree(hashpack *hp) {
+    zfree(hp->arena);
+    zfree(hp->index);
+    zfree(hp);
+}
+
+uint32_t hpLength(hashpack *hp) {
+    return hp->count;
+}
+
+/* Return 1 if a pair with a field of 'flen' bytes and a value of 'vlen'
+ * bytes can be added without the arena growing past HP_MAX_ARENA. Deleted
+ * pairs are counted as well, as they may not be reclaimed before. The two
+ * varints of the pair take 5 bytes at most each. */
+int hpSafeToAdd(hashpack *hp, size_t flen, size_t vlen) {
+    return flen < HP_MAX_ARENA && vlen < HP_MAX_ARENA &&
+           (size_t)hp->used+flen+vlen+10 <= HP_MAX_ARENA;
+}
+
+/* Return the bytes used by the hashpack. */
+size_t hpBytes(hashpack *hp) {
+    return sizeof(*hp)+hp->alloc+sizeof(uint32_t)*hp->size;
+}
+
+/* Lookup the field. Return 1 and set '*v' and '*vlen' to the value if it
+ * exists, otherwise return 0. The value is valid until the next change. */
+int hpFind(hashpack *hp, unsigned char *f, uint32_t flen, unsigned char **v,
+           uint32_t *vlen)
+{
+    unsigned char *pf;
+    uint32_t pflen;
+    int64_t pos;
+    int deleted;
+
+    if (hp->count == 0) return 0;
+    pos = hpLookup(hp,f,flen,NULL);
+    if (pos == -1) return 0;
+    hpPair(hp,HP_OFFSET(hp->index[pos]),&pf,&pflen,v,vlen,&deleted);
+    return 1;
+}
+
+/* Set the field to the given value. Return 1 if the field already existed
+ * and its value was updated, 0 if the field was added. */
+int hpSet(hashpack *hp, unsigned char *f, uint32_t flen, unsigned char *v,
+          uint32_t vlen)
+{
+    uint32_t insertpos;
+    int64_t pos = hpLookup(hp,f,flen,&insertpos);
+
+    if (pos != -1) {
+        uint32_t offset = HP_OFFSET(hp->index[pos]);
+        unsigned char *pf, *pv;
+        uint32_t pflen, pvlen;
+        int deleted;
+
+        hpPair(hp,offset,&pf,&pflen,&pv,&pvlen,&deleted);
+        if (pvlen == vlen) {
+            memcpy(pv,v,vlen);
+        } else {
+            hpKill(hp,offset);
+            hp->index[pos] = HP_SLOT(hpAppend(hp,f,flen,v,vlen));
+            if (hp->garbage > HP_GARBAGE_MIN && hp->garbage > hp->used/2)
+                hpCompact(hp);
+        }
+        return 1;
+    }
+
+    if (hp->index[insertpos] == HP_EMPTY) hp->filled++;
+    hp->index[insertpos] = HP_SLOT(hpAppend(hp,f,flen,v,vlen));
+    hp->count++;
+    if ((uint64_t)hp->filled*4 > (uint64_t)hp->size*3)
+        hpRebuildIndex(hp,hpIndexSize(hp->count));
+    return 0;
+}
+
+/* Delete the field. Return 1 if it was found, 0 otherwise. */
+int hpDelete(hashpack *hp, unsigned char *f, uint32_t flen) {
+    int64_t pos;
+
+    if (hp->count == 0) return 0;
+    pos = hpLookup(hp,f,flen,NULL);
+    if (pos == -1) return 0;
+    hpKill(hp,HP_OFFSET(hp->index[pos]));
+    hp->index[pos] = HP_DELETED;
+    hp->count--;
+    if (hp->count == 0) {
+        /* Start again from scratch instead of compacting. */
+        zfree(hp->arena);
+        hp->arena = NULL;
+        hp->used = hp->alloc = hp->garbage = 0;
+        hpRebuildIndex(hp,HP_INDEX_MIN);
+    } else if (hp->garbage > HP_GARBAGE_MIN && hp->garbage > hp->used/2) {
+        hpCompact(hp);
+    }
+    return 1;
+}
+
+/* Iterate the live pairs in insertion order. '*cursor' must be set to zero
+ * before the first call. Return 1 and set the field and value if there is
+ * a pair, 0 at the end. The hashpack must not be modified while iterating. */
+int hpNext(hashpack *hp, uint32_t *cursor, unsigned char **f, uint32_t *flen,
+           unsigned char **v, uint32_t *vlen)
+{
+    while(*cursor < hp->used) {
+        int deleted;
+
+        *cursor += hpPair(hp,*cursor,f,flen,v,vlen,&deleted);
+        if (!deleted) return 1;
+    }
+    return 0;
+}
+
+/* Reverse the bits of 'v', see dictScan(). */
+static unsigned long hpRev(unsigned long v) {
+    unsigned long s = 8 * sizeof(v);
+    unsigned long mask = ~0;
+
+    while ((s >>= 1) > 0) {
+        mask ^= (mask << s);
+        v = ((v >> s) & mask) | ((v << s) & ~mask);
+    }
+    return v;
+}
+
+/* Call 'fn' for the pairs having the index slot 'cursor' as home slot, and
+ * return the next cursor, 0 at the end. This works like dictScan() and has
+ * the same guarantees: pairs that are in the hash for the whole iteration
+ * are returned, possibly more than once, even if the index is resized.
+ *
+ * Pairs are found by linear probing, so the ones of the home slot 'v' are
+ * in the run of non empty slots starting at 'v'. The slot 'v' itself can
+ * hold a pair with another home only if the previous slot is not empty. */
+unsigned long hpScan(hashpack *hp, unsigned long cursor, hpScanFunction *fn,
+                     void *privdata)
+{
+    unsigned long mask = hp->size-1, v = cursor & mask, i = v;
+    int check = hp->index[(v-1) & mask] != HP_EMPTY;
+
+    if (hp->count == 0) return 0;
+    while(hp->index[i] != HP_EMPTY) {
+        uint32_t slot = hp->index[i];
+
+        if (slot != HP_DELETED) {
+            unsigned char *f, *val;
+            uint32_t flen, vlen;
+            int deleted;
+
+            hpPair(hp,HP_OFFSET(slot),&f,&flen,&val,&vlen,&deleted);
+            if (!check || (dictGenHashFunction(f,flen) & mask) == v)
+                fn(privdata,f,flen,val,vlen);
+        }
+        i = (i+1) & mask;
+        check = 1;
+    }
+
+    /* Increment the reversed cursor on the bits of the mask. */
+    cursor |= ~mask;
+    cursor = hpRev(cursor);
+    cursor++;
+    return hpRev(cursor);
+}
+
+/* Return the length of the serialized hashpack. */
+size_t hpBlobLen(hashpack *hp) {
+    return 4+hp->used-hp->garbage;
+}
+
+/* Serialize the hashpack into 'buf', that must be hpBlobLen() bytes. */
+void hpSerialize(hashpack *hp, unsigned char *buf) {
+    uint32_t count = hp->count, offset = 0;
+
+    memrev32ifbe(&count);
+    memcpy(buf,&count,4);
+    buf += 4;
+    while(offset < hp->used) {
+        unsigned char *f, *v;
+        uint32_t flen, vlen, len;
+        int deleted;
+
+        len = hpPair(hp,offset,&f,&flen,&v,&vlen,&deleted);
+        if (!deleted) {
+            memcpy(buf,hp->arena+offset,len);
+            buf += len;
+        }
+        offset += len;
+    }
+}
+
+/* Load a hashpack serialized with hpSerialize(). Return NULL if the blob
+ * is not valid: truncated, with deleted or duplicated fields, or with a
+ * count not matching the pairs. */
+hashpack *hpDeserialize(unsigned char *buf, size_t len) {
+    hashpack *hp;
+    uint32_t count, offset = 0;
+
+    if (len < 4 || len-4 > UINT32_MAX/2) return NULL;
+    memcpy(&count,buf,4);
+    memrev32ifbe(&count);
+    buf += 4;
+    len -= 4;
+
+    /* Every pair takes at least two bytes. */
+    if (count > len/2) return NULL;
+
+    hp = hpNew();
+    zfree(hp->index);
+    hp->size = hpIndexSize(count);
+    hp->index = zcalloc(sizeof(uint32_t)*hp->size);
+    if (len) {
+        hp->arena = zmalloc(len);
+        memcpy(hp->arena,buf,len);
+    }
+    hp->used = hp->alloc = len;
+    while(offset < hp->used) {
+        unsigned char *p = hp->arena+offset, *end = hp->arena+hp->used, *f;
+        uint32_t l, flen, vlen, insertpos;
+
+        if ((l = hpDecodeVarint(p,end,&flen)) == 0 || (flen & 1)) goto err;
+        flen >>= 1;
+        p += l;
+        if ((size_t)(end-p) < flen) goto err;
+        f = p;
+        p += flen;
+        if ((l = hpDecodeVarint(p,end,&vlen)) == 0) goto err;
+        p += l;
+        if ((size_t)(end-p) < vlen) goto err;
+        p += vlen;
+
+        if (hp->count == count) goto err;
+        if (hpLookup(hp,f,flen,&insertpos) != -1) goto err;
+        hp->index[insertpos] = HP_SLOT(offset);
+        hp->filled++;
+        hp->count++;
+        offset = p-hp->arena;
+    }
+    if (hp->count != count) goto err;
+    return hp;
+
+err:
+    hpFree(hp);
+    return NULL;
+}
+
+#ifdef HASHPACK_TEST_MAIN
+/* Randomized test of the hashpack against a plain array of values indexed
+ * by field number, followed by a small benchmark:
+ *
+ * cc -O2 -DHASHPACK_TEST_MAIN -o hashpack-test hashpack.c dict.c zmalloc.c
+ */
+#include <assert.h>
+#include <sys/time.h>
+
+#define HP_TEST_FIELDS 2000
+
+void _redisAssert(char *estr, char *file, int line) {
+    fprintf(stderr,"ASSERTION FAILED %s:%d '%s'\n",file,line,estr);
+    abort();
+}
+
+static long long hpTestUstime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+static uint32_t hpTestField(char *buf, int j) {
+    return sprintf(buf,"field:%d",j);
+}
+
+/* Check every field of 'hp' against the reference values. */
+static void hpTestCheck(hashpack *hp, char **ref, uint32_t *reflen) {
+    unsigned char *f, *v;
+    uint32_t flen, vlen, cursor = 0, count = 0, seen = 0;
+    char buf[32];
+    int j;
+
+    for (j = 0; j < HP_TEST_FIELDS; j++) {
+        flen = hpTestField(buf,j);
+        if (ref[j]) {
+            assert(hpFind(hp,(unsigned char*)buf,flen,&v,&vlen));
+            assert(vlen == reflen[j] && memcmp(v,ref[j],vlen) == 0);
+            count++;
+        } else {
+            assert(!hpFind(hp,(unsigned char*)buf,flen,&v,&vlen));
+        }
+    }
+    assert(hpLength(hp) == count);
+    while(hpNext(hp,&cursor,&f,&flen,&v,&vlen)) {
+        assert(flen > 6 && flen < sizeof(buf));
+        memcpy(buf,f,flen);
+        buf[flen] = '\0';
+        j = atoi(buf+6);
+        assert(ref[j] && vlen == reflen[j] && memcmp(v,ref[j],vlen) == 0);
+        seen++;
+    }
+    assert(seen == count);
+}
+
+/* Count the fields returned by hpScan() in the array 'privdata'. */
+static void hpTestScanCallback(void *privdata, unsigned char *f, uint32_t flen,
+                               unsigned char *v, uint32_t vlen)
+{
+    int *seen = privdata;
+    char buf[32];
+
+    (void)v;
+    (void)vlen;
+    assert(flen > 6 && flen < sizeof(buf));
+    memcpy(buf,f,flen);
+    buf[flen] = '\0';
+    seen[atoi(buf+6)]++;
+}
+
+int main(int argc, char **argv) {
+    char *ref[HP_TEST_FIELDS];
+    uint32_t reflen[HP_TEST_FIELDS];
+    unsigned char *blob;
+    hashpack *hp, *copy;
+    char buf[32], val[512];
+    long long start;
+    uint32_t flen, vlen;
+    int iter, j;
+
+    srand((argc == 2) ? atoi(argv[1]) : 1234);
+    memset(ref,0,sizeof(ref));
+    hp = hpNew();
+    assert(hpSafeToAdd(hp,100,HP_MAX_ARENA/2));
+    assert(!hpSafeToAdd(hp,100,HP_MAX_ARENA));
+    for (iter = 0; iter < 200000; iter++) {
+        j = rand() % HP_TEST_FIELDS;
+        flen = hpTestField(buf,j);
+        if (rand() % 3 == 0) {
+            assert(hpDelete(hp,(unsigned char*)buf,flen) == (ref[j] != NULL));
+            free(ref[j]);
+            ref[j] = NULL;
+        } else {
+            vlen = (rand() % 10 == 0) ? rand() % 500 : rand() % 20;
+            for (flen = 0; flen < vlen; flen++) val[flen] = 'a' + rand() % 26;
+            flen = hpTestField(buf,j);
+            assert(hpSet(hp,(unsigned char*)buf,flen,(unsigned char*)val,vlen)
+                   == (ref[j] != NULL));
+            free(ref[j]);
+            ref[j] = malloc(vlen+1);
+            memcpy(ref[j],val,vlen);
+            reflen[j] = vlen;
+        }
+        if (iter % 10000 == 0) {
+            hpTestCheck(hp,ref,reflen);
+            blob = zmalloc(hpBlobLen(hp));
+            hpSerialize(hp,blob);
+            copy = hpDeserialize(blob,hpBlobLen(hp));
+            assert(copy != NULL);
+            hpTestCheck(copy,ref,reflen);
+            /* A truncated blob must be rejected. */
+            if (hpBlobLen(hp) > 4)
+                assert(hpDeserialize(blob,hpBlobLen(hp)-1) == NULL);
+            hpFree(copy);
+            zfree(blob);
+        }
+    }
+    hpTestCheck(hp,ref,reflen);
+    hpFree(hp);
+    printf("Random operations: OK\n");
+
+    /* Scan the first 500 fields while others are added and removed, so that
+     * the index grows and shrinks: all of them must be returned. */
+    {
+        int seen[HP_TEST_FIELDS];
+        unsigned long cursor = 0;
+        int next = 500;
+
+        memset(seen,0,sizeof(seen));
+        hp = hpNew();
+        for (j = 0; j < 500; j++) {
+            flen = hpTestField(buf,j);
+            hpSet(hp,(unsigned char*)buf,flen,(unsigned char*)"v",1);
+        }
+        do {
+            cursor = hpScan(hp,cursor,hpTestScanCallback,seen);
+            if (next < HP_TEST_FIELDS && rand() % 2) {
+                for (j = 0; j < 100 && next < HP_TEST_FIELDS; j++, next++) {
+                    flen = hpTestField(buf,next);
+                    hpSet(hp,(unsigned char*)buf,flen,(unsigned char*)"v",1);
+                }
+            } else {
+                for (j = 500; j < next; j++) {
+                    flen = hpTestField(buf,j);
+                    hpDelete(hp,(unsigned char*)buf,flen);
+                }
+            }
+        } while(cursor);
+        for (j = 0; j < 500; j++) assert(seen[j] >= 1);
+        hpFree(hp);
+    }
+    printf("Scan while resizing: OK\n");
+
+    /* Lookups in a hash of 8192 fields. */
+    hp = hpNew();
+    for (j = 0; j < 8192; j++) {
+        flen = hpTestField(buf,j);
+        hpSet(hp,(unsigned char*)buf,flen,(unsigned char*)"value",5);
+    }
+    start = hpTestUstime();
+    for (iter = 0; iter < 1000000; iter++) {
+        unsigned char *v;
+
+        flen = hpTestField(buf,iter % 8192);
+        assert(hpFind(hp,(unsigned char*)buf,flen,&v,&vlen));
+    }
+    printf("1M lookups in 8192 fields: %lld usec, %zu bytes\n",
+        hpTestUstime()-start,hpBytes(hp));
+    hpFree(hp);
+    for (j = 0; j < HP_TEST_FIELDS; j++) free(ref[j]);
+    return 0;
+}
+#endif
@@ -0,0 +1,78 @@
+/* hashpack.h - Hash of strings packed in a single arena with an index
+ *
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HASHPACK_H
+#define __HASHPACK_H
+
+#include <stdint.h>
+
+/* A hashpack stores field/value pairs one after the other in an arena, in
+ * insertion order, and finds them with an open addressing table holding
+ * the arena offset of every pair. Every pair is stored as:
+ *
+ * <flen-and-flag><field><vlen><value>
+ *
+ * where the lengths are varints. The lowest bit of the first one is set
+ * when the pair was deleted: deleted pairs are reclaimed in bulk when they
+ * waste more than half of the arena. */
+typedef struct hashpack {
+    unsigned char *arena;   /* Field/value pairs. */
+    uint32_t *index;        /* 0 = empty, 1 = deleted, else arena offset+2. */
+    uint32_t count;         /* Number of live pairs. */
+    uint32_t used;          /* Used arena bytes. */
+    uint32_t alloc;         /* Allocated arena bytes. */
+    uint32_t garbage;       /* Arena bytes used by deleted pairs. */
+    uint32_t size;          /* Index slots, a power of two. */
+    uint32_t filled;        /* Non empty index slots, deleted included. */
+} hashpack;
+
+/* Arena offsets and sizes are 32 bit, and the arena grows by half of its
+ * size at a time: hashes that would take more than this should be converted
+ * to a real hash table, see hpSafeToAdd(). */
+#define HP_MAX_ARENA (UINT32_MAX/2)
+
+typedef void hpScanFunction(void *privdata, unsigned char *f, uint32_t flen,
+                            unsigned char *v, uint32_t vlen);
+
+hashpack *hpNew(void);
+void hpFree(hashpack *hp);
+int hpFind(hashpack *hp, unsigned char *f, uint32_t flen, unsigned char **v, uint32_t *vlen);
+int hpSet(hashpack *hp, unsigned char *f, uint32_t flen, unsigned char *v, uint32_t vlen);
+int hpDelete(hashpack *hp, unsigned char *f, uint32_t flen);
+uint32_t hpLength(hashpack *hp);
+int hpSafeToAdd(hashpack *hp, size_t flen, size_t vlen);
+int hpNext(hashpack *hp, uint32_t *cursor, unsigned char **f, uint32_t *flen, unsigned char **v, uint32_t *vlen);
+unsigned long hpScan(hashpack *hp, unsigned long cursor, hpScanFunction *fn, void *privdata);
+size_t hpBytes(hashpack *hp);
+size_t hpBlobLen(hashpack *hp);
+void hpSerialize(hashpack *hp, unsigned char *buf);
+hashpack *hpDeserialize(unsigned char *buf, size_t len);
+
+#endif /* __HASHPACK_H */
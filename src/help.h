@@ -50,6 +50,11 @@ struct commandHelp {
     "Count set bits in a string",
     1,
     "2.6.0" },
+    { "BITFIELD",
+    "key [GET type offset] [SET type offset value] [INCRBY type offset increment] [OVERFLOW WRAP|SAT|FAIL]",
+    "Perform arbitrary bitfield integer operations on strings",
+    1,
+    "2.8.18" },
     { "BITOP",
     "operation destkey key [key ...]",
     "Perform bitwise operations between strings",
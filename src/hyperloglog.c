@@ -34,6 +34,12 @@
 #include <stdint.h>
 #include <math.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* The Redis HyperLogLog implementation is based on the following ideas:
  *
  * * The use of a 64 bit hash function as proposed in [1], in order to don't
@@ -202,6 +208,8 @@ struct hllhdr {
 #define HLL_SPARSE 1 /* Sparse encoding. */
 #define HLL_RAW 255 /* Only used internally, never exposed. */
 #define HLL_MAX_ENCODING 1
+#define HLL_HASH_SEED 0xadc83b19ULL /* Seed of the elements hash function. */
+#define HLL_ADD_BATCH 64 /* Elements hashed at once by hllAddMany(). */
 
 static char *invalid_hll_err = "-INVALIDOBJ Corrupted HLL object detected\r\n";
 
@@ -438,13 +446,10 @@ uint64_t MurmurHash64A (const void * key, int len, unsigned int seed) {
     return h;
 }
 
-/* Given a string element to add to the HyperLogLog, returns the length
- * of the pattern 000..1 of the element hash. As a side effect 'regp' is
+/* Given the hash of an element to add to the HyperLogLog, returns the
+ * length of the pattern 000..1 of the hash. As a side effect 'regp' is
  * set to the register index this element hashes to. */
-int hllPatLen(unsigned char *ele, size_t elesize, long *regp) {
-    uint64_t hash, bit, index;
-    int count;
-
+static inline int hllHashPatLen(uint64_t hash, long *regp) {
     /* Count the number of zeroes starting from bit HLL_REGISTERS
      * (that is a power of two corresponding to the first bit we don't use
      * as index). The max run can be 64-P+1 bits.
@@ -454,26 +459,23 @@ int hllPatLen(unsigned char *ele, size_t elesize, long *regp) {
      * the smallest count possible is no zeroes at all, just a 1 bit
      * at the first position, that is a count of 1.
      *
-     * This may sound like inefficient, but actually in the average case
-     * there are high probabilities to find a 1 after a few iterations. */
-    hash = MurmurHash64A(ele,elesize,0xadc83b19ULL);
-    index = hash & HLL_P_MASK; /* Register index. */
-    hash |= ((uint64_t)1<<63); /* Make sure the loop terminates. */
-    bit = HLL_REGISTERS; /* First bit not used to address the register. */
-    count = 1; /* Initialized to 1 since we count the "00000...1" pattern. */
-    while((hash & bit) == 0) {
-        count++;
-        bit <<= 1;
-    }
-    *regp = (int) index;
-    return count;
+     * Bit 63 is set so that the run always ends, and the count is just
+     * the number of trailing zeroes after the index bits, plus one. */
+    *regp = (long) (hash & HLL_P_MASK); /* Register index. */
+    return __builtin_ctzll((hash | ((uint64_t)1<<63)) >> HLL_P) + 1;
+}
+
+/* Given a string element to add to the HyperLogLog, returns the length
+ * of the pattern 000..1 of the element hash. As a side effect 'regp' is
+ * set to the register index this element hashes to. */
+int hllPatLen(unsigned char *ele, size_t elesize, long *regp) {
+    return hllHashPatLen(MurmurHash64A(ele,elesize,HLL_HASH_SEED),regp);
 }
 
 /* ================== Dense representation implementation  ================== */
 
-/* "Add" the element in the dense hyperloglog data structure.
- * Actually nothing is added, but the max 0 pattern counter of the subset
- * the element belongs to is incremented if needed.
+/* Low level function to set the dense HLL register at 'index' to the
+ * specified value if the current value is smaller than 'count'.
  *
  * 'registers' is expected to have room for HLL_REGISTERS plus an
  * additional byte on the right. This requirement is met by sds strings
@@ -482,12 +484,9 @@ int hllPatLen(unsigned char *ele, size_t elesize, long *regp) {
  * The function always succeed, however if as a result of the operation
  * the approximated cardinality changed, 1 is returned. Otherwise 0
  * is returned. */
-int hllDenseAdd(uint8_t *registers, unsigned char *ele, size_t elesize) {
-    uint8_t oldcount, count;
-    long index;
+int hllDenseSet(uint8_t *registers, long index, uint8_t count) {
+    uint8_t oldcount;
 
-    /* Update the register if this element produced a longer run of zeroes. */
-    count = hllPatLen(ele,elesize,&index);
     HLL_DENSE_GET_REGISTER(oldcount,registers,index);
     if (count > oldcount) {
         HLL_DENSE_SET_REGISTER(registers,index,count);
@@ -497,64 +496,244 @@ int hllDenseAdd(uint8_t *registers, unsigned char *ele, size_t elesize) {
     }
 }
 
-/* Compute SUM(2^-reg) in the dense representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
-
-    /* Redis default is to use 16384 registers 6 bits each. The code works
-     * with other values by modifying the defines, but for our target value
-     * we take a faster path with unrolled loops. */
-    if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
-        uint8_t *r = registers;
-        unsigned long r0, r1, r2, r3, r4, r5, r6, r7, r8, r9,
-                      r10, r11, r12, r13, r14, r15;
-        for (j = 0; j < 1024; j++) {
-            /* Handle 16 registers per iteration. */
-            r0 = r[0] & 63; if (r0 == 0) ez++;
-            r1 = (r[0] >> 6 | r[1] << 2) & 63; if (r1 == 0) ez++;
-            r2 = (r[1] >> 4 | r[2] << 4) & 63; if (r2 == 0) ez++;
-            r3 = (r[2] >> 2) & 63; if (r3 == 0) ez++;
-            r4 = r[3] & 63; if (r4 == 0) ez++;
-            r5 = (r[3] >> 6 | r[4] << 2) & 63; if (r5 == 0) ez++;
-            r6 = (r[4] >> 4 | r[5] << 4) & 63; if (r6 == 0) ez++;
-            r7 = (r[5] >> 2) & 63; if (r7 == 0) ez++;
-            r8 = r[6] & 63; if (r8 == 0) ez++;
-            r9 = (r[6] >> 6 | r[7] << 2) & 63; if (r9 == 0) ez++;
-            r10 = (r[7] >> 4 | r[8] << 4) & 63; if (r10 == 0) ez++;
-            r11 = (r[8] >> 2) & 63; if (r11 == 0) ez++;
-            r12 = r[9] & 63; if (r12 == 0) ez++;
-            r13 = (r[9] >> 6 | r[10] << 2) & 63; if (r13 == 0) ez++;
-            r14 = (r[10] >> 4 | r[11] << 4) & 63; if (r14 == 0) ez++;
-            r15 = (r[11] >> 2) & 63; if (r15 == 0) ez++;
-
-            /* Additional parens will allow the compiler to optimize the
-             * code more with a loss of precision that is not very relevant
-             * here (floating point math is not commutative!). */
-            E += (PE[r0] + PE[r1]) + (PE[r2] + PE[r3]) + (PE[r4] + PE[r5]) +
-                 (PE[r6] + PE[r7]) + (PE[r8] + PE[r9]) + (PE[r10] + PE[r11]) +
-                 (PE[r12] + PE[r13]) + (PE[r14] + PE[r15]);
-            r += 12;
-        }
-    } else {
-        for (j = 0; j < HLL_REGISTERS; j++) {
-            unsigned long reg;
+/* "Add" the element in the dense hyperloglog data structure.
+ * Actually nothing is added, but the max 0 pattern counter of the subset
+ * the element belongs to is incremented if needed.
+ *
+ * This is just a wrapper to hllDenseSet(), performing the hashing of the
+ * element in order to retrieve the index and zero-run count. */
+int hllDenseAdd(uint8_t *registers, unsigned char *ele, size_t elesize) {
+    long index;
+    uint8_t count = hllPatLen(ele,elesize,&index);
 
-            HLL_DENSE_GET_REGISTER(reg,registers,j);
-            if (reg == 0) {
-                ez++;
-                /* Increment E at the end of the loop. */
-            } else {
-                E += PE[reg]; /* Precomputed 2^(-reg[j]). */
-            }
+    /* Update the register if this element produced a longer run of zeroes. */
+    return hllDenseSet(registers,index,count);
+}
+
+/* ===================== Dense registers bulk operations =====================
+ *
+ * PFCOUNT with multiple keys and PFMERGE need to access all the registers of
+ * the dense HLLs, and doing it one register at a time with the macros above
+ * is slow. The functions below unpack, merge and pack the whole array of
+ * registers at once.
+ *
+ * With 6 bit registers every 3 bytes hold exactly 4 registers, so the scalar
+ * kernels work on groups of 3 bytes. The SIMD kernels spread the bits of a
+ * few such groups into one byte per register with shifts and masks, and use
+ * the scalar kernels for the last registers, so that they never read or
+ * write past the end of the packed array. */
+
+/* Unpack 'count' registers, that must be a multiple of 4, from 'src' to
+ * 'dst' using one byte per register. */
+static void hllUnpackScalar(uint8_t *dst, uint8_t *src, long count) {
+    long j;
+
+    for (j = 0; j < count; j += 4) {
+        dst[0] = src[0] & 63;
+        dst[1] = (src[0] >> 6 | src[1] << 2) & 63;
+        dst[2] = (src[1] >> 4 | src[2] << 4) & 63;
+        dst[3] = (src[2] >> 2) & 63;
+        dst += 4;
+        src += 3;
+    }
+}
+
+/* Like hllUnpackScalar() but set every byte of 'max' to the max between its
+ * value and the value of the corresponding register. */
+static void hllMaxScalar(uint8_t *max, uint8_t *src, long count) {
+    uint8_t r[4];
+    long j;
+    int k;
+
+    for (j = 0; j < count; j += 4) {
+        hllUnpackScalar(r,src,4);
+        for (k = 0; k < 4; k++)
+            if (r[k] > max[k]) max[k] = r[k];
+        max += 4;
+        src += 3;
+    }
+}
+
+/* Pack 'count' registers, that must be a multiple of 4, from 'src', where
+ * every byte is a register, into 'dst'. */
+static void hllPackScalar(uint8_t *dst, uint8_t *src, long count) {
+    long j;
+
+    for (j = 0; j < count; j += 4) {
+        dst[0] = src[0] | src[1] << 6;
+        dst[1] = src[1] >> 2 | src[2] << 4;
+        dst[2] = src[2] >> 4 | src[3] << 2;
+        dst += 3;
+        src += 4;
+    }
+}
+
+#if defined(__SSE2__)
+/* Unpack 16 registers from the 12 bytes at 'p': each 64 bit lane is loaded
+ * with 6 bytes, that is 8 registers, and register 'k' is moved from bit 6*k
+ * to bit 8*k. Reads 14 bytes. */
+static inline __m128i hllUnpack16(uint8_t *p) {
+    __m128i x = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)p),
+                                   _mm_loadl_epi64((__m128i*)(p+6)));
+    __m128i r = _mm_and_si128(x,_mm_set1_epi64x(0x3F));
+
+    r = _mm_or_si128(r,_mm_and_si128(_mm_slli_epi64(x,2),
+                                     _mm_set1_epi64x(0x3FLL << 8)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_slli_epi64(x,4),
+                                     _mm_set1_epi64x(0x3FLL << 16)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_slli_epi64(x,6),
+                                     _mm_set1_epi64x(0x3FLL << 24)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_slli_epi64(x,8),
+                                     _mm_set1_epi64x(0x3FLL << 32)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_slli_epi64(x,10),
+                                     _mm_set1_epi64x(0x3FLL << 40)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_slli_epi64(x,12),
+                                     _mm_set1_epi64x(0x3FLL << 48)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_slli_epi64(x,14),
+                                     _mm_set1_epi64x(0x3FLL << 56)));
+    return r;
+}
+
+/* Pack 16 registers into the 12 bytes at 'p', the reverse of hllUnpack16().
+ * Writes 14 bytes, the last two are garbage. */
+static inline void hllPack16(uint8_t *p, __m128i x) {
+    __m128i r = _mm_and_si128(x,_mm_set1_epi64x(0x3F));
+
+    r = _mm_or_si128(r,_mm_and_si128(_mm_srli_epi64(x,2),
+                                     _mm_set1_epi64x(0x3FLL << 6)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_srli_epi64(x,4),
+                                     _mm_set1_epi64x(0x3FLL << 12)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_srli_epi64(x,6),
+                                     _mm_set1_epi64x(0x3FLL << 18)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_srli_epi64(x,8),
+                                     _mm_set1_epi64x(0x3FLL << 24)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_srli_epi64(x,10),
+                                     _mm_set1_epi64x(0x3FLL << 30)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_srli_epi64(x,12),
+                                     _mm_set1_epi64x(0x3FLL << 36)));
+    r = _mm_or_si128(r,_mm_and_si128(_mm_srli_epi64(x,14),
+                                     _mm_set1_epi64x(0x3FLL << 42)));
+    _mm_storel_epi64((__m128i*)p,r);
+    _mm_storel_epi64((__m128i*)(p+6),_mm_unpackhi_epi64(r,r));
+}
+#endif /* __SSE2__ */
+
+#if defined(__AVX2__)
+/* Unpack 32 registers from the 24 bytes at 'p'. Every 3 bytes group is
+ * moved to its own 32 bit lane, where the 4 registers are spread to one
+ * byte each. Reads 32 bytes. */
+static inline __m256i hllUnpack32(uint8_t *p) {
+    __m256i x = _mm256_loadu_si256((__m256i*)p);
+
+    x = _mm256_permutevar8x32_epi32(x,_mm256_setr_epi32(0,1,2,3,3,4,5,6));
+    x = _mm256_shuffle_epi8(x,_mm256_setr_epi8(
+            0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1,
+            0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1));
+    return _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_and_si256(x,_mm256_set1_epi32(0x3F)),
+            _mm256_and_si256(_mm256_slli_epi32(x,2),
+                             _mm256_set1_epi32(0x3F00))),
+        _mm256_or_si256(
+            _mm256_and_si256(_mm256_slli_epi32(x,4),
+                             _mm256_set1_epi32(0x3F0000)),
+            _mm256_and_si256(_mm256_slli_epi32(x,6),
+                             _mm256_set1_epi32(0x3F000000))));
+}
+
+/* Pack 32 registers into the 24 bytes at 'p', the reverse of hllUnpack32().
+ * Writes exactly 24 bytes. */
+static inline void hllPack32(uint8_t *p, __m256i x) {
+    x = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_and_si256(x,_mm256_set1_epi32(0x3F)),
+            _mm256_and_si256(_mm256_srli_epi32(x,2),
+                             _mm256_set1_epi32(0xFC0))),
+        _mm256_or_si256(
+            _mm256_and_si256(_mm256_srli_epi32(x,4),
+                             _mm256_set1_epi32(0x3F000)),
+            _mm256_and_si256(_mm256_srli_epi32(x,6),
+                             _mm256_set1_epi32(0xFC0000))));
+    x = _mm256_shuffle_epi8(x,_mm256_setr_epi8(
+            0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+            0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1));
+    x = _mm256_permutevar8x32_epi32(x,_mm256_setr_epi32(0,1,2,4,5,6,7,7));
+    _mm_storeu_si128((__m128i*)p,_mm256_castsi256_si128(x));
+    _mm_storel_epi64((__m128i*)(p+16),_mm256_extracti128_si256(x,1));
+}
+#endif /* __AVX2__ */
+
+/* Unpack the HLL_REGISTERS dense registers at 'registers' into 'dst', one
+ * byte per register. */
+void hllDenseUnpack(uint8_t *dst, uint8_t *registers) {
+    long j = 0;
+
+    if (HLL_BITS != 6) {
+        for (j = 0; j < HLL_REGISTERS; j++)
+            HLL_DENSE_GET_REGISTER(dst[j],registers,j);
+        return;
+    }
+#if defined(__AVX2__)
+    for (; HLL_REGISTERS-j >= 48; j += 32)
+        _mm256_storeu_si256((__m256i*)(dst+j),hllUnpack32(registers+j/4*3));
+#endif
+#if defined(__SSE2__)
+    for (; HLL_REGISTERS-j > 16; j += 16)
+        _mm_storeu_si128((__m128i*)(dst+j),hllUnpack16(registers+j/4*3));
+#endif
+    hllUnpackScalar(dst+j,registers+j/4*3,HLL_REGISTERS-j);
+}
+
+/* Set every byte of 'max' to MAX(max[i],register[i]) where register[i] is
+ * the i-th of the dense registers at 'registers'. */
+void hllDenseMax(uint8_t *max, uint8_t *registers) {
+    long j = 0;
+
+    if (HLL_BITS != 6) {
+        uint8_t val;
+
+        for (j = 0; j < HLL_REGISTERS; j++) {
+            HLL_DENSE_GET_REGISTER(val,registers,j);
+            if (val > max[j]) max[j] = val;
         }
-        E += ez; /* Add 2^0 'ez' times. */
+        return;
+    }
+#if defined(__AVX2__)
+    for (; HLL_REGISTERS-j >= 48; j += 32) {
+        __m256i m = _mm256_loadu_si256((__m256i*)(max+j));
+        m = _mm256_max_epu8(m,hllUnpack32(registers+j/4*3));
+        _mm256_storeu_si256((__m256i*)(max+j),m);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; HLL_REGISTERS-j > 16; j += 16) {
+        __m128i m = _mm_loadu_si128((__m128i*)(max+j));
+        m = _mm_max_epu8(m,hllUnpack16(registers+j/4*3));
+        _mm_storeu_si128((__m128i*)(max+j),m);
     }
-    *ezp = ez;
-    return E;
+#endif
+    hllMaxScalar(max+j,registers+j/4*3,HLL_REGISTERS-j);
+}
+
+/* Pack the HLL_REGISTERS registers at 'src', one byte per register, into
+ * the dense registers at 'registers'. */
+void hllDensePack(uint8_t *registers, uint8_t *src) {
+    long j = 0;
+
+    if (HLL_BITS != 6) {
+        for (j = 0; j < HLL_REGISTERS; j++)
+            HLL_DENSE_SET_REGISTER(registers,j,src[j]);
+        return;
+    }
+#if defined(__AVX2__)
+    for (; HLL_REGISTERS-j >= 32; j += 32)
+        hllPack32(registers+j/4*3,_mm256_loadu_si256((__m256i*)(src+j)));
+#endif
+#if defined(__SSE2__)
+    for (; HLL_REGISTERS-j > 16; j += 16)
+        hllPack16(registers+j/4*3,_mm_loadu_si128((__m128i*)(src+j)));
+#endif
+    hllPackScalar(registers+j/4*3,src+j,HLL_REGISTERS-j);
 }
 
 /* ================== Sparse representation implementation  ================= */
@@ -619,9 +798,8 @@ int hllSparseToDense(robj *o) {
     return REDIS_OK;
 }
 
-/* "Add" the element in the sparse hyperloglog data structure.
- * Actually nothing is added, but the max 0 pattern counter of the subset
- * the element belongs to is incremented if needed.
+/* Low level function to set the sparse HLL register at 'index' to the
+ * specified value if the current value is smaller than 'count'.
  *
  * The object 'o' is the String object holding the HLL. The function requires
  * a reference to the object in order to be able to enlarge the string if
@@ -635,15 +813,12 @@ int hllSparseToDense(robj *o) {
  * sparse to dense: this happens when a register requires to be set to a value
  * not representable with the sparse representation, or when the resulting
  * size would be greater than server.hll_sparse_max_bytes. */
-int hllSparseAdd(robj *o, unsigned char *ele, size_t elesize) {
+int hllSparseSet(robj *o, long index, uint8_t count) {
     struct hllhdr *hdr;
-    uint8_t oldcount, count, *sparse, *end, *p, *prev, *next;
-    long index, first, span;
+    uint8_t oldcount, *sparse, *end, *p, *prev, *next;
+    long first, span;
     long is_zero = 0, is_xzero = 0, is_val = 0, runlen = 0;
 
-    /* Update the register if this element produced a longer run of zeroes. */
-    count = hllPatLen(ele,elesize,&index);
-
     /* If the count is too big to be representable by the sparse representation
      * switch to dense representation. */
     if (count > HLL_SPARSE_VAL_MAX_VALUE) goto promote;
@@ -869,88 +1044,102 @@ promote: /* Promote to dense representation. */
     if (hllSparseToDense(o) == REDIS_ERR) return -1; /* Corrupted HLL. */
     hdr = o->ptr;
 
-    /* We need to call hllDenseAdd() to perform the operation after the
+    /* We need to call hllDenseSet() to perform the operation after the
      * conversion. However the result must be 1, since if we need to
      * convert from sparse to dense a register requires to be updated.
      *
      * Note that this in turn means that PFADD will make sure the command
      * is propagated to slaves / AOF, so if there is a sparse -> dense
      * convertion, it will be performed in all the slaves as well. */
-    int dense_retval = hllDenseAdd(hdr->registers, ele, elesize);
+    int dense_retval = hllDenseSet(hdr->registers,index,count);
     redisAssert(dense_retval == 1);
     return dense_retval;
 }
 
-/* Compute SUM(2^-reg) in the sparse representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-double hllSparseSum(uint8_t *sparse, int sparselen, double *PE, int *ezp, int *invalid) {
-    double E = 0;
-    int ez = 0, idx = 0, runlen, regval;
+/* "Add" the element in the sparse hyperloglog data structure.
+ * Actually nothing is added, but the max 0 pattern counter of the subset
+ * the element belongs to is incremented if needed.
+ *
+ * This function is actually a wrapper for hllSparseSet(), it only performs
+ * the hashing of the element to obtain the index and zeros run length. */
+int hllSparseAdd(robj *o, unsigned char *ele, size_t elesize) {
+    long index;
+    uint8_t count = hllPatLen(ele,elesize,&index);
+
+    /* Update the register if this element produced a longer run of zeroes. */
+    return hllSparseSet(o,index,count);
+}
+
+/* Compute the histogram of the register values in the sparse
+ * representation: reghisto[v] is incremented by the number of registers
+ * set to 'v'. If the sparse representation does not cover exactly
+ * HLL_REGISTERS registers, the integer pointed by 'invalid' is set. */
+void hllSparseRegHisto(uint8_t *sparse, int sparselen, int *invalid, int *reghisto) {
+    int idx = 0, runlen, regval;
     uint8_t *end = sparse+sparselen, *p = sparse;
 
     while(p < end) {
         if (HLL_SPARSE_IS_ZERO(p)) {
             runlen = HLL_SPARSE_ZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p++;
         } else if (HLL_SPARSE_IS_XZERO(p)) {
             runlen = HLL_SPARSE_XZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p += 2;
         } else {
             runlen = HLL_SPARSE_VAL_LEN(p);
             regval = HLL_SPARSE_VAL_VALUE(p);
             idx += runlen;
-            E += PE[regval]*runlen;
+            reghisto[regval] += runlen;
             p++;
         }
     }
     if (idx != HLL_REGISTERS && invalid) *invalid = 1;
-    E += ez; /* Add 2^0 'ez' times. */
-    *ezp = ez;
-    return E;
 }
 
 /* ========================= HyperLogLog Count ==============================
  * This is the core of the algorithm where the approximated count is computed.
- * The function uses the lower level hllDenseSum() and hllSparseSum() functions
- * as helpers to compute the SUM(2^-reg) part of the computation, which is
- * representation-specific, while all the rest is common. */
-
-/* Implements the SUM operation for uint8_t data type which is only used
- * internally as speedup for PFCOUNT with multiple keys. */
-double hllRawSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
+ * The functions hllDenseRegHisto(), hllSparseRegHisto() and hllRawRegHisto()
+ * are used as helpers to compute the histogram of the register values, which
+ * is representation-specific, while all the rest is common: SUM(2^-reg) is
+ * computed from the histogram, since all the registers with the same value
+ * contribute the same term to the sum. */
+
+/* Compute the register histogram for the uint8_t data type, which is only
+ * used internally as speedup for PFCOUNT with multiple keys. */
+void hllRawRegHisto(uint8_t *registers, int *reghisto) {
     uint64_t *word = (uint64_t*) registers;
     uint8_t *bytes;
+    int j;
 
     for (j = 0; j < HLL_REGISTERS/8; j++) {
         if (*word == 0) {
-            ez += 8;
+            reghisto[0] += 8;
         } else {
             bytes = (uint8_t*) word;
-            if (bytes[0]) E += PE[bytes[0]]; else ez++;
-            if (bytes[1]) E += PE[bytes[1]]; else ez++;
-            if (bytes[2]) E += PE[bytes[2]]; else ez++;
-            if (bytes[3]) E += PE[bytes[3]]; else ez++;
-            if (bytes[4]) E += PE[bytes[4]]; else ez++;
-            if (bytes[5]) E += PE[bytes[5]]; else ez++;
-            if (bytes[6]) E += PE[bytes[6]]; else ez++;
-            if (bytes[7]) E += PE[bytes[7]]; else ez++;
+            reghisto[bytes[0]]++;
+            reghisto[bytes[1]]++;
+            reghisto[bytes[2]]++;
+            reghisto[bytes[3]]++;
+            reghisto[bytes[4]]++;
+            reghisto[bytes[5]]++;
+            reghisto[bytes[6]]++;
+            reghisto[bytes[7]]++;
         }
         word++;
     }
-    E += ez; /* 2^(-reg[j]) is 1 when m is 0, add it 'ez' times for every
-                zero register in the HLL. */
-    *ezp = ez;
-    return E;
+}
+
+/* Compute the histogram of the register values in the dense representation:
+ * reghisto[v] is incremented by the number of registers set to 'v'. */
+void hllDenseRegHisto(uint8_t *registers, int *reghisto) {
+    uint64_t bytes[HLL_REGISTERS/8];
+
+    hllDenseUnpack((uint8_t*)bytes,registers);
+    hllRawRegHisto((uint8_t*)bytes,reghisto);
 }
 
 /* Return the approximated cardinality of the set based on the harmonic
@@ -968,6 +1157,7 @@ uint64_t hllCount(struct hllhdr *hdr, int *invalid) {
     double m = HLL_REGISTERS;
     double E, alpha = 0.7213/(1+1.079/m);
     int j, ez; /* Number of registers equal to 0. */
+    int reghisto[64] = {0};
 
     /* We precompute 2^(-reg[j]) in a small table in order to
      * speedup the computation of SUM(2^-register[0..i]). */
@@ -982,18 +1172,24 @@ uint64_t hllCount(struct hllhdr *hdr, int *invalid) {
         initialized = 1;
     }
 
-    /* Compute SUM(2^-register[0..i]). */
+    /* Compute the histogram of the register values. */
     if (hdr->encoding == HLL_DENSE) {
-        E = hllDenseSum(hdr->registers,PE,&ez);
+        hllDenseRegHisto(hdr->registers,reghisto);
     } else if (hdr->encoding == HLL_SPARSE) {
-        E = hllSparseSum(hdr->registers,
-                         sdslen((sds)hdr)-HLL_HDR_SIZE,PE,&ez,invalid);
+        hllSparseRegHisto(hdr->registers,
+                          sdslen((sds)hdr)-HLL_HDR_SIZE,invalid,reghisto);
     } else if (hdr->encoding == HLL_RAW) {
-        E = hllRawSum(hdr->registers,PE,&ez);
+        hllRawRegHisto(hdr->registers,reghisto);
     } else {
         redisPanic("Unknown HyperLogLog encoding in hllCount()");
     }
 
+    /* Compute SUM(2^-register[0..i]). */
+    E = 0;
+    for (j = HLL_REGISTER_MAX; j >= 1; j--) E += reghisto[j]*PE[j];
+    ez = reghisto[0];
+    E += ez; /* 2^(-reg[j]) is 1 when m is 0, add it 'ez' times. */
+
     /* Muliply the inverse of E for alpha_m * m^2 to have the raw estimate. */
     E = (1/E)*alpha*m*m;
 
@@ -1033,6 +1229,47 @@ int hllAdd(robj *o, unsigned char *ele, size_t elesize) {
     }
 }
 
+/* Add the 'count' string objects at 'elev' to the HLL 'o'.
+ *
+ * The elements are processed in batches of HLL_ADD_BATCH: the hashes of the
+ * whole batch are computed first in a tight loop, where the hash of an
+ * element does not depend on the previous one so that the CPU is free to
+ * overlap the computations, then the registers are updated. This is much
+ * faster than interleaving the hashing with the register updates, that
+ * may also convert the HLL from sparse to dense in the middle of a batch.
+ *
+ * The number of registers updated is returned, or -1 if the HLL
+ * representation is invalid. */
+int hllAddMany(robj *o, robj **elev, int count) {
+    uint64_t hash[HLL_ADD_BATCH];
+    long index[HLL_ADD_BATCH];
+    uint8_t patlen[HLL_ADD_BATCH];
+    struct hllhdr *hdr;
+    int updated = 0, j, k, n, retval;
+
+    for (j = 0; j < count; j += n) {
+        n = count-j < HLL_ADD_BATCH ? count-j : HLL_ADD_BATCH;
+        for (k = 0; k < n; k++) {
+            sds ele = elev[j+k]->ptr;
+            hash[k] = MurmurHash64A(ele,sdslen(ele),HLL_HASH_SEED);
+        }
+        for (k = 0; k < n; k++)
+            patlen[k] = hllHashPatLen(hash[k],&index[k]);
+        for (k = 0; k < n; k++) {
+            hdr = o->ptr;
+            if (hdr->encoding == HLL_DENSE)
+                retval = hllDenseSet(hdr->registers,index[k],patlen[k]);
+            else if (hdr->encoding == HLL_SPARSE)
+                retval = hllSparseSet(o,index[k],patlen[k]);
+            else
+                retval = -1; /* Invalid representation. */
+            if (retval == -1) return -1;
+            updated += retval;
+        }
+    }
+    return updated;
+}
+
 /* Merge by computing MAX(registers[i],hll[i]) the HyperLogLog 'hll'
  * with an array of uint8_t HLL_REGISTERS registers pointed by 'max'.
  *
@@ -1046,12 +1283,7 @@ int hllMerge(uint8_t *max, robj *hll) {
     int i;
 
     if (hdr->encoding == HLL_DENSE) {
-        uint8_t val;
-
-        for (i = 0; i < HLL_REGISTERS; i++) {
-            HLL_DENSE_GET_REGISTER(val,hdr->registers,i);
-            if (val > max[i]) max[i] = val;
-        }
+        hllDenseMax(max,hdr->registers);
     } else {
         uint8_t *p = hll->ptr, *end = p + sdslen(hll->ptr);
         long runlen, regval;
@@ -1082,6 +1314,150 @@ int hllMerge(uint8_t *max, robj *hll) {
     return REDIS_OK;
 }
 
+/* ===================== PFCOUNT multiple keys cache ========================
+ *
+ * PFCOUNT with multiple keys needs to merge all the HLLs every time it is
+ * called, and unlike what happens with a single key there is no place in
+ * the HLLs themselves where the result can be cached. However the same
+ * PFCOUNT is often repeated again and again over the same keys, so the
+ * cardinality computed for a given list of keys is remembered in
+ * server.hll_count_cache.
+ *
+ * Every key used by a cached entry has a version in the dictionary
+ * server.hll_count_versions, taken from the server.hll_count_version
+ * counter when the entry is created. When a key is modified or deleted
+ * its version is just removed (see hllCountCacheTouchKey(), called by
+ * signalModifiedKey() and dbDelete()), and an entry is only valid as long
+ * as the versions of all its keys are the ones seen when it was created.
+ *
+ * Keys with an expire are never cached since they may logically expire
+ * without being touched, and when the cache is full it is just emptied. */
+
+#define HLL_COUNT_CACHE_MAX_ENTRIES 1024
+
+typedef struct hllCountCacheEntry {
+    uint64_t card;          /* Cached cardinality. */
+    uint64_t version[];     /* Versions of the keys, in the PFCOUNT order. */
+} hllCountCacheEntry;
+
+unsigned int dictSdsHash(const void *key);
+int dictSdsKeyCompare(void *privdata, const void *key1, const void *key2);
+void dictSdsDestructor(void *privdata, void *val);
+void dictVanillaFree(void *privdata, void *val);
+
+/* server.hll_count_cache, list of keys -> hllCountCacheEntry. */
+dictType hllCountCacheDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    dictVanillaFree,            /* val destructor */
+    NULL,                       /* key embed len */
+    NULL                        /* key embed */
+};
+
+/* server.hll_count_versions, key name -> version as unsigned integer. */
+dictType hllCountVersionsDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    NULL,                       /* val destructor */
+    NULL,                       /* key embed len */
+    NULL                        /* key embed */
+};
+
+void hllCountCacheInit(void) {
+    server.hll_count_cache = dictCreate(&hllCountCacheDictType,NULL);
+    server.hll_count_versions = dictCreate(&hllCountVersionsDictType,NULL);
+    server.hll_count_version = 0;
+}
+
+/* Drop all the cached cardinalities. */
+void hllCountCacheFlush(void) {
+    if (dictSize(server.hll_count_versions) == 0) return;
+    dictEmpty(server.hll_count_cache,NULL);
+    dictEmpty(server.hll_count_versions,NULL);
+}
+
+/* Invalidate the cached cardinalities using 'key', in any DB. */
+void hllCountCacheTouchKey(robj *key) {
+    if (dictSize(server.hll_count_versions) == 0) return;
+    dictDelete(server.hll_count_versions,key->ptr);
+}
+
+/* Return the key of the cache entry for the keys of the PFCOUNT call 'c',
+ * that is the DB id followed by every key prefixed by its length. */
+static sds hllCountCacheKey(redisClient *c) {
+    sds cachekey = sdsnewlen(&c->db->id,sizeof(c->db->id));
+    int j;
+
+    for (j = 1; j < c->argc; j++) {
+        uint32_t len = sdslen(c->argv[j]->ptr);
+
+        cachekey = sdscatlen(cachekey,&len,sizeof(len));
+        cachekey = sdscatlen(cachekey,c->argv[j]->ptr,len);
+    }
+    return cachekey;
+}
+
+/* If a valid cardinality is cached for the keys of 'c' store it in 'card'
+ * and return 1, otherwise return 0. */
+static int hllCountCacheLookup(redisClient *c, sds cachekey, uint64_t *card) {
+    hllCountCacheEntry *entry;
+    dictEntry *de;
+    int j;
+
+    if (dictSize(server.hll_count_cache) == 0) return 0;
+    if ((de = dictFind(server.hll_count_cache,cachekey)) == NULL) return 0;
+    entry = dictGetVal(de);
+    for (j = 1; j < c->argc; j++) {
+        dictEntry *ve = dictFind(server.hll_count_versions,c->argv[j]->ptr);
+
+        if (ve == NULL || dictGetUnsignedIntegerVal(ve) != entry->version[j-1])
+            return 0;
+    }
+    *card = entry->card;
+    return 1;
+}
+
+/* Cache the cardinality 'card' computed for the keys of 'c'. The function
+ * takes ownership of 'cachekey'. */
+static void hllCountCacheAdd(redisClient *c, sds cachekey, uint64_t card) {
+    hllCountCacheEntry *entry;
+    dictEntry *de;
+    int j;
+
+    /* Keys with an expire may turn into missing keys at any time. */
+    if (dictSize(c->db->expires)) {
+        for (j = 1; j < c->argc; j++) {
+            if (getExpire(c->db,c->argv[j]) != -1) {
+                sdsfree(cachekey);
+                return;
+            }
+        }
+    }
+
+    if (dictSize(server.hll_count_cache) >= HLL_COUNT_CACHE_MAX_ENTRIES)
+        hllCountCacheFlush();
+
+    entry = zmalloc(sizeof(*entry)+sizeof(uint64_t)*(c->argc-1));
+    entry->card = card;
+    for (j = 1; j < c->argc; j++) {
+        de = dictFind(server.hll_count_versions,c->argv[j]->ptr);
+        if (de == NULL) {
+            de = dictAddRaw(server.hll_count_versions,
+                            sdsdup(c->argv[j]->ptr));
+            dictSetUnsignedIntegerVal(de,++server.hll_count_version);
+        }
+        entry->version[j-1] = dictGetUnsignedIntegerVal(de);
+    }
+    if (dictReplace(server.hll_count_cache,cachekey,entry) == 0)
+        sdsfree(cachekey); /* Replaced a stale entry, key not used. */
+}
+
 /* ========================== HyperLogLog commands ========================== */
 
 /* Create an HLL object. We always create the HLL using sparse encoding.
@@ -1155,7 +1531,7 @@ invalid:
 void pfaddCommand(redisClient *c) {
     robj *o = lookupKeyWrite(c->db,c->argv[1]);
     struct hllhdr *hdr;
-    int updated = 0, j;
+    int updated = 0, retval;
 
     if (o == NULL) {
         /* Create the key with a string value of the exact length to
@@ -1169,18 +1545,12 @@ void pfaddCommand(redisClient *c) {
         o = dbUnshareStringValue(c->db,c->argv[1],o);
     }
     /* Perform the low level ADD operation for every element. */
-    for (j = 2; j < c->argc; j++) {
-        int retval = hllAdd(o, (unsigned char*)c->argv[j]->ptr,
-                               sdslen(c->argv[j]->ptr));
-        switch(retval) {
-        case 1:
-            updated++;
-            break;
-        case -1:
-            addReplySds(c,sdsnew(invalid_hll_err));
-            return;
-        }
+    retval = hllAddMany(o,c->argv+2,c->argc-2);
+    if (retval == -1) {
+        addReplySds(c,sdsnew(invalid_hll_err));
+        return;
     }
+    updated += retval;
     hdr = o->ptr;
     if (updated) {
         signalModifiedKey(c->db,c->argv[1]);
@@ -1203,8 +1573,17 @@ void pfcountCommand(redisClient *c) {
      * the cardinality of the merge of the N HLLs specified. */
     if (c->argc > 2) {
         uint8_t max[HLL_HDR_SIZE+HLL_REGISTERS], *registers;
+        sds cachekey = hllCountCacheKey(c);
         int j;
 
+        /* Return the cached cardinality if no key changed since the same
+         * keys were counted. */
+        if (hllCountCacheLookup(c,cachekey,&card)) {
+            sdsfree(cachekey);
+            addReplyLongLong(c,card);
+            return;
+        }
+
         /* Compute an HLL with M[i] = MAX(M[i]_j). */
         memset(max,0,sizeof(max));
         hdr = (struct hllhdr*) max;
@@ -1214,18 +1593,24 @@ void pfcountCommand(redisClient *c) {
             /* Check type and size. */
             robj *o = lookupKeyRead(c->db,c->argv[j]);
             if (o == NULL) continue; /* Assume empty HLL for non existing var.*/
-            if (isHLLObjectOrReply(c,o) != REDIS_OK) return;
+            if (isHLLObjectOrReply(c,o) != REDIS_OK) {
+                sdsfree(cachekey);
+                return;
+            }
 
             /* Merge with this HLL with our 'max' HHL by setting max[i]
              * to MAX(max[i],hll[i]). */
             if (hllMerge(registers,o) == REDIS_ERR) {
+                sdsfree(cachekey);
                 addReplySds(c,sdsnew(invalid_hll_err));
                 return;
             }
         }
 
         /* Compute cardinality of the resulting set. */
-        addReplyLongLong(c,hllCount(hdr,NULL));
+        card = hllCount(hdr,NULL);
+        hllCountCacheAdd(c,cachekey,card);
+        addReplyLongLong(c,card);
         return;
     }
 
@@ -1329,9 +1714,7 @@ void pfmergeCommand(redisClient *c) {
     /* Write the resulting HLL to the destination HLL registers and
      * invalidate the cached value. */
     hdr = o->ptr;
-    for (j = 0; j < HLL_REGISTERS; j++) {
-        HLL_DENSE_SET_REGISTER(hdr->registers,j,max[j]);
-    }
+    hllDensePack(hdr->registers,max);
     HLL_INVALIDATE_CACHE(hdr);
 
     signalModifiedKey(c->db,c->argv[1]);
@@ -1354,6 +1737,9 @@ void pfselftestCommand(redisClient *c) {
     struct hllhdr *hdr = (struct hllhdr*) bitcounters, *hdr2;
     robj *o = NULL;
     uint8_t bytecounters[HLL_REGISTERS];
+    uint8_t bytecounters2[HLL_REGISTERS], maxcounters[HLL_REGISTERS];
+    uint8_t packed[HLL_DENSE_SIZE-HLL_HDR_SIZE];
+    int reghisto[64], reghisto2[64];
 
     /* Test 1: access registers.
      * The test is conceived to test that the different counters of our data
@@ -1380,6 +1766,42 @@ void pfselftestCommand(redisClient *c) {
                 goto cleanup;
             }
         }
+
+        /* Check that the bulk operations on the whole array of registers
+         * agree with the registers accessed one by one. */
+        hllDenseUnpack(bytecounters2,hdr->registers);
+        if (memcmp(bytecounters,bytecounters2,HLL_REGISTERS) != 0) {
+            addReplyError(c,"TESTFAILED registers unpacking");
+            goto cleanup;
+        }
+        for (i = 0; i < HLL_REGISTERS; i++)
+            maxcounters[i] = bytecounters2[i] = rand() & HLL_REGISTER_MAX;
+        hllDenseMax(bytecounters2,hdr->registers);
+        for (i = 0; i < HLL_REGISTERS; i++) {
+            unsigned int val = bytecounters[i];
+
+            if (maxcounters[i] > val) val = maxcounters[i];
+            if (bytecounters2[i] != val) {
+                addReplyErrorFormat(c,
+                    "TESTFAILED Max register %d should be %d but is %d",
+                    i, (int) val, (int) bytecounters2[i]);
+                goto cleanup;
+            }
+            HLL_DENSE_SET_REGISTER(hdr->registers,i,bytecounters2[i]);
+        }
+        hllDensePack(packed,bytecounters2);
+        if (memcmp(packed,hdr->registers,sizeof(packed)) != 0) {
+            addReplyError(c,"TESTFAILED registers packing");
+            goto cleanup;
+        }
+        memset(reghisto,0,sizeof(reghisto));
+        memset(reghisto2,0,sizeof(reghisto2));
+        hllDenseRegHisto(hdr->registers,reghisto);
+        for (i = 0; i < HLL_REGISTERS; i++) reghisto2[bytecounters2[i]]++;
+        if (memcmp(reghisto,reghisto2,sizeof(reghisto)) != 0) {
+            addReplyError(c,"TESTFAILED registers histogram");
+            goto cleanup;
+        }
     }
 
     /* Test 2: approximation error.
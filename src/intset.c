@@ -35,6 +35,12 @@
 #include "zmalloc.h"
 #include "endianconv.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* Note that these encodings are ordered, so:
  * INTSET_ENC_INT16 < INTSET_ENC_INT32 < INTSET_ENC_INT64. */
 #define INTSET_ENC_INT16 (sizeof(int16_t))
@@ -93,6 +99,230 @@ static void _intsetSet(intset *is, int pos, int64_t value) {
     }
 }
 
+/* Typed kernels working directly on the contents of intsets stored in native
+ * byte order, one copy for every integer width. The contents are sorted and
+ * never contain duplicates. */
+#define INTSET_GALLOP_RATIO 16
+#define INTSET_GALLOP_RUN 8
+
+#define INTSET_TYPED_KERNELS(T,SFX)                                            \
+/* Return the index of the first of the 'n' elements of 'v' not smaller     \
+ * than 'value', or 'n' if there is none. The loop has no data dependent     \
+ * branches, so it doesn't pay for mispredictions on random lookups. */     \
+static uint32_t _intsetLowerBound##SFX(const T *v, uint32_t n, T value) {     \
+    const T *base = v;                                                        \
+                                                                              \
+    if (n == 0) return 0;                                                     \
+    while (n > 1) {                                                           \
+        uint32_t half = n/2;                                                  \
+        base = (base[half] < value) ? base+half : base;                       \
+        n -= half;                                                            \
+    }                                                                         \
+    return (base-v) + (*base < value);                                        \
+}                                                                             \
+                                                                              \
+/* Like _intsetLowerBound() but only looks at the elements from 'lo' on,    \
+ * doubling the step at every probe. This is cheaper than a binary search   \
+ * when the element is expected to be close to 'lo'. */                      \
+static uint32_t _intsetGallop##SFX(const T *v, uint32_t lo, uint32_t n,       \
+                                   T value) {                                 \
+    uint32_t hi = lo, step = 1;                                               \
+                                                                              \
+    while (hi < n && v[hi] < value) {                                         \
+        lo = hi+1;                                                            \
+        hi += step;                                                           \
+        step <<= 1;                                                           \
+    }                                                                         \
+    if (hi > n) hi = n;                                                       \
+    return lo + _intsetLowerBound##SFX(v+lo,hi-lo,value);                     \
+}                                                                             \
+                                                                              \
+/* Store in 'dst' the elements both in 'a' and 'b', returning how many they \
+ * are. 'a' should be the smaller array: when 'b' is much larger every     \
+ * element of 'a' is searched in 'b' galloping from the previous match,     \
+ * otherwise the arrays are merged. */                                       \
+static uint32_t _intsetInterScalar##SFX(const T *a, uint32_t na,             \
+                                        const T *b, uint32_t nb, T *dst) {    \
+    uint32_t i = 0, j = 0, n = 0;                                             \
+                                                                              \
+    if (na && nb/na >= INTSET_GALLOP_RATIO) {                                 \
+        for (; i < na && j < nb; i++) {                                       \
+            j = _intsetGallop##SFX(b,j,nb,a[i]);                              \
+            if (j < nb && b[j] == a[i]) dst[n++] = b[j++];                    \
+        }                                                                     \
+        return n;                                                             \
+    }                                                                         \
+    while (i < na && j < nb) {                                                \
+        if (a[i] < b[j]) {                                                    \
+            i++;                                                              \
+        } else if (a[i] > b[j]) {                                             \
+            j++;                                                              \
+        } else {                                                              \
+            dst[n++] = a[i];                                                  \
+            i++;                                                              \
+            j++;                                                              \
+        }                                                                     \
+    }                                                                         \
+    return n;                                                                 \
+}                                                                             \
+                                                                              \
+/* Store in 'dst' the elements either in 'a' or in 'b', returning how many  \
+ * they are. Long runs of elements of one array falling between two         \
+ * elements of the other are found galloping and copied at once. */          \
+static uint32_t _intsetUnion##SFX(const T *a, uint32_t na,                    \
+                                  const T *b, uint32_t nb, T *dst) {          \
+    uint32_t i = 0, j = 0, n = 0, k;                                          \
+                                                                              \
+    while (i < na && j < nb) {                                                \
+        if (a[i] < b[j]) {                                                    \
+            if (i+INTSET_GALLOP_RUN < na && a[i+INTSET_GALLOP_RUN] < b[j]) {  \
+                k = _intsetGallop##SFX(a,i+INTSET_GALLOP_RUN+1,na,b[j]);      \
+                memcpy(dst+n,a+i,(k-i)*sizeof(T));                            \
+                n += k-i;                                                     \
+                i = k;                                                        \
+            } else {                                                          \
+                dst[n++] = a[i++];                                            \
+            }                                                                 \
+        } else if (a[i] > b[j]) {                                             \
+            if (j+INTSET_GALLOP_RUN < nb && b[j+INTSET_GALLOP_RUN] < a[i]) {  \
+                k = _intsetGallop##SFX(b,j+INTSET_GALLOP_RUN+1,nb,a[i]);      \
+                memcpy(dst+n,b+j,(k-j)*sizeof(T));                            \
+                n += k-j;                                                     \
+                j = k;                                                        \
+            } else {                                                          \
+                dst[n++] = b[j++];                                            \
+            }                                                                 \
+        } else {                                                              \
+            dst[n++] = a[i];                                                  \
+            i++;                                                              \
+            j++;                                                              \
+        }                                                                     \
+    }                                                                         \
+    memcpy(dst+n,a+i,(na-i)*sizeof(T));                                       \
+    n += na-i;                                                                \
+    memcpy(dst+n,b+j,(nb-j)*sizeof(T));                                       \
+    return n+nb-j;                                                            \
+}
+
+INTSET_TYPED_KERNELS(int16_t,16)
+INTSET_TYPED_KERNELS(int32_t,32)
+INTSET_TYPED_KERNELS(int64_t,64)
+
+/* Block based intersection: a block of elements of 'a' is compared against
+ * every rotation of a block of 'b' of the same size, so that all the pairs
+ * are checked with a few vector compares. The block with the smaller last
+ * element is then replaced by the next one of its array. The matches are
+ * emitted in order since both arrays are sorted. The tails shorter than a
+ * block are intersected by the scalar kernel. */
+#if defined(__SSE2__)
+#define INTSET_ROT16(v,r) \
+    _mm_or_si128(_mm_srli_si128(v,2*(r)),_mm_slli_si128(v,16-2*(r)))
+
+static uint32_t _intsetInterSIMD16(const int16_t *a, uint32_t na,
+                                   const int16_t *b, uint32_t nb,
+                                   int16_t *dst) {
+    uint32_t i = 0, j = 0, n = 0;
+
+    while (i+8 <= na && j+8 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a+i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b+j));
+        __m128i m;
+        unsigned int mask;
+        int16_t amax, bmax;
+
+        m = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi16(va,vb),
+                                 _mm_cmpeq_epi16(va,INTSET_ROT16(vb,1))),
+                    _mm_or_si128(_mm_cmpeq_epi16(va,INTSET_ROT16(vb,2)),
+                                 _mm_cmpeq_epi16(va,INTSET_ROT16(vb,3)))),
+                _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi16(va,INTSET_ROT16(vb,4)),
+                                 _mm_cmpeq_epi16(va,INTSET_ROT16(vb,5))),
+                    _mm_or_si128(_mm_cmpeq_epi16(va,INTSET_ROT16(vb,6)),
+                                 _mm_cmpeq_epi16(va,INTSET_ROT16(vb,7)))));
+        /* Two mask bits for every 16 bit lane, keep one. */
+        mask = _mm_movemask_epi8(m) & 0x5555;
+        while (mask) {
+            dst[n++] = a[i+__builtin_ctz(mask)/2];
+            mask &= mask-1;
+        }
+        amax = a[i+7];
+        bmax = b[j+7];
+        if (amax <= bmax) i += 8;
+        if (bmax <= amax) j += 8;
+    }
+    return n + _intsetInterScalar16(a+i,na-i,b+j,nb-j,dst+n);
+}
+
+#if defined(__AVX2__)
+static uint32_t _intsetInterSIMD32(const int32_t *a, uint32_t na,
+                                   const int32_t *b, uint32_t nb,
+                                   int32_t *dst) {
+    uint32_t i = 0, j = 0, n = 0;
+    const __m256i rot1 = _mm256_setr_epi32(1,2,3,4,5,6,7,0);
+
+    while (i+8 <= na && j+8 <= nb) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a+i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b+j));
+        __m256i m = _mm256_cmpeq_epi32(va,vb);
+        unsigned int mask;
+        int32_t amax, bmax;
+        int r;
+
+        for (r = 1; r < 8; r++) {
+            vb = _mm256_permutevar8x32_epi32(vb,rot1);
+            m = _mm256_or_si256(m,_mm256_cmpeq_epi32(va,vb));
+        }
+        mask = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+        while (mask) {
+            dst[n++] = a[i+__builtin_ctz(mask)];
+            mask &= mask-1;
+        }
+        amax = a[i+7];
+        bmax = b[j+7];
+        if (amax <= bmax) i += 8;
+        if (bmax <= amax) j += 8;
+    }
+    return n + _intsetInterScalar32(a+i,na-i,b+j,nb-j,dst+n);
+}
+#else
+static uint32_t _intsetInterSIMD32(const int32_t *a, uint32_t na,
+                                   const int32_t *b, uint32_t nb,
+                                   int32_t *dst) {
+    uint32_t i = 0, j = 0, n = 0;
+
+    while (i+4 <= na && j+4 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a+i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b+j));
+        __m128i m;
+        unsigned int mask;
+        int32_t amax, bmax;
+
+        m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi32(va,vb),
+                    _mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(0,3,2,1)))),
+                _mm_or_si128(
+                    _mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(1,0,3,2))),
+                    _mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(2,1,0,3)))));
+        mask = _mm_movemask_ps(_mm_castsi128_ps(m));
+        while (mask) {
+            dst[n++] = a[i+__builtin_ctz(mask)];
+            mask &= mask-1;
+        }
+        amax = a[i+3];
+        bmax = b[j+3];
+        if (amax <= bmax) i += 4;
+        if (bmax <= amax) j += 4;
+    }
+    return n + _intsetInterScalar32(a+i,na-i,b+j,nb-j,dst+n);
+}
+#endif /* __AVX2__ */
+#else
+#define _intsetInterSIMD16 _intsetInterScalar16
+#define _intsetInterSIMD32 _intsetInterScalar32
+#endif /* __SSE2__ */
+
 /* Create an empty intset. */
 intset *intsetNew(void) {
     intset *is = zmalloc(sizeof(intset));
@@ -132,6 +362,32 @@ static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
         }
     }
 
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+    /* The callers make sure the value fits the encoding of the set, so we
+     * can search the native integers directly. The checks above also make
+     * sure the lower bound is inside the set. */
+    {
+        uint32_t len = is->length, idx;
+        int found;
+
+        if (is->encoding == INTSET_ENC_INT16) {
+            int16_t *v = (int16_t*)is->contents;
+            idx = _intsetLowerBound16(v,len,value);
+            found = v[idx] == value;
+        } else if (is->encoding == INTSET_ENC_INT32) {
+            int32_t *v = (int32_t*)is->contents;
+            idx = _intsetLowerBound32(v,len,value);
+            found = v[idx] == value;
+        } else {
+            int64_t *v = (int64_t*)is->contents;
+            idx = _intsetLowerBound64(v,len,value);
+            found = v[idx] == value;
+        }
+        if (pos) *pos = idx;
+        return found;
+    }
+#endif
+
     while(max >= min) {
         mid = ((unsigned int)min + (unsigned int)max) >> 1;
         cur = _intsetGet(is,mid);
@@ -281,6 +537,124 @@ size_t intsetBlobLen(intset *is) {
     return sizeof(intset)+intrev32ifbe(is->length)*intrev32ifbe(is->encoding);
 }
 
+/* Return the contents of 'is' as an array of native integers of 'enc' bytes,
+ * that must not be smaller than the encoding of 'is'. When the contents can
+ * be used as they are they are returned directly, otherwise a converted
+ * copy is returned and should be freed by the caller with zfree(). */
+static void *_intsetNativeContents(intset *is, uint8_t enc, int *copied) {
+    uint32_t len = intrev32ifbe(is->length), j;
+    void *v;
+
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+    if (enc == intrev32ifbe(is->encoding)) {
+        *copied = 0;
+        return is->contents;
+    }
+#endif
+    v = zmalloc((size_t)len*enc);
+    for (j = 0; j < len; j++) {
+        int64_t value = _intsetGet(is,j);
+
+        if (enc == INTSET_ENC_INT64)
+            ((int64_t*)v)[j] = value;
+        else if (enc == INTSET_ENC_INT32)
+            ((int32_t*)v)[j] = value;
+        else
+            ((int16_t*)v)[j] = value;
+    }
+    *copied = 1;
+    return v;
+}
+
+/* Return a new intset with the first 'len' native integers of 'enc' bytes
+ * of 'v', stored with the encoding 'dstenc' that must be large enough to
+ * hold all of them. When possible 'v' is used as the new intset itself,
+ * so it must be the contents of an intset allocated by zmalloc(). */
+static intset *_intsetFromNative(intset *v, uint32_t len, uint8_t enc,
+                                 uint8_t dstenc) {
+    intset *is;
+    uint32_t j;
+
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+    if (enc == dstenc) {
+        v->encoding = intrev32ifbe(enc);
+        v->length = intrev32ifbe(len);
+        return intsetResize(v,len);
+    }
+#endif
+    is = zmalloc(sizeof(intset)+(size_t)len*dstenc);
+    is->encoding = intrev32ifbe(dstenc);
+    is->length = intrev32ifbe(len);
+    for (j = 0; j < len; j++) {
+        if (enc == INTSET_ENC_INT64)
+            _intsetSet(is,j,((int64_t*)v->contents)[j]);
+        else if (enc == INTSET_ENC_INT32)
+            _intsetSet(is,j,((int32_t*)v->contents)[j]);
+        else
+            _intsetSet(is,j,((int16_t*)v->contents)[j]);
+    }
+    zfree(v);
+    return is;
+}
+
+/* Return a new intset with the elements both in 'a' and 'b'. */
+intset *intsetIntersect(intset *a, intset *b) {
+    uint8_t enca = intrev32ifbe(a->encoding), encb = intrev32ifbe(b->encoding);
+    uint8_t enc = enca > encb ? enca : encb;
+    uint32_t na = intrev32ifbe(a->length), nb = intrev32ifbe(b->length), n;
+    int copya, copyb;
+    void *va, *vb;
+    intset *dst;
+
+    /* Make 'a' the smaller set, the kernels expect it. */
+    if (na > nb) return intsetIntersect(b,a);
+
+    va = _intsetNativeContents(a,enc,&copya);
+    vb = _intsetNativeContents(b,enc,&copyb);
+    dst = zmalloc(sizeof(intset)+(size_t)na*enc);
+    if (nb/(na ? na : 1) >= INTSET_GALLOP_RATIO || enc == INTSET_ENC_INT64) {
+        if (enc == INTSET_ENC_INT64)
+            n = _intsetInterScalar64(va,na,vb,nb,(int64_t*)dst->contents);
+        else if (enc == INTSET_ENC_INT32)
+            n = _intsetInterScalar32(va,na,vb,nb,(int32_t*)dst->contents);
+        else
+            n = _intsetInterScalar16(va,na,vb,nb,(int16_t*)dst->contents);
+    } else {
+        if (enc == INTSET_ENC_INT32)
+            n = _intsetInterSIMD32(va,na,vb,nb,(int32_t*)dst->contents);
+        else
+            n = _intsetInterSIMD16(va,na,vb,nb,(int16_t*)dst->contents);
+    }
+    if (copya) zfree(va);
+    if (copyb) zfree(vb);
+
+    /* The common elements always fit the smaller of the two encodings. */
+    return _intsetFromNative(dst,n,enc,enca < encb ? enca : encb);
+}
+
+/* Return a new intset with the elements either in 'a' or in 'b'. */
+intset *intsetUnion(intset *a, intset *b) {
+    uint8_t enca = intrev32ifbe(a->encoding), encb = intrev32ifbe(b->encoding);
+    uint8_t enc = enca > encb ? enca : encb;
+    uint32_t na = intrev32ifbe(a->length), nb = intrev32ifbe(b->length), n;
+    int copya, copyb;
+    void *va, *vb;
+    intset *dst;
+
+    va = _intsetNativeContents(a,enc,&copya);
+    vb = _intsetNativeContents(b,enc,&copyb);
+    dst = zmalloc(sizeof(intset)+((size_t)na+nb)*enc);
+    if (enc == INTSET_ENC_INT64)
+        n = _intsetUnion64(va,na,vb,nb,(int64_t*)dst->contents);
+    else if (enc == INTSET_ENC_INT32)
+        n = _intsetUnion32(va,na,vb,nb,(int32_t*)dst->contents);
+    else
+        n = _intsetUnion16(va,na,vb,nb,(int16_t*)dst->contents);
+    if (copya) zfree(va);
+    if (copyb) zfree(vb);
+    return _intsetFromNative(dst,n,enc,enc);
+}
+
 #ifdef INTSET_TEST_MAIN
 #include <sys/time.h>
 
@@ -479,5 +853,101 @@ int main(int argc, char **argv) {
         checkConsistency(is);
         ok();
     }
+
+    printf("Intersection and union: "); {
+        int bits[] = {12, 20, 40}, x, y, k;
+
+        for (k = 0; k < 200; k++) {
+            intset *a, *b, *inter, *uni;
+            uint32_t expected_inter = 0;
+            int64_t v;
+
+            x = bits[rand()%3];
+            y = bits[rand()%3];
+            a = createSet(x,rand()%2000);
+            b = createSet(y,(k%4 == 0) ? rand()%50 : rand()%2000);
+            /* Make sure there are common elements regardless of width. */
+            for (i = 0; i < 100; i++) {
+                v = rand()%4096;
+                a = intsetAdd(a,v,NULL);
+                b = intsetAdd(b,v,NULL);
+            }
+            inter = intsetIntersect(a,b);
+            uni = intsetUnion(a,b);
+            checkConsistency(inter);
+            checkConsistency(uni);
+            for (i = 0; i < intrev32ifbe(a->length); i++) {
+                v = _intsetGet(a,i);
+                assert(intsetFind(uni,v));
+                if (intsetFind(b,v)) {
+                    assert(intsetFind(inter,v));
+                    expected_inter++;
+                }
+            }
+            for (i = 0; i < intrev32ifbe(b->length); i++)
+                assert(intsetFind(uni,_intsetGet(b,i)));
+            assert(intrev32ifbe(inter->length) == expected_inter);
+            assert(intrev32ifbe(uni->length) ==
+                   intrev32ifbe(a->length)+intrev32ifbe(b->length)-
+                   expected_inter);
+            zfree(a);
+            zfree(b);
+            zfree(inter);
+            zfree(uni);
+        }
+        ok();
+    }
+
+    printf("Intersection and union speed:\n"); {
+        long sizes[] = {1000, 10000, 100000, 1000000};
+        int s, iter;
+
+        for (s = 0; s < 4; s++) {
+            long size = sizes[s], j, hits = 0, common = 0;
+            intset *a = intsetNew(), *b = intsetNew(), *r;
+            long long start, t_find, t_inter, t_union;
+
+            /* Every value is randomly in one of the sets, in both, or in
+             * none of them, so that the merge branches are unpredictable. */
+            for (j = 0; j < size*2; j++) {
+                int where = rand() % 4;
+                if (where & 1) a = intsetAdd(a,j*3,NULL);
+                if (where & 2) b = intsetAdd(b,j*3,NULL);
+                if (where == 3) common++;
+            }
+            size = intrev32ifbe(a->length);
+            iter = 10000000/size;
+
+            start = usec();
+            for (i = 0; i < iter; i++) {
+                for (j = 0; j < size; j++)
+                    hits += intsetFind(b,_intsetGet(a,j));
+            }
+            t_find = usec()-start;
+
+            start = usec();
+            for (i = 0; i < iter; i++) {
+                r = intsetIntersect(a,b);
+                hits -= intrev32ifbe(r->length);
+                zfree(r);
+            }
+            t_inter = usec()-start;
+            assert(hits == 0);
+
+            start = usec();
+            for (i = 0; i < iter; i++) {
+                r = intsetUnion(a,b);
+                assert(intrev32ifbe(r->length) ==
+                       intrev32ifbe(a->length)+intrev32ifbe(b->length)-common);
+                zfree(r);
+            }
+            t_union = usec()-start;
+            printf("%8ld elements: lookups %.1f us, intersect %.1f us, "
+                   "union %.1f us\n", size, (double)t_find/iter,
+                   (double)t_inter/iter, (double)t_union/iter);
+            zfree(a);
+            zfree(b);
+        }
+    }
 }
 #endif
@@ -46,5 +46,7 @@ int64_t intsetRandom(intset *is);
 uint8_t intsetGet(intset *is, uint32_t pos, int64_t *value);
 uint32_t intsetLen(intset *is);
 size_t intsetBlobLen(intset *is);
+intset *intsetIntersect(intset *a, intset *b);
+intset *intsetUnion(intset *a, intset *b);
 
 #endif // __INTSET_H
@@ -0,0 +1,183 @@
+/* Lazy freeing of keys and databases in a background thread.
+ *
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+#include "bio.h"
+#include "atomicvar.h"
+
+/* Releasing a big aggregate value means freeing every element it holds, and
+ * this can take seconds for values with millions of elements. UNLINK and
+ * FLUSHALL/FLUSHDB ASYNC just detach the value or the database from the
+ * keyspace, that is O(1), and leave the actual work to the REDIS_BIO_LAZY_FREE
+ * background thread.
+ *
+ * This is safe because the detached values can't be reached anymore by the
+ * main thread, while the elements they share with other values (for example
+ * the shared integers, or the members copied by SUNIONSTORE) are protected by
+ * the atomic reference count updates of incrRefCount() / decrRefCount(). */
+
+/* Values with fewer allocations than this are freed synchronously, as it is
+ * cheaper than creating a background job. */
+#define LAZYFREE_THRESHOLD 64
+
+static unsigned long lazyfree_objects = 0;  /* Objects waiting to be freed. */
+static unsigned long long lazyfreed_objects = 0; /* Objects freed so far. */
+
+/* Return the number of objects the background thread still has to free. */
+unsigned long lazyfreeGetPendingObjectsCount(void) {
+    return atomicGet(lazyfree_objects);
+}
+
+/* Return the number of objects freed by the background thread. */
+unsigned long long lazyfreeGetFreedObjectsCount(void) {
+    return atomicGet(lazyfreed_objects);
+}
+
+/* Return the amount of work needed to free the object: this is roughly the
+ * number of allocations composing the value. Values encoded as a single
+ * allocation, like strings, ziplists and intsets, return 1.
+ *
+ * Module types return 1 as well, so they are always freed by the main thread:
+ * their free callbacks are not required to be thread safe. */
+size_t lazyfreeGetFreeEffort(robj *o) {
+    if (o->type == REDIS_LIST && o->encoding == REDIS_ENCODING_QUICKLIST) {
+        return ((quicklist*)o->ptr)->len;
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_HT) {
+        return dictSize((dict*)o->ptr);
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_ROARING) {
+        return ((roaring*)o->ptr)->len;
+    } else if (o->type == REDIS_ZSET && o->encoding == REDIS_ENCODING_SKIPLIST) {
+        return ((zset*)o->ptr)->zsl->length;
+    } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
+        return dictSize((dict*)o->ptr);
+    } else {
+        return 1;
+    }
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the DB.
+ * If the value is big enough it is released in a background thread, otherwise
+ * this is the same as dbDelete(). */
+int dbAsyncDelete(redisDb *db, robj *key) {
+#ifdef HAVE_ATOMIC_VARS
+    dictEntry *de;
+
+    hllCountCacheTouchKey(key);
+
+    /* Deleting an entry from the expires dict will not free the sds of
+     * the key, because it is shared with the main dictionary. */
+    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+
+    /* Steal the value from the dictionary entry so that dictDelete() will
+     * just release the key: the dictionary value destructor skips NULL. */
+    de = dictFind(db->dict,key->ptr);
+    if (de) {
+        robj *val = dictGetVal(de);
+
+        /* A shared value (refcount > 1) may still be used by the main thread
+         * after the key is gone, so it is just unreferenced. */
+        if (val->refcount == 1 &&
+            lazyfreeGetFreeEffort(val) > LAZYFREE_THRESHOLD)
+        {
+            atomicIncr(lazyfree_objects,1);
+            bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,val,NULL,NULL);
+            dictSetVal(db->dict,de,NULL);
+        }
+    }
+    return dictDelete(db->dict,key->ptr) == DICT_OK;
+#else
+    return dbDelete(db,key);
+#endif
+}
+
+#ifdef HAVE_ATOMIC_VARS
+/* Release the module type values of the dictionary 'd', leaving NULL in
+ * their place, that the dictionary value destructor skips. The background
+ * thread can't release them, see lazyfreeGetFreeEffort(). Checking the type
+ * of every value is much cheaper than releasing them, and is skipped when no
+ * module type is registered. */
+static void lazyfreeReleaseModuleValues(dict *d) {
+    dictIterator *di;
+    dictEntry *de;
+
+    if (redisModuleTypesCount() == 0) return;
+    di = dictGetSafeIterator(d);
+    while((de = dictNext(di)) != NULL) {
+        robj *val = dictGetVal(de);
+
+        if (val && val->type >= REDIS_MODULE_TYPE_MIN) {
+            decrRefCount(val);
+            dictSetVal(d,de,NULL);
+        }
+    }
+    dictReleaseIterator(di);
+}
+#endif
+
+/* Empty a database, replacing the main and the expires dictionaries with new
+ * empty ones, and releasing the old ones in a background thread. Returns the
+ * number of keys removed. */
+long long emptyDbAsync(redisDb *db) {
+    long long removed = dictSize(db->dict);
+#ifdef HAVE_ATOMIC_VARS
+    dict *oldht1 = db->dict, *oldht2 = db->expires;
+
+    if (removed == 0) return 0;
+    lazyfreeReleaseModuleValues(oldht1);
+    db->dict = dbDictCreate(&dbDictType);
+    db->expires = dbDictCreate(&keyptrDictType);
+    atomicIncr(lazyfree_objects,removed);
+    bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,NULL,oldht1,oldht2);
+#else
+    dictEmpty(db->dict,NULL);
+    dictEmpty(db->expires,NULL);
+#endif
+    return removed;
+}
+
+/* Release an object detached by dbAsyncDelete(). Called by the background
+ * thread. */
+void lazyfreeFreeObjectFromBioThread(robj *o) {
+    decrRefCount(o);
+    atomicDecr(lazyfree_objects,1);
+    atomicIncr(lazyfreed_objects,1);
+}
+
+/* Release a database detached by emptyDbAsync(). Called by the background
+ * thread. The expires dictionary doesn't own its keys, so it is released
+ * first, then the main dictionary releases keys and values. */
+void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2) {
+    unsigned long numkeys = dictSize(ht1);
+
+    dictRelease(ht2);
+    dictRelease(ht1);
+    atomicDecr(lazyfree_objects,numkeys);
+    atomicIncr(lazyfreed_objects,numkeys);
+}
@@ -0,0 +1,741 @@
+/* listpack.c - A compact list of strings and integers without cascade updates
+ *
+ * The listpack stores a list of strings and integers in a single block of
+ * memory, like the ziplist, but every entry stores its own length at its
+ * end instead of the length of the previous entry at its start. Inserting
+ * or deleting an entry never changes the encoding of the other entries, so
+ * there are no cascade updates: the cost of a change is always a single
+ * memmove() of the entries that follow.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * LISTPACK OVERALL LAYOUT:
+ * <total-bytes><num-elements><entry><entry>...<entry><end>
+ *
+ * <total-bytes> is a 32 bit unsigned integer, little endian, holding the
+ * size of the whole listpack including the header and the end byte.
+ *
+ * <num-elements> is a 16 bit unsigned integer, little endian. When it is
+ * 65535 the number of elements is unknown, and lpLength() counts them.
+ *
+ * <end> is a single byte, equal to 255.
+ *
+ * LISTPACK ENTRIES:
+ * <encoding-type><element-data><element-tot-len>
+ *
+ * The encoding type also holds the element (small integers) or the length
+ * of the string that follows:
+ *
+ * |0xxxxxxx| 7 bit unsigned integer, no data.
+ * |10xxxxxx| string of up to 63 bytes.
+ * |110xxxxx|yyyyyyyy| 13 bit signed integer.
+ * |1110xxxx|yyyyyyyy| string of up to 4095 bytes.
+ * |11110000|4 bytes length| string of up to 2^32-1 bytes.
+ * |11110001| 16 bit signed integer in the next 2 bytes.
+ * |11110010| 24 bit signed integer in the next 3 bytes.
+ * |11110011| 32 bit signed integer in the next 4 bytes.
+ * |11110100| 64 bit signed integer in the next 8 bytes.
+ *
+ * Multi byte lengths and integers are little endian.
+ *
+ * <element-tot-len> is the size of the encoding type plus the element data,
+ * stored in 1 to 5 bytes to be read from right to left: every byte holds 7
+ * bits of the length, the least significant ones in the rightmost byte, and
+ * has its high bit set if more bytes follow on its left. This is what makes
+ * it possible to walk the listpack backward.
+ *
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "zmalloc.h"
+#include "util.h"
+#include "listpack.h"
+#include "redisassert.h"
+
+#define LP_HDR_SIZE 6
+#define LP_HDR_NUMELE_UNKNOWN UINT16_MAX
+#define LP_EOF 0xFF
+
+#define LP_ENCODING_7BIT_UINT 0x00
+#define LP_ENCODING_7BIT_UINT_MASK 0x80
+#define LP_ENCODING_6BIT_STR 0x80
+#define LP_ENCODING_6BIT_STR_MASK 0xC0
+#define LP_ENCODING_13BIT_INT 0xC0
+#define LP_ENCODING_13BIT_INT_MASK 0xE0
+#define LP_ENCODING_12BIT_STR 0xE0
+#define LP_ENCODING_12BIT_STR_MASK 0xF0
+#define LP_ENCODING_32BIT_STR 0xF0
+#define LP_ENCODING_16BIT_INT 0xF1
+#define LP_ENCODING_24BIT_INT 0xF2
+#define LP_ENCODING_32BIT_INT 0xF3
+#define LP_ENCODING_64BIT_INT 0xF4
+
+#define LP_IS_7BIT_UINT(b) (((b) & LP_ENCODING_7BIT_UINT_MASK) == LP_ENCODING_7BIT_UINT)
+#define LP_IS_6BIT_STR(b) (((b) & LP_ENCODING_6BIT_STR_MASK) == LP_ENCODING_6BIT_STR)
+#define LP_IS_13BIT_INT(b) (((b) & LP_ENCODING_13BIT_INT_MASK) == LP_ENCODING_13BIT_INT)
+#define LP_IS_12BIT_STR(b) (((b) & LP_ENCODING_12BIT_STR_MASK) == LP_ENCODING_12BIT_STR)
+
+/* Strings longer than this can't represent a 64 bit integer. */
+#define LP_INTBUF_SIZE 21
+
+static inline uint32_t lpRead32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void lpWrite32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+#define lpGetTotalBytes(lp) lpRead32(lp)
+#define lpSetTotalBytes(lp,v) lpWrite32(lp,v)
+#define lpGetNumElements(lp) ((uint16_t)((lp)[4] | ((lp)[5] << 8)))
+#define lpSetNumElements(lp,v) do { \
+    (lp)[4] = (v) & 0xff; \
+    (lp)[5] = ((v) >> 8) & 0xff; \
+} while(0)
+#define lpFirstEntry(lp) ((lp)+LP_HDR_SIZE)
+#define lpEnd(lp) ((lp)+lpGetTotalBytes(lp)-1)
+
+/* Store in 'buf' the back length 'l' of an entry, and return the number of
+ * bytes used. When 'buf' is NULL only the number of bytes is returned. */
+static inline unsigned int lpEncodeBacklen(unsigned char *buf, uint32_t l) {
+    if (l <= 127) {
+        if (buf) buf[0] = l;
+        return 1;
+    } else if (l < 16383) {
+        if (buf) {
+            buf[0] = l >> 7;
+            buf[1] = (l & 127) | 128;
+        }
+        return 2;
+    } else if (l < 2097151) {
+        if (buf) {
+            buf[0] = l >> 14;
+            buf[1] = ((l >> 7) & 127) | 128;
+            buf[2] = (l & 127) | 128;
+        }
+        return 3;
+    } else if (l < 268435455) {
+        if (buf) {
+            buf[0] = l >> 21;
+            buf[1] = ((l >> 14) & 127) | 128;
+            buf[2] = ((l >> 7) & 127) | 128;
+            buf[3] = (l & 127) | 128;
+        }
+        return 4;
+    } else {
+        if (buf) {
+            buf[0] = l >> 28;
+            buf[1] = ((l >> 21) & 127) | 128;
+            buf[2] = ((l >> 14) & 127) | 128;
+            buf[3] = ((l >> 7) & 127) | 128;
+            buf[4] = (l & 127) | 128;
+        }
+        return 5;
+    }
+}
+
+/* Decode the back length whose rightmost byte is at 'p'. */
+static inline uint32_t lpDecodeBacklen(unsigned char *p) {
+    uint32_t val = 0, shift = 0;
+
+    do {
+        val |= (uint32_t)(p[0] & 127) << shift;
+        if (!(p[0] & 128)) break;
+        shift += 7;
+        p--;
+    } while (shift <= 28);
+    return val;
+}
+
+/* Encode the integer 'v' with the smallest encoding that can hold it,
+ * and return the number of bytes used. */
+static unsigned int lpEncodeInteger(unsigned char *buf, long long v) {
+    uint64_t u = (uint64_t)v;
+
+    if (v >= 0 && v <= 127) {
+        buf[0] = v;
+        return 1;
+    } else if (v >= -4096 && v <= 4095) {
+        u &= 0x1fff;
+        buf[0] = LP_ENCODING_13BIT_INT | (u >> 8);
+        buf[1] = u & 0xff;
+        return 2;
+    } else if (v >= INT16_MIN && v <= INT16_MAX) {
+        buf[0] = LP_ENCODING_16BIT_INT;
+        buf[1] = u & 0xff;
+        buf[2] = (u >> 8) & 0xff;
+        return 3;
+    } else if (v >= -8388608 && v <= 8388607) {
+        buf[0] = LP_ENCODING_24BIT_INT;
+        buf[1] = u & 0xff;
+        buf[2] = (u >> 8) & 0xff;
+        buf[3] = (u >> 16) & 0xff;
+        return 4;
+    } else if (v >= INT32_MIN && v <= INT32_MAX) {
+        buf[0] = LP_ENCODING_32BIT_INT;
+        lpWrite32(buf+1,(uint32_t)u);
+        return 5;
+    } else {
+        buf[0] = LP_ENCODING_64BIT_INT;
+        lpWrite32(buf+1,(uint32_t)u);
+        lpWrite32(buf+5,(uint32_t)(u >> 32));
+        return 9;
+    }
+}
+
+/* Encode the type of a string of 'len' bytes, and return the number of
+ * bytes used. */
+static unsigned int lpEncodeStringType(unsigned char *buf, uint32_t len) {
+    if (len < 64) {
+        buf[0] = LP_ENCODING_6BIT_STR | len;
+        return 1;
+    } else if (len < 4096) {
+        buf[0] = LP_ENCODING_12BIT_STR | (len >> 8);
+        buf[1] = len & 0xff;
+        return 2;
+    } else {
+        buf[0] = LP_ENCODING_32BIT_STR;
+        lpWrite32(buf+1,len);
+        return 5;
+    }
+}
+
+/* Return the size of the encoding type and data of the entry at 'p', that
+ * is the entry without its back length. */
+static inline uint32_t lpCurrentEncodedSize(unsigned char *p) {
+    unsigned char b = p[0];
+
+    if (LP_IS_7BIT_UINT(b)) return 1;
+    if (LP_IS_6BIT_STR(b)) return 1 + (b & 0x3f);
+    if (LP_IS_13BIT_INT(b)) return 2;
+    if (LP_IS_12BIT_STR(b)) return 2 + (((b & 0x0f) << 8) | p[1]);
+    switch(b) {
+    case LP_ENCODING_16BIT_INT: return 3;
+    case LP_ENCODING_24BIT_INT: return 4;
+    case LP_ENCODING_32BIT_INT: return 5;
+    case LP_ENCODING_64BIT_INT: return 9;
+    case LP_ENCODING_32BIT_STR: return 5 + lpRead32(p+1);
+    case LP_EOF: return 1;
+    }
+    assert(NULL);
+    return 0;
+}
+
+/* Return the full size of the entry at 'p', back length included. */
+static inline uint32_t lpEntrySize(unsigned char *p) {
+    uint32_t l = lpCurrentEncodedSize(p);
+    return l + lpEncodeBacklen(NULL,l);
+}
+
+/* Return the bytes a string entry of 'slen' bytes takes besides the string
+ * itself. Integers are never larger than this. */
+size_t lpEntryOverhead(size_t slen) {
+    unsigned int typelen = (slen < 64) ? 1 : (slen < 4096) ? 2 : 5;
+    return typelen + lpEncodeBacklen(NULL,typelen+slen);
+}
+
+/* Create a new empty listpack. */
+unsigned char *lpNew(void) {
+    unsigned char *lp = zmalloc(LP_HDR_SIZE+1);
+
+    lpSetTotalBytes(lp,LP_HDR_SIZE+1);
+    lpSetNumElements(lp,0);
+    lp[LP_HDR_SIZE] = LP_EOF;
+    return lp;
+}
+
+/* Insert the string 's' before the entry at 'p', that may also be the end
+ * of the listpack. Strings that look like integers are stored as integers. */
+static unsigned char *__lpInsert(unsigned char *lp, unsigned char *p, unsigned char *s, unsigned int slen) {
+    unsigned char type[9], backlen[5], *dst;
+    uint32_t bytes = lpGetTotalBytes(lp), offset = p-lp, typelen, entrylen;
+    unsigned int backlen_size, isint = 0;
+    uint16_t num;
+    long long v;
+
+    if (slen < LP_INTBUF_SIZE && string2ll((char*)s,slen,&v)) {
+        typelen = lpEncodeInteger(type,v);
+        entrylen = typelen;
+        isint = 1;
+    } else {
+        typelen = lpEncodeStringType(type,slen);
+        entrylen = typelen+slen;
+    }
+    backlen_size = lpEncodeBacklen(backlen,entrylen);
+
+    lp = zrealloc(lp,bytes+entrylen+backlen_size);
+    dst = lp+offset;
+    memmove(dst+entrylen+backlen_size,dst,bytes-offset);
+    memcpy(dst,type,typelen);
+    if (!isint) memcpy(dst+typelen,s,slen);
+    memcpy(dst+entrylen,backlen,backlen_size);
+
+    lpSetTotalBytes(lp,bytes+entrylen+backlen_size);
+    num = lpGetNumElements(lp);
+    if (num != LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,num+1);
+    return lp;
+}
+
+/* Add the string 's' at the head or at the tail of the listpack. */
+unsigned char *lpPush(unsigned char *lp, unsigned char *s, unsigned int slen, int where) {
+    unsigned char *p = (where == LISTPACK_HEAD) ? lpFirstEntry(lp) : lpEnd(lp);
+    return __lpInsert(lp,p,s,slen);
+}
+
+/* Insert the string 's' before the entry at 'p'. */
+unsigned char *lpInsert(unsigned char *lp, unsigned char *p, unsigned char *s, unsigned int slen) {
+    return __lpInsert(lp,p,s,slen);
+}
+
+/* Return the entry after 'p', or NULL if 'p' is the last one. */
+unsigned char *lpNext(unsigned char *lp, unsigned char *p) {
+    ((void) lp);
+    if (p[0] == LP_EOF) return NULL;
+    p += lpEntrySize(p);
+    if (p[0] == LP_EOF) return NULL;
+    return p;
+}
+
+/* Return the entry before 'p', or NULL if 'p' is the first one. When 'p'
+ * is the end of the listpack the last entry is returned. */
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p) {
+    uint32_t prevlen;
+
+    if (p == lpFirstEntry(lp)) return NULL;
+    p--;
+    prevlen = lpDecodeBacklen(p);
+    prevlen += lpEncodeBacklen(NULL,prevlen);
+    return p-prevlen+1;
+}
+
+/* Return the entry at 'index', negative indexes counting from the tail, or
+ * NULL if there is no such entry. The walk starts from the nearest end. */
+unsigned char *lpIndex(unsigned char *lp, long index) {
+    uint16_t num = lpGetNumElements(lp);
+    unsigned char *p;
+
+    if (num != LP_HDR_NUMELE_UNKNOWN) {
+        if (index < 0) index += num;
+        if (index < 0 || index >= num) return NULL;
+        if (index > num/2) index -= num;
+    }
+    if (index >= 0) {
+        p = lpFirstEntry(lp);
+        while (index-- > 0 && p[0] != LP_EOF) p += lpEntrySize(p);
+        return (p[0] == LP_EOF) ? NULL : p;
+    } else {
+        p = lpEnd(lp);
+        while (index++ < 0) {
+            if ((p = lpPrev(lp,p)) == NULL) return NULL;
+        }
+        return p;
+    }
+}
+
+/* Get the value of the entry at 'p'. Strings are returned setting 'sval'
+ * and 'slen', integers setting 'lval' and 'sval' to NULL. Returns 0 if 'p'
+ * is NULL or the end of the listpack, otherwise 1. */
+unsigned int lpGet(unsigned char *p, unsigned char **sval, unsigned int *slen, long long *lval) {
+    unsigned char b;
+    long long v;
+    uint64_t u;
+
+    if (p == NULL || p[0] == LP_EOF) return 0;
+    if (sval) *sval = NULL;
+    b = p[0];
+
+    if (LP_IS_7BIT_UINT(b)) {
+        v = b;
+    } else if (LP_IS_6BIT_STR(b)) {
+        if (sval) {
+            *slen = b & 0x3f;
+            *sval = p+1;
+        }
+        return 1;
+    } else if (LP_IS_13BIT_INT(b)) {
+        u = ((b & 0x1f) << 8) | p[1];
+        v = (u >= 4096) ? (long long)u - 8192 : (long long)u;
+    } else if (LP_IS_12BIT_STR(b)) {
+        if (sval) {
+            *slen = ((b & 0x0f) << 8) | p[1];
+            *sval = p+2;
+        }
+        return 1;
+    } else if (b == LP_ENCODING_32BIT_STR) {
+        if (sval) {
+            *slen = lpRead32(p+1);
+            *sval = p+5;
+        }
+        return 1;
+    } else if (b == LP_ENCODING_16BIT_INT) {
+        v = (int16_t)(p[1] | (p[2] << 8));
+    } else if (b == LP_ENCODING_24BIT_INT) {
+        u = p[1] | (p[2] << 8) | ((uint32_t)p[3] << 16);
+        v = (u >= 8388608) ? (long long)u - 16777216 : (long long)u;
+    } else if (b == LP_ENCODING_32BIT_INT) {
+        v = (int32_t)lpRead32(p+1);
+    } else if (b == LP_ENCODING_64BIT_INT) {
+        u = (uint64_t)lpRead32(p+1) | ((uint64_t)lpRead32(p+5) << 32);
+        v = (long long)u;
+    } else {
+        assert(NULL);
+        return 0;
+    }
+    if (lval) *lval = v;
+    return 1;
+}
+
+/* Delete the entry at '*p', and set '*p' to the entry that followed it,
+ * or to the end of the listpack. */
+unsigned char *lpDelete(unsigned char *lp, unsigned char **p) {
+    uint32_t bytes = lpGetTotalBytes(lp), offset = *p-lp, len;
+    uint16_t num;
+
+    len = lpEntrySize(*p);
+    memmove(*p,*p+len,bytes-offset-len);
+    lp = zrealloc(lp,bytes-len);
+    lpSetTotalBytes(lp,bytes-len);
+    num = lpGetNumElements(lp);
+    if (num != LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,num-1);
+    *p = lp+offset;
+    return lp;
+}
+
+/* Delete 'num' entries starting at 'index', or less if the listpack ends
+ * before. */
+unsigned char *lpDeleteRange(unsigned char *lp, long index, unsigned int num) {
+    uint32_t bytes = lpGetTotalBytes(lp), offset, len;
+    unsigned char *p, *q;
+    unsigned int deleted = 0;
+    uint16_t numele;
+
+    if ((p = lpIndex(lp,index)) == NULL || num == 0) return lp;
+    q = p;
+    while (deleted < num && q[0] != LP_EOF) {
+        q += lpEntrySize(q);
+        deleted++;
+    }
+    offset = p-lp;
+    len = q-p;
+    memmove(p,q,bytes-offset-len);
+    lp = zrealloc(lp,bytes-len);
+    lpSetTotalBytes(lp,bytes-len);
+    numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,numele-deleted);
+    return lp;
+}
+
+/* Return 1 if the entry at 'p' is equal to the string 's'. */
+unsigned int lpCompare(unsigned char *p, unsigned char *s, unsigned int slen) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll, sll;
+
+    if (!lpGet(p,&vstr,&vlen,&vll)) return 0;
+    if (vstr) return vlen == slen && memcmp(vstr,s,slen) == 0;
+    return slen < LP_INTBUF_SIZE && string2ll((char*)s,slen,&sll) &&
+           sll == vll;
+}
+
+/* Find the entry equal to the string 'vstr' starting at 'p', skipping
+ * 'skip' entries between every comparison. Returns NULL when there is no
+ * such entry.
+ *
+ * Strings of up to 63 bytes and 7 bit integers, the most common entries of
+ * small hashes and sorted sets, are decoded inline. Entries of the same
+ * length are compared by their last byte before calling memcmp(). */
+unsigned char *lpFind(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip) {
+    unsigned int skipcnt = 0, len;
+    int vencoding = 0; /* 0: not checked yet, 1: integer, -1: not integer */
+    long long vll = 0, ll;
+    unsigned char *s;
+
+    while (p[0] != LP_EOF) {
+        unsigned char b = p[0];
+
+        if (LP_IS_6BIT_STR(b)) {
+            len = b & 0x3f;
+            if (skipcnt == 0) {
+                s = p+1;
+                if (len == vlen &&
+                    (len == 0 || (s[len-1] == vstr[len-1] &&
+                                  memcmp(s,vstr,len) == 0)))
+                {
+                    return p;
+                }
+                skipcnt = skip;
+            } else {
+                skipcnt--;
+            }
+            /* A string of up to 63 bytes has a one byte back length. */
+            p += len+2;
+            continue;
+        }
+
+        if (skipcnt == 0) {
+            lpGet(p,&s,&len,&ll);
+            if (s) {
+                if (len == vlen && memcmp(s,vstr,vlen) == 0) return p;
+            } else {
+                /* Parse the searched string as an integer only once. */
+                if (vencoding == 0) {
+                    vencoding = (vlen < LP_INTBUF_SIZE &&
+                        string2ll((char*)vstr,vlen,&vll)) ? 1 : -1;
+                }
+                if (vencoding == 1 && ll == vll) return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p += LP_IS_7BIT_UINT(b) ? 2 : lpEntrySize(p);
+    }
+    return NULL;
+}
+
+/* Return the number of entries of the listpack. */
+unsigned int lpLength(unsigned char *lp) {
+    uint16_t num = lpGetNumElements(lp);
+    unsigned char *p;
+    unsigned int count = 0;
+
+    if (num != LP_HDR_NUMELE_UNKNOWN) return num;
+
+    /* Too many entries for the header: count them, and store the count if
+     * it fits again. */
+    p = lpFirstEntry(lp);
+    while (p[0] != LP_EOF) {
+        count++;
+        p += lpEntrySize(p);
+    }
+    if (count < LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,count);
+    return count;
+}
+
+/* Return the size in bytes of the listpack. */
+size_t lpBytes(unsigned char *lp) {
+    return lpGetTotalBytes(lp);
+}
+
+#ifdef LISTPACK_TEST_MAIN
+/* Randomized test of the listpack against the ziplist, that implements the
+ * same operations, followed by a benchmark of the worst case of the ziplist
+ * cascade updates:
+ *
+ * cc -O2 -DLISTPACK_TEST_MAIN -o listpack-test listpack.c ziplist.c \
+ *    zmalloc.c util.c sha1.c sds.c
+ */
+#include <sys/time.h>
+#include "ziplist.h"
+
+void _redisAssert(char *estr, char *file, int line) {
+    fprintf(stderr,"ASSERTION FAILED %s:%d '%s'\n",file,line,estr);
+    abort();
+}
+
+static long long lpTestUstime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+/* Fill 'buf' with a random integer or string, and return its length. */
+static unsigned int lpTestRandomValue(char *buf) {
+    static const long long ints[] = {0, 127, 128, -1, 4095, -4096, 4096,
+        32767, -32768, 8388607, -8388608, 2147483647, -2147483648LL,
+        2147483648LL, 9223372036854775807LL};
+    unsigned int len, j;
+
+    switch(rand() % 4) {
+    case 0:
+        return sprintf(buf,"%lld",ints[rand() % 15]);
+    case 1:
+        return sprintf(buf,"%lld",(long long)rand()-RAND_MAX/2);
+    default:
+        /* Mostly short strings, sometimes longer than 63 or 4095 bytes. */
+        len = rand() % 40;
+        if (rand() % 10 == 0) len = rand() % 300;
+        if (rand() % 200 == 0) len = 4090 + rand() % 20;
+        for (j = 0; j < len; j++) buf[j] = 'a' + rand() % 26;
+        return len;
+    }
+}
+
+static void lpTestCheckEqual(unsigned char *lp, unsigned char *zl) {
+    unsigned char *p, *q, *ls, *zs;
+    unsigned int llen, zlen, n = 0;
+    long long lv, zv;
+
+    assert(lpLength(lp) == ziplistLen(zl));
+    p = lpIndex(lp,0);
+    q = ziplistIndex(zl,0);
+    while (q) {
+        assert(lpGet(p,&ls,&llen,&lv) && ziplistGet(q,&zs,&zlen,&zv));
+        assert((ls == NULL) == (zs == NULL));
+        if (ls) assert(llen == zlen && memcmp(ls,zs,llen) == 0);
+        else assert(lv == zv);
+        p = lpNext(lp,p);
+        q = ziplistNext(zl,q);
+        n++;
+    }
+    assert(p == NULL);
+    /* And backward. */
+    p = lpIndex(lp,-1);
+    while (n--) p = lpPrev(lp,p);
+    assert(p == NULL);
+}
+
+int main(int argc, char **argv) {
+    char *buf = zmalloc(8192);
+    unsigned char *lp, *zl, *p, *q;
+    unsigned int len, j, iter;
+    long long start;
+
+    srand((argc == 2) ? atoi(argv[1]) : 1234);
+
+    /* Random operations on both structures. */
+    for (iter = 0; iter < 200; iter++) {
+        lp = lpNew();
+        zl = ziplistNew();
+        for (j = 0; j < 400; j++) {
+            unsigned int count = lpLength(lp);
+            long idx = count ? rand() % count : 0;
+
+            len = lpTestRandomValue(buf);
+            switch(rand() % 6) {
+            case 0:
+                lp = lpPush(lp,(unsigned char*)buf,len,LISTPACK_HEAD);
+                zl = ziplistPush(zl,(unsigned char*)buf,len,ZIPLIST_HEAD);
+                break;
+            case 1:
+                lp = lpPush(lp,(unsigned char*)buf,len,LISTPACK_TAIL);
+                zl = ziplistPush(zl,(unsigned char*)buf,len,ZIPLIST_TAIL);
+                break;
+            case 2:
+                if (!count) break;
+                p = lpIndex(lp,idx);
+                q = ziplistIndex(zl,idx);
+                lp = lpInsert(lp,p,(unsigned char*)buf,len);
+                zl = ziplistInsert(zl,q,(unsigned char*)buf,len);
+                break;
+            case 3:
+                if (!count) break;
+                p = lpIndex(lp,-idx-1);
+                q = ziplistIndex(zl,-idx-1);
+                assert(lpCompare(p,(unsigned char*)buf,len) ==
+                       ziplistCompare(q,(unsigned char*)buf,len));
+                lp = lpDelete(lp,&p);
+                zl = ziplistDelete(zl,&q);
+                break;
+            case 4:
+                if (!count) break;
+                lp = lpDeleteRange(lp,idx,j % 4);
+                zl = ziplistDeleteRange(zl,idx,j % 4);
+                break;
+            case 5:
+                if (!count) break;
+                p = lpFind(lpIndex(lp,0),(unsigned char*)buf,len,j % 2);
+                q = ziplistFind(ziplistIndex(zl,0),(unsigned char*)buf,len,
+                                j % 2);
+                assert((p == NULL) == (q == NULL));
+                if (p) assert(lpCompare(p,(unsigned char*)buf,len));
+                break;
+            }
+            lpTestCheckEqual(lp,zl);
+        }
+        zfree(lp);
+        zfree(zl);
+    }
+    printf("Random operations against the ziplist: OK\n");
+
+    /* Find with skip, as done by hashes. */
+    lp = lpNew();
+    for (j = 0; j < 100; j++) {
+        len = sprintf(buf,"field:%u",j);
+        lp = lpPush(lp,(unsigned char*)buf,len,LISTPACK_TAIL);
+        len = sprintf(buf,"%u",j*1000);
+        lp = lpPush(lp,(unsigned char*)buf,len,LISTPACK_TAIL);
+    }
+    for (j = 0; j < 100; j++) {
+        len = sprintf(buf,"field:%u",j);
+        assert(lpFind(lpIndex(lp,0),(unsigned char*)buf,len,1) ==
+               lpIndex(lp,j*2));
+        len = sprintf(buf,"%u",j*1000);
+        assert(lpFind(lpIndex(lp,1),(unsigned char*)buf,len,1) ==
+               lpIndex(lp,j*2+1));
+        assert(lpFind(lpIndex(lp,0),(unsigned char*)buf,len,1) == NULL);
+    }
+    zfree(lp);
+    printf("lpFind(): OK\n");
+
+    /* Inserting a 254 bytes entry at the head of a list of 250 bytes
+     * entries makes every ziplist entry grow its prevlen to 5 bytes. */
+    printf("Insert at head of N entries of 250 bytes, then delete it:\n");
+    memset(buf,'x',300);
+    for (len = 1000; len <= 8000; len *= 2) {
+        long long zltime, lptime;
+
+        zl = ziplistNew();
+        lp = lpNew();
+        for (j = 0; j < len; j++) {
+            zl = ziplistPush(zl,(unsigned char*)buf,250,ZIPLIST_TAIL);
+            lp = lpPush(lp,(unsigned char*)buf,250,LISTPACK_TAIL);
+        }
+        start = lpTestUstime();
+        for (j = 0; j < 20; j++) {
+            zl = ziplistPush(zl,(unsigned char*)buf,254,ZIPLIST_HEAD);
+            p = ziplistIndex(zl,0);
+            zl = ziplistDelete(zl,&p);
+        }
+        zltime = lpTestUstime()-start;
+        start = lpTestUstime();
+        for (j = 0; j < 20; j++) {
+            lp = lpPush(lp,(unsigned char*)buf,254,LISTPACK_HEAD);
+            p = lpIndex(lp,0);
+            lp = lpDelete(lp,&p);
+        }
+        lptime = lpTestUstime()-start;
+        printf("  N=%-5u ziplist %8.1f us, listpack %6.1f us\n",
+            len, (double)zltime/20, (double)lptime/20);
+        zfree(zl);
+        zfree(lp);
+    }
+    zfree(buf);
+    return 0;
+}
+#endif
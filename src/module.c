@@ -78,3 +78,65 @@ loaderr:
 
 
 
+
+/* Registered module types, by robj->type. */
+static redisModuleType* moduleTypes[REDIS_MODULE_TYPE_MAX+1];
+static int moduleTypesCount = 0;
+
+/* Register a native data type. Modules call it from their init function.
+ * All the callbacks but 'encoding' and 'mem_usage' are mandatory. */
+int redisModuleRegisterType(redisModuleType* mt)
+{
+    if (mt->type < REDIS_MODULE_TYPE_MIN || mt->type > REDIS_MODULE_TYPE_MAX) {
+        redisLog(REDIS_WARNING, "module type `%s`: invalid type id %d",
+            mt->name, mt->type);
+        return REDIS_ERR;
+    }
+    if (!mt->name || !mt->free || !mt->rdb_save || !mt->rdb_load ||
+        !mt->aof_rewrite)
+    {
+        redisLog(REDIS_WARNING, "module type `%s`: missing callbacks",
+            mt->name ? mt->name : "(null)");
+        return REDIS_ERR;
+    }
+    if (moduleTypes[mt->type] || redisModuleTypeLookupByName(mt->name)) {
+        redisLog(REDIS_WARNING, "module type `%s` already exists", mt->name);
+        return REDIS_ERR;
+    }
+    moduleTypes[mt->type] = mt;
+    moduleTypesCount++;
+    return REDIS_OK;
+}
+
+/* Return the number of registered module types. */
+int redisModuleTypesCount(void)
+{
+    return moduleTypesCount;
+}
+
+redisModuleType* redisModuleTypeLookup(int type)
+{
+    if (type < REDIS_MODULE_TYPE_MIN || type > REDIS_MODULE_TYPE_MAX)
+        return NULL;
+    return moduleTypes[type];
+}
+
+redisModuleType* redisModuleTypeLookupByName(const char* name)
+{
+    int j;
+
+    for (j = REDIS_MODULE_TYPE_MIN; j <= REDIS_MODULE_TYPE_MAX; j++) {
+        if (moduleTypes[j] && !strcmp(moduleTypes[j]->name, name))
+            return moduleTypes[j];
+    }
+    return NULL;
+}
+
+/* The encoding reported by OBJECT ENCODING and DEBUG OBJECT. */
+char* redisModuleObjectEncoding(robj *o)
+{
+    redisModuleType* mt = redisModuleTypeLookup(o->type);
+
+    if (mt && mt->encoding) return mt->encoding(o);
+    return strEncoding(o->encoding);
+}
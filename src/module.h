@@ -62,6 +62,45 @@ typedef struct redisModule {
         {NULL, NULL, 0, NULL, 0, NULL, 0, 0, 0, 0, 0}               \
     };
 
+/* Native data types.
+ *
+ * A module storing its own kind of values in the keyspace registers a type
+ * from its init function. The value objects have robj->type set to the
+ * registered 'type', and the server dispatches to the type callbacks every
+ * time it needs to free, persist, rewrite or inspect them. */
+#define REDIS_MODULE_TYPE_MIN 5     /* Lower ids are the core types. */
+#define REDIS_MODULE_TYPE_MAX 15    /* robj->type is 4 bits. */
+
+struct redisObject;
+struct _rio;
+
+typedef struct redisModuleType {
+    const char* name;   /* Reported by TYPE and stored in the RDB file to
+                           find the type of the value when loading it. */
+    int type;           /* robj->type of the values. */
+
+    /* Release the value of the object, like decrRefCount() does. */
+    void (*free)(struct redisObject *o);
+    /* Serialize the object with the rdbSave*() functions, returning the
+     * number of bytes written or -1 on error, like rdbSaveObject(). */
+    int (*rdb_save)(struct _rio *rdb, struct redisObject *o);
+    /* Load an object saved by rdb_save, or return NULL on error. */
+    struct redisObject* (*rdb_load)(struct _rio *rdb);
+    /* Emit the commands to rebuild the key, returning 0 on error. */
+    int (*aof_rewrite)(struct _rio *aof, struct redisObject *key,
+                       struct redisObject *o);
+
+    /* Optional: reported by OBJECT ENCODING instead of the encoding name. */
+    char* (*encoding)(struct redisObject *o);
+    /* Optional: memory used by the object, reported by DEBUG OBJECT. */
+    size_t (*mem_usage)(struct redisObject *o);
+} redisModuleType;
+
 int redisLoadModule(const char* szModule);
+int redisModuleRegisterType(redisModuleType* mt);
+redisModuleType* redisModuleTypeLookup(int type);
+redisModuleType* redisModuleTypeLookupByName(const char* name);
+int redisModuleTypesCount(void);
+char* redisModuleObjectEncoding(struct redisObject *o);
 
 #endif
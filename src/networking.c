@@ -31,19 +31,88 @@
 #include <sys/uio.h>
 #include <math.h>
 
-static void setProtocolError(redisClient *c, int pos);
+static void setProtocolError(redisClient *c, int pos, sds err);
+static int ioThreadsShouldRun(int pending);
+static int ioThreadsCanServe(redisClient *c);
+static void ioThreadsRunBatch(int op, list *clients);
+
+/* I/O threads operations, see the "Threaded I/O" section. */
+#define REDIS_IO_OP_READ 0
+#define REDIS_IO_OP_WRITE 1
+
+/* True while processEventsWhileBlocked() is running: reads can't be
+ * postponed since beforeSleep() is not going to be called. */
+static int processingEventsWhileBlocked = 0;
 
 /* To evaluate the output buffer size of a client we need to get size of
  * allocated objects, however we can't used zmalloc_size() directly on sds
- * strings because of the trick they use to work (the header is before the
- * returned pointer), so we use this helper function. */
+ * strings because of the trick they use to work (the header, whose size
+ * depends on the string type, is before the returned pointer), so we use
+ * this helper function. */
 size_t zmalloc_size_sds(sds s) {
-    return zmalloc_size(s-sizeof(struct sdshdr));
+    return zmalloc_size(sdsAllocPtr(s));
+}
+
+/* Reply blocks of the default size are not released once sent, but kept
+ * in a pool for the next replies, so that large replies don't turn into a
+ * stream of allocations and frees of 16k each. The pool is only touched by
+ * the main thread: I/O threads never append replies, see setProtocolError(),
+ * and defer the release of the blocks they sent. */
+static clientReplyBlock *replyBlockPool[REDIS_REPLY_POOL_MAX];
+static int replyBlockPoolLen = 0;
+
+/* Return an empty block able to hold at least 'len' bytes. */
+static clientReplyBlock *createReplyBlock(size_t len) {
+    clientReplyBlock *b;
+
+    if (len <= REDIS_REPLY_CHUNK_BYTES) {
+        if (replyBlockPoolLen) {
+            b = replyBlockPool[--replyBlockPoolLen];
+            b->used = 0;
+            return b;
+        }
+        len = REDIS_REPLY_CHUNK_BYTES;
+    }
+    b = zmalloc(sizeof(*b)+len);
+    b->size = len;
+    b->used = 0;
+    b->obj = NULL;
+    return b;
+}
+
+void freeClientReplyValue(void *o) {
+    clientReplyBlock *b = o;
+
+    if (b == NULL) return; /* Deferred length never set. */
+    if (b->obj) decrRefCount(b->obj);
+    if (b->obj == NULL && b->size == REDIS_REPLY_CHUNK_BYTES &&
+        replyBlockPoolLen < REDIS_REPLY_POOL_MAX)
+    {
+        replyBlockPool[replyBlockPoolLen++] = b;
+    } else {
+        zfree(b);
+    }
 }
 
 void *dupClientReplyValue(void *o) {
-    incrRefCount((robj*)o);
-    return o;
+    clientReplyBlock *b = o, *new;
+
+    if (b->obj) {
+        new = zmalloc(sizeof(*new));
+        new->size = b->size;
+        new->obj = b->obj;
+        incrRefCount(b->obj);
+    } else if (b->size == REDIS_REPLY_CHUNK_BYTES) {
+        new = createReplyBlock(b->size);
+        memcpy(new->buf,b->buf,b->used);
+    } else {
+        new = zmalloc(sizeof(*new)+b->size);
+        new->size = b->size;
+        new->obj = NULL;
+        memcpy(new->buf,b->buf,b->used);
+    }
+    new->used = b->used;
+    return new;
 }
 
 int listMatchObjects(void *a, void *b) {
@@ -97,7 +166,7 @@ redisClient *createClient(int fd) {
     c->reply = listCreate();
     c->reply_bytes = 0;
     c->obuf_soft_limit_reached_time = 0;
-    listSetFreeMethod(c->reply,decrRefCountVoid);
+    listSetFreeMethod(c->reply,freeClientReplyValue);
     listSetDupMethod(c->reply,dupClientReplyValue);
     c->bpop.keys = dictCreate(&setDictType,NULL);
     c->bpop.timeout = 0;
@@ -106,6 +175,10 @@ redisClient *createClient(int fd) {
     c->pubsub_channels = dictCreate(&setDictType,NULL);
     c->pubsub_patterns = listCreate();
     c->peerid = NULL;
+    c->io_nbytes = 0;
+    c->io_errno = 0;
+    c->io_sent_nodes = 0;
+    c->io_protocol_error = NULL;
     listSetFreeMethod(c->pubsub_patterns,decrRefCountVoid);
     listSetMatchMethod(c->pubsub_patterns,listMatchObjects);
     if (fd != -1) listAddNodeTail(server.clients,c);
@@ -117,8 +190,10 @@ redisClient *createClient(int fd) {
  * to the client. The behavior is the following:
  *
  * If the client should receive new data (normal clients will) the function
- * returns REDIS_OK, and make sure to install the write handler in our event
- * loop so that when the socket is writable new data gets written.
+ * returns REDIS_OK, and make sure to put the client in the list of clients
+ * with pending writes, so that before re-entering the event loop we'll try
+ * to write the data directly to the socket, and install a write handler
+ * only if the socket could not accept it all.
  *
  * If the client should not receive new data, because it is a fake client,
  * a master, a slave not yet online, or because the setup of the write handler
@@ -132,28 +207,21 @@ int prepareClientToWrite(redisClient *c) {
     if ((c->flags & REDIS_MASTER) &&
         !(c->flags & REDIS_MASTER_FORCE_REPLY)) return REDIS_ERR;
     if (c->fd <= 0) return REDIS_ERR; /* Fake client */
-    if (c->bufpos == 0 && listLength(c->reply) == 0 &&
-        (c->replstate == REDIS_REPL_NONE ||
-         c->replstate == REDIS_REPL_ONLINE) &&
-        aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
-        sendReplyToClient, c) == AE_ERR) return REDIS_ERR;
+
+    if (!clientHasPendingReplies(c)) clientInstallWriteHandler(c);
     return REDIS_OK;
 }
 
-/* Create a duplicate of the last object in the reply list when
- * it is not exclusively owned by the reply list. */
-robj *dupLastObjectIfNeeded(list *reply) {
-    robj *new, *cur;
-    listNode *ln;
-    redisAssert(listLength(reply) > 0);
-    ln = listLast(reply);
-    cur = listNodeValue(ln);
-    if (cur->refcount > 1) {
-        new = dupStringObject(cur);
-        decrRefCount(cur);
-        listNodeValue(ln) = new;
+/* Put the client in the list of clients with pending writes, unless it is
+ * already there or it is a slave that should not receive data yet. */
+void clientInstallWriteHandler(redisClient *c) {
+    if (!(c->flags & REDIS_PENDING_WRITE) &&
+        (c->replstate == REDIS_REPL_NONE ||
+         c->replstate == REDIS_REPL_ONLINE))
+    {
+        c->flags |= REDIS_PENDING_WRITE;
+        listAddNodeHead(server.clients_pending_write,c);
     }
-    return listNodeValue(ln);
 }
 
 /* -----------------------------------------------------------------------------
@@ -177,96 +245,46 @@ int _addReplyToBuffer(redisClient *c, char *s, size_t len) {
     return REDIS_OK;
 }
 
-void _addReplyObjectToList(redisClient *c, robj *o) {
-    robj *tail;
+/* Append the protocol to the reply list, filling the free space of the
+ * last block before creating a new one. */
+void _addReplyStringToList(redisClient *c, char *s, size_t len) {
+    listNode *ln = listLast(c->reply);
+    clientReplyBlock *tail = ln ? listNodeValue(ln) : NULL;
 
     if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
-    if (listLength(c->reply) == 0) {
-        incrRefCount(o);
-        listAddNodeTail(c->reply,o);
-        c->reply_bytes += zmalloc_size_sds(o->ptr);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
+    if (tail) {
+        size_t avail = tail->size - tail->used;
+        size_t copy = avail >= len ? len : avail;
 
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            sdslen(tail->ptr)+sdslen(o->ptr) <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,o->ptr,sdslen(o->ptr));
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
-        } else {
-            incrRefCount(o);
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += zmalloc_size_sds(o->ptr);
-        }
+        memcpy(tail->buf+tail->used,s,copy);
+        tail->used += copy;
+        s += copy;
+        len -= copy;
     }
-    asyncCloseClientOnOutputBufferLimitReached(c);
-}
-
-/* This method takes responsibility over the sds. When it is no longer
- * needed it will be free'd, otherwise it ends up in a robj. */
-void _addReplySdsToList(redisClient *c, sds s) {
-    robj *tail;
-
-    if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
-        sdsfree(s);
-        return;
-    }
-
-    if (listLength(c->reply) == 0) {
-        listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
-        c->reply_bytes += zmalloc_size_sds(s);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            sdslen(tail->ptr)+sdslen(s) <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,s,sdslen(s));
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
-            sdsfree(s);
-        } else {
-            listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
-            c->reply_bytes += zmalloc_size_sds(s);
-        }
+    if (len) {
+        tail = createReplyBlock(len);
+        memcpy(tail->buf,s,len);
+        tail->used = len;
+        listAddNodeTail(c->reply,tail);
+        c->reply_bytes += tail->size;
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
-void _addReplyStringToList(redisClient *c, char *s, size_t len) {
-    robj *tail;
+/* Reference a big string object from the reply list instead of copying
+ * it in the blocks. */
+void _addReplyObjectToList(redisClient *c, robj *o) {
+    clientReplyBlock *b;
 
     if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
-    if (listLength(c->reply) == 0) {
-        robj *o = createStringObject(s,len);
-
-        listAddNodeTail(c->reply,o);
-        c->reply_bytes += zmalloc_size_sds(o->ptr);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            sdslen(tail->ptr)+len <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,s,len);
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
-        } else {
-            robj *o = createStringObject(s,len);
-
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += zmalloc_size_sds(o->ptr);
-        }
-    }
+    b = zmalloc(sizeof(*b));
+    b->size = b->used = sdslen(o->ptr);
+    b->obj = o;
+    incrRefCount(o);
+    listAddNodeTail(c->reply,b);
+    c->reply_bytes += b->size;
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
@@ -285,9 +303,13 @@ void addReply(redisClient *c, robj *obj) {
      * If the encoding is RAW and there is room in the static buffer
      * we'll be able to send the object to the client without
      * messing with its page. */
-    if (obj->encoding == REDIS_ENCODING_RAW) {
-        if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != REDIS_OK)
+    if (sdsEncodedObject(obj)) {
+        if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) == REDIS_OK)
+            return;
+        if (sdslen(obj->ptr) >= REDIS_REPLY_CHUNK_BYTES)
             _addReplyObjectToList(c,obj);
+        else
+            _addReplyStringToList(c,obj->ptr,sdslen(obj->ptr));
     } else if (obj->encoding == REDIS_ENCODING_INT) {
         /* Optimization: if there is room in the static buffer for 32 bytes
          * (more than the max chars a 64 bit integer can take as string) we
@@ -304,7 +326,7 @@ void addReply(redisClient *c, robj *obj) {
         }
         obj = getDecodedObject(obj);
         if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != REDIS_OK)
-            _addReplyObjectToList(c,obj);
+            _addReplyStringToList(c,obj->ptr,sdslen(obj->ptr));
         decrRefCount(obj);
     } else {
         redisPanic("Wrong obj->encoding in addReply()");
@@ -317,12 +339,9 @@ void addReplySds(redisClient *c, sds s) {
         sdsfree(s);
         return;
     }
-    if (_addReplyToBuffer(c,s,sdslen(s)) == REDIS_OK) {
-        sdsfree(s);
-    } else {
-        /* This method free's the sds when it is no longer needed. */
-        _addReplySdsToList(c,s);
-    }
+    if (_addReplyToBuffer(c,s,sdslen(s)) != REDIS_OK)
+        _addReplyStringToList(c,s,sdslen(s));
+    sdsfree(s);
 }
 
 void addReplyString(redisClient *c, char *s, size_t len) {
@@ -376,39 +395,44 @@ void addReplyStatusFormat(redisClient *c, const char *fmt, ...) {
     sdsfree(s);
 }
 
-/* Adds an empty object to the reply list that will contain the multi bulk
+/* Adds an empty node to the reply list that will contain the multi bulk
  * length, which is not known when this function is called. */
 void *addDeferredMultiBulkLength(redisClient *c) {
     /* Note that we install the write event here even if the object is not
      * ready to be sent, since we are sure that before returning to the
      * event loop setDeferredMultiBulkLength() will be called. */
     if (prepareClientToWrite(c) != REDIS_OK) return NULL;
-    listAddNodeTail(c->reply,createObject(REDIS_STRING,NULL));
+    listAddNodeTail(c->reply,NULL);
     return listLast(c->reply);
 }
 
-/* Populate the length object and try gluing it to the next chunk. */
+/* Populate the length node, prepending it to the next block when it has
+ * enough free space and is not too big to move. */
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length) {
     listNode *ln = (listNode*)node;
-    robj *len, *next;
+    clientReplyBlock *len, *next;
+    char lenstr[128];
+    size_t lenstr_len;
 
     /* Abort when *node is NULL (see addDeferredMultiBulkLength). */
     if (node == NULL) return;
 
-    len = listNodeValue(ln);
-    len->ptr = sdscatprintf(sdsempty(),"*%ld\r\n",length);
-    c->reply_bytes += zmalloc_size_sds(len->ptr);
-    if (ln->next != NULL) {
-        next = listNodeValue(ln->next);
-
-        /* Only glue when the next node is non-NULL (an sds in this case) */
-        if (next->ptr != NULL) {
-            c->reply_bytes -= zmalloc_size_sds(len->ptr);
-            c->reply_bytes -= zmalloc_size_sds(next->ptr);
-            len->ptr = sdscatlen(len->ptr,next->ptr,sdslen(next->ptr));
-            c->reply_bytes += zmalloc_size_sds(len->ptr);
-            listDelNode(c->reply,ln->next);
-        }
+    lenstr_len = snprintf(lenstr,sizeof(lenstr),"*%ld\r\n",length);
+    if (ln->next != NULL && (next = listNodeValue(ln->next)) != NULL &&
+        next->size - next->used >= lenstr_len &&
+        next->used < REDIS_REPLY_CHUNK_BYTES)
+    {
+        memmove(next->buf+lenstr_len,next->buf,next->used);
+        memcpy(next->buf,lenstr,lenstr_len);
+        next->used += lenstr_len;
+        listDelNode(c->reply,ln);
+    } else {
+        len = zmalloc(sizeof(*len)+lenstr_len);
+        len->size = len->used = lenstr_len;
+        len->obj = NULL;
+        memcpy(len->buf,lenstr,lenstr_len);
+        listNodeValue(ln) = len;
+        c->reply_bytes += len->size;
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
@@ -472,7 +496,7 @@ void addReplyMultiBulkLen(redisClient *c, long length) {
 void addReplyBulkLen(redisClient *c, robj *obj) {
     size_t len;
 
-    if (obj->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(obj)) {
         len = sdslen(obj->ptr);
     } else {
         long n = (long)obj->ptr;
@@ -668,6 +692,7 @@ void freeClient(redisClient *c) {
 
     /* Free the query buffer */
     sdsfree(c->querybuf);
+    sdsfree(c->io_protocol_error);
     c->querybuf = NULL;
 
     /* Deallocate structures used to block on blocking ops. */
@@ -702,6 +727,9 @@ void freeClient(redisClient *c) {
         listDelNode(server.clients,ln);
     }
 
+    /* Remove from the lists of clients with pending reads or writes. */
+    removeClientFromPendingLists(c);
+
     /* When client was just unblocked because of a blocking operation,
      * remove it from the list of unblocked clients. */
     if (c->flags & REDIS_UNBLOCKED) {
@@ -771,49 +799,114 @@ void freeClientsInAsyncFreeQueue(void) {
     }
 }
 
-void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = privdata;
-    int nwritten = 0, totwritten = 0, objlen;
-    size_t objmem;
-    robj *o;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
+/* Return true if the specified client has pending reply buffers to write to
+ * the socket. */
+int clientHasPendingReplies(redisClient *c) {
+    return c->bufpos || listLength(c->reply);
+}
 
-    while(c->bufpos > 0 || listLength(c->reply)) {
-        if (c->bufpos > 0) {
-            nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
+/* Remove the client from the lists of clients with pending reads and writes,
+ * used when the client is freed or its socket is going away. */
+void removeClientFromPendingLists(redisClient *c) {
+    listNode *ln;
 
-            /* If the buffer was sent, set bufpos to zero to continue with
-             * the remainder of the reply. */
-            if (c->sentlen == c->bufpos) {
-                c->bufpos = 0;
-                c->sentlen = 0;
-            }
-        } else {
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o->ptr);
-            objmem = zmalloc_size_sds(o->ptr);
+    if (c->flags & REDIS_PENDING_WRITE) {
+        ln = listSearchKey(server.clients_pending_write,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_write,ln);
+        c->flags &= ~REDIS_PENDING_WRITE;
+    }
+    if (c->flags & REDIS_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
+        c->flags &= ~REDIS_PENDING_READ;
+    }
+}
 
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                continue;
+/* Write as much as possible of the client output buffers to the socket.
+ *
+ * Blocks in the reply list that were sent completely are released, unless
+ * 'defer_release' is true: this is the case of I/O threads, that can't touch
+ * the pool of reply blocks owned by the main thread, so they just count the
+ * nodes in c->io_sent_nodes and the main thread will release them in
+ * releaseSentReplyNodes() later.
+ *
+ * Returns the number of bytes written, or -1 on write errors, with errno
+ * set accordingly. Only the client structure is touched here. */
+static ssize_t _writeToClient(redisClient *c, int defer_release) {
+    struct iovec iov[REDIS_IOV_MAX];
+    ssize_t nwritten = 0, totwritten = 0;
+    size_t objlen, offset, iovbytes, remaining;
+    int iovcnt;
+    listNode *ln = listFirst(c->reply), *next;
+    clientReplyBlock *o;
+
+    while(c->bufpos > 0 || ln) {
+        /* Gather the static buffer and the reply blocks in a single
+         * writev() call, up to REDIS_MAX_WRITE_PER_EVENT bytes. Empty
+         * blocks don't take an iovec, they are just released below. */
+        iovcnt = 0;
+        iovbytes = 0;
+        offset = c->sentlen;
+        if (c->bufpos > 0) {
+            iov[iovcnt].iov_base = c->buf+c->sentlen;
+            iov[iovcnt].iov_len = c->bufpos-c->sentlen;
+            iovbytes += iov[iovcnt++].iov_len;
+            offset = 0;
+        }
+        for (next = ln; next && iovcnt < REDIS_IOV_MAX &&
+                        iovbytes < REDIS_MAX_WRITE_PER_EVENT;
+             next = listNextNode(next))
+        {
+            o = listNodeValue(next);
+            objlen = o->used;
+            if (objlen > offset) {
+                iov[iovcnt].iov_base = replyBlockData(o)+offset;
+                iov[iovcnt].iov_len = objlen-offset;
+                iovbytes += iov[iovcnt++].iov_len;
             }
-
-            nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
+            offset = 0;
+        }
+        if (iovcnt) {
+            nwritten = writev(c->fd,iov,iovcnt);
             if (nwritten <= 0) break;
-            c->sentlen += nwritten;
             totwritten += nwritten;
+        } else {
+            nwritten = 0;
+        }
 
-            /* If we fully sent the object on head go to the next one */
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->sentlen = 0;
-                c->reply_bytes -= objmem;
+        /* Consume the written bytes: the static buffer first, then the
+         * blocks, that are released once sent completely. */
+        remaining = nwritten;
+        if (c->bufpos > 0) {
+            if (remaining < (size_t)(c->bufpos-c->sentlen)) {
+                c->sentlen += remaining;
+                break; /* The socket buffer is full. */
+            }
+            remaining -= c->bufpos-c->sentlen;
+            c->bufpos = 0;
+            c->sentlen = 0;
+        }
+        while(ln) {
+            o = listNodeValue(ln);
+            objlen = o->used;
+            if (objlen-c->sentlen > remaining) {
+                c->sentlen += remaining;
+                break;
             }
+            remaining -= objlen-c->sentlen;
+            c->reply_bytes -= o->size;
+            next = listNextNode(ln);
+            if (defer_release)
+                c->io_sent_nodes++;
+            else
+                listDelNode(c->reply,ln);
+            ln = next;
+            c->sentlen = 0;
         }
+        if ((size_t)nwritten < iovbytes) break; /* The socket buffer is full. */
+
         /* Note that we avoid to send more than REDIS_MAX_WRITE_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
          * other clients as well, even if a very large request comes from
@@ -822,35 +915,112 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
          *
          * However if we are over the maxmemory limit we ignore that and
          * just deliver as much data as it is possible to deliver. */
-        server.stat_net_output_bytes += totwritten;
         if (totwritten > REDIS_MAX_WRITE_PER_EVENT &&
             (server.maxmemory == 0 ||
              zmalloc_used_memory() < server.maxmemory)) break;
     }
+    if (nwritten == -1 && errno != EAGAIN) return -1;
+    return totwritten;
+}
+
+/* Release the reply nodes an I/O thread reported as sent. */
+static void releaseSentReplyNodes(redisClient *c) {
+    while(c->io_sent_nodes) {
+        listDelNode(c->reply,listFirst(c->reply));
+        c->io_sent_nodes--;
+    }
+}
+
+/* Main thread side of a write: update stats, and handle errors and clients
+ * that are done with their replies. Returns REDIS_ERR if the client was
+ * freed in the process. */
+static int afterClientWrite(redisClient *c, ssize_t nwritten, int err,
+                            int handler_installed)
+{
     if (nwritten == -1) {
-        if (errno == EAGAIN) {
-            nwritten = 0;
-        } else {
-            redisLog(REDIS_VERBOSE,
-                "Error writing to client: %s", strerror(errno));
-            freeClient(c);
-            return;
-        }
+        redisLog(REDIS_VERBOSE,
+            "Error writing to client: %s", strerror(err));
+        freeClient(c);
+        return REDIS_ERR;
     }
-    if (totwritten > 0) {
+    server.stat_net_output_bytes += nwritten;
+    if (nwritten > 0) {
         /* For clients representing masters we don't count sending data
          * as an interaction, since we always send REPLCONF ACK commands
          * that take some time to just fill the socket output buffer.
          * We just rely on data / pings received for timeout detection. */
         if (!(c->flags & REDIS_MASTER)) c->lastinteraction = server.unixtime;
     }
-    if (c->bufpos == 0 && listLength(c->reply) == 0) {
+    if (!clientHasPendingReplies(c)) {
         c->sentlen = 0;
-        aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+        if (handler_installed) aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
 
         /* Close connection after entire reply has been sent. */
-        if (c->flags & REDIS_CLOSE_AFTER_REPLY) freeClient(c);
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
+            freeClient(c);
+            return REDIS_ERR;
+        }
+    }
+    return REDIS_OK;
+}
+
+/* Write data in output buffers to client. Return REDIS_OK if the client
+ * is still valid after the call, REDIS_ERR if it was freed. */
+int writeToClient(int fd, redisClient *c, int handler_installed) {
+    ssize_t nwritten;
+
+    REDIS_NOTUSED(fd);
+    nwritten = _writeToClient(c,0);
+    return afterClientWrite(c,nwritten,errno,handler_installed);
+}
+
+/* Write event handler. Just send data to the client. */
+void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+    writeToClient(fd,privdata,1);
+}
+
+/* This function is called just before entering the event loop, in the hope
+ * we can just write the replies to the client output buffer without any
+ * need to use a syscall in order to install the writable event handler,
+ * get it called, and so forth. When I/O threads are enabled and there are
+ * enough clients the writes are performed by the threads. */
+int handleClientsWithPendingWrites(void) {
+    int processed = listLength(server.clients_pending_write);
+    int threaded = ioThreadsShouldRun(processed);
+    listNode *ln;
+    redisClient *c;
+
+    if (threaded) ioThreadsRunBatch(REDIS_IO_OP_WRITE,
+                                    server.clients_pending_write);
+
+    while(listLength(server.clients_pending_write)) {
+        ln = listFirst(server.clients_pending_write);
+        c = listNodeValue(ln);
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+
+        /* Try to write buffers to the client socket, unless already done
+         * by the I/O threads. */
+        if (threaded && ioThreadsCanServe(c)) {
+            releaseSentReplyNodes(c);
+            if (afterClientWrite(c,c->io_nbytes,c->io_errno,0) == REDIS_ERR)
+                continue;
+        } else {
+            if (writeToClient(c->fd,c,0) == REDIS_ERR) continue;
+        }
+
+        /* If there is nothing left, do nothing. Otherwise install
+         * the write handler. */
+        if (clientHasPendingReplies(c) &&
+            aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
+                sendReplyToClient, c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
     }
+    return processed;
 }
 
 /* resetClient prepare the client to process the next command */
@@ -875,8 +1045,8 @@ int processInlineBuffer(redisClient *c) {
     /* Nothing to do without a \r\n */
     if (newline == NULL) {
         if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
-            addReplyError(c,"Protocol error: too big inline request");
-            setProtocolError(c,0);
+            setProtocolError(c,0,
+                sdsnew("Protocol error: too big inline request"));
         }
         return REDIS_ERR;
     }
@@ -891,8 +1061,8 @@ int processInlineBuffer(redisClient *c) {
     argv = sdssplitargs(aux,&argc);
     sdsfree(aux);
     if (argv == NULL) {
-        addReplyError(c,"Protocol error: unbalanced quotes in request");
-        setProtocolError(c,0);
+        setProtocolError(c,0,
+            sdsnew("Protocol error: unbalanced quotes in request"));
         return REDIS_ERR;
     }
 
@@ -924,17 +1094,35 @@ int processInlineBuffer(redisClient *c) {
     return REDIS_OK;
 }
 
-/* Helper function. Trims query buffer to make the function that processes
- * multi bulk requests idempotent. */
-static void setProtocolError(redisClient *c, int pos) {
+/* Reply with the protocol error 'err' and close the client once the reply
+ * is sent. The error string is released. */
+static void addReplyProtocolError(redisClient *c, sds err) {
     if (server.verbosity >= REDIS_VERBOSE) {
         sds client = catClientInfoString(sdsempty(),c);
         redisLog(REDIS_VERBOSE,
             "Protocol error from client: %s", client);
         sdsfree(client);
     }
+    addReplyErrorFormat(c,"%s",err);
+    sdsfree(err);
     c->flags |= REDIS_CLOSE_AFTER_REPLY;
+}
+
+/* Helper function. Trims query buffer to make the function that processes
+ * multi bulk requests idempotent, and replies with the error 'err'.
+ *
+ * I/O threads parse the clients flagged REDIS_PENDING_READ, and can't append
+ * replies, as reply blocks come from a pool owned by the main thread: the
+ * error is stored in the client, and handleClientsWithPendingReads() sends
+ * it. Parsing stops anyway, since a thread parses one command at most. */
+static void setProtocolError(redisClient *c, int pos, sds err) {
     sdsrange(c->querybuf,pos,-1);
+    if (c->flags & REDIS_PENDING_READ) {
+        sdsfree(c->io_protocol_error);
+        c->io_protocol_error = err;
+    } else {
+        addReplyProtocolError(c,err);
+    }
 }
 
 int processMultibulkBuffer(redisClient *c) {
@@ -950,8 +1138,8 @@ int processMultibulkBuffer(redisClient *c) {
         newline = strchr(c->querybuf,'\r');
         if (newline == NULL) {
             if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
-                addReplyError(c,"Protocol error: too big mbulk count string");
-                setProtocolError(c,0);
+                setProtocolError(c,0,
+                    sdsnew("Protocol error: too big mbulk count string"));
             }
             return REDIS_ERR;
         }
@@ -965,8 +1153,8 @@ int processMultibulkBuffer(redisClient *c) {
         redisAssertWithInfo(c,NULL,c->querybuf[0] == '*');
         ok = string2ll(c->querybuf+1,newline-(c->querybuf+1),&ll);
         if (!ok || ll > 1024*1024) {
-            addReplyError(c,"Protocol error: invalid multibulk length");
-            setProtocolError(c,pos);
+            setProtocolError(c,pos,
+                sdsnew("Protocol error: invalid multibulk length"));
             return REDIS_ERR;
         }
 
@@ -990,9 +1178,8 @@ int processMultibulkBuffer(redisClient *c) {
             newline = strchr(c->querybuf+pos,'\r');
             if (newline == NULL) {
                 if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
-                    addReplyError(c,
-                        "Protocol error: too big bulk count string");
-                    setProtocolError(c,0);
+                    setProtocolError(c,0,
+                        sdsnew("Protocol error: too big bulk count string"));
                     return REDIS_ERR;
                 }
                 break;
@@ -1003,17 +1190,16 @@ int processMultibulkBuffer(redisClient *c) {
                 break;
 
             if (c->querybuf[pos] != '$') {
-                addReplyErrorFormat(c,
+                setProtocolError(c,pos,sdscatprintf(sdsempty(),
                     "Protocol error: expected '$', got '%c'",
-                    c->querybuf[pos]);
-                setProtocolError(c,pos);
+                    c->querybuf[pos]));
                 return REDIS_ERR;
             }
 
             ok = string2ll(c->querybuf+pos+1,newline-(c->querybuf+pos+1),&ll);
             if (!ok || ll < 0 || ll > 512*1024*1024) {
-                addReplyError(c,"Protocol error: invalid bulk length");
-                setProtocolError(c,pos);
+                setProtocolError(c,pos,
+                    sdsnew("Protocol error: invalid bulk length"));
                 return REDIS_ERR;
             }
 
@@ -1075,53 +1261,68 @@ int processMultibulkBuffer(redisClient *c) {
     return REDIS_ERR;
 }
 
-void processInputBuffer(redisClient *c) {
-    /* Keep processing while there is something in the input buffer */
-    while(sdslen(c->querybuf)) {
-        /* Immediately abort if the client is in the middle of something. */
-        if (c->flags & REDIS_BLOCKED) return;
-
-        /* REDIS_CLOSE_AFTER_REPLY closes the connection once the reply is
-         * written to the client. Make sure to not let the reply grow after
-         * this flag has been set (i.e. don't process more commands). */
-        if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
-
-        /* Determine request type when unknown. */
-        if (!c->reqtype) {
-            if (c->querybuf[0] == '*') {
-                c->reqtype = REDIS_REQ_MULTIBULK;
-            } else {
-                c->reqtype = REDIS_REQ_INLINE;
-            }
-        }
+/* Parse the next command in the query buffer into c->argv / c->argc.
+ * Returns REDIS_OK when a whole command was parsed (argc may still be zero
+ * for empty requests), REDIS_ERR when more data is needed, on protocol errors,
+ * or when the client should not process more commands right now. */
+static int parseInputBuffer(redisClient *c) {
+    /* Immediately abort if the client is in the middle of something. */
+    if (c->flags & REDIS_BLOCKED) return REDIS_ERR;
+
+    /* REDIS_CLOSE_AFTER_REPLY closes the connection once the reply is
+     * written to the client. Make sure to not let the reply grow after
+     * this flag has been set (i.e. don't process more commands). */
+    if (c->flags & REDIS_CLOSE_AFTER_REPLY) return REDIS_ERR;
+
+    if (sdslen(c->querybuf) == 0) return REDIS_ERR;
 
-        if (c->reqtype == REDIS_REQ_INLINE) {
-            if (processInlineBuffer(c) != REDIS_OK) break;
-        } else if (c->reqtype == REDIS_REQ_MULTIBULK) {
-            if (processMultibulkBuffer(c) != REDIS_OK) break;
+    /* Determine request type when unknown. */
+    if (!c->reqtype) {
+        if (c->querybuf[0] == '*') {
+            c->reqtype = REDIS_REQ_MULTIBULK;
         } else {
-            redisPanic("Unknown request type");
+            c->reqtype = REDIS_REQ_INLINE;
         }
+    }
+
+    if (c->reqtype == REDIS_REQ_INLINE) {
+        return processInlineBuffer(c);
+    } else if (c->reqtype == REDIS_REQ_MULTIBULK) {
+        return processMultibulkBuffer(c);
+    } else {
+        redisPanic("Unknown request type");
+    }
+    return REDIS_ERR; /* Not reached. */
+}
 
-        /* Multibulk processing could see a <= 0 length. */
-        if (c->argc == 0) {
+/* Execute the command parsed by parseInputBuffer(). */
+static void processParsedCommand(redisClient *c) {
+    /* Multibulk processing could see a <= 0 length. */
+    if (c->argc == 0) {
+        resetClient(c);
+    } else {
+        /* Only reset the client when the command was executed. */
+        if (processCommand(c) == REDIS_OK)
             resetClient(c);
-        } else {
-            /* Only reset the client when the command was executed. */
-            if (processCommand(c) == REDIS_OK)
-                resetClient(c);
-        }
     }
 }
 
-void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = (redisClient*) privdata;
+void processInputBuffer(redisClient *c) {
+    /* Keep processing while there is something in the input buffer */
+    while(sdslen(c->querybuf)) {
+        if (parseInputBuffer(c) != REDIS_OK) break;
+        processParsedCommand(c);
+    }
+}
+
+/* Read from the client socket into the query buffer. Returns the number of
+ * bytes read, zero if there was nothing to read, or -1 if the client should be
+ * closed, with errno set to zero if the peer closed the connection. Only the
+ * client structure is touched here, so I/O threads can call it as well. */
+static int readClientSocket(redisClient *c) {
     int nread, readlen;
     size_t qblen;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
 
-    server.current_client = c;
     readlen = REDIS_IOBUF_LEN;
     /* If this is a multi bulk request, and we are processing a bulk reply
      * that is large enough, try to maximize the probability that the query
@@ -1140,29 +1341,35 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     qblen = sdslen(c->querybuf);
     if (c->querybuf_peak < qblen) c->querybuf_peak = qblen;
     c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
-    nread = read(fd, c->querybuf+qblen, readlen);
+    nread = read(c->fd, c->querybuf+qblen, readlen);
     if (nread == -1) {
-        if (errno == EAGAIN) {
-            nread = 0;
-        } else {
-            redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
-            return;
-        }
+        if (errno == EAGAIN) return 0;
+        return -1;
     } else if (nread == 0) {
-        redisLog(REDIS_VERBOSE, "Client closed connection");
-        freeClient(c);
-        return;
+        errno = 0;
+        return -1;
     }
-    if (nread) {
-        sdsIncrLen(c->querybuf,nread);
-        c->lastinteraction = server.unixtime;
-        if (c->flags & REDIS_MASTER) c->reploff += nread;
-        server.stat_net_input_bytes += nread;
-    } else {
-        server.current_client = NULL;
-        return;
+    sdsIncrLen(c->querybuf,nread);
+    c->lastinteraction = server.unixtime;
+    return nread;
+}
+
+/* Main thread side of a read: update stats, and close the client on errors
+ * or if the query buffer got too big. Returns REDIS_ERR if the client was
+ * freed in the process. */
+static int afterClientRead(redisClient *c, int nread, int err) {
+    if (nread == -1) {
+        if (err)
+            redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(err));
+        else
+            redisLog(REDIS_VERBOSE, "Client closed connection");
+        freeClient(c);
+        return REDIS_ERR;
     }
+    if (nread == 0) return REDIS_OK;
+
+    if (c->flags & REDIS_MASTER) c->reploff += nread;
+    server.stat_net_input_bytes += nread;
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = catClientInfoString(sdsempty(),c), bytes = sdsempty();
 
@@ -1171,12 +1378,90 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         sdsfree(ci);
         sdsfree(bytes);
         freeClient(c);
-        return;
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/* When I/O threads are configured to perform reads, don't read from the
+ * socket in the event handler, but queue the client so that the reads of all
+ * the ready clients are performed in parallel by the threads before sleeping
+ * again. Masters and slaves are always served by the main thread. Returns 1
+ * if the read was postponed. */
+static int postponeClientRead(redisClient *c) {
+    if (server.io_threads_num > 1 && server.io_threads_do_reads &&
+        !processingEventsWhileBlocked && ioThreadsCanServe(c) &&
+        !(c->flags & REDIS_PENDING_READ))
+    {
+        c->flags |= REDIS_PENDING_READ;
+        listAddNodeTail(server.clients_pending_read,c);
+        return 1;
     }
-    processInputBuffer(c);
+    return 0;
+}
+
+void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    redisClient *c = (redisClient*) privdata;
+    int nread;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+    REDIS_NOTUSED(mask);
+
+    if (postponeClientRead(c)) return;
+
+    server.current_client = c;
+    nread = readClientSocket(c);
+    if (afterClientRead(c,nread,errno) == REDIS_ERR) return;
+    if (nread) processInputBuffer(c);
     server.current_client = NULL;
 }
 
+/* Serve the reads postponed by readQueryFromClient(), using the I/O threads
+ * if there are enough clients. The threads read and parse the first command
+ * of every client, while commands are always executed by the main thread. */
+int handleClientsWithPendingReads(void) {
+    int processed = listLength(server.clients_pending_read);
+    int threaded = ioThreadsShouldRun(processed);
+    listNode *ln;
+    redisClient *c;
+
+    if (processed == 0) return 0;
+    if (threaded) ioThreadsRunBatch(REDIS_IO_OP_READ,
+                                    server.clients_pending_read);
+
+    while(listLength(server.clients_pending_read)) {
+        ln = listFirst(server.clients_pending_read);
+        c = listNodeValue(ln);
+        c->flags &= ~REDIS_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+
+        if (!threaded) {
+            c->io_nbytes = readClientSocket(c);
+            c->io_errno = errno;
+        }
+        if (afterClientRead(c,c->io_nbytes,c->io_errno) == REDIS_ERR)
+            continue;
+
+        /* Send the protocol error found by the thread while parsing. */
+        if (c->io_protocol_error) {
+            sds err = c->io_protocol_error;
+
+            c->io_protocol_error = NULL;
+            addReplyProtocolError(c,err);
+        }
+        if (c->io_nbytes == 0) continue;
+
+        server.current_client = c;
+        if (c->flags & REDIS_PENDING_COMMAND) {
+            c->flags &= ~REDIS_PENDING_COMMAND;
+            processParsedCommand(c);
+        }
+        processInputBuffer(c);
+        server.current_client = NULL;
+    }
+    return processed;
+}
+
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer) {
     redisClient *c;
@@ -1514,7 +1799,7 @@ void rewriteClientCommandArgument(redisClient *c, int i, robj *newval) {
  * the caller wishes. The main usage of this function currently is
  * enforcing the client output length limits. */
 unsigned long getClientOutputBufferMemoryUsage(redisClient *c) {
-    unsigned long list_item_size = sizeof(listNode)+sizeof(robj);
+    unsigned long list_item_size = sizeof(listNode)+sizeof(clientReplyBlock);
 
     return c->reply_bytes + (list_item_size*listLength(c->reply));
 }
@@ -1601,6 +1886,8 @@ int checkClientOutputBufferLimits(redisClient *c) {
 void asyncCloseClientOnOutputBufferLimitReached(redisClient *c) {
     redisAssert(c->reply_bytes < ULONG_MAX-(1024*64));
     if (c->reply_bytes == 0 || c->flags & REDIS_CLOSE_ASAP) return;
+    /* Not from I/O threads, the main thread will check again. */
+    if (c->flags & REDIS_PENDING_READ) return;
     if (checkClientOutputBufferLimits(c)) {
         sds client = catClientInfoString(sdsempty(),c);
 
@@ -1619,14 +1906,11 @@ void flushSlavesOutputBuffers(void) {
     listRewind(server.slaves,&li);
     while((ln = listNext(&li))) {
         redisClient *slave = listNodeValue(ln);
-        int events;
 
-        events = aeGetFileEvents(server.el,slave->fd);
-        if (events & AE_WRITABLE &&
-            slave->replstate == REDIS_REPL_ONLINE &&
-            listLength(slave->reply))
+        if (slave->replstate == REDIS_REPL_ONLINE &&
+            clientHasPendingReplies(slave))
         {
-            sendReplyToClient(server.el,slave->fd,slave,0);
+            writeToClient(slave->fd,slave,0);
         }
     }
 }
@@ -1646,10 +1930,170 @@ void flushSlavesOutputBuffers(void) {
 int processEventsWhileBlocked(void) {
     int iterations = 4; /* See the function top-comment. */
     int count = 0;
+
+    processingEventsWhileBlocked = 1;
     while (iterations--) {
-        int events = aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+        int events = 0;
+        events += aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+        events += handleClientsWithPendingWrites();
         if (!events) break;
         count += events;
     }
+    processingEventsWhileBlocked = 0;
     return count;
 }
+
+/* -----------------------------------------------------------------------------
+ * Threaded I/O
+ *
+ * When io-threads is greater than one, the clients having pending writes (and
+ * pending reads if io-threads-do-reads is enabled) at every event loop
+ * iteration are split among the I/O threads, that perform the read(2) and
+ * write(2) calls and parse the first command of every query buffer, in
+ * parallel. The main thread serves its share of clients as well, then waits
+ * for the other threads, so that while a batch is running no other code
+ * touches the clients. Commands are always executed by the main thread.
+ * -------------------------------------------------------------------------- */
+
+static pthread_mutex_t io_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_threads_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t io_threads_done = PTHREAD_COND_INITIALIZER;
+static unsigned long io_threads_batch = 0;  /* Incremented at every batch. */
+static int io_threads_op;                   /* REDIS_IO_OP_* of the batch. */
+static int io_threads_pending = 0;          /* Threads yet working on it. */
+
+/* Read or write every client assigned to the thread in the current batch. */
+static void ioThreadProcessClients(redisIOThread *t, int op) {
+    while(listLength(t->clients)) {
+        listNode *ln = listFirst(t->clients);
+        redisClient *c = listNodeValue(ln);
+
+        listDelNode(t->clients,ln);
+        if (op == REDIS_IO_OP_WRITE) {
+            c->io_nbytes = _writeToClient(c,1);
+            c->io_errno = errno;
+            if (c->io_nbytes > 0) {
+                t->stat_writes++;
+                t->stat_written_bytes += c->io_nbytes;
+            }
+        } else {
+            c->io_nbytes = readClientSocket(c);
+            c->io_errno = errno;
+            if (c->io_nbytes <= 0) continue;
+            t->stat_reads++;
+            t->stat_read_bytes += c->io_nbytes;
+
+            /* Parse the first command ahead, unless the client is going to
+             * be closed for the query buffer limit anyway. */
+            if (sdslen(c->querybuf) <= server.client_max_querybuf_len &&
+                parseInputBuffer(c) == REDIS_OK)
+            {
+                c->flags |= REDIS_PENDING_COMMAND;
+            }
+        }
+    }
+}
+
+static void *ioThreadMain(void *arg) {
+    redisIOThread *t = arg;
+    unsigned long batch = 0;
+    sigset_t sigset;
+    int op;
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        redisLog(REDIS_WARNING,
+            "Warning: can't mask SIGALRM in I/O thread: %s", strerror(errno));
+
+    while(1) {
+        pthread_mutex_lock(&io_threads_mutex);
+        while (io_threads_batch == batch)
+            pthread_cond_wait(&io_threads_start,&io_threads_mutex);
+        batch = io_threads_batch;
+        op = io_threads_op;
+        pthread_mutex_unlock(&io_threads_mutex);
+
+        ioThreadProcessClients(t,op);
+
+        pthread_mutex_lock(&io_threads_mutex);
+        if (--io_threads_pending == 0)
+            pthread_cond_signal(&io_threads_done);
+        pthread_mutex_unlock(&io_threads_mutex);
+    }
+    return NULL;
+}
+
+/* Initialize the I/O threads state and spawn the threads. The thread with
+ * id 0 is the main thread itself. */
+void initThreadedIO(void) {
+    int j;
+
+    server.io_threads = zcalloc(sizeof(redisIOThread)*server.io_threads_num);
+    for (j = 0; j < server.io_threads_num; j++) {
+        redisIOThread *t = server.io_threads+j;
+
+        t->id = j;
+        t->clients = listCreate();
+        if (j == 0) {
+            t->thread = pthread_self();
+            continue;
+        }
+        if (pthread_create(&t->thread,NULL,ioThreadMain,t) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't initialize I/O threads.");
+            exit(1);
+        }
+    }
+}
+
+/* Return true if it is worth to use the I/O threads to serve the specified
+ * number of clients: with just a few of them the synchronization overhead
+ * is bigger than the gain. */
+static int ioThreadsShouldRun(int pending) {
+    return server.io_threads_num > 1 && !processingEventsWhileBlocked &&
+           pending >= server.io_threads_num*REDIS_IO_THREADS_MIN_CLIENTS;
+}
+
+/* Masters and slaves are always served by the main thread. */
+static int ioThreadsCanServe(redisClient *c) {
+    return !(c->flags & (REDIS_MASTER|REDIS_SLAVE));
+}
+
+/* Split the clients among the threads, and wait for all of them to perform
+ * the specified operation. The list of clients is not modified, and the
+ * clients the threads can't serve are skipped. */
+static void ioThreadsRunBatch(int op, list *clients) {
+    listIter li;
+    listNode *ln;
+    int j = 0;
+
+    listRewind(clients,&li);
+    while((ln = listNext(&li))) {
+        redisIOThread *t = server.io_threads+(j % server.io_threads_num);
+
+        if (!ioThreadsCanServe(listNodeValue(ln))) continue;
+        listAddNodeTail(t->clients,listNodeValue(ln));
+        j++;
+    }
+
+    pthread_mutex_lock(&io_threads_mutex);
+    io_threads_op = op;
+    io_threads_pending = server.io_threads_num-1;
+    io_threads_batch++;
+    pthread_cond_broadcast(&io_threads_start);
+    pthread_mutex_unlock(&io_threads_mutex);
+
+    ioThreadProcessClients(server.io_threads,op);
+
+    pthread_mutex_lock(&io_threads_mutex);
+    while (io_threads_pending)
+        pthread_cond_wait(&io_threads_done,&io_threads_mutex);
+    pthread_mutex_unlock(&io_threads_mutex);
+
+    if (op == REDIS_IO_OP_READ)
+        server.stat_io_reads_processed += j;
+    else
+        server.stat_io_writes_processed += j;
+}
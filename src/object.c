@@ -29,6 +29,7 @@
  */
 
 #include "redis.h"
+#include "atomicvar.h"
 #include <math.h>
 #include <ctype.h>
 
@@ -48,10 +49,37 @@ robj *createObject(int type, void *ptr) {
     return o;
 }
 
-robj *createStringObject(char *ptr, size_t len) {
+/* Create a string object with encoding REDIS_ENCODING_RAW, that is a plain
+ * string object where o->ptr points to a proper sds string. */
+robj *createRawStringObject(char *ptr, size_t len) {
     return createObject(REDIS_STRING,sdsnewlen(ptr,len));
 }
 
+/* Create a string object with encoding REDIS_ENCODING_EMBSTR, that is
+ * an object where the sds string is allocated in the same chunk as the
+ * object itself: a single allocation, and the string is found right after
+ * the object header. The string can't be resized, so the object must be
+ * converted to RAW with dbUnshareStringValue() before modifying it. */
+robj *createEmbeddedStringObject(char *ptr, size_t len) {
+    robj *o = zmalloc(sizeof(robj)+sdsEmbedLen(len));
+
+    o->type = REDIS_STRING;
+    o->encoding = REDIS_ENCODING_EMBSTR;
+    o->ptr = sdsnewat(o+1,ptr,len);
+    o->refcount = 1;
+    o->lru = server.lruclock;
+    return o;
+}
+
+/* Create a string object, EMBSTR encoded if it is short enough, otherwise
+ * RAW encoded. */
+robj *createStringObject(char *ptr, size_t len) {
+    if (len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT)
+        return createEmbeddedStringObject(ptr,len);
+    else
+        return createRawStringObject(ptr,len);
+}
+
 robj *createStringObjectFromLongLong(long long value) {
     robj *o;
     if (value >= 0 && value < REDIS_SHARED_INTEGERS) {
@@ -111,23 +139,32 @@ robj *createStringObjectFromLongDouble(long double value, int humanfriendly) {
     return createStringObject(buf,len);
 }
 
+/* Duplicate a string object, with the guarantee that the returned object
+ * has the same encoding as the original one. */
 robj *dupStringObject(robj *o) {
-    redisAssertWithInfo(NULL,o,o->encoding == REDIS_ENCODING_RAW);
-    return createStringObject(o->ptr,sdslen(o->ptr));
+    switch(o->encoding) {
+    case REDIS_ENCODING_RAW:
+        return createRawStringObject(o->ptr,sdslen(o->ptr));
+    case REDIS_ENCODING_EMBSTR:
+        return createEmbeddedStringObject(o->ptr,sdslen(o->ptr));
+    default:
+        redisPanic("Wrong encoding.");
+        return NULL; /* Not reached */
+    }
 }
 
-robj *createListObject(void) {
-    list *l = listCreate();
+robj *createQuicklistObject(void) {
+    quicklist *l = quicklistNew(server.list_max_ziplist_size,
+                                server.list_compress_depth);
     robj *o = createObject(REDIS_LIST,l);
-    listSetFreeMethod(l,decrRefCountVoid);
-    o->encoding = REDIS_ENCODING_LINKEDLIST;
+    o->encoding = REDIS_ENCODING_QUICKLIST;
     return o;
 }
 
-robj *createZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
+robj *createListpackObject(void) {
+    unsigned char *zl = lpNew();
     robj *o = createObject(REDIS_LIST,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_LISTPACK;
     return o;
 }
 
@@ -145,10 +182,24 @@ robj *createIntsetObject(void) {
     return o;
 }
 
+robj *createRoaringObject(void) {
+    roaring *r = roaringNew();
+    robj *o = createObject(REDIS_SET,r);
+    o->encoding = REDIS_ENCODING_ROARING;
+    return o;
+}
+
 robj *createHashObject(void) {
-    unsigned char *zl = ziplistNew();
+    unsigned char *zl = lpNew();
     robj *o = createObject(REDIS_HASH, zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_LISTPACK;
+    return o;
+}
+
+robj *createHashpackObject(void) {
+    hashpack *hp = hpNew();
+    robj *o = createObject(REDIS_HASH, hp);
+    o->encoding = REDIS_ENCODING_HASHPACK;
     return o;
 }
 
@@ -163,10 +214,10 @@ robj *createZsetObject(void) {
     return o;
 }
 
-robj *createZsetZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
+robj *createZsetListpackObject(void) {
+    unsigned char *zl = lpNew();
     robj *o = createObject(REDIS_ZSET,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_LISTPACK;
     return o;
 }
 
@@ -178,10 +229,10 @@ void freeStringObject(robj *o) {
 
 void freeListObject(robj *o) {
     switch (o->encoding) {
-    case REDIS_ENCODING_LINKEDLIST:
-        listRelease((list*) o->ptr);
+    case REDIS_ENCODING_QUICKLIST:
+        quicklistRelease(o->ptr);
         break;
-    case REDIS_ENCODING_ZIPLIST:
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -197,6 +248,9 @@ void freeSetObject(robj *o) {
     case REDIS_ENCODING_INTSET:
         zfree(o->ptr);
         break;
+    case REDIS_ENCODING_ROARING:
+        roaringFree(o->ptr);
+        break;
     default:
         redisPanic("Unknown set encoding type");
     }
@@ -211,7 +265,7 @@ void freeZsetObject(robj *o) {
         zslFree(zs->zsl);
         zfree(zs);
         break;
-    case REDIS_ENCODING_ZIPLIST:
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -224,33 +278,44 @@ void freeHashObject(robj *o) {
     case REDIS_ENCODING_HT:
         dictRelease((dict*) o->ptr);
         break;
-    case REDIS_ENCODING_ZIPLIST:
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
+    case REDIS_ENCODING_HASHPACK:
+        hpFree(o->ptr);
+        break;
     default:
         redisPanic("Unknown hash encoding type");
         break;
     }
 }
 
+/* The reference count is updated atomically, as objects released by the lazy
+ * free thread may share elements with the values still in the keyspace.
+ * When the count is 1 the caller is the only owner of the object, so it can
+ * be released without paying for an atomic operation. */
 void incrRefCount(robj *o) {
-    o->refcount++;
+    atomicIncr(o->refcount,1);
 }
 
 void decrRefCount(robj *o) {
+    redisModuleType *mt;
+
     if (o->refcount <= 0) redisPanic("decrRefCount against refcount <= 0");
-    if (o->refcount == 1) {
+    if (o->refcount == 1 || atomicDecr(o->refcount,1) == 0) {
         switch(o->type) {
         case REDIS_STRING: freeStringObject(o); break;
         case REDIS_LIST: freeListObject(o); break;
         case REDIS_SET: freeSetObject(o); break;
         case REDIS_ZSET: freeZsetObject(o); break;
         case REDIS_HASH: freeHashObject(o); break;
-        default: redisPanic("Unknown object type"); break;
+        default:
+            if ((mt = redisModuleTypeLookup(o->type)) == NULL)
+                redisPanic("Unknown object type");
+            mt->free(o);
+            break;
         }
         zfree(o);
-    } else {
-        o->refcount--;
     }
 }
 
@@ -302,32 +367,45 @@ robj *tryObjectEncoding(robj *o) {
     sds s = o->ptr;
     size_t len;
 
-    if (o->encoding != REDIS_ENCODING_RAW)
-        return o; /* Already encoded */
+    /* Make sure this is a string object, the only type we encode
+     * in this function. Other types use encoded memory efficient
+     * representations but are handled by the commands implementing
+     * the type. */
+    redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
+
+    /* We try some specialized encoding only for objects that are
+     * RAW or EMBSTR encoded, in other words objects that are still
+     * in represented by an actually array of chars. */
+    if (!sdsEncodedObject(o)) return o;
 
     /* It's not safe to encode shared objects: shared objects can be shared
      * everywhere in the "object space" of Redis. Encoded objects can only
      * appear as "values" (and not, for instance, as keys) */
      if (o->refcount > 1) return o;
 
-    /* Currently we try to encode only strings */
-    redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-
     /* Check if we can represent this string as a long integer */
     len = sdslen(s);
     if (len > 21 || !string2l(s,len,&value)) {
+        /* If the string is small and is still RAW encoded,
+         * try the EMBSTR encoding which is more efficient.
+         * In this representation the object and the SDS string are
+         * allocated in the same chunk of memory to save space and
+         * cache misses. */
+        if (len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT) {
+            robj *emb;
+
+            if (o->encoding == REDIS_ENCODING_EMBSTR) return o;
+            emb = createEmbeddedStringObject(s,len);
+            decrRefCount(o);
+            return emb;
+        }
+
         /* We can't encode the object...
          *
          * Do the last try, and at least optimize the SDS string inside
          * the string object to require little space, in case there
-         * is more than 10% of free space at the end of the SDS string.
-         *
-         * We do that for larger strings, using the arbitrary value
-         * of 32 bytes. This code was backported from the unstable branch
-         * where this is performed when the object is too large to be
-         * encoded as EMBSTR. */
-        if (len > 32 &&
-            o->encoding == REDIS_ENCODING_RAW &&
+         * is more than 10% of free space at the end of the SDS string. */
+        if (o->encoding == REDIS_ENCODING_RAW &&
             sdsavail(s) > len/10)
         {
             o->ptr = sdsRemoveFreeSpace(o->ptr);
@@ -351,6 +429,16 @@ robj *tryObjectEncoding(robj *o) {
         decrRefCount(o);
         incrRefCount(shared.integers[value]);
         return shared.integers[value];
+    } else if (o->encoding == REDIS_ENCODING_EMBSTR) {
+        /* Converting an EMBSTR object in place would keep the string
+         * allocated with it: create a new object. It is never a shared
+         * integer, since we may be here to keep a private LRU field. */
+        robj *enc = createObject(REDIS_STRING,NULL);
+
+        enc->encoding = REDIS_ENCODING_INT;
+        enc->ptr = (void*) value;
+        decrRefCount(o);
+        return enc;
     } else {
         o->encoding = REDIS_ENCODING_INT;
         sdsfree(o->ptr);
@@ -364,7 +452,7 @@ robj *tryObjectEncoding(robj *o) {
 robj *getDecodedObject(robj *o) {
     robj *dec;
 
-    if (o->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(o)) {
         incrRefCount(o);
         return o;
     }
@@ -396,14 +484,14 @@ int compareStringObjectsWithFlags(robj *a, robj *b, int flags) {
     size_t alen, blen, minlen;
 
     if (a == b) return 0;
-    if (a->encoding != REDIS_ENCODING_RAW) {
+    if (!sdsEncodedObject(a)) {
         alen = ll2string(bufa,sizeof(bufa),(long) a->ptr);
         astr = bufa;
     } else {
         astr = a->ptr;
         alen = sdslen(astr);
     }
-    if (b->encoding != REDIS_ENCODING_RAW) {
+    if (!sdsEncodedObject(b)) {
         blen = ll2string(bufb,sizeof(bufb),(long) b->ptr);
         bstr = bufb;
     } else {
@@ -437,7 +525,9 @@ int collateStringObjects(robj *a, robj *b) {
  * this function is faster then checking for (compareStringObject(a,b) == 0)
  * because it can perform some more optimization. */
 int equalStringObjects(robj *a, robj *b) {
-    if (a->encoding != REDIS_ENCODING_RAW && b->encoding != REDIS_ENCODING_RAW){
+    if (a->encoding == REDIS_ENCODING_INT &&
+        b->encoding == REDIS_ENCODING_INT)
+    {
         return a->ptr == b->ptr;
     } else {
         return compareStringObjects(a,b) == 0;
@@ -446,7 +536,7 @@ int equalStringObjects(robj *a, robj *b) {
 
 size_t stringObjectLen(robj *o) {
     redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-    if (o->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(o)) {
         return sdslen(o->ptr);
     } else {
         char buf[32];
@@ -463,7 +553,7 @@ int getDoubleFromObject(robj *o, double *target) {
         value = 0;
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtod(o->ptr, &eptr);
             if (isspace(((char*)o->ptr)[0]) ||
@@ -505,7 +595,7 @@ int getLongDoubleFromObject(robj *o, long double *target) {
         value = 0;
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtold(o->ptr, &eptr);
             if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' ||
@@ -543,7 +633,7 @@ int getLongLongFromObject(robj *o, long long *target) {
         value = 0;
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtoll(o->ptr, &eptr, 10);
             if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' ||
@@ -592,12 +682,17 @@ int getLongFromObjectOrReply(redisClient *c, robj *o, long *target, const char *
 char *strEncoding(int encoding) {
     switch(encoding) {
     case REDIS_ENCODING_RAW: return "raw";
+    case REDIS_ENCODING_EMBSTR: return "embstr";
     case REDIS_ENCODING_INT: return "int";
     case REDIS_ENCODING_HT: return "hashtable";
     case REDIS_ENCODING_LINKEDLIST: return "linkedlist";
-    case REDIS_ENCODING_ZIPLIST: return "ziplist";
+    case REDIS_ENCODING_LISTPACK: return "listpack";
+    case REDIS_ENCODING_ROARING: return "roaring";
+    case REDIS_ENCODING_HASHPACK: return "hashpack";
     case REDIS_ENCODING_INTSET: return "intset";
     case REDIS_ENCODING_SKIPLIST: return "skiplist";
+    case REDIS_ENCODING_RBTREE: return "rbtree";
+    case REDIS_ENCODING_QUICKLIST: return "quicklist";
     default: return "unknown";
     }
 }
@@ -641,7 +736,7 @@ void objectCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[1]->ptr,"encoding") && c->argc == 3) {
         if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
                 == NULL) return;
-        addReplyBulkCString(c,strEncoding(o->encoding));
+        addReplyBulkCString(c,redisModuleObjectEncoding(o));
     } else if (!strcasecmp(c->argv[1]->ptr,"idletime") && c->argc == 3) {
         if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
                 == NULL) return;
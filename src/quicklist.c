@@ -0,0 +1,1358 @@
+/* quicklist.c - A doubly linked list of listpacks
+ *
+ * Copyright (c) 2014, Matt Stancliff <matt@genges.com>
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h> /* for memcpy */
+#include "quicklist.h"
+#include "zmalloc.h"
+#include "listpack.h"
+#include "util.h" /* for ll2string */
+#include "lzf.h"
+
+#if defined(QUICKLIST_TEST_MAIN)
+#include <stdio.h> /* for printf (debug printing), snprintf (genstr) */
+#endif
+
+/* Optimization levels for size-based filling: a negative fill -N limits
+ * every listpack to optimization_level[N-1] bytes. */
+static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
+
+/* Maximum size in bytes of any multi-element listpack when the fill is a
+ * number of entries. Larger values are stored in a node of their own. */
+#define SIZE_SAFETY_LIMIT 8192
+
+/* Largest fill factor: a node can't hold more than 2^15 entries. */
+#define FILL_MAX (1 << 15)
+
+/* Largest compress depth. */
+#define COMPRESS_MAX (1 << 16)
+
+/* Minimum listpack size in bytes for attempting compression. */
+#define MIN_COMPRESS_BYTES 48
+
+/* Minimum size reduction in bytes to store compressed quicklistNode data.
+ * This also prevents us from storing compression if the compression
+ * resulted in a larger size than the original data. */
+#define MIN_COMPRESS_IMPROVE 8
+
+/* Create a new quicklist.
+ * Free with quicklistRelease(). */
+quicklist *quicklistCreate(void) {
+    struct quicklist *quicklist;
+
+    quicklist = zmalloc(sizeof(*quicklist));
+    quicklist->head = quicklist->tail = NULL;
+    quicklist->len = 0;
+    quicklist->count = 0;
+    quicklist->compress = 0;
+    quicklist->fill = -2;
+    return quicklist;
+}
+
+void quicklistSetCompressDepth(quicklist *quicklist, int compress) {
+    if (compress > COMPRESS_MAX - 1) {
+        compress = COMPRESS_MAX - 1;
+    } else if (compress < 0) {
+        compress = 0;
+    }
+    quicklist->compress = compress;
+}
+
+void quicklistSetFill(quicklist *quicklist, int fill) {
+    if (fill > FILL_MAX) {
+        fill = FILL_MAX;
+    } else if (fill < -5) {
+        fill = -5;
+    } else if (fill == 0) {
+        fill = 1;
+    }
+    quicklist->fill = fill;
+}
+
+void quicklistSetOptions(quicklist *quicklist, int fill, int depth) {
+    quicklistSetFill(quicklist, fill);
+    quicklistSetCompressDepth(quicklist, depth);
+}
+
+/* Create a new quicklist with some default parameters. */
+quicklist *quicklistNew(int fill, int compress) {
+    quicklist *quicklist = quicklistCreate();
+    quicklistSetOptions(quicklist, fill, compress);
+    return quicklist;
+}
+
+static quicklistNode *quicklistCreateNode(void) {
+    quicklistNode *node;
+    node = zmalloc(sizeof(*node));
+    node->zl = NULL;
+    node->count = 0;
+    node->sz = 0;
+    node->next = node->prev = NULL;
+    node->encoding = QUICKLIST_NODE_ENCODING_RAW;
+    node->recompress = 0;
+    node->attempted_compress = 0;
+    node->extra = 0;
+    return node;
+}
+
+/* Return cached quicklist count */
+unsigned long quicklistCount(const quicklist *ql) { return ql->count; }
+
+/* Free entire quicklist. */
+void quicklistRelease(quicklist *quicklist) {
+    quicklistNode *current, *next;
+
+    current = quicklist->head;
+    while (current) {
+        next = current->next;
+        zfree(current->zl);
+        zfree(current);
+        current = next;
+    }
+    zfree(quicklist);
+}
+
+/* Compress the listpack in 'node' and update encoding details.
+ * Returns 1 if listpack compressed successfully.
+ * Returns 0 if compression failed or if listpack too small to compress. */
+static int __quicklistCompressNode(quicklistNode *node) {
+    quicklistLZF *lzf;
+
+    node->attempted_compress = 1;
+    node->recompress = 0;
+
+    /* Don't bother compressing small values */
+    if (node->sz < MIN_COMPRESS_BYTES) return 0;
+
+    lzf = zmalloc(sizeof(*lzf) + node->sz);
+
+    /* Cancel if compression fails or doesn't compress small enough */
+    if (((lzf->sz = lzf_compress(node->zl, node->sz, lzf->compressed,
+                                 node->sz)) == 0) ||
+        lzf->sz + MIN_COMPRESS_IMPROVE >= node->sz) {
+        /* lzf_compress aborts/rejects compression if value not compressable. */
+        zfree(lzf);
+        return 0;
+    }
+    lzf = zrealloc(lzf, sizeof(*lzf) + lzf->sz);
+    zfree(node->zl);
+    node->zl = (unsigned char *)lzf;
+    node->encoding = QUICKLIST_NODE_ENCODING_LZF;
+    return 1;
+}
+
+/* Compress only uncompressed nodes. */
+#define quicklistCompressNode(_node)                                           \
+    do {                                                                       \
+        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_RAW) {     \
+            __quicklistCompressNode((_node));                                  \
+        }                                                                      \
+    } while (0)
+
+/* Uncompress the listpack in 'node' and update encoding details.
+ * Returns 1 on successful decode, 0 on failure to decode. */
+static int __quicklistDecompressNode(quicklistNode *node) {
+    void *decompressed = zmalloc(node->sz);
+    quicklistLZF *lzf = (quicklistLZF *)node->zl;
+
+    if (lzf_decompress(lzf->compressed, lzf->sz, decompressed, node->sz) == 0) {
+        /* Someone requested decompress, but we can't decompress.  Not good. */
+        zfree(decompressed);
+        return 0;
+    }
+    zfree(lzf);
+    node->zl = decompressed;
+    node->encoding = QUICKLIST_NODE_ENCODING_RAW;
+    node->attempted_compress = 0;
+    return 1;
+}
+
+/* Decompress only compressed nodes. */
+#define quicklistDecompressNode(_node)                                         \
+    do {                                                                       \
+        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+            __quicklistDecompressNode((_node));                                \
+        }                                                                      \
+        if (_node) (_node)->recompress = 0;                                    \
+    } while (0)
+
+/* Force node to not be immediately re-compresable */
+#define quicklistDecompressNodeForUse(_node)                                   \
+    do {                                                                       \
+        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+            __quicklistDecompressNode((_node));                                \
+            (_node)->recompress = 1;                                           \
+        }                                                                      \
+    } while (0)
+
+/* Extract the raw LZF data from this quicklistNode.
+ * Pointer to LZF data is assigned to '*data'.
+ * Return value is the length of compressed LZF data. */
+size_t quicklistGetLzf(const quicklistNode *node, void **data) {
+    quicklistLZF *lzf = (quicklistLZF *)node->zl;
+    *data = lzf->compressed;
+    return lzf->sz;
+}
+
+#define quicklistAllowsCompression(_ql) ((_ql)->compress != 0)
+
+/* Enforce the compression depth of 'quicklist': the 'compress' nodes at
+ * both ends are decompressed, while the first nodes past them and 'node'
+ * itself, if it is not one of the end nodes, are compressed.
+ *
+ * All the other nodes are already compressed, so calling this every time
+ * a node is added, removed or modified keeps the whole list consistent. */
+static void __quicklistCompress(const quicklist *quicklist,
+                                quicklistNode *node) {
+    quicklistNode *forward, *reverse;
+    int depth = 0;
+    int in_depth = 0;
+
+    if (!quicklistAllowsCompression(quicklist)) return;
+
+    forward = quicklist->head;
+    reverse = quicklist->tail;
+    while (depth++ < quicklist->compress) {
+        quicklistDecompressNode(forward);
+        quicklistDecompressNode(reverse);
+
+        if (forward == node || reverse == node) in_depth = 1;
+
+        /* The ends met: no node is far enough from them to be compressed. */
+        if (forward == reverse || forward->next == reverse) return;
+
+        forward = forward->next;
+        reverse = reverse->prev;
+    }
+
+    if (!in_depth) quicklistCompressNode(node);
+
+    /* Nodes that just moved out of the uncompressed ends. */
+    quicklistCompressNode(forward);
+    quicklistCompressNode(reverse);
+}
+
+#define quicklistCompress(_ql, _node) __quicklistCompress((_ql), (_node))
+
+/* If we previously used quicklistDecompressNodeForUse(), just recompress. */
+#define quicklistRecompressOnly(_ql, _node)                                    \
+    do {                                                                       \
+        if ((_node)->recompress) __quicklistCompress((_ql), (_node));          \
+    } while (0)
+
+/* Insert 'new_node' after 'old_node' if 'after' is 1.
+ * Insert 'new_node' before 'old_node' if 'after' is 0.
+ * Note: 'new_node' is *always* uncompressed, so if we assign it to
+ *       head or tail, we do not need to uncompress it. */
+static void __quicklistInsertNode(quicklist *quicklist,
+                                  quicklistNode *old_node,
+                                  quicklistNode *new_node, int after) {
+    if (after) {
+        new_node->prev = old_node;
+        if (old_node) {
+            new_node->next = old_node->next;
+            if (old_node->next)
+                old_node->next->prev = new_node;
+            old_node->next = new_node;
+        }
+        if (quicklist->tail == old_node)
+            quicklist->tail = new_node;
+    } else {
+        new_node->next = old_node;
+        if (old_node) {
+            new_node->prev = old_node->prev;
+            if (old_node->prev)
+                old_node->prev->next = new_node;
+            old_node->prev = new_node;
+        }
+        if (quicklist->head == old_node)
+            quicklist->head = new_node;
+    }
+    /* If this insert creates the only element so far, initialize head/tail. */
+    if (quicklist->len == 0) {
+        quicklist->head = quicklist->tail = new_node;
+    }
+
+    quicklist->len++;
+    quicklistCompress(quicklist, new_node);
+}
+
+/* Wrappers for node inserting around existing node. */
+static void _quicklistInsertNodeBefore(quicklist *quicklist,
+                                       quicklistNode *old_node,
+                                       quicklistNode *new_node) {
+    __quicklistInsertNode(quicklist, old_node, new_node, 0);
+}
+
+static void _quicklistInsertNodeAfter(quicklist *quicklist,
+                                      quicklistNode *old_node,
+                                      quicklistNode *new_node) {
+    __quicklistInsertNode(quicklist, old_node, new_node, 1);
+}
+
+static int
+_quicklistNodeSizeMeetsOptimizationRequirement(const size_t sz,
+                                               const int fill) {
+    size_t offset;
+
+    if (fill >= 0) return 0;
+
+    offset = (-fill) - 1;
+    if (offset < (sizeof(optimization_level) / sizeof(*optimization_level))) {
+        if (sz <= optimization_level[offset]) {
+            return 1;
+        } else {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+}
+
+#define sizeMeetsSafetyLimit(sz) ((sz) <= SIZE_SAFETY_LIMIT)
+
+/* Return 1 if 'sz' more bytes can be added to the listpack of 'node'
+ * without going over the 'fill' limits. */
+static int _quicklistNodeAllowInsert(const quicklistNode *node,
+                                     const int fill, const size_t sz) {
+    size_t new_sz;
+
+    if (!node) return 0;
+
+    /* new_sz overestimates if 'sz' encodes to an integer type */
+    new_sz = node->sz + sz + lpEntryOverhead(sz);
+    if (_quicklistNodeSizeMeetsOptimizationRequirement(new_sz, fill))
+        return 1;
+    else if (!sizeMeetsSafetyLimit(new_sz))
+        return 0;
+    else if ((int)node->count < fill)
+        return 1;
+    else
+        return 0;
+}
+
+/* Return 1 if the listpacks of 'a' and 'b' can be merged in a single node
+ * without going over the 'fill' limits. */
+static int _quicklistNodeAllowMerge(const quicklistNode *a,
+                                    const quicklistNode *b,
+                                    const int fill) {
+    size_t merge_sz;
+
+    if (!a || !b) return 0;
+
+    /* approximate merged listpack size (- 7 to remove one listpack
+     * header/trailer) */
+    merge_sz = a->sz + b->sz - 7;
+    if (_quicklistNodeSizeMeetsOptimizationRequirement(merge_sz, fill))
+        return 1;
+    else if (!sizeMeetsSafetyLimit(merge_sz))
+        return 0;
+    else if ((int)(a->count + b->count) <= fill)
+        return 1;
+    else
+        return 0;
+}
+
+#define quicklistNodeUpdateSz(node)                                            \
+    do {                                                                       \
+        (node)->sz = lpBytes((node)->zl);                               \
+    } while (0)
+
+/* Add new entry to head node of quicklist.
+ *
+ * Returns 0 if used existing head.
+ * Returns 1 if new head created. */
+int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
+    quicklistNode *orig_head = quicklist->head;
+    if (_quicklistNodeAllowInsert(quicklist->head, quicklist->fill, sz)) {
+        quicklist->head->zl =
+            lpPush(quicklist->head->zl, value, sz, LISTPACK_HEAD);
+        quicklistNodeUpdateSz(quicklist->head);
+    } else {
+        quicklistNode *node = quicklistCreateNode();
+        node->zl = lpPush(lpNew(), value, sz, LISTPACK_HEAD);
+
+        quicklistNodeUpdateSz(node);
+        _quicklistInsertNodeBefore(quicklist, quicklist->head, node);
+    }
+    quicklist->count++;
+    quicklist->head->count++;
+    return (orig_head != quicklist->head);
+}
+
+/* Add new entry to tail node of quicklist.
+ *
+ * Returns 0 if used existing tail.
+ * Returns 1 if new tail created. */
+int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
+    quicklistNode *orig_tail = quicklist->tail;
+    if (_quicklistNodeAllowInsert(quicklist->tail, quicklist->fill, sz)) {
+        quicklist->tail->zl =
+            lpPush(quicklist->tail->zl, value, sz, LISTPACK_TAIL);
+        quicklistNodeUpdateSz(quicklist->tail);
+    } else {
+        quicklistNode *node = quicklistCreateNode();
+        node->zl = lpPush(lpNew(), value, sz, LISTPACK_TAIL);
+
+        quicklistNodeUpdateSz(node);
+        _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
+    }
+    quicklist->count++;
+    quicklist->tail->count++;
+    return (orig_tail != quicklist->tail);
+}
+
+/* Wrapper to allow argument-based switching between HEAD/TAIL pop */
+void quicklistPush(quicklist *quicklist, void *value, const size_t sz,
+                   int where) {
+    if (where == QUICKLIST_HEAD) {
+        quicklistPushHead(quicklist, value, sz);
+    } else if (where == QUICKLIST_TAIL) {
+        quicklistPushTail(quicklist, value, sz);
+    }
+}
+
+/* Create new node consisting of a pre-formed listpack.
+ * Used for loading RDBs where entire listpacks have been stored
+ * to be retrieved later. The quicklist takes ownership of 'zl'. */
+void quicklistAppendListpack(quicklist *quicklist, unsigned char *zl) {
+    quicklistNode *node = quicklistCreateNode();
+
+    node->zl = zl;
+    node->count = lpLength(node->zl);
+    node->sz = lpBytes(zl);
+
+    _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
+    quicklist->count += node->count;
+}
+
+/* Append all values of listpack 'zl' individually into 'quicklist'.
+ *
+ * This allows us to restore old RDB listpacks into new quicklists
+ * with smaller listpack sizes than the saved RDB listpack.
+ *
+ * Returns 'quicklist' argument. Frees passed-in listpack 'zl' */
+static quicklist *quicklistAppendValuesFromListpack(quicklist *quicklist,
+                                                    unsigned char *zl) {
+    unsigned char *value;
+    unsigned int sz;
+    long long longval;
+    char longstr[32] = {0};
+
+    unsigned char *p = lpIndex(zl, 0);
+    while (lpGet(p, &value, &sz, &longval)) {
+        if (!value) {
+            /* Write the longval as a string so we can re-add it */
+            sz = ll2string(longstr, sizeof(longstr), longval);
+            value = (unsigned char *)longstr;
+        }
+        quicklistPushTail(quicklist, value, sz);
+        p = lpNext(zl, p);
+    }
+    zfree(zl);
+    return quicklist;
+}
+
+/* Create new (potentially multi-node) quicklist from a single existing
+ * listpack. Frees passed-in listpack 'zl'. */
+quicklist *quicklistCreateFromListpack(int fill, int compress,
+                                       unsigned char *zl) {
+    return quicklistAppendValuesFromListpack(quicklistNew(fill, compress), zl);
+}
+
+/* Unlink 'node' from the list and free it, then enforce the compression
+ * depth, as other nodes may have moved near the ends. */
+static void __quicklistDelNode(quicklist *quicklist, quicklistNode *node) {
+    if (node->next)
+        node->next->prev = node->prev;
+    if (node->prev)
+        node->prev->next = node->next;
+
+    if (node == quicklist->tail) {
+        quicklist->tail = node->prev;
+    }
+
+    if (node == quicklist->head) {
+        quicklist->head = node->next;
+    }
+
+    quicklist->count -= node->count;
+
+    zfree(node->zl);
+    zfree(node);
+    quicklist->len--;
+
+    quicklistCompress(quicklist, NULL);
+}
+
+/* Delete one entry from list given the node for the entry and a pointer
+ * to the entry in the node.
+ *
+ * Note: quicklistDelIndex() *requires* uncompressed nodes because you
+ *       already had to get *p from an uncompressed node somewhere.
+ *
+ * Returns 1 if the entire node was deleted, 0 if node still exists.
+ * Also updates in/out param 'p' with the next offset in the listpack. */
+static int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
+                             unsigned char **p) {
+    int gone = 0;
+
+    node->zl = lpDelete(node->zl, p);
+    node->count--;
+    if (node->count == 0) {
+        gone = 1;
+        __quicklistDelNode(quicklist, node);
+    } else {
+        quicklistNodeUpdateSz(node);
+    }
+    quicklist->count--;
+    /* If we deleted the node, the original node is no longer valid */
+    return gone ? 1 : 0;
+}
+
+/* Delete one element represented by 'entry'
+ *
+ * 'entry' stores enough metadata to delete the proper position in
+ * the correct listpack in the correct quicklist node. */
+void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry) {
+    quicklistNode *prev = entry->node->prev;
+    quicklistNode *next = entry->node->next;
+    int deleted_node = quicklistDelIndex((quicklist *)entry->quicklist,
+                                         entry->node, &entry->zi);
+
+    /* after delete, the zi is now invalid for any future usage. */
+    iter->zi = NULL;
+
+    /* If current node is deleted, we must update iterator node and offset. */
+    if (deleted_node) {
+        if (iter->direction == AL_START_HEAD) {
+            iter->current = next;
+            iter->offset = 0;
+        } else if (iter->direction == AL_START_TAIL) {
+            iter->current = prev;
+            iter->offset = -1;
+        }
+    }
+    /* else if (!deleted_node), no changes needed.
+     * we already reset iter->zi above, and the existing iter->offset
+     * doesn't move again because:
+     *   - [1, 2, 3] => delete offset 1 => [1, 3]: next element still offset 1
+     *   - [1, 2, 3] => delete offset 0 => [2, 3]: next element still offset 0
+     *  if we deleted the last element at offet N and now
+     *  length of this listpack is N-1, the next call into
+     *  quicklistNext() will jump to the next node. */
+}
+
+/* Replace quicklist entry at offset 'index' by 'data' with length 'sz'.
+ *
+ * Returns 1 if replace happened.
+ * Returns 0 if replace failed and no changes happened. */
+int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data,
+                            int sz) {
+    quicklistEntry entry;
+    if (quicklistIndex(quicklist, index, &entry)) {
+        /* quicklistIndex provides an uncompressed node */
+        entry.node->zl = lpDelete(entry.node->zl, &entry.zi);
+        entry.node->zl = lpInsert(entry.node->zl, entry.zi, data, sz);
+        quicklistNodeUpdateSz(entry.node);
+        quicklistCompress(quicklist, entry.node);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* Move all the entries of the listpack of 'other' into the listpack of
+ * 'keep', at the head if 'other' is the previous node, at the tail if it
+ * is the next one, then delete 'other'. Both nodes must be uncompressed. */
+static void _quicklistListpackMerge(quicklist *quicklist, quicklistNode *keep,
+                                    quicklistNode *other) {
+    int at_head = (other == keep->prev);
+    unsigned char *p = lpIndex(other->zl, at_head ? -1 : 0);
+    unsigned char *value;
+    unsigned int sz;
+    long long longval;
+    char longstr[32];
+
+    while (lpGet(p, &value, &sz, &longval)) {
+        if (!value) {
+            sz = ll2string(longstr, sizeof(longstr), longval);
+            value = (unsigned char *)longstr;
+        }
+        keep->zl = lpPush(keep->zl, value, sz,
+                          at_head ? LISTPACK_HEAD : LISTPACK_TAIL);
+        p = at_head ? lpPrev(other->zl, p) : lpNext(other->zl, p);
+    }
+    keep->count += other->count;
+    quicklistNodeUpdateSz(keep);
+
+    /* The entries moved to 'keep' are still part of the list. */
+    other->count = 0;
+    __quicklistDelNode(quicklist, other);
+}
+
+/* Attempt to merge the listpacks of the nodes on either side of 'center'
+ * into 'center' itself:
+ *   - (center->prev, center)
+ *   - (center, center->next)
+ *
+ * Called after splitting a node, so that inserting in the middle of a list
+ * many times doesn't leave a trail of half empty nodes. 'center' is never
+ * deleted, so an iterator positioned on it stays valid. */
+static void _quicklistMergeNodes(quicklist *quicklist, quicklistNode *center) {
+    int fill = quicklist->fill;
+
+    if (_quicklistNodeAllowMerge(center->prev, center, fill)) {
+        quicklistDecompressNode(center->prev);
+        quicklistDecompressNode(center);
+        _quicklistListpackMerge(quicklist, center, center->prev);
+        quicklistCompress(quicklist, center);
+    }
+
+    if (_quicklistNodeAllowMerge(center, center->next, fill)) {
+        quicklistDecompressNode(center);
+        quicklistDecompressNode(center->next);
+        _quicklistListpackMerge(quicklist, center, center->next);
+        quicklistCompress(quicklist, center);
+    }
+}
+
+/* Split 'node' into two parts, parameterized by 'offset' and 'after'.
+ *
+ * The 'after' argument controls which quicklistNode gets returned.
+ * If 'after'==1, returned node has elements after 'offset'.
+ *                input node keeps elements up to 'offset', including 'offset'.
+ * If 'after'==0, returned node has elements up to 'offset', excluding 'offset'.
+ *                input node keeps elements after 'offset', including 'offset'.
+ *
+ * 'node' must be uncompressed and 'offset' not negative.
+ *
+ * Returns newly created node or NULL if split not possible. */
+static quicklistNode *_quicklistSplitNode(quicklistNode *node, int offset,
+                                          int after) {
+    size_t zl_sz = node->sz;
+    quicklistNode *new_node = quicklistCreateNode();
+    int orig_start = after ? offset + 1 : 0;
+    int orig_extent = after ? -1 : offset;
+    int new_start = after ? 0 : offset;
+    int new_extent = after ? offset + 1 : -1;
+
+    new_node->zl = zmalloc(zl_sz);
+
+    /* Copy original listpack so we can split it */
+    memcpy(new_node->zl, node->zl, zl_sz);
+
+    /* -1 here means "continue deleting until the list ends" */
+    node->zl = lpDeleteRange(node->zl, orig_start, orig_extent);
+    node->count = lpLength(node->zl);
+    quicklistNodeUpdateSz(node);
+
+    new_node->zl = lpDeleteRange(new_node->zl, new_start, new_extent);
+    new_node->count = lpLength(new_node->zl);
+    quicklistNodeUpdateSz(new_node);
+
+    return new_node;
+}
+
+/* Insert a new entry before or after existing entry 'entry'.
+ *
+ * If after==1, the new value is inserted after 'entry', otherwise
+ * the new value is inserted before 'entry'. */
+static void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
+                             void *value, const size_t sz, int after) {
+    int full = 0, at_tail = 0, at_head = 0, full_next = 0, full_prev = 0;
+    int fill = quicklist->fill;
+    quicklistNode *node = entry->node;
+    quicklistNode *new_node = NULL;
+    int offset;
+
+    if (!node) {
+        /* we have no reference node, so let's create only node in the list */
+        new_node = quicklistCreateNode();
+        new_node->zl = lpPush(lpNew(), value, sz, LISTPACK_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        __quicklistInsertNode(quicklist, NULL, new_node, after);
+        quicklist->count++;
+        return;
+    }
+
+    offset = entry->offset < 0 ? (int)node->count + entry->offset
+                               : entry->offset;
+
+    /* Populate accounting flags for easier boolean checks later */
+    if (!_quicklistNodeAllowInsert(node, fill, sz)) full = 1;
+
+    if (after && offset == (int)node->count - 1) {
+        at_tail = 1;
+        if (!_quicklistNodeAllowInsert(node->next, fill, sz)) full_next = 1;
+    }
+
+    if (!after && offset == 0) {
+        at_head = 1;
+        if (!_quicklistNodeAllowInsert(node->prev, fill, sz)) full_prev = 1;
+    }
+
+    /* Now determine where and how to insert the new element */
+    if (!full && after) {
+        unsigned char *next;
+
+        quicklistDecompressNodeForUse(node);
+        next = lpNext(node->zl, entry->zi);
+        if (next == NULL) {
+            node->zl = lpPush(node->zl, value, sz, LISTPACK_TAIL);
+        } else {
+            node->zl = lpInsert(node->zl, next, value, sz);
+        }
+        node->count++;
+        quicklistNodeUpdateSz(node);
+        quicklistRecompressOnly(quicklist, node);
+    } else if (!full && !after) {
+        quicklistDecompressNodeForUse(node);
+        node->zl = lpInsert(node->zl, entry->zi, value, sz);
+        node->count++;
+        quicklistNodeUpdateSz(node);
+        quicklistRecompressOnly(quicklist, node);
+    } else if (full && at_tail && node->next && !full_next && after) {
+        /* If we are: at tail, next has free space, and inserting after:
+         *   - insert entry at head of next node. */
+        new_node = node->next;
+        quicklistDecompressNodeForUse(new_node);
+        new_node->zl = lpPush(new_node->zl, value, sz, LISTPACK_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        quicklistRecompressOnly(quicklist, new_node);
+        quicklistRecompressOnly(quicklist, node);
+    } else if (full && at_head && node->prev && !full_prev && !after) {
+        /* If we are: at head, previous has free space, and inserting before:
+         *   - insert entry at tail of previous node. */
+        new_node = node->prev;
+        quicklistDecompressNodeForUse(new_node);
+        new_node->zl = lpPush(new_node->zl, value, sz, LISTPACK_TAIL);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        quicklistRecompressOnly(quicklist, new_node);
+        quicklistRecompressOnly(quicklist, node);
+    } else if (full && ((at_tail && after) || (at_head && !after))) {
+        /* If we are: full, and our neighbor is missing or full too:
+         *   - create new node and attach to quicklist */
+        new_node = quicklistCreateNode();
+        new_node->zl = lpPush(lpNew(), value, sz, LISTPACK_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        __quicklistInsertNode(quicklist, node, new_node, after);
+        quicklistRecompressOnly(quicklist, node);
+    } else if (full) {
+        /* else, node is full we need to split it. */
+        /* covers both after and !after cases */
+        quicklistDecompressNodeForUse(node);
+        new_node = _quicklistSplitNode(node, offset, after);
+        new_node->zl = lpPush(new_node->zl, value, sz,
+                              after ? LISTPACK_HEAD : LISTPACK_TAIL);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        __quicklistInsertNode(quicklist, node, new_node, after);
+        quicklistCompress(quicklist, node);
+        _quicklistMergeNodes(quicklist, node);
+    }
+
+    quicklist->count++;
+}
+
+void quicklistInsertBefore(quicklist *quicklist, quicklistEntry *entry,
+                           void *value, const size_t sz) {
+    _quicklistInsert(quicklist, entry, value, sz, 0);
+}
+
+void quicklistInsertAfter(quicklist *quicklist, quicklistEntry *entry,
+                          void *value, const size_t sz) {
+    _quicklistInsert(quicklist, entry, value, sz, 1);
+}
+
+/* Delete a range of elements from the quicklist.
+ *
+ * elements may span across multiple quicklistNodes, so we
+ * have to be careful about tracking where we start and end.
+ *
+ * Returns 1 if entries were deleted, 0 if nothing was deleted. */
+int quicklistDelRange(quicklist *quicklist, const long start,
+                      const long count) {
+    quicklistEntry entry;
+    quicklistNode *node;
+    unsigned long extent = count; /* range is inclusive of start position */
+    long offset;
+
+    if (count <= 0) return 0;
+
+    if (start >= 0 && extent > (quicklist->count - start)) {
+        /* if requesting delete more elements than exist, limit to list size. */
+        extent = quicklist->count - start;
+    } else if (start < 0 && extent > (unsigned long)(-start)) {
+        /* else, if at negative offset, limit max size to rest of list. */
+        extent = -start; /* c.f. LREM -29 29; just delete until end. */
+    }
+
+    if (!quicklistIndex(quicklist, start, &entry)) return 0;
+
+    node = entry.node;
+    offset = entry.offset < 0 ? (long)node->count + entry.offset
+                              : entry.offset;
+
+    /* iterate over next nodes until everything is deleted. */
+    while (extent) {
+        quicklistNode *next = node->next;
+        unsigned long del;
+
+        if (offset == 0 && extent >= node->count) {
+            /* If we are deleting more than the count of this node, we
+             * can just delete the entire node without listpack math. */
+            del = node->count;
+            __quicklistDelNode(quicklist, node);
+        } else {
+            /* Delete from 'offset' up to the end of the node, or less if
+             * the range ends in this node. */
+            del = node->count - offset;
+            if (del > extent) del = extent;
+
+            quicklistDecompressNodeForUse(node);
+            node->zl = lpDeleteRange(node->zl, offset, del);
+            quicklistNodeUpdateSz(node);
+            node->count -= del;
+            quicklist->count -= del;
+            quicklistRecompressOnly(quicklist, node);
+        }
+
+        extent -= del;
+        node = next;
+        offset = 0;
+    }
+    return 1;
+}
+
+/* Passthrough to lpCompare() */
+int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len) {
+    return lpCompare(p1, p2, p2_len);
+}
+
+/* Returns a quicklist iterator 'iter'. After the initialization every
+ * call to quicklistNext() will return the next element of the quicklist. */
+quicklistIter *quicklistGetIterator(const quicklist *quicklist,
+                                    int direction) {
+    quicklistIter *iter;
+
+    iter = zmalloc(sizeof(*iter));
+
+    if (direction == AL_START_HEAD) {
+        iter->current = quicklist->head;
+        iter->offset = 0;
+    } else {
+        iter->current = quicklist->tail;
+        iter->offset = -1;
+    }
+
+    iter->direction = direction;
+    iter->quicklist = quicklist;
+
+    iter->zi = NULL;
+
+    return iter;
+}
+
+/* Initialize an iterator at a specific offset 'idx' and make the iterator
+ * return nodes in 'direction' direction.
+ *
+ * Returns NULL if 'idx' is out of range. */
+quicklistIter *quicklistGetIteratorAtIdx(const quicklist *quicklist,
+                                         const int direction,
+                                         const long long idx) {
+    quicklistEntry entry;
+
+    if (quicklistIndex(quicklist, idx, &entry)) {
+        quicklistIter *base = quicklistGetIterator(quicklist, direction);
+        int count = entry.node->count;
+
+        base->zi = NULL;
+        base->current = entry.node;
+        /* Deleting while iterating relies on offsets counted from the
+         * side the iterator moves away from, see quicklistDelEntry(). */
+        if (direction == AL_START_HEAD)
+            base->offset = entry.offset < 0 ? count + entry.offset
+                                            : entry.offset;
+        else
+            base->offset = entry.offset >= 0 ? entry.offset - count
+                                             : entry.offset;
+        return base;
+    } else {
+        return NULL;
+    }
+}
+
+/* Release iterator.
+ * If we still have a valid current node, then re-encode current node. */
+void quicklistReleaseIterator(quicklistIter *iter) {
+    if (!iter) return;
+    if (iter->current)
+        quicklistCompress(iter->quicklist, iter->current);
+
+    zfree(iter);
+}
+
+/* Get next element in iterator.
+ *
+ * Note: You must NOT insert into the list while iterating over it.
+ * You *may* delete from the list while iterating using the
+ * quicklistDelEntry() function.
+ * If you insert into the quicklist while iterating, you should
+ * re-create the iterator after your addition.
+ *
+ * iter = quicklistGetIterator(quicklist,<direction>);
+ * quicklistEntry entry;
+ * while (quicklistNext(iter, &entry)) {
+ *     if (entry.value)
+ *          [[ use entry.value with entry.sz ]]
+ *     else
+ *          [[ use entry.longval ]]
+ * }
+ *
+ * Populates 'entry' with values for this iteration.
+ * Returns 0 when iteration is complete or if iteration not possible.
+ * If return value is 0, the contents of 'entry' are not valid.
+ */
+int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
+    if (!iter) return 0;
+
+    while (iter->current) {
+        if (!iter->zi) {
+            /* If !zi, use current index. */
+            quicklistDecompressNodeForUse(iter->current);
+            iter->zi = lpIndex(iter->current->zl, iter->offset);
+        } else {
+            if (iter->direction == AL_START_HEAD) {
+                iter->zi = lpNext(iter->current->zl, iter->zi);
+                iter->offset += 1;
+            } else {
+                iter->zi = lpPrev(iter->current->zl, iter->zi);
+                iter->offset -= 1;
+            }
+        }
+
+        if (iter->zi) {
+            entry->quicklist = iter->quicklist;
+            entry->node = iter->current;
+            entry->zi = iter->zi;
+            entry->offset = iter->offset;
+            entry->value = NULL;
+            entry->longval = -123456789;
+            entry->sz = 0;
+            lpGet(entry->zi, &entry->value, &entry->sz, &entry->longval);
+            return 1;
+        }
+
+        /* We ran out of listpack entries: move to the next node. */
+        quicklistCompress(iter->quicklist, iter->current);
+        if (iter->direction == AL_START_HEAD) {
+            iter->current = iter->current->next;
+            iter->offset = 0;
+        } else {
+            iter->current = iter->current->prev;
+            iter->offset = -1;
+        }
+        iter->zi = NULL;
+    }
+    return 0;
+}
+
+/* Populate 'entry' with the element at the specified zero-based index
+ * where 0 is the head, 1 is the element next to head
+ * and so on. Negative integers are used in order to count
+ * from the tail, -1 is the last element, -2 the penultimate
+ * and so on. If the index is out of range 0 is returned.
+ *
+ * The node of the entry is left decompressed for use: the caller is
+ * expected to modify it and then compress it again.
+ *
+ * Returns 1 if element found
+ * Returns 0 if element not found */
+int quicklistIndex(const quicklist *quicklist, const long long idx,
+                   quicklistEntry *entry) {
+    quicklistNode *n;
+    unsigned long long accum = 0;
+    unsigned long long index;
+    int forward = idx < 0 ? 0 : 1; /* < 0 -> reverse, 0+ -> forward */
+
+    entry->quicklist = quicklist;
+    entry->node = NULL;
+    entry->zi = NULL;
+    entry->value = NULL;
+    entry->longval = -123456789;
+    entry->sz = 0;
+    entry->offset = 0;
+
+    index = forward ? idx : (-idx) - 1;
+    if (index >= quicklist->count) return 0;
+
+    n = forward ? quicklist->head : quicklist->tail;
+    while (n) {
+        if ((accum + n->count) > index) {
+            break;
+        } else {
+            accum += n->count;
+            n = forward ? n->next : n->prev;
+        }
+    }
+
+    if (!n) return 0;
+
+    entry->node = n;
+    if (forward) {
+        /* forward = normal head-to-tail offset. */
+        entry->offset = index - accum;
+    } else {
+        /* reverse = need negative offset for tail-to-head, so undo
+         * the result of the original if (index < 0) above. */
+        entry->offset = (-index) - 1 + accum;
+    }
+
+    quicklistDecompressNodeForUse(entry->node);
+    entry->zi = lpIndex(entry->node->zl, entry->offset);
+    lpGet(entry->zi, &entry->value, &entry->sz, &entry->longval);
+    /* The caller will use our result, so we don't re-compress here.
+     * The caller can recompress or delete the node as needed. */
+    return 1;
+}
+
+/* Default pop function
+ *
+ * Returns malloc'd value from quicklist */
+static void *_quicklistSaver(unsigned char *data, unsigned int sz) {
+    unsigned char *vstr;
+    if (data) {
+        vstr = zmalloc(sz);
+        memcpy(vstr, data, sz);
+        return vstr;
+    }
+    return NULL;
+}
+
+/* pop from quicklist and return result in 'data' ptr.  Value of 'data'
+ * is the return value of 'saver' function pointer if the data is NOT a number.
+ *
+ * If the quicklist element is a long long, then the return value is returned in
+ * 'sval'.
+ *
+ * Return value of 0 means no elements available.
+ * Return value of 1 means check 'data' and 'sval' for values.
+ * If 'data' is set, use 'data' and 'sz'.  Otherwise, use 'sval'. */
+int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
+                       unsigned int *sz, long long *sval,
+                       void *(*saver)(unsigned char *data, unsigned int sz)) {
+    unsigned char *p;
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+    int pos = (where == QUICKLIST_HEAD) ? 0 : -1;
+    quicklistNode *node;
+
+    if (quicklist->count == 0) return 0;
+
+    if (data) *data = NULL;
+    if (sz) *sz = 0;
+    if (sval) *sval = -123456789;
+
+    /* The ends are never compressed. */
+    if (where == QUICKLIST_HEAD && quicklist->head) {
+        node = quicklist->head;
+    } else if (where == QUICKLIST_TAIL && quicklist->tail) {
+        node = quicklist->tail;
+    } else {
+        return 0;
+    }
+
+    p = lpIndex(node->zl, pos);
+    if (lpGet(p, &vstr, &vlen, &vlong)) {
+        if (vstr) {
+            if (data) *data = saver(vstr, vlen);
+            if (sz) *sz = vlen;
+        } else {
+            if (data) *data = NULL;
+            if (sval) *sval = vlong;
+        }
+        quicklistDelIndex(quicklist, node, &p);
+        return 1;
+    }
+    return 0;
+}
+
+/* Return a malloc'd copy of data popped from head or tail of quicklist */
+int quicklistPop(quicklist *quicklist, int where, unsigned char **data,
+                 unsigned int *sz, long long *slong) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+    if (quicklist->count == 0) return 0;
+    int ret = quicklistPopCustom(quicklist, where, &vstr, &vlen, &vlong,
+                                 _quicklistSaver);
+    if (data) *data = vstr;
+    if (slong) *slong = vlong;
+    if (sz) *sz = vlen;
+    return ret;
+}
+
+#ifdef QUICKLIST_TEST_MAIN
+#include <stdlib.h>
+#include <assert.h>
+
+/* Check the structure of 'ql': links, counts, sizes and that exactly the
+ * nodes far enough from the ends are compressed. */
+static void ql_verify(quicklist *ql) {
+    quicklistNode *node, *prev = NULL;
+    unsigned long count = 0;
+    unsigned int len = 0;
+
+    for (node = ql->head; node; prev = node, node = node->next) {
+        int from_head = len, from_tail;
+        quicklistNode *n;
+
+        for (from_tail = 0, n = node->next; n; n = n->next) from_tail++;
+        assert(node->prev == prev);
+        assert(node->count > 0);
+        count += node->count;
+        len++;
+
+        if (ql->compress &&
+            from_head >= ql->compress && from_tail >= ql->compress) {
+            assert(node->encoding == QUICKLIST_NODE_ENCODING_LZF ||
+                   node->attempted_compress);
+        } else {
+            assert(node->encoding == QUICKLIST_NODE_ENCODING_RAW);
+        }
+        if (node->encoding == QUICKLIST_NODE_ENCODING_RAW) {
+            assert(node->sz == lpBytes(node->zl));
+            assert(node->count == lpLength(node->zl));
+        }
+    }
+    assert(ql->tail == prev);
+    assert(ql->count == count);
+    assert(ql->len == len);
+}
+
+/* Values are either plain integers or "value-<n>" padded strings, so that
+ * nodes are big enough to be compressed. */
+static int ql_genvalue(char *buf, size_t len, long v) {
+    if (v % 2) return ll2string(buf, len, v);
+    return snprintf(buf, len, "value-%020ld", v);
+}
+
+static long ql_parse(unsigned char *p, unsigned int sz) {
+    char tmp[32];
+
+    assert(sz > 6 && sz < sizeof(tmp)+6 && memcmp(p, "value-", 6) == 0);
+    memcpy(tmp, p+6, sz-6);
+    tmp[sz-6] = '\0';
+    return strtol(tmp, NULL, 10);
+}
+
+static long ql_value(quicklistEntry *entry) {
+    if (entry->value == NULL) return entry->longval;
+    return ql_parse(entry->value, entry->sz);
+}
+
+/* Compare 'ql' with the model array of integers 'model'. */
+static void ql_check(quicklist *ql, long *model, long len) {
+    quicklistIter *iter;
+    quicklistEntry entry;
+    long i = 0;
+
+    ql_verify(ql);
+    assert(ql->count == (unsigned long)len);
+    iter = quicklistGetIterator(ql, AL_START_HEAD);
+    while (quicklistNext(iter, &entry)) {
+        assert(ql_value(&entry) == model[i]);
+        i++;
+    }
+    quicklistReleaseIterator(iter);
+    assert(i == len);
+    ql_verify(ql);
+}
+
+#define MODEL_MAX 4096
+
+int main(void) {
+    int fills[] = {1, 2, 7, 32, -1, -2};
+    int depths[] = {0, 1, 2, 4};
+    unsigned f, d;
+    long next = 0;
+
+    srand(1234);
+    for (f = 0; f < sizeof(fills)/sizeof(*fills); f++) {
+        for (d = 0; d < sizeof(depths)/sizeof(*depths); d++) {
+            quicklist *ql = quicklistNew(fills[f], depths[d]);
+            long model[MODEL_MAX];
+            long len = 0, i;
+            int op;
+
+            for (op = 0; op < 20000; op++) {
+                /* Weighted towards growing the list. */
+                static const int ops[] = {0,0,0,1,1,1,2,2,3,3,3,4,5,6,7,7};
+                int r = ops[rand() % 16];
+                char buf[32];
+                int sz;
+                long idx, j;
+
+                if (len >= MODEL_MAX-1) r = 2;
+                sz = ql_genvalue(buf, sizeof(buf), next);
+                if (r == 0) {
+                    quicklistPushHead(ql, buf, sz);
+                    memmove(model+1, model, sizeof(long)*len);
+                    model[0] = next++;
+                    len++;
+                } else if (r == 1) {
+                    quicklistPushTail(ql, buf, sz);
+                    model[len++] = next++;
+                } else if (r == 2) {
+                    unsigned char *data;
+                    unsigned int vlen;
+                    long long v;
+                    int where = rand() % 2 ? QUICKLIST_HEAD : QUICKLIST_TAIL;
+
+                    if (quicklistPop(ql, where, &data, &vlen, &v)) {
+                        if (data) {
+                            v = ql_parse(data, vlen);
+                            zfree(data);
+                        }
+                        if (where == QUICKLIST_HEAD) {
+                            assert(v == model[0]);
+                            memmove(model, model+1, sizeof(long)*(len-1));
+                        } else {
+                            assert(v == model[len-1]);
+                        }
+                        len--;
+                    } else {
+                        assert(len == 0);
+                    }
+                } else if (r == 3 && len) {
+                    quicklistEntry entry;
+                    int after = rand() % 2;
+
+                    idx = rand() % len;
+                    assert(quicklistIndex(ql, rand() % 2 ? idx : idx-len,
+                                          &entry));
+                    assert(ql_value(&entry) == model[idx]);
+                    if (after) {
+                        quicklistInsertAfter(ql, &entry, buf, sz);
+                        idx++;
+                    } else {
+                        quicklistInsertBefore(ql, &entry, buf, sz);
+                    }
+                    memmove(model+idx+1, model+idx, sizeof(long)*(len-idx));
+                    model[idx] = next++;
+                    len++;
+                } else if (r == 4 && len) {
+                    idx = rand() % len;
+                    assert(quicklistReplaceAtIndex(ql, idx, buf, sz));
+                    model[idx] = next++;
+                } else if (r == 5 && len) {
+                    long count = rand() % 4 + 1;
+
+                    idx = rand() % len;
+                    quicklistDelRange(ql, rand() % 2 ? idx : idx-len, count);
+                    if (count > len-idx) count = len-idx;
+                    memmove(model+idx, model+idx+count,
+                            sizeof(long)*(len-idx-count));
+                    len -= count;
+                } else if (r == 6 && len) {
+                    /* Delete some elements while iterating. */
+                    int dir = rand() % 2 ? AL_START_HEAD : AL_START_TAIL;
+                    quicklistIter *iter;
+                    quicklistEntry entry;
+                    long seen = 0;
+
+                    idx = rand() % len;
+                    iter = quicklistGetIteratorAtIdx(ql, dir,
+                                                     rand() % 2 ? idx : idx-len);
+                    j = 0;
+                    while (quicklistNext(iter, &entry)) {
+                        long pos = dir == AL_START_HEAD ? idx + seen
+                                                        : idx - seen;
+                        seen++;
+                        if (dir == AL_START_HEAD) pos -= j;
+                        assert(ql_value(&entry) == model[pos]);
+                        if (seen % 97 == 0) {
+                            quicklistDelEntry(iter, &entry);
+                            memmove(model+pos, model+pos+1,
+                                    sizeof(long)*(len-pos-1));
+                            len--;
+                            j++;
+                        }
+                    }
+                    quicklistReleaseIterator(iter);
+                } else if (r == 7 && len) {
+                    quicklistEntry entry;
+
+                    idx = rand() % len;
+                    assert(quicklistIndex(ql, idx, &entry));
+                    assert(ql_value(&entry) == model[idx]);
+                    quicklistCompress(ql, entry.node);
+                }
+                if (op % 97 == 0) ql_check(ql, model, len);
+            }
+            ql_check(ql, model, len);
+
+            /* Round trip through a listpack. */
+            {
+                unsigned char *zl = lpNew();
+                quicklist *copy;
+                char buf[32];
+
+                for (i = 0; i < len; i++) {
+                    int sz = ql_genvalue(buf, sizeof(buf), model[i]);
+                    zl = lpPush(zl, (unsigned char*)buf, sz,
+                                LISTPACK_TAIL);
+                }
+                copy = quicklistCreateFromListpack(fills[f], depths[d], zl);
+                ql_check(copy, model, len);
+                quicklistRelease(copy);
+            }
+            {
+                quicklistNode *n;
+                int compressed = 0;
+
+                for (n = ql->head; n; n = n->next)
+                    compressed += quicklistNodeIsCompressed(n);
+                printf("fill %d, compress %d: %lu entries in %u nodes, "
+                       "%d compressed: OK\n", fills[f], depths[d],
+                       ql->count, ql->len, compressed);
+            }
+            quicklistRelease(ql);
+        }
+    }
+    return 0;
+}
+#endif
@@ -33,6 +33,9 @@
 void rbtreeReleaseSubtree(rbNode *n);
 void rbtreeRotateLeft(rbtree *tree, rbNode *node);
 void rbtreeRotateRight(rbtree *tree, rbNode *node);
+void rbtreeUpdateLeftCount(rbNode *node, int incr);
+unsigned long rbtreeCountLess(rbtree *tree, robj *obj);
+rbNode *rbtreeBuildSubtree(robj **objs, unsigned long len, int depth, int reddepth);
 void rbtreeTransplantLeft(rbtree *tree, rbNode *node);
 void rbtreeTransplantRight(rbtree *tree, rbNode *node);
 
@@ -51,6 +54,8 @@ rbtree *rbtreeCreateWithCompare(int (*compare)(robj *v1, robj *v2))
     rbtree *t = zmalloc(sizeof(*t));
     t->root = NULL;
     t->compare = compare;
+    t->privdata = NULL;
+    t->length = 0;
     return t;
 }
 
@@ -169,6 +174,7 @@ void rbtreeRotateLeft(rbtree *tree, rbNode *node)
         right->left->parent = node;
 
     right->left = node;
+    right->left_count += node->left_count + 1;
 }
 
 void rbtreeRotateRight(rbtree *tree, rbNode *node)
@@ -196,12 +202,13 @@ void rbtreeRotateRight(rbtree *tree, rbNode *node)
         left->right->parent = node;
 
     left->right = node;
+    node->left_count -= left->left_count + 1;
 }
 
 rbNode *rbtreeInsert(rbtree *tree, robj *obj)
 {
     int c;
-    rbNode *parent = NULL, **node = &tree->root;
+    rbNode *parent = NULL, **node = &tree->root, *n;
     while ( *node ) {
         c = tree->compare((*node)->obj, obj);
         if ( c == 0 ) {
@@ -215,11 +222,28 @@ rbNode *rbtreeInsert(rbtree *tree, robj *obj)
         }
     }
 
-    *node = rbtreeCreateNode(obj);
-    (*node)->parent = parent;
+    /* Rotations done by the fixup may change what *node points to. */
+    n = *node = rbtreeCreateNode(obj);
+    n->parent = parent;
+
+    rbtreeUpdateLeftCount(n, 1);
+    rbtreeInsertFixup(tree, n);
+    tree->length++;
+    return n;
+}
 
-    rbtreeInsertFixup(tree, *node);
-    return *node;
+/* Every node keeps in left_count the number of nodes of its left subtree.
+ * When 'node' is linked into (incr = 1) or unlinked from (incr = -1) the
+ * tree, all the ancestors that reach it through their left child need to
+ * be updated. Rotations fix the counters of the two rotated nodes. */
+void rbtreeUpdateLeftCount(rbNode *node, int incr)
+{
+    rbNode *parent;
+    while ( (parent = node->parent) ) {
+        if ( parent->left == node )
+            parent->left_count += incr;
+        node = parent;
+    }
 }
 
 void rbtreeTransplantLeft(rbtree *tree, rbNode *node)
@@ -354,6 +378,8 @@ rbNode *rbtreeDeleteOneChildNode(rbtree *tree, rbNode *node)
     rbNode *fix = NULL;
     rbNode *parent = node->parent;
 
+    rbtreeUpdateLeftCount(node, -1);
+    tree->length--;
     if ( node->right ) {
         fix = node->right;
         rbtreeTransplantRight(tree, node);
@@ -483,4 +509,110 @@ rbNode *rbtreeMaximun(rbNode *n)
     return n;
 }
 
+/* Find the rank of the node holding an object equal to 'obj'.
+ * Returns 0 when the object cannot be found, rank otherwise.
+ * Like for the skiplist, the rank is 1-based. */
+unsigned long rbtreeRank(rbtree *tree, robj *obj)
+{
+    int c;
+    unsigned long rank = 0;
+    rbNode *n = tree->root;
+    while ( n ) {
+        c = tree->compare(n->obj, obj);
+        if ( c == 0 ) {
+            return rank + n->left_count + 1;
+        } else if ( c < 0 ) {
+            rank += n->left_count + 1;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return 0;
+}
+
+/* Finds a node by its rank. The rank argument needs to be 1-based. */
+rbNode *rbtreeSelect(rbtree *tree, unsigned long rank)
+{
+    rbNode *n = tree->root;
+    while ( n && rank ) {
+        if ( rank <= n->left_count ) {
+            n = n->left;
+        } else if ( rank == n->left_count + 1 ) {
+            return n;
+        } else {
+            rank -= n->left_count + 1;
+            n = n->right;
+        }
+    }
+    return NULL;
+}
+
+/* Number of nodes lower than 'obj'. */
+unsigned long rbtreeCountLess(rbtree *tree, robj *obj)
+{
+    unsigned long count = 0;
+    rbNode *n = tree->root;
+    while ( n ) {
+        if ( tree->compare(n->obj, obj) < 0 ) {
+            count += n->left_count + 1;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return count;
+}
+
+/* Count the nodes greater or equal than 'min' and lower than 'max' in
+ * O(log(N)), without visiting them. A NULL 'min' or 'max' means that the
+ * range is unbounded on that side. */
+unsigned long rbtreeCountRange(rbtree *tree, robj *min, robj *max)
+{
+    unsigned long start, end;
+
+    start = min ? rbtreeCountLess(tree, min) : 0;
+    end = max ? rbtreeCountLess(tree, max) : tree->length;
+    return (end > start) ? end - start : 0;
+}
+
+/* Build a perfectly balanced subtree from the sorted 'objs' array. All the
+ * nodes are black but the ones at depth 'reddepth', that is the last level
+ * of the tree when it is not complete: this way every path from the root
+ * crosses the same number of black nodes. */
+rbNode *rbtreeBuildSubtree(robj **objs, unsigned long len, int depth, int reddepth)
+{
+    unsigned long mid = len / 2;
+    rbNode *n;
+
+    if ( len == 0 ) return NULL;
+
+    n = rbtreeCreateNode(objs[mid]);
+    n->color = (depth == reddepth) ? RBNODE_RED : RBNODE_BLACK;
+    n->left_count = mid;
+    n->left = rbtreeBuildSubtree(objs, mid, depth+1, reddepth);
+    n->right = rbtreeBuildSubtree(objs+mid+1, len-mid-1, depth+1, reddepth);
+    if ( n->left ) n->left->parent = n;
+    if ( n->right ) n->right->parent = n;
+    return n;
+}
+
+/* Load 'len' objects, sorted in strictly increasing order by the tree
+ * compare function, into the empty tree 'tree' in O(N), without going
+ * through the rebalancing of N inserts. The reference count of every
+ * object is incremented, as rbtreeInsert() does. */
+void rbtreeBulkLoad(rbtree *tree, robj **objs, unsigned long len)
+{
+    int depth = 0;
+
+    redisAssert(tree->root == NULL);
+
+    /* 'depth' is the depth of the deepest level of the balanced tree. */
+    while ( (1UL << (depth+1)) - 1 < len )
+        depth++;
 
+    tree->root = rbtreeBuildSubtree(objs, len, 0,
+        ((1UL << (depth+1)) - 1 == len) ? -1 : depth);
+    if ( tree->root ) tree->root->color = RBNODE_BLACK;
+    tree->length = len;
+}
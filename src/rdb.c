@@ -209,10 +209,31 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
     return rdbEncodeInteger(value,enc);
 }
 
-int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
-    size_t comprlen, outlen;
+/* Save 'len' bytes already compressed with LZF into 'comprlen' bytes of
+ * 'data', in the format of a LZF encoded string. */
+int rdbSaveLzfBlob(rio *rdb, void *data, size_t comprlen, size_t len) {
     unsigned char byte;
     int n, nwritten = 0;
+
+    byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
+    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) return -1;
+    nwritten += n;
+
+    if ((n = rdbSaveLen(rdb,comprlen)) == -1) return -1;
+    nwritten += n;
+
+    if ((n = rdbSaveLen(rdb,len)) == -1) return -1;
+    nwritten += n;
+
+    if ((n = rdbWriteRaw(rdb,data,comprlen)) == -1) return -1;
+    nwritten += n;
+
+    return nwritten;
+}
+
+int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+    size_t comprlen, outlen;
+    int nwritten;
     void *out;
 
     /* We require at least four bytes compression for this to be worth it */
@@ -225,25 +246,9 @@ int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
         return 0;
     }
     /* Data compressed! Let's save it on disk */
-    byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
-    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
-    nwritten += n;
-
-    if ((n = rdbSaveLen(rdb,comprlen)) == -1) goto writeerr;
-    nwritten += n;
-
-    if ((n = rdbSaveLen(rdb,len)) == -1) goto writeerr;
-    nwritten += n;
-
-    if ((n = rdbWriteRaw(rdb,out,comprlen)) == -1) goto writeerr;
-    nwritten += n;
-
+    nwritten = rdbSaveLzfBlob(rdb,out,comprlen,len);
     zfree(out);
     return nwritten;
-
-writeerr:
-    zfree(out);
-    return -1;
 }
 
 robj *rdbLoadLzfStringObject(rio *rdb) {
@@ -325,7 +330,7 @@ int rdbSaveStringObject(rio *rdb, robj *obj) {
     if (obj->encoding == REDIS_ENCODING_INT) {
         return rdbSaveLongLongAsStringObject(rdb,(long)obj->ptr);
     } else {
-        redisAssertWithInfo(NULL,obj,obj->encoding == REDIS_ENCODING_RAW);
+        redisAssertWithInfo(NULL,obj,sdsEncodedObject(obj));
         return rdbSaveRawString(rdb,obj->ptr,sdslen(obj->ptr));
     }
 }
@@ -432,34 +437,40 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
     case REDIS_STRING:
         return rdbSaveType(rdb,REDIS_RDB_TYPE_STRING);
     case REDIS_LIST:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_ZIPLIST);
-        else if (o->encoding == REDIS_ENCODING_LINKEDLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST);
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_LISTPACK);
+        else if (o->encoding == REDIS_ENCODING_QUICKLIST)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_QUICKLIST_2);
         else
             redisPanic("Unknown list encoding");
     case REDIS_SET:
         if (o->encoding == REDIS_ENCODING_INTSET)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_SET_INTSET);
+        else if (o->encoding == REDIS_ENCODING_ROARING)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_SET_ROARING);
         else if (o->encoding == REDIS_ENCODING_HT)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_SET);
         else
             redisPanic("Unknown set encoding");
     case REDIS_ZSET:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_ZIPLIST);
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_LISTPACK);
         else if (o->encoding == REDIS_ENCODING_SKIPLIST)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET);
         else
             redisPanic("Unknown sorted set encoding");
     case REDIS_HASH:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_ZIPLIST);
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_LISTPACK);
+        else if (o->encoding == REDIS_ENCODING_HASHPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_HASHPACK);
         else if (o->encoding == REDIS_ENCODING_HT)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH);
         else
             redisPanic("Unknown hash encoding");
     default:
+        if (redisModuleTypeLookup(o->type))
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_MODULE);
         redisPanic("Unknown object type");
     }
     return -1; /* avoid warning */
@@ -476,6 +487,7 @@ int rdbLoadObjectType(rio *rdb) {
 
 /* Save a Redis object. Returns -1 on error, number of bytes written on success. */
 int rdbSaveObject(rio *rdb, robj *o) {
+    redisModuleType *mt;
     int n, nwritten = 0;
 
     if (o->type == REDIS_STRING) {
@@ -484,23 +496,28 @@ int rdbSaveObject(rio *rdb, robj *o) {
         nwritten += n;
     } else if (o->type == REDIS_LIST) {
         /* Save a list value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
-        } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-            list *list = o->ptr;
-            listIter li;
-            listNode *ln;
+        } else if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+            /* Save the listpacks of the nodes, compressed nodes as they
+             * are, without compressing them again. */
+            quicklist *ql = o->ptr;
+            quicklistNode *node = ql->head;
 
-            if ((n = rdbSaveLen(rdb,listLength(list))) == -1) return -1;
+            if ((n = rdbSaveLen(rdb,ql->len)) == -1) return -1;
             nwritten += n;
 
-            listRewind(list,&li);
-            while((ln = listNext(&li))) {
-                robj *eleobj = listNodeValue(ln);
-                if ((n = rdbSaveStringObject(rdb,eleobj)) == -1) return -1;
+            for (; node; node = node->next) {
+                if (quicklistNodeIsCompressed(node)) {
+                    void *data;
+                    size_t compress_len = quicklistGetLzf(node, &data);
+                    if ((n = rdbSaveLzfBlob(rdb,data,compress_len,node->sz)) == -1) return -1;
+                } else {
+                    if ((n = rdbSaveRawString(rdb,node->zl,node->sz)) == -1) return -1;
+                }
                 nwritten += n;
             }
         } else {
@@ -527,13 +544,22 @@ int rdbSaveObject(rio *rdb, robj *o) {
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
+        } else if (o->encoding == REDIS_ENCODING_ROARING) {
+            size_t l = roaringBlobLen(o->ptr);
+            unsigned char *blob = zmalloc(l);
+
+            roaringSerialize(o->ptr,blob);
+            n = rdbSaveRawString(rdb,blob,l);
+            zfree(blob);
+            if (n == -1) return -1;
+            nwritten += n;
         } else {
             redisPanic("Unknown set encoding");
         }
     } else if (o->type == REDIS_ZSET) {
         /* Save a sorted set value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
@@ -560,12 +586,22 @@ int rdbSaveObject(rio *rdb, robj *o) {
         }
     } else if (o->type == REDIS_HASH) {
         /* Save a hash value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
 
+        } else if (o->encoding == REDIS_ENCODING_HASHPACK) {
+            size_t l = hpBlobLen(o->ptr);
+            unsigned char *blob = zmalloc(l);
+
+            hpSerialize(o->ptr,blob);
+            n = rdbSaveRawString(rdb,blob,l);
+            zfree(blob);
+            if (n == -1) return -1;
+            nwritten += n;
+
         } else if (o->encoding == REDIS_ENCODING_HT) {
             dictIterator *di = dictGetIterator(o->ptr);
             dictEntry *de;
@@ -588,6 +624,14 @@ int rdbSaveObject(rio *rdb, robj *o) {
             redisPanic("Unknown hash encoding");
         }
 
+    } else if ((mt = redisModuleTypeLookup(o->type)) != NULL) {
+        /* Save the type name, so that the loading server can find the
+         * module type, then let the module serialize the value. */
+        if ((n = rdbSaveRawString(rdb,(unsigned char*)mt->name,
+                                  strlen(mt->name))) == -1) return -1;
+        nwritten += n;
+        if ((n = mt->rdb_save(rdb,o)) == -1) return -1;
+        nwritten += n;
     } else {
         redisPanic("Unknown object type");
     }
@@ -815,6 +859,27 @@ void rdbRemoveTempFile(pid_t childpid) {
     unlink(tmpfile);
 }
 
+/* Convert the ziplist blob 'zl', as stored by files written before
+ * listpacks, into a newly allocated listpack with the same entries. */
+static unsigned char *rdbListpackFromZiplist(unsigned char *zl) {
+    unsigned char *lp = lpNew();
+    unsigned char *p = ziplistIndex(zl,0);
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    char buf[32];
+
+    while (ziplistGet(p,&vstr,&vlen,&vll)) {
+        if (vstr == NULL) {
+            vlen = ll2string(buf,sizeof(buf),vll);
+            vstr = (unsigned char*)buf;
+        }
+        lp = lpPush(lp,vstr,vlen,LISTPACK_TAIL);
+        p = ziplistNext(zl,p);
+    }
+    return lp;
+}
+
 /* Load a Redis object of the specified type from the specified file.
  * On success a newly allocated object is returned, otherwise NULL. */
 robj *rdbLoadObject(int rdbtype, rio *rdb) {
@@ -830,45 +895,42 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Read list value */
         if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
 
-        /* Use a real list when there are too many entries */
+        /* Use a quicklist when there are too many entries */
         if (len > server.list_max_ziplist_entries) {
-            o = createListObject();
+            o = createQuicklistObject();
         } else {
-            o = createZiplistObject();
+            o = createListpackObject();
         }
 
         /* Load every single element of the list */
         while(len--) {
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
 
-            /* If we are using a ziplist and the value is too big, convert
-             * the object to a real list. */
-            if (o->encoding == REDIS_ENCODING_ZIPLIST &&
-                ele->encoding == REDIS_ENCODING_RAW &&
+            /* If we are using a listpack and the value is too big, convert
+             * the object to a quicklist. */
+            if (o->encoding == REDIS_ENCODING_LISTPACK &&
+                sdsEncodedObject(ele) &&
                 sdslen(ele->ptr) > server.list_max_ziplist_value)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
+                    listTypeConvert(o,REDIS_ENCODING_QUICKLIST);
 
-            if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-                dec = getDecodedObject(ele);
-                o->ptr = ziplistPush(o->ptr,dec->ptr,sdslen(dec->ptr),REDIS_TAIL);
-                decrRefCount(dec);
-                decrRefCount(ele);
+            dec = getDecodedObject(ele);
+            if (o->encoding == REDIS_ENCODING_LISTPACK) {
+                o->ptr = lpPush(o->ptr,dec->ptr,sdslen(dec->ptr),REDIS_TAIL);
             } else {
-                ele = tryObjectEncoding(ele);
-                listAddNodeTail(o->ptr,ele);
+                quicklistPushTail(o->ptr,dec->ptr,sdslen(dec->ptr));
             }
+            decrRefCount(dec);
+            decrRefCount(ele);
         }
     } else if (rdbtype == REDIS_RDB_TYPE_SET) {
         /* Read list/set value */
         if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
 
-        /* Use a regular set when there are too many entries. */
+        /* Use a roaring bitmap when there are too many entries for an
+         * intset. Sets that are not made of integers are converted to a
+         * regular set as soon as a non integer element is found. */
         if (len > server.set_max_intset_entries) {
-            o = createSetObject();
-            /* It's faster to expand the dict to the right size asap in order
-             * to avoid rehashing */
-            if (len > DICT_HT_INITIAL_SIZE)
-                dictExpand(o->ptr,len);
+            o = createRoaringObject();
         } else {
             o = createIntsetObject();
         }
@@ -887,6 +949,21 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     setTypeConvert(o,REDIS_ENCODING_HT);
                     dictExpand(o->ptr,len);
                 }
+            } else if (o->encoding == REDIS_ENCODING_ROARING) {
+                if (isObjectRepresentableAsLongLong(ele,&llval) == REDIS_OK) {
+                    roaringAdd(o->ptr,llval);
+                    /* The element is part of the set even if a too sparse
+                     * bitmap is converted to a regular set here. */
+                    setTypeCheckRoaring(o);
+                    if (o->encoding == REDIS_ENCODING_HT)
+                        dictExpand(o->ptr,len);
+                    decrRefCount(ele);
+                    continue;
+                }
+                setTypeConvert(o,REDIS_ENCODING_HT);
+                /* It's faster to expand the dict to the right size asap in
+                 * order to avoid rehashing */
+                dictExpand(o->ptr,len);
             }
 
             /* This will also be called when the set was just converted
@@ -897,6 +974,28 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 decrRefCount(ele);
             }
         }
+        if (o->encoding == REDIS_ENCODING_ROARING) roaringOptimize(o->ptr);
+    } else if (rdbtype == REDIS_RDB_TYPE_SET_ROARING) {
+        robj *aux = rdbLoadStringObject(rdb);
+        roaring *r;
+
+        if (aux == NULL) return NULL;
+        r = roaringDeserialize(aux->ptr,sdslen(aux->ptr));
+        decrRefCount(aux);
+        if (r == NULL) {
+            redisLog(REDIS_WARNING,"Invalid roaring bitmap set in RDB file");
+            return NULL;
+        }
+        o = createObject(REDIS_SET,r);
+        o->encoding = REDIS_ENCODING_ROARING;
+
+        /* Sets are never saved empty, but don't trust the file. */
+        if (roaringCard(r) == 0) {
+            decrRefCount(o);
+            redisLog(REDIS_WARNING,"Empty roaring bitmap set in RDB file");
+            return NULL;
+        }
+        setTypeCheckRoaring(o);
     } else if (rdbtype == REDIS_RDB_TYPE_ZSET) {
         /* Read list/set value */
         size_t zsetlen;
@@ -918,7 +1017,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             if (rdbLoadDoubleValue(rdb,&score) == -1) return NULL;
 
             /* Don't care about integer-encoded strings. */
-            if (ele->encoding == REDIS_ENCODING_RAW &&
+            if (sdsEncodedObject(ele) &&
                 sdslen(ele->ptr) > maxelelen)
                     maxelelen = sdslen(ele->ptr);
 
@@ -930,7 +1029,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Convert *after* loading, since sorted sets are not stored ordered. */
         if (zsetLength(o) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(o,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(o,REDIS_ENCODING_LISTPACK);
     } else if (rdbtype == REDIS_RDB_TYPE_HASH) {
         size_t len;
         int ret;
@@ -940,29 +1039,61 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 
         o = createHashObject();
 
-        /* Too many entries? Use a hash table. */
-        if (len > server.hash_max_ziplist_entries)
+        /* Too many entries? Use a hashpack or a hash table. */
+        if (len > server.hash_max_hashpack_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
+        else if (len > server.hash_max_ziplist_entries)
+            hashTypeConvert(o, REDIS_ENCODING_HASHPACK);
 
-        /* Load every field and value into the ziplist */
-        while (o->encoding == REDIS_ENCODING_ZIPLIST && len > 0) {
+        /* Load every field and value into the listpack */
+        while (o->encoding == REDIS_ENCODING_LISTPACK && len > 0) {
             robj *field, *value;
 
             len--;
             /* Load raw strings */
             field = rdbLoadStringObject(rdb);
             if (field == NULL) return NULL;
-            redisAssert(field->encoding == REDIS_ENCODING_RAW);
+            redisAssert(sdsEncodedObject(field));
             value = rdbLoadStringObject(rdb);
             if (value == NULL) return NULL;
-            redisAssert(field->encoding == REDIS_ENCODING_RAW);
+            redisAssert(sdsEncodedObject(value));
 
-            /* Add pair to ziplist */
-            o->ptr = ziplistPush(o->ptr, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            o->ptr = ziplistPush(o->ptr, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
-            /* Convert to hash table if size threshold is exceeded */
+            /* Add pair to listpack */
+            o->ptr = lpPush(o->ptr, field->ptr, sdslen(field->ptr), LISTPACK_TAIL);
+            o->ptr = lpPush(o->ptr, value->ptr, sdslen(value->ptr), LISTPACK_TAIL);
+            /* Convert to hashpack if size threshold is exceeded */
             if (sdslen(field->ptr) > server.hash_max_ziplist_value ||
                 sdslen(value->ptr) > server.hash_max_ziplist_value)
+            {
+                decrRefCount(field);
+                decrRefCount(value);
+                hashTypeConvert(o, REDIS_ENCODING_HASHPACK);
+                break;
+            }
+            decrRefCount(field);
+            decrRefCount(value);
+        }
+
+        /* Load fields and values into the hashpack */
+        while (o->encoding == REDIS_ENCODING_HASHPACK && len > 0) {
+            robj *field, *value;
+
+            len--;
+            /* Load raw strings */
+            field = rdbLoadStringObject(rdb);
+            if (field == NULL) return NULL;
+            redisAssert(sdsEncodedObject(field));
+            value = rdbLoadStringObject(rdb);
+            if (value == NULL) return NULL;
+            redisAssert(sdsEncodedObject(value));
+
+            /* Add pair to hashpack */
+            ret = hpSet(o->ptr, field->ptr, sdslen(field->ptr),
+                        value->ptr, sdslen(value->ptr));
+            redisAssert(ret == 0);
+            /* Convert to hash table if size threshold is exceeded */
+            if (sdslen(field->ptr) > server.hash_max_hashpack_value ||
+                sdslen(value->ptr) > server.hash_max_hashpack_value)
             {
                 decrRefCount(field);
                 decrRefCount(value);
@@ -995,18 +1126,60 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* All pairs should be read by now */
         redisAssert(len == 0);
 
+    } else if (rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST ||
+               rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST_2)
+    {
+        /* Read the listpacks of the quicklist nodes, or the ziplists of
+         * files written before listpacks, converting them on the fly. */
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
+        o = createQuicklistObject();
+
+        while(len--) {
+            robj *aux = rdbLoadStringObject(rdb);
+            unsigned char *lp;
+
+            if (aux == NULL) {
+                decrRefCount(o);
+                return NULL;
+            }
+            if (rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST) {
+                lp = rdbListpackFromZiplist(aux->ptr);
+            } else {
+                lp = zmalloc(sdslen(aux->ptr));
+                memcpy(lp,aux->ptr,sdslen(aux->ptr));
+            }
+            decrRefCount(aux);
+
+            /* Nodes are never saved empty, but don't trust the file. */
+            if (lpLength(lp) == 0) {
+                zfree(lp);
+                continue;
+            }
+            quicklistAppendListpack(o->ptr,lp);
+        }
     } else if (rdbtype == REDIS_RDB_TYPE_HASH_ZIPMAP  ||
                rdbtype == REDIS_RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == REDIS_RDB_TYPE_SET_INTSET   ||
                rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST ||
-               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST)
+               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST ||
+               rdbtype == REDIS_RDB_TYPE_LIST_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_ZSET_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_HASH_LISTPACK)
     {
         robj *aux = rdbLoadStringObject(rdb);
 
         if (aux == NULL) return NULL;
         o = createObject(REDIS_STRING,NULL); /* string is just placeholder */
-        o->ptr = zmalloc(sdslen(aux->ptr));
-        memcpy(o->ptr,aux->ptr,sdslen(aux->ptr));
+        if (rdbtype == REDIS_RDB_TYPE_LIST_ZIPLIST ||
+            rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST ||
+            rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST)
+        {
+            /* Ziplists of old files are converted to listpacks. */
+            o->ptr = rdbListpackFromZiplist(aux->ptr);
+        } else {
+            o->ptr = zmalloc(sdslen(aux->ptr));
+            memcpy(o->ptr,aux->ptr,sdslen(aux->ptr));
+        }
         decrRefCount(aux);
 
         /* Fix the object encoding, and make sure to convert the encoded
@@ -1017,10 +1190,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
          * converted. */
         switch(rdbtype) {
             case REDIS_RDB_TYPE_HASH_ZIPMAP:
-                /* Convert to ziplist encoded hash. This must be deprecated
+                /* Convert to listpack encoded hash. This must be deprecated
                  * when loading dumps created by Redis 2.4 gets deprecated. */
                 {
-                    unsigned char *zl = ziplistNew();
+                    unsigned char *lp = lpNew();
                     unsigned char *zi = zipmapRewind(o->ptr);
                     unsigned char *fstr, *vstr;
                     unsigned int flen, vlen;
@@ -1029,50 +1202,90 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     while ((zi = zipmapNext(zi, &fstr, &flen, &vstr, &vlen)) != NULL) {
                         if (flen > maxlen) maxlen = flen;
                         if (vlen > maxlen) maxlen = vlen;
-                        zl = ziplistPush(zl, fstr, flen, ZIPLIST_TAIL);
-                        zl = ziplistPush(zl, vstr, vlen, ZIPLIST_TAIL);
+                        lp = lpPush(lp, fstr, flen, LISTPACK_TAIL);
+                        lp = lpPush(lp, vstr, vlen, LISTPACK_TAIL);
                     }
 
                     zfree(o->ptr);
-                    o->ptr = zl;
+                    o->ptr = lp;
                     o->type = REDIS_HASH;
-                    o->encoding = REDIS_ENCODING_ZIPLIST;
+                    o->encoding = REDIS_ENCODING_LISTPACK;
 
                     if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
                         maxlen > server.hash_max_ziplist_value)
                     {
-                        hashTypeConvert(o, REDIS_ENCODING_HT);
+                        hashTypeConvert(o, REDIS_ENCODING_HASHPACK);
                     }
                 }
                 break;
             case REDIS_RDB_TYPE_LIST_ZIPLIST:
+            case REDIS_RDB_TYPE_LIST_LISTPACK:
                 o->type = REDIS_LIST;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
-                if (ziplistLen(o->ptr) > server.list_max_ziplist_entries)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
+                o->encoding = REDIS_ENCODING_LISTPACK;
+                if (lpLength(o->ptr) > server.list_max_ziplist_entries)
+                    listTypeConvert(o,REDIS_ENCODING_QUICKLIST);
                 break;
             case REDIS_RDB_TYPE_SET_INTSET:
                 o->type = REDIS_SET;
                 o->encoding = REDIS_ENCODING_INTSET;
                 if (intsetLen(o->ptr) > server.set_max_intset_entries)
-                    setTypeConvert(o,REDIS_ENCODING_HT);
+                    setTypeConvert(o,REDIS_ENCODING_ROARING);
                 break;
             case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+            case REDIS_RDB_TYPE_ZSET_LISTPACK:
                 o->type = REDIS_ZSET;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
+                o->encoding = REDIS_ENCODING_LISTPACK;
                 if (zsetLength(o) > server.zset_max_ziplist_entries)
                     zsetConvert(o,REDIS_ENCODING_SKIPLIST);
                 break;
             case REDIS_RDB_TYPE_HASH_ZIPLIST:
+            case REDIS_RDB_TYPE_HASH_LISTPACK:
                 o->type = REDIS_HASH;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
+                o->encoding = REDIS_ENCODING_LISTPACK;
                 if (hashTypeLength(o) > server.hash_max_ziplist_entries)
-                    hashTypeConvert(o, REDIS_ENCODING_HT);
+                    hashTypeConvert(o, REDIS_ENCODING_HASHPACK);
                 break;
             default:
                 redisPanic("Unknown encoding");
                 break;
         }
+    } else if (rdbtype == REDIS_RDB_TYPE_HASH_HASHPACK) {
+        robj *aux = rdbLoadStringObject(rdb);
+        hashpack *hp;
+
+        if (aux == NULL) return NULL;
+        hp = hpDeserialize(aux->ptr,sdslen(aux->ptr));
+        decrRefCount(aux);
+        if (hp == NULL) {
+            redisLog(REDIS_WARNING,"Invalid hashpack hash in RDB file");
+            return NULL;
+        }
+        o = createObject(REDIS_HASH,hp);
+        o->encoding = REDIS_ENCODING_HASHPACK;
+
+        /* Hashes are never saved empty, but don't trust the file. */
+        if (hpLength(hp) == 0) {
+            decrRefCount(o);
+            redisLog(REDIS_WARNING,"Empty hashpack hash in RDB file");
+            return NULL;
+        }
+        if (hashTypeLength(o) > server.hash_max_hashpack_entries)
+            hashTypeConvert(o, REDIS_ENCODING_HT);
+    } else if (rdbtype == REDIS_RDB_TYPE_MODULE) {
+        redisModuleType *mt;
+        robj *name;
+
+        if ((name = rdbLoadStringObject(rdb)) == NULL) return NULL;
+        mt = redisModuleTypeLookupByName(name->ptr);
+        if (mt == NULL) {
+            redisLog(REDIS_WARNING,
+                "Value of module type '%s' found, but no module registered it",
+                (char*)name->ptr);
+            decrRefCount(name);
+            return NULL;
+        }
+        decrRefCount(name);
+        if ((o = mt->rdb_load(rdb)) == NULL) return NULL;
     } else {
         redisPanic("Unknown object type");
     }
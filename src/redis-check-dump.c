@@ -53,6 +53,13 @@
 #define REDIS_SET_INTSET 11
 #define REDIS_ZSET_ZIPLIST 12
 #define REDIS_HASH_ZIPLIST 13
+#define REDIS_LIST_QUICKLIST 14
+#define REDIS_LIST_LISTPACK 15
+#define REDIS_HASH_LISTPACK 16
+#define REDIS_ZSET_LISTPACK 17
+#define REDIS_LIST_QUICKLIST_2 18
+#define REDIS_SET_ROARING 19
+#define REDIS_HASH_HASHPACK 20
 
 /* Objects encoding. Some kind of objects like Strings and Hashes can be
  * internally represented in multiple ways. The 'encoding' field of the object
@@ -148,7 +155,7 @@ int checkType(unsigned char t) {
     /* In case a new object type is added, update the following
      * condition as necessary. */
     return
-        (t >= REDIS_HASH_ZIPMAP && t <= REDIS_HASH_ZIPLIST) ||
+        (t >= REDIS_HASH_ZIPMAP && t <= REDIS_HASH_HASHPACK) ||
         t <= REDIS_HASH ||
         t >= REDIS_EXPIRETIME_MS;
 }
@@ -182,7 +189,7 @@ int processHeader(void) {
     }
 
     dump_version = (int)strtol(buf + 5, NULL, 10);
-    if (dump_version < 1 || dump_version > 6) {
+    if (dump_version < 1 || dump_version > 7) {
         ERROR("Unknown RDB format version: %d\n", dump_version);
     }
     return dump_version;
@@ -418,6 +425,8 @@ int loadPair(entry *e) {
 
     uint32_t length = 0;
     if (e->type == REDIS_LIST ||
+        e->type == REDIS_LIST_QUICKLIST ||
+        e->type == REDIS_LIST_QUICKLIST_2 ||
         e->type == REDIS_SET  ||
         e->type == REDIS_ZSET ||
         e->type == REDIS_HASH) {
@@ -434,12 +443,19 @@ int loadPair(entry *e) {
     case REDIS_SET_INTSET:
     case REDIS_ZSET_ZIPLIST:
     case REDIS_HASH_ZIPLIST:
+    case REDIS_LIST_LISTPACK:
+    case REDIS_ZSET_LISTPACK:
+    case REDIS_HASH_LISTPACK:
+    case REDIS_SET_ROARING:
+    case REDIS_HASH_HASHPACK:
         if (!processStringObject(NULL)) {
             SHIFT_ERROR(offset, "Error reading entry value");
             return 0;
         }
     break;
     case REDIS_LIST:
+    case REDIS_LIST_QUICKLIST:
+    case REDIS_LIST_QUICKLIST_2:
     case REDIS_SET:
         for (i = 0; i < length; i++) {
             offset = CURR_OFFSET;
@@ -59,8 +59,12 @@ typedef long long mstime_t; /* millisecond time type. */
 #include "adlist.h"  /* Linked lists */
 #include "zmalloc.h" /* total memory usage aware version of malloc/free */
 #include "anet.h"    /* Networking the easy way */
-#include "ziplist.h" /* Compact list data structure */
+#include "ziplist.h" /* Compact list data structure of old RDB files */
+#include "listpack.h" /* Compact list data structure */
+#include "quicklist.h" /* Lists of listpacks */
 #include "intset.h"  /* Compact integer set structure */
+#include "roaring.h" /* Compressed bitmap of integers */
+#include "hashpack.h" /* Hash of strings packed in an arena */
 #include "version.h" /* Version macro */
 #include "util.h"    /* Misc functions useful in many places */
 #include "latency.h" /* Latency monitor API */
@@ -82,6 +86,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_CONFIGLINE_MAX    1024
 #define REDIS_DBCRON_DBS_PER_CALL 16
 #define REDIS_MAX_WRITE_PER_EVENT (1024*64)
+#define REDIS_IOV_MAX 128 /* Max iovecs of a single writev() to clients */
 #define REDIS_SHARED_SELECT_CMDS 10
 #define REDIS_SHARED_INTEGERS 10000
 #define REDIS_SHARED_BULKHDR_LEN 32
@@ -125,6 +130,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define REDIS_DEFAULT_AOF_LOAD_TRUNCATED 1
 #define REDIS_DEFAULT_ACTIVE_REHASHING 1
+#define REDIS_DEFAULT_KEYSPACE_OPEN_ADDRESSING 0
 #define REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
 #define REDIS_DEFAULT_MIN_SLAVES_TO_WRITE 0
 #define REDIS_DEFAULT_MIN_SLAVES_MAX_LAG 10
@@ -133,6 +139,11 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_BINDADDR_MAX 16
 #define REDIS_MIN_RESERVED_FDS 32
 #define REDIS_DEFAULT_LATENCY_MONITOR_THRESHOLD 0
+#define REDIS_DEFAULT_IO_THREADS_NUM 1        /* Single threaded by default */
+#define REDIS_DEFAULT_IO_THREADS_DO_READS 1
+#define REDIS_IO_THREADS_MAX_NUM 128
+#define REDIS_IO_THREADS_MIN_CLIENTS 2  /* Min pending clients per thread to
+                                           use the I/O threads at all. */
 
 #define ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP 20 /* Loopkups per loop. */
 #define ACTIVE_EXPIRE_CYCLE_FAST_DURATION 1000 /* Microseconds */
@@ -151,6 +162,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_MAX_QUERYBUF_LEN  (1024*1024*1024) /* 1GB max query buffer. */
 #define REDIS_IOBUF_LEN         (1024*16)  /* Generic I/O buffer size */
 #define REDIS_REPLY_CHUNK_BYTES (16*1024) /* 16k output buffer */
+#define REDIS_REPLY_POOL_MAX    64  /* Reply blocks kept for reuse */
 #define REDIS_INLINE_MAX_SIZE   (1024*64) /* Max size of inline reads */
 #define REDIS_MBULK_BIG_ARG     (1024*32)
 #define REDIS_LONGSTR_SIZE      21          /* Bytes needed for long -> str */
@@ -195,10 +207,15 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_ENCODING_HT 2      /* Encoded as hash table */
 #define REDIS_ENCODING_ZIPMAP 3  /* Encoded as zipmap */
 #define REDIS_ENCODING_LINKEDLIST 4 /* Encoded as regular linked list */
-#define REDIS_ENCODING_ZIPLIST 5 /* Encoded as ziplist */
+#define REDIS_ENCODING_ZIPLIST 5 /* No longer used: old ziplist encoding */
 #define REDIS_ENCODING_INTSET 6  /* Encoded as intset */
 #define REDIS_ENCODING_SKIPLIST 7  /* Encoded as skiplist */
 #define REDIS_ENCODING_RBTREE 8 /* Encoded as red-black tree */
+#define REDIS_ENCODING_QUICKLIST 9 /* Encoded as linked list of listpacks */
+#define REDIS_ENCODING_EMBSTR 10 /* Embedded sds string encoding */
+#define REDIS_ENCODING_LISTPACK 11 /* Encoded as listpack */
+#define REDIS_ENCODING_ROARING 12 /* Encoded as roaring bitmap */
+#define REDIS_ENCODING_HASHPACK 13 /* Encoded as hashpack */
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -253,6 +270,12 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_PRE_PSYNC (1<<16)   /* Instance don't understand PSYNC. */
 #define REDIS_READONLY (1<<17)    /* Cluster client is in read-only state. */
 #define REDIS_PUBSUB (1<<18)      /* Client is in Pub/Sub mode. */
+#define REDIS_PENDING_WRITE (1<<19) /* Client has output to send but a write
+                                       handler is yet not installed. */
+#define REDIS_PENDING_READ (1<<20)  /* Client read is postponed to be served
+                                       by the I/O threads. */
+#define REDIS_PENDING_COMMAND (1<<21) /* An I/O thread already parsed the next
+                                         command into argv/argc. */
 
 /* Client request types */
 #define REDIS_REQ_INLINE 1
@@ -294,6 +317,10 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_SORT_ASC 1
 #define REDIS_SORT_DESC 2
 #define REDIS_SORTKEY_MAX 1024
+#define REDIS_SORT_POOL_SIZE 1024   /* Sorting vectors up to this size are
+                                       taken from server.sort_pool. */
+#define REDIS_SORT_HEAP_RATIO 16    /* Sort with a heap if LIMIT needs at
+                                       most 1/RATIO of the elements. */
 
 /* Log levels */
 #define REDIS_DEBUG 0
@@ -318,8 +345,12 @@ typedef long long mstime_t; /* millisecond time type. */
 /* Zip structure related defaults */
 #define REDIS_HASH_MAX_ZIPLIST_ENTRIES 512
 #define REDIS_HASH_MAX_ZIPLIST_VALUE 64
+#define REDIS_HASH_MAX_HASHPACK_ENTRIES 8192
+#define REDIS_HASH_MAX_HASHPACK_VALUE 1024
 #define REDIS_LIST_MAX_ZIPLIST_ENTRIES 512
 #define REDIS_LIST_MAX_ZIPLIST_VALUE 64
+#define REDIS_LIST_MAX_ZIPLIST_SIZE -2
+#define REDIS_LIST_COMPRESS_DEPTH 0
 #define REDIS_SET_MAX_INTSET_ENTRIES 512
 #define REDIS_ZSET_MAX_ZIPLIST_ENTRIES 128
 #define REDIS_ZSET_MAX_ZIPLIST_VALUE 64
@@ -415,6 +446,16 @@ typedef struct redisObject {
     void *ptr;
 } robj;
 
+/* Strings up to this size are created with the EMBSTR encoding: the sds
+ * string is allocated in the same chunk of the object, that fits 64 bytes
+ * (16 bytes of robj, 3 bytes of sdshdr8, the string and its null term). */
+#define REDIS_ENCODING_EMBSTR_SIZE_LIMIT 44
+
+/* True if the string object is represented by an sds string. */
+#define sdsEncodedObject(objptr) \
+    ((objptr)->encoding == REDIS_ENCODING_RAW || \
+     (objptr)->encoding == REDIS_ENCODING_EMBSTR)
+
 /* Macro used to initialize a Redis object allocated on the stack.
  * Note that this macro is taken near the structure definition to make sure
  * we'll update it when the structure is changed, to avoid bugs like
@@ -475,6 +516,18 @@ typedef struct readyList {
     robj *key;
 } readyList;
 
+/* Node of the client reply list: 'used' bytes of protocol out of 'size'.
+ * Big string objects are referenced by 'obj' instead of being copied, and
+ * the protocol is obj->ptr then. Blocks of REDIS_REPLY_CHUNK_BYTES are
+ * recycled, see networking.c. */
+typedef struct clientReplyBlock {
+    size_t size, used;
+    robj *obj;
+    char buf[];
+} clientReplyBlock;
+
+#define replyBlockData(b) ((b)->obj ? (char*)(b)->obj->ptr : (b)->buf)
+
 /* With multiplexing we need to take per-client state.
  * Clients are taken in a linked list. */
 typedef struct redisClient {
@@ -492,7 +545,7 @@ typedef struct redisClient {
     int multibulklen;       /* number of multi bulk arguments left to read */
     long bulklen;           /* length of bulk argument in multi bulk request */
     list *reply;
-    unsigned long reply_bytes; /* Tot bytes of objects in reply list */
+    unsigned long reply_bytes; /* Tot bytes of blocks in reply list */
     int sentlen;            /* Amount of bytes already sent in the current
                                buffer or object being sent. */
     time_t ctime;           /* Client creation time */
@@ -517,6 +570,13 @@ typedef struct redisClient {
     dict *pubsub_channels;  /* channels a client is interested in (SUBSCRIBE) */
     list *pubsub_patterns;  /* patterns a client is interested in (SUBSCRIBE) */
     sds peerid;             /* Cached peer ID. */
+    /* Results of the last I/O thread operation, see networking.c. */
+    ssize_t io_nbytes;      /* Bytes transferred, -1 if client should close. */
+    int io_errno;           /* errno of the failed read/write, if any. */
+    unsigned long io_sent_nodes; /* Reply nodes fully sent by an I/O thread
+                                    that the main thread should release. */
+    sds io_protocol_error;  /* Protocol error found by an I/O thread while
+                               parsing, replied by the main thread. */
 
     /* Response buffer */
     int bufpos;
@@ -544,12 +604,16 @@ struct sharedObjectsStruct {
 };
 
 /* ZSETs use a specialized version of Skiplists */
+/* Every level also stores the score of the node it points to, so that the
+ * search can decide whether to move forward without touching the next
+ * node: only the nodes actually visited are loaded into the cache. */
 typedef struct zskiplistNode {
     robj *obj;
     double score;
     struct zskiplistNode *backward;
     struct zskiplistLevel {
         struct zskiplistNode *forward;
+        double score;           /* Score of 'forward'. */
         unsigned int span;
     } level[];
 } zskiplistNode;
@@ -577,6 +641,8 @@ typedef struct rbNode {
 typedef struct rbtree {
     rbNode *root;
     int (*compare)(robj *v1, robj *v2);
+    void *privdata; /* owner defined, not released with the tree */
+    unsigned long length;
 } rbtree;
 
 #define RBNODE_RED      0
@@ -599,6 +665,23 @@ rbNode *rbtreeNext(rbNode *n);
 rbNode *rbtreePrev(rbNode *n);
 rbNode *rbtreeMinimun(rbNode *n);
 rbNode *rbtreeMaximun(rbNode *n);
+unsigned long rbtreeRank(rbtree *tree, robj *obj); /* 1-based, 0 if not found */
+rbNode *rbtreeSelect(rbtree *tree, unsigned long rank); /* 1-based */
+unsigned long rbtreeCountRange(rbtree *tree, robj *min, robj *max); /* min <= obj < max */
+void rbtreeBulkLoad(rbtree *tree, robj **objs, unsigned long len);
+
+/* Threaded I/O. Every thread serves a subset of the clients that have pending
+ * reads or writes at every event loop iteration, while the main thread (that
+ * is the thread with id 0) waits for all of them to terminate. */
+typedef struct redisIOThread {
+    pthread_t thread;
+    int id;
+    list *clients;                  /* Clients assigned in the current batch. */
+    long long stat_reads;           /* Number of reads served. */
+    long long stat_writes;          /* Number of writes served. */
+    long long stat_read_bytes;      /* Bytes read from network. */
+    long long stat_written_bytes;   /* Bytes written to network. */
+} redisIOThread;
 
 typedef struct clientBufferLimitsConfig {
     unsigned long long hard_limit_bytes;
@@ -653,6 +736,7 @@ struct redisServer {
     unsigned lruclock:REDIS_LRU_BITS; /* Clock for LRU eviction */
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
     int activerehashing;        /* Incremental rehash in serverCron() */
+    int keyspace_open_addressing; /* Keyspace dicts use open addressing. */
     char *requirepass;          /* Pass for AUTH command, or NULL */
     char *pidfile;              /* PID file path */
     int arch_bits;              /* 32 or 64 depending on sizeof(long) */
@@ -671,6 +755,8 @@ struct redisServer {
     int sofd;                   /* Unix socket file descriptor */
     list *clients;              /* List of active clients */
     list *clients_to_close;     /* Clients to close asynchronously */
+    list *clients_pending_write; /* There is to write or install handler. */
+    list *clients_pending_read; /* Clients with reads postponed to threads */
     list *slaves, *monitors;    /* List of slaves and MONITORs */
     redisClient *current_client; /* Current client, only used on crash report */
     char neterr[ANET_ERR_LEN];   /* Error buffer for anet.c */
@@ -719,9 +805,17 @@ struct redisServer {
     int maxidletime;                /* Client timeout in seconds */
     int tcpkeepalive;               /* Set SO_KEEPALIVE if non-zero. */
     int active_expire_enabled;      /* Can be disabled for testing purposes. */
+    int bitops_simd;                /* Use the SIMD bitops kernels if the CPU
+                                       supports them. Can be disabled for
+                                       testing purposes. */
     size_t client_max_querybuf_len; /* Limit for client query buffer length */
     int dbnum;                      /* Total number of configured DBs */
     int daemonize;                  /* True if running as a daemon */
+    int io_threads_num;             /* Number of I/O threads, main included */
+    int io_threads_do_reads;        /* Read and parse queries in threads too */
+    redisIOThread *io_threads;      /* I/O threads, io_threads_num entries */
+    long long stat_io_reads_processed;  /* Reads served by I/O threads */
+    long long stat_io_writes_processed; /* Writes served by I/O threads */
     clientBufferLimitsConfig client_obuf_limits[REDIS_CLIENT_TYPE_COUNT];
     /* AOF persistence */
     int aof_state;                  /* REDIS_AOF_(ON|OFF|WAIT_REWRITE) */
@@ -834,15 +928,24 @@ struct redisServer {
     int sort_alpha;
     int sort_bypattern;
     int sort_store;
+    struct _redisSortObject *sort_pool; /* Pooled sorting vector. */
     /* Zip structure config, see redis.conf for more information  */
     size_t hash_max_ziplist_entries;
     size_t hash_max_ziplist_value;
+    size_t hash_max_hashpack_entries;
+    size_t hash_max_hashpack_value;
     size_t list_max_ziplist_entries;
     size_t list_max_ziplist_value;
+    int list_max_ziplist_size;
+    int list_compress_depth;
     size_t set_max_intset_entries;
     size_t zset_max_ziplist_entries;
     size_t zset_max_ziplist_value;
     size_t hll_sparse_max_bytes;
+    /* PFCOUNT with multiple keys cache, see hyperloglog.c */
+    dict *hll_count_cache;      /* List of keys -> cached cardinality. */
+    dict *hll_count_versions;   /* Key -> version of the key when cached. */
+    uint64_t hll_count_version; /* Last version assigned to a key. */
     time_t unixtime;        /* Unix time sampled every cron cycle. */
     long long mstime;       /* Like 'unixtime' but with milliseconds resolution. */
     /* Pubsub */
@@ -930,14 +1033,14 @@ typedef struct {
     unsigned char encoding;
     unsigned char direction; /* Iteration direction */
     unsigned char *zi;
-    listNode *ln;
+    quicklistIter *iter;
 } listTypeIterator;
 
 /* Structure for an entry while iterating over a list. */
 typedef struct {
     listTypeIterator *li;
-    unsigned char *zi;  /* Entry in ziplist */
-    listNode *ln;       /* Entry in linked list */
+    unsigned char *zi;  /* Entry in listpack */
+    quicklistEntry entry; /* Entry in quicklist */
 } listTypeEntry;
 
 /* Structure to hold set iteration abstraction. */
@@ -945,6 +1048,7 @@ typedef struct {
     robj *subject;
     int encoding;
     int ii; /* intset iterator */
+    roaringIterator ri;
     dictIterator *di;
 } setTypeIterator;
 
@@ -958,6 +1062,8 @@ typedef struct {
 
     unsigned char *fptr, *vptr;
 
+    uint32_t cursor, flen, vlen; /* Hashpack cursor and current pair. */
+
     dictIterator *di;
     dictEntry *de;
 } hashTypeIterator;
@@ -974,6 +1080,7 @@ extern struct sharedObjectsStruct shared;
 extern dictType setDictType;
 extern dictType zsetDictType;
 extern dictType dbDictType;
+extern dictType keyptrDictType;
 extern dictType shaScriptObjectDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
@@ -999,6 +1106,13 @@ void freeClient(redisClient *c);
 void freeClientAsync(redisClient *c);
 void resetClient(redisClient *c);
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
+int writeToClient(int fd, redisClient *c, int handler_installed);
+int clientHasPendingReplies(redisClient *c);
+void clientInstallWriteHandler(redisClient *c);
+void removeClientFromPendingLists(redisClient *c);
+int handleClientsWithPendingWrites(void);
+int handleClientsWithPendingReads(void);
+void initThreadedIO(void);
 void *addDeferredMultiBulkLength(redisClient *c);
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length);
 void processInputBuffer(redisClient *c);
@@ -1019,6 +1133,7 @@ void addReplyLongLong(redisClient *c, long long ll);
 void addReplyMultiBulkLen(redisClient *c, long length);
 void copyClientOutputBuffer(redisClient *dst, redisClient *src);
 void *dupClientReplyValue(void *o);
+void freeClientReplyValue(void *o);
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer);
 void formatPeerId(char *peerid, size_t peerid_len, char *ip, int port);
@@ -1087,6 +1202,8 @@ void freeZsetObject(robj *o);
 void freeHashObject(robj *o);
 robj *createObject(int type, void *ptr);
 robj *createStringObject(char *ptr, size_t len);
+robj *createRawStringObject(char *ptr, size_t len);
+robj *createEmbeddedStringObject(char *ptr, size_t len);
 robj *dupStringObject(robj *o);
 int isObjectRepresentableAsLongLong(robj *o, long long *llongval);
 robj *tryObjectEncoding(robj *o);
@@ -1094,13 +1211,15 @@ robj *getDecodedObject(robj *o);
 size_t stringObjectLen(robj *o);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongDouble(long double value, int humanfriendly);
-robj *createListObject(void);
-robj *createZiplistObject(void);
+robj *createQuicklistObject(void);
+robj *createListpackObject(void);
 robj *createSetObject(void);
 robj *createIntsetObject(void);
+robj *createRoaringObject(void);
 robj *createHashObject(void);
+robj *createHashpackObject(void);
 robj *createZsetObject(void);
-robj *createZsetZiplistObject(void);
+robj *createZsetListpackObject(void);
 int getLongFromObjectOrReply(redisClient *c, robj *o, long *target, const char *msg);
 int checkType(redisClient *c, robj *o, int type);
 int getLongLongFromObjectOrReply(redisClient *c, robj *o, long long *target, const char *msg);
@@ -1156,6 +1275,7 @@ int startAppendOnly(void);
 void backgroundRewriteDoneHandler(int exitcode, int bysignal);
 void aofRewriteBufferReset(void);
 unsigned long aofRewriteBufferSize(void);
+int rioWriteBulkObject(rio *r, robj *obj);
 
 /* Sorted sets data type */
 
@@ -1226,6 +1346,7 @@ robj *setTypeNextObject(setTypeIterator *si);
 int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele);
 unsigned long setTypeSize(robj *subject);
 void setTypeConvert(robj *subject, int enc);
+void setTypeCheckRoaring(robj *o);
 
 /* Hash data type */
 void hashTypeConvert(robj *o, int enc);
@@ -1239,10 +1360,13 @@ unsigned long hashTypeLength(robj *o);
 hashTypeIterator *hashTypeInitIterator(robj *subject);
 void hashTypeReleaseIterator(hashTypeIterator *hi);
 int hashTypeNext(hashTypeIterator *hi);
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
-                                unsigned char **vstr,
-                                unsigned int *vlen,
-                                long long *vll);
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
+                                 unsigned char **vstr,
+                                 unsigned int *vlen,
+                                 long long *vll);
+void hashTypeCurrentFromHashpack(hashTypeIterator *hi, int what,
+                                 unsigned char **vstr,
+                                 unsigned int *vlen);
 void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst);
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what);
 robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key);
@@ -1254,6 +1378,11 @@ void freePubsubPattern(void *p);
 int listMatchPubsubPattern(void *a, void *b);
 int pubsubPublishMessage(robj *channel, robj *message);
 
+/* HyperLogLog */
+void hllCountCacheInit(void);
+void hllCountCacheFlush(void);
+void hllCountCacheTouchKey(robj *key);
+
 /* Keyspace events notification */
 void notifyKeyspaceEvent(int type, char *event, robj *key, int dbid);
 int keyspaceEventsStringToFlags(char *classes);
@@ -1285,10 +1414,23 @@ int dbExists(redisDb *db, robj *key);
 robj *dbRandomKey(redisDb *db);
 int dbDelete(redisDb *db, robj *key);
 robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o);
-long long emptyDb(void(callback)(void*));
+#define EMPTYDB_NO_FLAGS 0      /* No flags. */
+#define EMPTYDB_ASYNC (1<<0)    /* Reclaim memory in another thread. */
+long long emptyDb(int flags, void(callback)(void*));
 int selectDb(redisClient *c, int id);
 void signalModifiedKey(redisDb *db, robj *key);
 void signalFlushedDb(int dbid);
+
+/* Lazy free */
+int dbAsyncDelete(redisDb *db, robj *key);
+long long emptyDbAsync(redisDb *db);
+dict *dbDictCreate(dictType *type);
+size_t lazyfreeGetFreeEffort(robj *o);
+unsigned long lazyfreeGetPendingObjectsCount(void);
+unsigned long long lazyfreeGetFreedObjectsCount(void);
+void lazyfreeFreeObjectFromBioThread(robj *o);
+void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2);
+
 unsigned int GetKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count);
 void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor);
 int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor);
@@ -1328,6 +1470,7 @@ void setexCommand(redisClient *c);
 void psetexCommand(redisClient *c);
 void getCommand(redisClient *c);
 void delCommand(redisClient *c);
+void unlinkCommand(redisClient *c);
 void existsCommand(redisClient *c);
 void setbitCommand(redisClient *c);
 void getbitCommand(redisClient *c);
@@ -1464,6 +1607,7 @@ void timeCommand(redisClient *c);
 void bitopCommand(redisClient *c);
 void bitcountCommand(redisClient *c);
 void bitposCommand(redisClient *c);
+void bitfieldCommand(redisClient *c);
 void replconfCommand(redisClient *c);
 void pfselftestCommand(redisClient *c);
 void pfaddCommand(redisClient *c);
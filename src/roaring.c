@@ -0,0 +1,1074 @@
+/* roaring.c - Compressed bitmap of 64 bit integers
+ *
+ * Containers of the roaring bitmap are described in roaring.h. Single
+ * additions and removals keep the array and bitmap containers in the
+ * representation implied by their cardinality and update run containers in
+ * place; set operations and roaringOptimize() repack every container in the
+ * smallest of the three representations.
+ *
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "roaring.h"
+#include "zmalloc.h"
+#include "endianconv.h"
+
+#define ROARING_ARRAY_MAX 4096      /* Larger arrays become bitmaps. */
+#define ROARING_WORDS 1024          /* 64 bit words of a bitmap. */
+#define ROARING_BITMAP_BYTES 8192
+#define ROARING_CHUNK 65536         /* Integers covered by a container. */
+
+#define roaringBias(v) ((uint64_t)(v) ^ (1ULL<<63))
+#define roaringUnbias(key,low) ((int64_t)((((key)<<16)|(low)) ^ (1ULL<<63)))
+#define rcWords(c) ((uint64_t*)(c)->data)
+
+/* ---------------------------------------------------------------------------
+ * Containers
+ * ------------------------------------------------------------------------ */
+
+/* Initialize 'c' as an empty container of the given type, with room for
+ * 'alloc' uint16_t slots (ignored for bitmaps). */
+static void rcInit(roaringContainer *c, uint32_t type, uint32_t alloc) {
+    c->type = type;
+    c->card = 0;
+    c->len = 0;
+    if (type == ROARING_BITMAP) {
+        c->alloc = 0;
+        c->data = zcalloc(ROARING_BITMAP_BYTES);
+    } else {
+        c->alloc = alloc;
+        c->data = zmalloc(sizeof(uint16_t)*alloc);
+    }
+}
+
+/* Make room for at least 'slots' uint16_t in an array or run container. */
+static void rcReserve(roaringContainer *c, uint32_t slots) {
+    if (slots <= c->alloc) return;
+    c->alloc = (c->alloc*2 > slots) ? c->alloc*2 : slots;
+    c->data = zrealloc(c->data,sizeof(uint16_t)*c->alloc);
+}
+
+/* Return the index of the first bit set at 'bit' or after it, or
+ * ROARING_CHUNK if there is none. */
+static uint32_t rcNextSetBit(const uint64_t *words, uint32_t bit) {
+    uint32_t w = bit >> 6;
+    uint64_t word;
+
+    if (bit >= ROARING_CHUNK) return ROARING_CHUNK;
+    word = words[w] & (~0ULL << (bit & 63));
+    while (word == 0) {
+        if (++w == ROARING_WORDS) return ROARING_CHUNK;
+        word = words[w];
+    }
+    return (w << 6) + __builtin_ctzll(word);
+}
+
+/* Like rcNextSetBit() but for cleared bits. */
+static uint32_t rcNextClearBit(const uint64_t *words, uint32_t bit) {
+    uint32_t w = bit >> 6;
+    uint64_t word;
+
+    if (bit >= ROARING_CHUNK) return ROARING_CHUNK;
+    word = ~words[w] & (~0ULL << (bit & 63));
+    while (word == 0) {
+        if (++w == ROARING_WORDS) return ROARING_CHUNK;
+        word = ~words[w];
+    }
+    return (w << 6) + __builtin_ctzll(word);
+}
+
+/* Set the bits from 'start' to 'last', both included. */
+static void rcSetRange(uint64_t *words, uint32_t start, uint32_t last) {
+    uint32_t ws = start >> 6, wl = last >> 6;
+    uint64_t ms = ~0ULL << (start & 63), ml = ~0ULL >> (63 - (last & 63));
+
+    if (ws == wl) {
+        words[ws] |= ms & ml;
+        return;
+    }
+    words[ws] |= ms;
+    while (++ws < wl) words[ws] = ~0ULL;
+    words[wl] |= ml;
+}
+
+static uint32_t rcPopcount(const uint64_t *words) {
+    uint32_t j, card = 0;
+
+    for (j = 0; j < ROARING_WORDS; j++) card += __builtin_popcountll(words[j]);
+    return card;
+}
+
+/* Binary search 'v' in the sorted array 'a' of 'n' elements. Return 1 if
+ * found, and set *pos to its position or to where it should be inserted. */
+static int rcArraySearch(const uint16_t *a, uint32_t n, uint16_t v,
+                         uint32_t *pos) {
+    uint32_t lo = 0, hi = n;
+
+    /* Appending is the most common case when loading sorted integers. */
+    if (n && a[n-1] < v) {
+        *pos = n;
+        return 0;
+    }
+    while (lo < hi) {
+        uint32_t mid = (lo+hi) >> 1;
+        if (a[mid] < v) lo = mid+1; else hi = mid;
+    }
+    *pos = lo;
+    return lo < n && a[lo] == v;
+}
+
+/* Return the index of the last run of 'c' starting at or before 'v', or -1
+ * if 'v' comes before all the runs. */
+static int32_t rcRunSearch(const roaringContainer *c, uint16_t v) {
+    int32_t lo = 0, hi = (int32_t)(c->len/2)-1, idx = -1;
+
+    while (lo <= hi) {
+        int32_t mid = (lo+hi) >> 1;
+        if (c->data[mid*2] <= v) {
+            idx = mid;
+            lo = mid+1;
+        } else {
+            hi = mid-1;
+        }
+    }
+    return idx;
+}
+
+static int rcContains(const roaringContainer *c, uint16_t v) {
+    uint32_t pos;
+    int32_t run;
+
+    switch(c->type) {
+    case ROARING_ARRAY:
+        return rcArraySearch(c->data,c->len,v,&pos);
+    case ROARING_BITMAP:
+        return (rcWords(c)[v >> 6] >> (v & 63)) & 1;
+    default:
+        run = rcRunSearch(c,v);
+        return run >= 0 && v - c->data[run*2] <= c->data[run*2+1];
+    }
+}
+
+/* Store in *v the integer at the iteration state 'pos'/'off' and advance
+ * it. Return 0 when there are no more integers. */
+static int rcNext(const roaringContainer *c, uint32_t *pos, uint32_t *off,
+                  uint16_t *v) {
+    switch(c->type) {
+    case ROARING_ARRAY:
+        if (*pos >= c->len) return 0;
+        *v = c->data[(*pos)++];
+        return 1;
+    case ROARING_BITMAP:
+        *pos = rcNextSetBit(rcWords(c),*pos);
+        if (*pos == ROARING_CHUNK) return 0;
+        *v = (*pos)++;
+        return 1;
+    default:
+        if (*pos*2 >= c->len) return 0;
+        *v = c->data[*pos*2] + *off;
+        if (*off == c->data[*pos*2+1]) {
+            (*pos)++;
+            *off = 0;
+        } else {
+            (*off)++;
+        }
+        return 1;
+    }
+}
+
+/* Convert an array or run container into a bitmap. */
+static void rcToBitmap(roaringContainer *c) {
+    uint64_t *words;
+    uint32_t j;
+
+    if (c->type == ROARING_BITMAP) return;
+    words = zcalloc(ROARING_BITMAP_BYTES);
+    if (c->type == ROARING_ARRAY) {
+        for (j = 0; j < c->len; j++)
+            words[c->data[j] >> 6] |= 1ULL << (c->data[j] & 63);
+    } else {
+        for (j = 0; j < c->len; j += 2)
+            rcSetRange(words,c->data[j],c->data[j]+c->data[j+1]);
+    }
+    zfree(c->data);
+    c->data = (uint16_t*)words;
+    c->type = ROARING_BITMAP;
+    c->len = c->alloc = 0;
+}
+
+/* Number of runs of consecutive integers in the container. */
+static uint32_t rcCountRuns(const roaringContainer *c) {
+    uint32_t j, runs = 0;
+
+    if (c->type == ROARING_RUN) {
+        return c->len/2;
+    } else if (c->type == ROARING_ARRAY) {
+        for (j = 0; j < c->len; j++)
+            if (j == 0 || c->data[j] != c->data[j-1]+1) runs++;
+    } else {
+        const uint64_t *words = rcWords(c);
+        uint64_t carry = 0;
+
+        /* A run starts at every set bit whose previous bit is clear. */
+        for (j = 0; j < ROARING_WORDS; j++) {
+            runs += __builtin_popcountll(words[j] & ~((words[j] << 1) | carry));
+            carry = words[j] >> 63;
+        }
+    }
+    return runs;
+}
+
+/* Convert the container to the representation using less memory. */
+static void rcRepack(roaringContainer *c) {
+    size_t runbytes = (size_t)rcCountRuns(c)*4;
+    size_t arraybytes = (c->card <= ROARING_ARRAY_MAX) ? c->card*2 : SIZE_MAX;
+    uint32_t type = ROARING_BITMAP, bit, end;
+    size_t best = ROARING_BITMAP_BYTES;
+    uint64_t *words;
+
+    if (runbytes < best) {
+        type = ROARING_RUN;
+        best = runbytes;
+    }
+    if (arraybytes <= best) type = ROARING_ARRAY;
+    if (type == c->type) return;
+
+    rcToBitmap(c);
+    if (type == ROARING_BITMAP) return;
+    words = rcWords(c);
+    c->data = NULL;
+    c->len = c->alloc = 0;
+    c->type = type;
+    if (type == ROARING_ARRAY) {
+        rcReserve(c,c->card);
+        bit = 0;
+        while ((bit = rcNextSetBit(words,bit)) != ROARING_CHUNK)
+            c->data[c->len++] = bit++;
+    } else {
+        rcReserve(c,runbytes/2);
+        bit = 0;
+        while ((bit = rcNextSetBit(words,bit)) != ROARING_CHUNK) {
+            end = rcNextClearBit(words,bit);
+            c->data[c->len++] = bit;
+            c->data[c->len++] = end-bit-1;
+            bit = end;
+        }
+    }
+    zfree(words);
+}
+
+/* Add 'v' to the container. Return 1 if it was not already there. */
+static int rcAdd(roaringContainer *c, uint16_t v) {
+    uint32_t pos, nruns;
+    int32_t run;
+
+    if (c->type == ROARING_ARRAY) {
+        if (rcArraySearch(c->data,c->len,v,&pos)) return 0;
+        if (c->len == ROARING_ARRAY_MAX) {
+            rcToBitmap(c);
+            return rcAdd(c,v);
+        }
+        rcReserve(c,c->len+1);
+        memmove(c->data+pos+1,c->data+pos,(c->len-pos)*sizeof(uint16_t));
+        c->data[pos] = v;
+        c->len++;
+    } else if (c->type == ROARING_BITMAP) {
+        uint64_t *word = rcWords(c)+(v >> 6), bit = 1ULL << (v & 63);
+
+        if (*word & bit) return 0;
+        *word |= bit;
+    } else {
+        uint16_t *d = c->data;
+
+        nruns = c->len/2;
+        run = rcRunSearch(c,v);
+        if (run >= 0 && v - d[run*2] <= d[run*2+1]) return 0;
+        if (run >= 0 && v == d[run*2]+d[run*2+1]+1) {
+            /* Extend the previous run, merging it with the next one if
+             * they are now adjacent. */
+            d[run*2+1]++;
+            if ((uint32_t)run+1 < nruns && d[run*2+2] == v+1) {
+                d[run*2+1] += d[run*2+3]+1;
+                memmove(d+run*2+2,d+run*2+4,
+                    (c->len-run*2-4)*sizeof(uint16_t));
+                c->len -= 2;
+            }
+        } else if ((uint32_t)(run+1) < nruns && d[run*2+2] == v+1) {
+            /* Extend the next run backward. */
+            d[run*2+2]--;
+            d[run*2+3]++;
+        } else {
+            rcReserve(c,c->len+2);
+            d = c->data;
+            pos = (run+1)*2;
+            memmove(d+pos+2,d+pos,(c->len-pos)*sizeof(uint16_t));
+            d[pos] = v;
+            d[pos+1] = 0;
+            c->len += 2;
+        }
+        c->card++;
+        if ((size_t)c->len*2 > ROARING_BITMAP_BYTES ||
+            (c->card <= ROARING_ARRAY_MAX && c->len > c->card)) rcRepack(c);
+        return 1;
+    }
+    c->card++;
+    return 1;
+}
+
+/* Remove 'v' from the container. Return 1 if it was there. */
+static int rcRemove(roaringContainer *c, uint16_t v) {
+    uint32_t pos;
+    int32_t run;
+
+    if (c->type == ROARING_ARRAY) {
+        if (!rcArraySearch(c->data,c->len,v,&pos)) return 0;
+        memmove(c->data+pos,c->data+pos+1,(c->len-pos-1)*sizeof(uint16_t));
+        c->len--;
+        c->card--;
+    } else if (c->type == ROARING_BITMAP) {
+        uint64_t *word = rcWords(c)+(v >> 6), bit = 1ULL << (v & 63);
+
+        if (!(*word & bit)) return 0;
+        *word &= ~bit;
+        c->card--;
+        if (c->card <= ROARING_ARRAY_MAX) rcRepack(c);
+    } else {
+        uint16_t *d;
+        uint16_t start, last;
+
+        run = rcRunSearch(c,v);
+        if (run < 0 || v - c->data[run*2] > c->data[run*2+1]) return 0;
+        d = c->data;
+        start = d[run*2];
+        last = start+d[run*2+1];
+        if (start == last) {
+            memmove(d+run*2,d+run*2+2,(c->len-run*2-2)*sizeof(uint16_t));
+            c->len -= 2;
+        } else if (v == start) {
+            d[run*2]++;
+            d[run*2+1]--;
+        } else if (v == last) {
+            d[run*2+1]--;
+        } else {
+            /* Split the run in two. */
+            rcReserve(c,c->len+2);
+            d = c->data;
+            memmove(d+run*2+4,d+run*2+2,(c->len-run*2-2)*sizeof(uint16_t));
+            d[run*2+1] = v-start-1;
+            d[run*2+2] = v+1;
+            d[run*2+3] = last-v-1;
+            c->len += 2;
+        }
+        c->card--;
+        if (c->card && ((size_t)c->len*2 > ROARING_BITMAP_BYTES ||
+            (c->card <= ROARING_ARRAY_MAX && c->len > c->card))) rcRepack(c);
+    }
+    return 1;
+}
+
+/* Return the integer of rank 'rank' (starting from 0) in the container. */
+static uint16_t rcSelect(const roaringContainer *c, uint32_t rank) {
+    uint32_t j;
+
+    if (c->type == ROARING_ARRAY) {
+        return c->data[rank];
+    } else if (c->type == ROARING_BITMAP) {
+        const uint64_t *words = rcWords(c);
+
+        for (j = 0; j < ROARING_WORDS; j++) {
+            uint32_t bits = __builtin_popcountll(words[j]);
+            uint64_t w = words[j];
+
+            if (rank < bits) {
+                while (rank--) w &= w-1;
+                return (j << 6) + __builtin_ctzll(w);
+            }
+            rank -= bits;
+        }
+    } else {
+        for (j = 0; j < c->len; j += 2) {
+            if (rank <= c->data[j+1]) return c->data[j]+rank;
+            rank -= c->data[j+1]+1;
+        }
+    }
+    return 0; /* Not reached with a valid rank. */
+}
+
+/* Append 'v', larger than all the integers of the array or bitmap 'c'. */
+static void rcAppend(roaringContainer *c, uint16_t v) {
+    if (c->type == ROARING_ARRAY && c->len < ROARING_ARRAY_MAX) {
+        rcReserve(c,c->len+1);
+        c->data[c->len++] = v;
+        c->card++;
+    } else {
+        rcAdd(c,v);
+    }
+}
+
+static void rcCopy(roaringContainer *dst, const roaringContainer *src) {
+    size_t bytes = (src->type == ROARING_BITMAP) ? ROARING_BITMAP_BYTES :
+                   src->len*sizeof(uint16_t);
+
+    *dst = *src;
+    dst->alloc = (src->type == ROARING_BITMAP) ? 0 : src->len;
+    dst->data = zmalloc(bytes ? bytes : 1);
+    memcpy(dst->data,src->data,bytes);
+}
+
+/* Set operations between two containers, storing the result in 'dst'.
+ * The result can be empty, then the caller must free it. */
+#define RC_AND 0
+#define RC_OR 1
+#define RC_ANDNOT 2
+static void rcOp(roaringContainer *dst, const roaringContainer *a,
+                 const roaringContainer *b, int op) {
+    uint32_t pos = 0, off = 0, j;
+    uint16_t v;
+
+    if (a->type == ROARING_BITMAP && b->type == ROARING_BITMAP) {
+        uint64_t *wd, *wa = rcWords(a), *wb = rcWords(b);
+
+        rcInit(dst,ROARING_BITMAP,0);
+        wd = rcWords(dst);
+        for (j = 0; j < ROARING_WORDS; j++) {
+            if (op == RC_AND) wd[j] = wa[j] & wb[j];
+            else if (op == RC_OR) wd[j] = wa[j] | wb[j];
+            else wd[j] = wa[j] & ~wb[j];
+        }
+        dst->card = rcPopcount(wd);
+    } else if (op == RC_OR) {
+        /* Set the integers of 'b' into a bitmap copy of 'a'. */
+        rcCopy(dst,a);
+        rcToBitmap(dst);
+        if (b->type == ROARING_RUN) {
+            for (j = 0; j < b->len; j += 2)
+                rcSetRange(rcWords(dst),b->data[j],b->data[j]+b->data[j+1]);
+        } else {
+            while (rcNext(b,&pos,&off,&v))
+                rcWords(dst)[v >> 6] |= 1ULL << (v & 63);
+        }
+        dst->card = rcPopcount(rcWords(dst));
+    } else {
+        /* Scan the smaller container for AND, and 'a' for ANDNOT, testing
+         * every integer against the other container. */
+        const roaringContainer *scan = a, *other = b;
+
+        if (op == RC_AND && b->card < a->card) {
+            scan = b;
+            other = a;
+        }
+        rcInit(dst,ROARING_ARRAY,16);
+        while (rcNext(scan,&pos,&off,&v)) {
+            if (rcContains(other,v) == (op == RC_AND)) rcAppend(dst,v);
+        }
+    }
+    if (dst->card) rcRepack(dst);
+}
+
+/* ---------------------------------------------------------------------------
+ * Roaring bitmaps
+ * ------------------------------------------------------------------------ */
+
+roaring *roaringNew(void) {
+    roaring *r = zmalloc(sizeof(*r));
+
+    r->card = 0;
+    r->len = r->alloc = 0;
+    r->keys = NULL;
+    r->containers = NULL;
+    return r;
+}
+
+void roaringFree(roaring *r) {
+    uint32_t j;
+
+    for (j = 0; j < r->len; j++) zfree(r->containers[j].data);
+    zfree(r->keys);
+    zfree(r->containers);
+    zfree(r);
+}
+
+roaring *roaringDup(roaring *r) {
+    roaring *dup = roaringNew();
+    uint32_t j;
+
+    dup->card = r->card;
+    dup->len = dup->alloc = r->len;
+    dup->keys = zmalloc(sizeof(uint64_t)*(r->len ? r->len : 1));
+    dup->containers = zmalloc(sizeof(roaringContainer)*(r->len ? r->len : 1));
+    memcpy(dup->keys,r->keys,sizeof(uint64_t)*r->len);
+    for (j = 0; j < r->len; j++) rcCopy(dup->containers+j,r->containers+j);
+    return dup;
+}
+
+/* Search the container for 'key'. Return 1 if found, and set *idx to its
+ * position or to where it should be inserted. */
+static int roaringFindContainer(roaring *r, uint64_t key, uint32_t *idx) {
+    uint32_t lo = 0, hi = r->len;
+
+    if (r->len && r->keys[r->len-1] <= key) {
+        *idx = r->len - (r->keys[r->len-1] == key);
+        return r->keys[r->len-1] == key;
+    }
+    while (lo < hi) {
+        uint32_t mid = (lo+hi) >> 1;
+        if (r->keys[mid] < key) lo = mid+1; else hi = mid;
+    }
+    *idx = lo;
+    return lo < r->len && r->keys[lo] == key;
+}
+
+/* Insert the container 'c' with the given key at position 'idx'. */
+static void roaringInsertContainer(roaring *r, uint32_t idx, uint64_t key,
+                                   roaringContainer *c) {
+    if (r->len == r->alloc) {
+        r->alloc = r->alloc ? r->alloc*2 : 4;
+        r->keys = zrealloc(r->keys,sizeof(uint64_t)*r->alloc);
+        r->containers = zrealloc(r->containers,
+                                 sizeof(roaringContainer)*r->alloc);
+    }
+    memmove(r->keys+idx+1,r->keys+idx,sizeof(uint64_t)*(r->len-idx));
+    memmove(r->containers+idx+1,r->containers+idx,
+            sizeof(roaringContainer)*(r->len-idx));
+    r->keys[idx] = key;
+    r->containers[idx] = *c;
+    r->len++;
+}
+
+static void roaringDeleteContainer(roaring *r, uint32_t idx) {
+    zfree(r->containers[idx].data);
+    memmove(r->keys+idx,r->keys+idx+1,sizeof(uint64_t)*(r->len-idx-1));
+    memmove(r->containers+idx,r->containers+idx+1,
+            sizeof(roaringContainer)*(r->len-idx-1));
+    r->len--;
+}
+
+/* Add 'value' to the bitmap. Return 1 if it was not already there. */
+int roaringAdd(roaring *r, int64_t value) {
+    uint64_t u = roaringBias(value);
+    uint32_t idx;
+
+    if (!roaringFindContainer(r,u >> 16,&idx)) {
+        roaringContainer c;
+
+        rcInit(&c,ROARING_ARRAY,4);
+        roaringInsertContainer(r,idx,u >> 16,&c);
+    }
+    if (!rcAdd(r->containers+idx,u & 0xffff)) return 0;
+    r->card++;
+    return 1;
+}
+
+/* Remove 'value' from the bitmap. Return 1 if it was there. */
+int roaringRemove(roaring *r, int64_t value) {
+    uint64_t u = roaringBias(value);
+    uint32_t idx;
+
+    if (!roaringFindContainer(r,u >> 16,&idx)) return 0;
+    if (!rcRemove(r->containers+idx,u & 0xffff)) return 0;
+    if (r->containers[idx].card == 0) roaringDeleteContainer(r,idx);
+    r->card--;
+    return 1;
+}
+
+int roaringContains(roaring *r, int64_t value) {
+    uint64_t u = roaringBias(value);
+    uint32_t idx;
+
+    return roaringFindContainer(r,u >> 16,&idx) &&
+           rcContains(r->containers+idx,u & 0xffff);
+}
+
+uint64_t roaringCard(roaring *r) {
+    return r->card;
+}
+
+/* Return a random integer of a non empty bitmap, with uniform distribution:
+ * a random rank is drawn, and the container holding it is found walking the
+ * container cardinalities. The cardinality may not fit the RAND_MAX range,
+ * so the rank is composed of two rand() calls. */
+int64_t roaringRandom(roaring *r) {
+    uint64_t rank = (((uint64_t)rand() << 31) | (uint64_t)rand()) % r->card;
+    uint32_t idx = 0;
+
+    while (rank >= r->containers[idx].card) {
+        rank -= r->containers[idx].card;
+        idx++;
+    }
+    return roaringUnbias(r->keys[idx],rcSelect(r->containers+idx,rank));
+}
+
+/* Convert every container to its smallest representation. This is useful
+ * after bulk loading, since single additions never create run containers. */
+void roaringOptimize(roaring *r) {
+    uint32_t j;
+
+    for (j = 0; j < r->len; j++) rcRepack(r->containers+j);
+}
+
+/* Return a new bitmap with the result of the 'op' between 'a' and 'b'. */
+static roaring *roaringOp(roaring *a, roaring *b, int op) {
+    roaring *dst = roaringNew();
+    uint32_t i = 0, j = 0;
+    roaringContainer c;
+
+    while (i < a->len || j < b->len) {
+        uint64_t ka = (i < a->len) ? a->keys[i] : UINT64_MAX;
+        uint64_t kb = (j < b->len) ? b->keys[j] : UINT64_MAX;
+
+        if (i < a->len && (j == b->len || ka < kb)) {
+            /* Only in 'a'. */
+            if (op != RC_AND) {
+                rcCopy(&c,a->containers+i);
+                roaringInsertContainer(dst,dst->len,ka,&c);
+                dst->card += c.card;
+            }
+            i++;
+        } else if (j < b->len && (i == a->len || kb < ka)) {
+            /* Only in 'b'. */
+            if (op == RC_OR) {
+                rcCopy(&c,b->containers+j);
+                roaringInsertContainer(dst,dst->len,kb,&c);
+                dst->card += c.card;
+            }
+            j++;
+        } else {
+            rcOp(&c,a->containers+i,b->containers+j,op);
+            if (c.card) {
+                roaringInsertContainer(dst,dst->len,ka,&c);
+                dst->card += c.card;
+            } else {
+                zfree(c.data);
+            }
+            i++;
+            j++;
+        }
+        /* Nothing left that can end in the result. */
+        if (op == RC_AND && (i == a->len || j == b->len)) break;
+        if (op == RC_ANDNOT && i == a->len) break;
+    }
+    return dst;
+}
+
+roaring *roaringAnd(roaring *a, roaring *b) {
+    return roaringOp(a,b,RC_AND);
+}
+
+roaring *roaringOr(roaring *a, roaring *b) {
+    return roaringOp(a,b,RC_OR);
+}
+
+roaring *roaringAndNot(roaring *a, roaring *b) {
+    return roaringOp(a,b,RC_ANDNOT);
+}
+
+/* ---------------------------------------------------------------------------
+ * Iteration
+ * ------------------------------------------------------------------------ */
+
+void roaringInitIterator(roaring *r, roaringIterator *it) {
+    it->r = r;
+    it->ci = 0;
+    it->pos = 0;
+    it->off = 0;
+}
+
+/* Move the iterator to the first integer not smaller than 'value'. */
+void roaringIteratorSeek(roaringIterator *it, int64_t value) {
+    roaring *r = it->r;
+    uint64_t u = roaringBias(value);
+    roaringContainer *c;
+    uint16_t low = u & 0xffff;
+    int32_t run;
+
+    it->pos = it->off = 0;
+    if (!roaringFindContainer(r,u >> 16,&it->ci)) return;
+    c = r->containers+it->ci;
+    if (c->type == ROARING_ARRAY) {
+        rcArraySearch(c->data,c->len,low,&it->pos);
+    } else if (c->type == ROARING_BITMAP) {
+        it->pos = low;
+    } else {
+        run = rcRunSearch(c,low);
+        if (run < 0) return;
+        if (low - c->data[run*2] <= c->data[run*2+1]) {
+            it->pos = run;
+            it->off = low - c->data[run*2];
+        } else {
+            it->pos = run+1;
+        }
+    }
+}
+
+/* Store the next integer in *value and return 1, or return 0 at the end. */
+int roaringIteratorNext(roaringIterator *it, int64_t *value) {
+    roaring *r = it->r;
+    uint16_t low;
+
+    while (it->ci < r->len) {
+        if (rcNext(r->containers+it->ci,&it->pos,&it->off,&low)) {
+            *value = roaringUnbias(r->keys[it->ci],low);
+            return 1;
+        }
+        it->ci++;
+        it->pos = it->off = 0;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Serialization
+ *
+ * <count:4> followed by every container as <key:8><type:1><card:4><len:4>
+ * and its data: 'card' 16 bit integers for arrays, 8192 bytes for bitmaps,
+ * 'len' 16 bit integers (start, length-1 pairs) for runs. Little endian.
+ * ------------------------------------------------------------------------ */
+
+#define ROARING_HDR_SIZE 4
+#define ROARING_CONTAINER_HDR_SIZE 17
+
+static size_t rcDataBytes(uint32_t type, uint32_t len) {
+    return (type == ROARING_BITMAP) ? ROARING_BITMAP_BYTES :
+                                      (size_t)len*sizeof(uint16_t);
+}
+
+size_t roaringBlobLen(roaring *r) {
+    size_t bytes = ROARING_HDR_SIZE;
+    uint32_t j;
+
+    for (j = 0; j < r->len; j++)
+        bytes += ROARING_CONTAINER_HDR_SIZE +
+                 rcDataBytes(r->containers[j].type,r->containers[j].len);
+    return bytes;
+}
+
+/* Write the bitmap in 'buf', that must be roaringBlobLen() bytes long. */
+void roaringSerialize(roaring *r, unsigned char *buf) {
+    uint32_t j, k, u32;
+    uint64_t u64;
+
+    u32 = intrev32ifbe(r->len);
+    memcpy(buf,&u32,4);
+    buf += ROARING_HDR_SIZE;
+    for (j = 0; j < r->len; j++) {
+        roaringContainer *c = r->containers+j;
+        size_t bytes = rcDataBytes(c->type,c->len);
+
+        u64 = intrev64ifbe(r->keys[j]);
+        memcpy(buf,&u64,8);
+        buf[8] = c->type;
+        u32 = intrev32ifbe(c->card);
+        memcpy(buf+9,&u32,4);
+        u32 = intrev32ifbe(c->len);
+        memcpy(buf+13,&u32,4);
+        buf += ROARING_CONTAINER_HDR_SIZE;
+        memcpy(buf,c->data,bytes);
+        if (c->type == ROARING_BITMAP) {
+            for (k = 0; k < ROARING_WORDS; k++) memrev64ifbe(buf+k*8);
+        } else {
+            for (k = 0; k < c->len; k++) memrev16ifbe(buf+k*2);
+        }
+        buf += bytes;
+    }
+}
+
+/* Check the runs or the sorted array of a loaded container. */
+static int rcValidate(roaringContainer *c) {
+    uint32_t j, card = 0;
+
+    if (c->type == ROARING_ARRAY) {
+        if (c->len != c->card || c->card > ROARING_ARRAY_MAX) return 0;
+        for (j = 1; j < c->len; j++)
+            if (c->data[j] <= c->data[j-1]) return 0;
+        return 1;
+    } else if (c->type == ROARING_BITMAP) {
+        return rcPopcount(rcWords(c)) == c->card;
+    } else {
+        if (c->len % 2) return 0;
+        for (j = 0; j < c->len; j += 2) {
+            if ((uint32_t)c->data[j]+c->data[j+1] >= ROARING_CHUNK) return 0;
+            if (j && c->data[j] <= (uint32_t)c->data[j-2]+c->data[j-1]+1)
+                return 0;
+            card += c->data[j+1]+1;
+        }
+        return card == c->card;
+    }
+}
+
+/* Load a bitmap written by roaringSerialize(). Return NULL if the data is
+ * not a valid bitmap. */
+roaring *roaringDeserialize(unsigned char *buf, size_t len) {
+    roaring *r = roaringNew();
+    unsigned char *end = buf+len;
+    uint32_t count, j, k;
+
+    if (len < ROARING_HDR_SIZE) goto err;
+    memcpy(&count,buf,4);
+    count = intrev32ifbe(count);
+    buf += ROARING_HDR_SIZE;
+    for (j = 0; j < count; j++) {
+        roaringContainer c;
+        uint64_t key;
+        size_t bytes;
+
+        if ((size_t)(end-buf) < ROARING_CONTAINER_HDR_SIZE) goto err;
+        memcpy(&key,buf,8);
+        key = intrev64ifbe(key);
+        c.type = buf[8];
+        memcpy(&c.card,buf+9,4);
+        memcpy(&c.len,buf+13,4);
+        c.card = intrev32ifbe(c.card);
+        c.len = intrev32ifbe(c.len);
+        buf += ROARING_CONTAINER_HDR_SIZE;
+        if (c.type > ROARING_RUN || c.card == 0 || c.card > ROARING_CHUNK ||
+            key >> 48 || (r->len && key <= r->keys[r->len-1]) ||
+            c.len > ROARING_CHUNK) goto err;
+        bytes = rcDataBytes(c.type,c.len);
+        if ((size_t)(end-buf) < bytes) goto err;
+
+        c.alloc = (c.type == ROARING_BITMAP) ? 0 : c.len;
+        c.data = zmalloc(bytes ? bytes : 1);
+        memcpy(c.data,buf,bytes);
+        if (c.type == ROARING_BITMAP) {
+            for (k = 0; k < ROARING_WORDS; k++) memrev64ifbe(c.data+k*4);
+        } else {
+            for (k = 0; k < c.len; k++) memrev16ifbe(c.data+k);
+        }
+        buf += bytes;
+        roaringInsertContainer(r,r->len,key,&c);
+        if (!rcValidate(&c)) goto err;
+        r->card += c.card;
+    }
+    if (buf != end) goto err;
+    return r;
+
+err:
+    roaringFree(r);
+    return NULL;
+}
+
+#ifdef ROARING_TEST_MAIN
+#include <sys/time.h>
+#include <time.h>
+
+#define assert(_e) ((_e)?(void)0:(_assert(#_e,__FILE__,__LINE__),exit(1)))
+void _assert(char *estr, char *file, int line) {
+    printf("\n\n=== ASSERTION FAILED ===\n");
+    printf("==> %s:%d '%s' is not true\n",file,line,estr);
+}
+
+long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+#define REF_RANGE (ROARING_CHUNK*4)
+
+/* Check 'r' against the reference membership array 'ref', covering the
+ * integers from 'base' to 'base'+REF_RANGE-1. */
+static void checkAgainst(roaring *r, unsigned char *ref, int64_t base) {
+    roaringIterator it;
+    uint64_t card = 0;
+    int64_t v, prev = 0;
+    unsigned char *blob;
+    roaring *copy;
+    size_t len;
+    int j;
+
+    for (j = 0; j < REF_RANGE; j++) {
+        assert(roaringContains(r,base+j) == ref[j]);
+        card += ref[j];
+    }
+    assert(roaringCard(r) == card);
+    roaringInitIterator(r,&it);
+    while (roaringIteratorNext(&it,&v)) {
+        assert(v >= base && v < base+REF_RANGE && ref[v-base]);
+        assert(card == roaringCard(r) || v > prev);
+        prev = v;
+        card--;
+    }
+    assert(card == 0);
+
+    len = roaringBlobLen(r);
+    blob = zmalloc(len);
+    roaringSerialize(r,blob);
+    copy = roaringDeserialize(blob,len);
+    assert(copy != NULL && roaringCard(copy) == roaringCard(r));
+    assert(roaringDeserialize(blob,len-1) == NULL);
+    roaringFree(copy);
+    zfree(blob);
+}
+
+int main(void) {
+    srand(time(NULL));
+
+    printf("Random adds and removes: "); {
+        unsigned char *ref = zcalloc(REF_RANGE);
+        int64_t base = -ROARING_CHUNK*2;
+        roaring *r = roaringNew();
+        int round, j;
+
+        /* Every round changes the density, to go through all the
+         * container types and conversions. */
+        for (round = 0; round < 12; round++) {
+            int ops = (round % 3 == 2) ? 5000 : 100000;
+            for (j = 0; j < ops; j++) {
+                int v = rand() % REF_RANGE;
+                if (round % 2 == 0) {
+                    assert(roaringAdd(r,base+v) == !ref[v]);
+                    ref[v] = 1;
+                } else {
+                    assert(roaringRemove(r,base+v) == ref[v]);
+                    ref[v] = 0;
+                }
+            }
+            checkAgainst(r,ref,base);
+            roaringOptimize(r);
+            checkAgainst(r,ref,base);
+        }
+        roaringFree(r);
+        zfree(ref);
+        printf("OK\n");
+    }
+
+    printf("Ranges and run containers: "); {
+        unsigned char *ref = zcalloc(REF_RANGE);
+        roaring *r = roaringNew();
+        int j, k;
+
+        for (j = 0; j < 200; j++) {
+            int start = rand() % REF_RANGE, len = rand() % 2000;
+            int add = rand() % 3 != 0;
+            for (k = start; k < start+len && k < REF_RANGE; k++) {
+                if (add) roaringAdd(r,k); else roaringRemove(r,k);
+                ref[k] = add;
+            }
+            if (j % 50 == 0) roaringOptimize(r);
+        }
+        checkAgainst(r,ref,0);
+        roaringFree(r);
+        zfree(ref);
+        printf("OK\n");
+    }
+
+    printf("Set operations: "); {
+        unsigned char *ra = zcalloc(REF_RANGE), *rb = zcalloc(REF_RANGE);
+        unsigned char *ref = zmalloc(REF_RANGE);
+        int round, j, op;
+
+        for (round = 0; round < 20; round++) {
+            roaring *a = roaringNew(), *b = roaringNew(), *r;
+            int na = rand() % 200000, nb = rand() % 200000;
+            memset(ra,0,REF_RANGE);
+            memset(rb,0,REF_RANGE);
+            for (j = 0; j < na; j++) {
+                int v = rand() % (REF_RANGE/2);
+                ra[v] = 1;
+                roaringAdd(a,v);
+            }
+            for (j = 0; j < nb; j++) {
+                int v = rand() % REF_RANGE;
+                if (round % 2) v = (j*3) % REF_RANGE;
+                rb[v] = 1;
+                roaringAdd(b,v);
+            }
+            if (round % 4 == 0) roaringOptimize(b);
+            for (op = 0; op < 3; op++) {
+                if (op == 0) r = roaringAnd(a,b);
+                else if (op == 1) r = roaringOr(a,b);
+                else r = roaringAndNot(a,b);
+                for (j = 0; j < REF_RANGE; j++) {
+                    if (op == 0) ref[j] = ra[j] && rb[j];
+                    else if (op == 1) ref[j] = ra[j] || rb[j];
+                    else ref[j] = ra[j] && !rb[j];
+                }
+                checkAgainst(r,ref,0);
+                roaringFree(r);
+            }
+            r = roaringDup(a);
+            checkAgainst(r,ra,0);
+            roaringFree(r);
+            roaringFree(a);
+            roaringFree(b);
+        }
+        zfree(ra);
+        zfree(rb);
+        zfree(ref);
+        printf("OK\n");
+    }
+
+    printf("Seek and random elements: "); {
+        roaring *r = roaringNew();
+        roaringIterator it;
+        int64_t v;
+        int j;
+
+        for (j = 0; j < 100000; j++) roaringAdd(r,(int64_t)rand()*7919-j);
+        roaringAdd(r,INT64_MIN);
+        roaringAdd(r,INT64_MAX);
+        for (j = 0; j < 1000; j++) {
+            int64_t seek = (int64_t)rand()*7919;
+            roaringInitIterator(r,&it);
+            roaringIteratorSeek(&it,seek);
+            assert(roaringIteratorNext(&it,&v) && v >= seek);
+            assert(roaringContains(r,roaringRandom(r)));
+        }
+        roaringInitIterator(r,&it);
+        assert(roaringIteratorNext(&it,&v) && v == INT64_MIN);
+        roaringIteratorSeek(&it,INT64_MAX);
+        assert(roaringIteratorNext(&it,&v) && v == INT64_MAX);
+        assert(!roaringIteratorNext(&it,&v));
+        roaringFree(r);
+        printf("OK\n");
+    }
+
+    printf("Membership speed:\n"); {
+        long sizes[] = {10000, 1000000};
+        int s;
+
+        for (s = 0; s < 2; s++) {
+            roaring *r = roaringNew();
+            long size = sizes[s], j, hits = 0;
+            long long start;
+
+            for (j = 0; j < size; j++) roaringAdd(r,rand() % (size*4));
+            start = usec();
+            for (j = 0; j < 1000000; j++)
+                hits += roaringContains(r,rand() % (size*4));
+            printf("%8ld elements, %zu bytes serialized: 1M lookups %lld usec "
+                   "(%ld hits)\n", size, roaringBlobLen(r), usec()-start, hits);
+            roaringFree(r);
+        }
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,95 @@
+/* roaring.h - Compressed bitmap of 64 bit integers
+ *
+ * Copyright (c) 2014, Nickey Woo <thenickey at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ROARING_H
+#define __ROARING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* A roaring bitmap is a set of 64 bit signed integers split in chunks of
+ * 65536 values sharing the same high 48 bits. Every non empty chunk is a
+ * container holding the low 16 bits of its integers in one of three ways,
+ * whichever is smaller:
+ *
+ * ARRAY: sorted array of 16 bit integers, up to 4096 of them.
+ * BITMAP: 65536 bits, one for every possible integer.
+ * RUN: sorted array of (start, length-1) pairs of 16 bit integers, for
+ *      ranges of consecutive integers.
+ *
+ * Integers are stored with the sign bit flipped, so that they sort as
+ * unsigned values. */
+#define ROARING_ARRAY 0
+#define ROARING_BITMAP 1
+#define ROARING_RUN 2
+
+typedef struct roaringContainer {
+    uint16_t *data;     /* Array, bitmap words or runs. */
+    uint32_t card;      /* Number of integers, 1 to 65536. */
+    uint32_t len;       /* Used uint16_t slots of arrays and runs. */
+    uint32_t alloc;     /* Allocated uint16_t slots of arrays and runs. */
+    uint32_t type;      /* ROARING_ARRAY, ROARING_BITMAP or ROARING_RUN. */
+} roaringContainer;
+
+typedef struct roaring {
+    uint64_t card;                  /* Total number of integers. */
+    uint32_t len;                   /* Number of containers. */
+    uint32_t alloc;                 /* Allocated containers. */
+    uint64_t *keys;                 /* High 48 bits of every container. */
+    roaringContainer *containers;   /* Containers sorted by key. */
+} roaring;
+
+typedef struct roaringIterator {
+    roaring *r;
+    uint32_t ci;        /* Current container. */
+    uint32_t pos;       /* Array index, bit or run of the container. */
+    uint32_t off;       /* Offset inside the current run. */
+} roaringIterator;
+
+roaring *roaringNew(void);
+void roaringFree(roaring *r);
+roaring *roaringDup(roaring *r);
+int roaringAdd(roaring *r, int64_t value);
+int roaringRemove(roaring *r, int64_t value);
+int roaringContains(roaring *r, int64_t value);
+uint64_t roaringCard(roaring *r);
+int64_t roaringRandom(roaring *r);
+void roaringOptimize(roaring *r);
+roaring *roaringAnd(roaring *a, roaring *b);
+roaring *roaringOr(roaring *a, roaring *b);
+roaring *roaringAndNot(roaring *a, roaring *b);
+void roaringInitIterator(roaring *r, roaringIterator *it);
+void roaringIteratorSeek(roaringIterator *it, int64_t value);
+int roaringIteratorNext(roaringIterator *it, int64_t *value);
+size_t roaringBlobLen(roaring *r);
+void roaringSerialize(roaring *r, unsigned char *buf);
+roaring *roaringDeserialize(unsigned char *buf, size_t len);
+
+#endif /* __ROARING_H */
@@ -363,7 +363,9 @@ dictType instancesDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCompare,         /* key compare */
     NULL,                      /* key destructor */
-    dictInstancesValDestructor /* val destructor */
+    dictInstancesValDestructor, /* val destructor */
+    NULL,                      /* key embed len */
+    NULL                       /* key embed */
 };
 
 /* Instance runid (sds) -> votes (long casted to void*)
@@ -376,7 +378,9 @@ dictType leaderVotesDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCompare,         /* key compare */
     NULL,                      /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    NULL,                      /* key embed len */
+    NULL                       /* key embed */
 };
 
 /* =========================== Initialization =============================== */
@@ -42,94 +42,119 @@ redisSortOperation *createSortOperation(int type, robj *pattern) {
     return so;
 }
 
+/* A BY or GET pattern, parsed just once per SORT call. Looking up the key
+ * of an element then only needs to copy the element into the name of the
+ * key object owned by the pattern, without any allocation. */
+typedef struct sortPattern {
+    robj *pattern;  /* The pattern as given by the user. */
+    int self;       /* The pattern is "#", that is the element itself. */
+    int prefixlen;  /* Length of the part before the '*', -1 if no '*'. */
+    int postfixlen; /* Length of the part after the '*' and before "->". */
+    robj *field;    /* Hash field on the right of "->", or NULL. */
+    robj *keyobj;   /* Object holding the name of the key to lookup. */
+} sortPattern;
+
+static void sortPatternInit(sortPattern *sp, robj *pattern) {
+    sds spat = pattern->ptr;
+    char *p, *f;
+    int fieldlen = 0;
+
+    sp->pattern = pattern;
+    sp->self = spat[0] == '#' && spat[1] == '\0';
+    sp->prefixlen = -1;
+    sp->postfixlen = 0;
+    sp->field = NULL;
+    sp->keyobj = NULL;
+    if (sp->self) return;
+
+    /* If we can't find '*' in the pattern the lookups return NULL, as to
+     * GET a fixed key does not make sense. */
+    p = strchr(spat,'*');
+    if (!p) return;
+
+    /* Find out if we're dealing with a hash dereference. */
+    if ((f = strstr(p+1, "->")) != NULL && *(f+2) != '\0') {
+        fieldlen = sdslen(spat)-(f-spat)-2;
+        sp->field = createStringObject(f+2,fieldlen);
+    }
+    sp->prefixlen = p-spat;
+    sp->postfixlen = sdslen(spat)-(sp->prefixlen+1)-
+                     (fieldlen ? fieldlen+2 : 0);
+    sp->keyobj = createObject(REDIS_STRING,sdsempty());
+}
+
+static void sortPatternRelease(sortPattern *sp) {
+    if (sp->field) decrRefCount(sp->field);
+    if (sp->keyobj) decrRefCount(sp->keyobj);
+}
+
 /* Return the value associated to the key with a name obtained using
  * the following rules:
  *
- * 1) The first occurrence of '*' in 'pattern' is substituted with 'subst'.
+ * 1) The first occurrence of '*' in the pattern is substituted with 'subst'.
  *
- * 2) If 'pattern' matches the "->" string, everything on the left of
+ * 2) If the pattern matches the "->" string, everything on the left of
  *    the arrow is treated as the name of a hash field, and the part on the
  *    left as the key name containing a hash. The value of the specified
  *    field is returned.
  *
- * 3) If 'pattern' equals "#", the function simply returns 'subst' itself so
- *    that the SORT command can be used like: SORT key GET # to retrieve
+ * 3) If the pattern equals "#", the function simply returns 'subst' itself
+ *    so that the SORT command can be used like: SORT key GET # to retrieve
  *    the Set/List elements directly.
  *
  * The returned object will always have its refcount increased by 1
  * when it is non-NULL. */
-robj *lookupKeyByPattern(redisDb *db, robj *pattern, robj *subst) {
-    char *p, *f, *k;
-    sds spat, ssub;
-    robj *keyobj, *fieldobj = NULL, *o;
-    int prefixlen, sublen, postfixlen, fieldlen;
-
-    /* If the pattern is "#" return the substitution object itself in order
-     * to implement the "SORT ... GET #" feature. */
-    spat = pattern->ptr;
-    if (spat[0] == '#' && spat[1] == '\0') {
+static robj *sortPatternLookup(redisDb *db, sortPattern *sp, robj *subst) {
+    sds spat = sp->pattern->ptr;
+    char *s, llbuf[32];
+    size_t slen;
+    robj *o;
+
+    if (sp->self) {
         incrRefCount(subst);
         return subst;
     }
+    if (sp->prefixlen == -1) return NULL;
 
-    /* The substitution object may be specially encoded. If so we create
-     * a decoded object on the fly. Otherwise getDecodedObject will just
-     * increment the ref count, that we'll decrement later. */
-    subst = getDecodedObject(subst);
-    ssub = subst->ptr;
-
-    /* If we can't find '*' in the pattern we return NULL as to GET a
-     * fixed key does not make sense. */
-    p = strchr(spat,'*');
-    if (!p) {
-        decrRefCount(subst);
-        return NULL;
-    }
-
-    /* Find out if we're dealing with a hash dereference. */
-    if ((f = strstr(p+1, "->")) != NULL && *(f+2) != '\0') {
-        fieldlen = sdslen(spat)-(f-spat)-2;
-        fieldobj = createStringObject(f+2,fieldlen);
+    /* The substitution object may be integer encoded. */
+    if (sdsEncodedObject(subst)) {
+        s = subst->ptr;
+        slen = sdslen(s);
     } else {
-        fieldlen = 0;
+        s = llbuf;
+        slen = ll2string(llbuf,sizeof(llbuf),(long)subst->ptr);
     }
 
-    /* Perform the '*' substitution. */
-    prefixlen = p-spat;
-    sublen = sdslen(ssub);
-    postfixlen = sdslen(spat)-(prefixlen+1)-(fieldlen ? fieldlen+2 : 0);
-    keyobj = createStringObject(NULL,prefixlen+sublen+postfixlen);
-    k = keyobj->ptr;
-    memcpy(k,spat,prefixlen);
-    memcpy(k+prefixlen,ssub,sublen);
-    memcpy(k+prefixlen+sublen,p+1,postfixlen);
-    decrRefCount(subst); /* Incremented by decodeObject() */
+    /* Perform the '*' substitution into the key object of the pattern. If
+     * the lookup of a previous key retained a reference to the object, for
+     * instance to propagate the expire of the key, we can't modify it. */
+    if (sp->keyobj->refcount != 1) {
+        decrRefCount(sp->keyobj);
+        sp->keyobj = createObject(REDIS_STRING,sdsempty());
+    }
+    sp->keyobj->ptr = sdscpylen(sp->keyobj->ptr,spat,sp->prefixlen);
+    sp->keyobj->ptr = sdscatlen(sp->keyobj->ptr,s,slen);
+    sp->keyobj->ptr = sdscatlen(sp->keyobj->ptr,spat+sp->prefixlen+1,
+                                sp->postfixlen);
 
     /* Lookup substituted key */
-    o = lookupKeyRead(db,keyobj);
-    if (o == NULL) goto noobj;
+    o = lookupKeyRead(db,sp->keyobj);
+    if (o == NULL) return NULL;
 
-    if (fieldobj) {
-        if (o->type != REDIS_HASH) goto noobj;
+    if (sp->field) {
+        if (o->type != REDIS_HASH) return NULL;
 
         /* Retrieve value from hash by the field name. This operation
          * already increases the refcount of the returned object. */
-        o = hashTypeGetObject(o, fieldobj);
+        return hashTypeGetObject(o,sp->field);
     } else {
-        if (o->type != REDIS_STRING) goto noobj;
+        if (o->type != REDIS_STRING) return NULL;
 
         /* Every object that this function returns needs to have its refcount
          * increased. sortCommand decreases it again. */
         incrRefCount(o);
+        return o;
     }
-    decrRefCount(keyobj);
-    if (fieldobj) decrRefCount(fieldobj);
-    return o;
-
-noobj:
-    decrRefCount(keyobj);
-    if (fieldlen) decrRefCount(fieldobj);
-    return NULL;
 }
 
 /* sortCompare() is used by qsort in sortCommand(). Given that qsort_r with
@@ -184,18 +209,157 @@ int sortCompare(const void *s1, const void *s2) {
     return server.sort_desc ? -cmp : cmp;
 }
 
+/* Return a sorting vector able to hold 'size' elements. Vectors of up to
+ * REDIS_SORT_POOL_SIZE elements, that is the common case of SORT with a
+ * small LIMIT or of small collections, are taken from a buffer allocated
+ * once per server, so that most calls don't allocate the vector at all. */
+static redisSortObject *sortVectorAlloc(long size) {
+    if (size <= REDIS_SORT_POOL_SIZE) {
+        if (server.sort_pool == NULL)
+            server.sort_pool =
+                zmalloc(sizeof(redisSortObject)*REDIS_SORT_POOL_SIZE);
+        return server.sort_pool;
+    }
+    return zmalloc(sizeof(redisSortObject)*size);
+}
+
+static void sortVectorFree(redisSortObject *vector) {
+    if (vector != server.sort_pool) zfree(vector);
+}
+
+/* State of the loading of the elements to sort into the sorting vector.
+ *
+ * When just the first elements of the output are needed (SORT with LIMIT)
+ * and they are a small part of the input, the vector is used as a heap
+ * holding only the 'size' first elements in output order found so far,
+ * with the last of them on top, so that every element is compared with
+ * the top and either discarded or swapped with it in O(log(size)). This
+ * way the input is never loaded in memory as a whole. */
+typedef struct sortLoader {
+    redisClient *c;
+    redisSortObject *vector;
+    long len;               /* Number of elements in the vector. */
+    long size;              /* Number of elements the vector can hold. */
+    int heap;               /* Keep just the first 'size' elements. */
+    int owned;              /* Elements are referenced by the vector. */
+    int dontsort;
+    int alpha;
+    sortPattern *sortby;    /* BY pattern, or NULL. */
+    int conversion_error;   /* Set if a score is not a valid double. */
+} sortLoader;
+
+/* If the elements are not sorted, loading stops when the vector is full. */
+#define sortLoaderFull(l) ((l)->dontsort && (l)->len == (l)->size)
+
+/* Load the score, or the object to compare for ALPHA sorting, of the
+ * element of 'so'. */
+static void sortLoadWeight(sortLoader *l, redisSortObject *so) {
+    robj *byval;
+
+    if (l->sortby) {
+        /* lookup value to sort by */
+        byval = sortPatternLookup(l->c->db,l->sortby,so->obj);
+        if (!byval) return;
+    } else {
+        /* use object itself to sort by */
+        byval = so->obj;
+    }
+
+    if (l->alpha) {
+        if (l->sortby) so->u.cmpobj = getDecodedObject(byval);
+    } else {
+        if (sdsEncodedObject(byval)) {
+            char *eptr;
+
+            so->u.score = strtod(byval->ptr,&eptr);
+            if (eptr[0] != '\0' || errno == ERANGE || isnan(so->u.score))
+                l->conversion_error = 1;
+        } else if (byval->encoding == REDIS_ENCODING_INT) {
+            /* Don't need to decode the object if it's
+             * integer-encoded (the only encoding supported) so
+             * far. We can just cast it */
+            so->u.score = (long)byval->ptr;
+        } else {
+            redisAssertWithInfo(l->c,byval,1 != 1);
+        }
+    }
+
+    /* when the object was retrieved using sortPatternLookup(),
+     * its refcount needs to be decreased. */
+    if (l->sortby) decrRefCount(byval);
+}
+
+/* Release the references taken by the sorting vector entry 'so'. */
+static void sortReleaseObject(sortLoader *l, redisSortObject *so) {
+    if (l->owned) decrRefCount(so->obj);
+    if (l->alpha && so->u.cmpobj) decrRefCount(so->u.cmpobj);
+}
+
+static void sortHeapSwap(redisSortObject *v, long a, long b) {
+    redisSortObject tmp = v[a];
+
+    v[a] = v[b];
+    v[b] = tmp;
+}
+
+static void sortHeapSiftUp(redisSortObject *v, long j) {
+    while(j > 0) {
+        long parent = (j-1)/2;
+
+        if (sortCompare(v+j,v+parent) <= 0) break;
+        sortHeapSwap(v,j,parent);
+        j = parent;
+    }
+}
+
+static void sortHeapSiftDown(redisSortObject *v, long len, long j) {
+    while(1) {
+        long child = j*2+1;
+
+        if (child >= len) break;
+        if (child+1 < len && sortCompare(v+child+1,v+child) > 0) child++;
+        if (sortCompare(v+child,v+j) <= 0) break;
+        sortHeapSwap(v,j,child);
+        j = child;
+    }
+}
+
+/* Add the element 'obj' to the elements to sort. If the vector is used as
+ * a heap and is full, the element replaces the top of the heap if it comes
+ * before it in the output, otherwise it is discarded. */
+static void sortLoadElement(sortLoader *l, robj *obj) {
+    redisSortObject so;
+
+    so.obj = obj;
+    so.u.score = 0;
+    so.u.cmpobj = NULL;
+    if (!l->dontsort) sortLoadWeight(l,&so);
+
+    if (l->len < l->size) {
+        l->vector[l->len++] = so;
+        if (l->heap) sortHeapSiftUp(l->vector,l->len-1);
+    } else if (l->heap && l->size && sortCompare(&so,l->vector) < 0) {
+        sortReleaseObject(l,l->vector);
+        l->vector[0] = so;
+        sortHeapSiftDown(l->vector,l->len,0);
+    } else {
+        sortReleaseObject(l,&so);
+    }
+}
+
 /* The SORT command is the most complex command in Redis. Warning: this code
  * is optimized for speed and a bit less for readability */
 void sortCommand(redisClient *c) {
     list *operations;
     unsigned int outputlen = 0;
     int desc = 0, alpha = 0;
-    long limit_start = 0, limit_count = -1, start, end;
-    int j, dontsort = 0, vectorlen;
+    long limit_start = 0, limit_count = -1, start, end, topcount;
+    int j, k, dontsort = 0, vectorlen;
     int getop = 0; /* GET operation counter */
-    int int_convertion_error = 0;
     robj *sortval, *sortby = NULL, *storekey = NULL;
     redisSortObject *vector; /* Resulting vector to sort */
+    sortPattern bypattern, *getpatterns;
+    sortLoader loader;
 
     /* Lookup the key to sort. It must be of the right types */
     sortval = lookupKeyRead(c->db,c->argv[1]);
@@ -219,7 +383,7 @@ void sortCommand(redisClient *c) {
     if (sortval)
         incrRefCount(sortval);
     else
-        sortval = createListObject();
+        sortval = createQuicklistObject();
 
     /* The SORT command has an SQL-alike syntax, parse it */
     while(j < c->argc) {
@@ -281,6 +445,20 @@ void sortCommand(redisClient *c) {
         sortby = NULL;
     }
 
+    /* Parse the BY and GET patterns once, instead of once per element. */
+    if (sortby) sortPatternInit(&bypattern,sortby);
+    getpatterns = zmalloc(sizeof(sortPattern)*getop);
+    {
+        listNode *ln;
+        listIter li;
+
+        listRewind(operations,&li);
+        for (k = 0; (ln = listNext(&li)); k++) {
+            redisSortOperation *sop = ln->value;
+            sortPatternInit(getpatterns+k,sop->pattern);
+        }
+    }
+
     /* Destructively convert encoded sorted sets for SORT. */
     if (sortval->type == REDIS_ZSET)
         zsetConvert(sortval, REDIS_ENCODING_SKIPLIST);
@@ -302,6 +480,10 @@ void sortCommand(redisClient *c) {
     }
     if (end >= vectorlen) end = vectorlen-1;
 
+    /* Number of elements, from the first one in the output, that we need
+     * in order to produce the output. */
+    topcount = (end >= start) ? end+1 : 0;
+
     /* Optimization:
      *
      * 1) if the object to sort is a sorted set.
@@ -319,28 +501,50 @@ void sortCommand(redisClient *c) {
         vectorlen = end-start+1;
     }
 
-    /* Load the sorting vector with all the objects to sort */
-    vector = zmalloc(sizeof(redisSortObject)*vectorlen);
+    /* Setup the loading of the elements. If there is nothing to sort, just
+     * the first 'topcount' elements are loaded. If LIMIT selects elements
+     * near the start of the output, we keep just the first 'topcount' ones
+     * in a heap while loading, instead of loading and sorting everything. */
+    loader.c = c;
+    loader.len = 0;
+    loader.size = vectorlen;
+    loader.heap = 0;
+    loader.owned = sortval->type == REDIS_LIST || sortval->type == REDIS_SET;
+    loader.dontsort = dontsort;
+    loader.alpha = alpha;
+    loader.sortby = sortby ? &bypattern : NULL;
+    loader.conversion_error = 0;
+    if (dontsort) {
+        if (sortval->type != REDIS_ZSET) loader.size = topcount;
+    } else if (topcount <= vectorlen/REDIS_SORT_HEAP_RATIO) {
+        loader.size = topcount;
+        loader.heap = 1;
+    }
+
+    if (dontsort == 0) {
+        server.sort_desc = desc;
+        server.sort_alpha = alpha;
+        server.sort_bypattern = sortby ? 1 : 0;
+        server.sort_store = storekey ? 1 : 0;
+    }
+
+    /* Load the sorting vector with the objects to sort */
+    vector = loader.vector = sortVectorAlloc(loader.size);
     j = 0;
 
     if (sortval->type == REDIS_LIST) {
         listTypeIterator *li = listTypeInitIterator(sortval,0,REDIS_TAIL);
         listTypeEntry entry;
-        while(listTypeNext(li,&entry)) {
-            vector[j].obj = listTypeGet(&entry);
-            vector[j].u.score = 0;
-            vector[j].u.cmpobj = NULL;
-            j++;
-        }
+        while(!sortLoaderFull(&loader) && listTypeNext(li,&entry))
+            sortLoadElement(&loader,listTypeGet(&entry));
         listTypeReleaseIterator(li);
     } else if (sortval->type == REDIS_SET) {
         setTypeIterator *si = setTypeInitIterator(sortval);
         robj *ele;
-        while((ele = setTypeNextObject(si)) != NULL) {
-            vector[j].obj = ele;
-            vector[j].u.score = 0;
-            vector[j].u.cmpobj = NULL;
-            j++;
+        while(!sortLoaderFull(&loader) &&
+              (ele = setTypeNextObject(si)) != NULL)
+        {
+            sortLoadElement(&loader,ele);
         }
         setTypeReleaseIterator(si);
     } else if (sortval->type == REDIS_ZSET && dontsort) {
@@ -354,7 +558,6 @@ void sortCommand(redisClient *c) {
         zset *zs = sortval->ptr;
         zskiplist *zsl = zs->zsl;
         zskiplistNode *ln;
-        robj *ele;
         int rangelen = vectorlen;
 
         /* Check if starting point is trivial, before doing log(N) lookup. */
@@ -372,11 +575,7 @@ void sortCommand(redisClient *c) {
 
         while(rangelen--) {
             redisAssertWithInfo(c,sortval,ln != NULL);
-            ele = ln->obj;
-            vector[j].obj = ele;
-            vector[j].u.score = 0;
-            vector[j].u.cmpobj = NULL;
-            j++;
+            sortLoadElement(&loader,ln->obj);
             ln = desc ? ln->backward : ln->level[0].forward;
         }
         /* The code producing the output does not know that in the case of
@@ -390,76 +589,28 @@ void sortCommand(redisClient *c) {
         dictIterator *di;
         dictEntry *setele;
         di = dictGetIterator(set);
-        while((setele = dictNext(di)) != NULL) {
-            vector[j].obj = dictGetKey(setele);
-            vector[j].u.score = 0;
-            vector[j].u.cmpobj = NULL;
-            j++;
-        }
+        while((setele = dictNext(di)) != NULL)
+            sortLoadElement(&loader,dictGetKey(setele));
         dictReleaseIterator(di);
     } else {
         redisPanic("Unknown type");
     }
-    redisAssertWithInfo(c,sortval,j == vectorlen);
+    redisAssertWithInfo(c,sortval,loader.len == loader.size);
 
-    /* Now it's time to load the right scores in the sorting vector */
+    /* Sort the loaded elements. If just a range of the output is needed,
+     * a partial sort is enough to put the elements of the range in place. */
     if (dontsort == 0) {
-        for (j = 0; j < vectorlen; j++) {
-            robj *byval;
-            if (sortby) {
-                /* lookup value to sort by */
-                byval = lookupKeyByPattern(c->db,sortby,vector[j].obj);
-                if (!byval) continue;
-            } else {
-                /* use object itself to sort by */
-                byval = vector[j].obj;
-            }
-
-            if (alpha) {
-                if (sortby) vector[j].u.cmpobj = getDecodedObject(byval);
-            } else {
-                if (byval->encoding == REDIS_ENCODING_RAW) {
-                    char *eptr;
-
-                    vector[j].u.score = strtod(byval->ptr,&eptr);
-                    if (eptr[0] != '\0' || errno == ERANGE ||
-                        isnan(vector[j].u.score))
-                    {
-                        int_convertion_error = 1;
-                    }
-                } else if (byval->encoding == REDIS_ENCODING_INT) {
-                    /* Don't need to decode the object if it's
-                     * integer-encoded (the only encoding supported) so
-                     * far. We can just cast it */
-                    vector[j].u.score = (long)byval->ptr;
-                } else {
-                    redisAssertWithInfo(c,sortval,1 != 1);
-                }
-            }
-
-            /* when the object was retrieved using lookupKeyByPattern,
-             * its refcount needs to be decreased. */
-            if (sortby) {
-                decrRefCount(byval);
-            }
-        }
-    }
-
-    if (dontsort == 0) {
-        server.sort_desc = desc;
-        server.sort_alpha = alpha;
-        server.sort_bypattern = sortby ? 1 : 0;
-        server.sort_store = storekey ? 1 : 0;
-        if (sortby && (start != 0 || end != vectorlen-1))
-            pqsort(vector,vectorlen,sizeof(redisSortObject),sortCompare, start,end);
+        if (start != 0 || end != loader.len-1)
+            pqsort(vector,loader.len,sizeof(redisSortObject),sortCompare,
+                   start,end);
         else
-            qsort(vector,vectorlen,sizeof(redisSortObject),sortCompare);
+            qsort(vector,loader.len,sizeof(redisSortObject),sortCompare);
     }
 
     /* Send command output to the output buffer, performing the specified
      * GET/DEL/INCR/DECR operations if any. */
     outputlen = getop ? getop*(end-start+1) : end-start+1;
-    if (int_convertion_error) {
+    if (loader.conversion_error) {
         addReplyError(c,"One or more scores can't be converted into double");
     } else if (storekey == NULL) {
         /* STORE option not specified, sent the sorting result to client */
@@ -470,9 +621,9 @@ void sortCommand(redisClient *c) {
 
             if (!getop) addReplyBulk(c,vector[j].obj);
             listRewind(operations,&li);
-            while((ln = listNext(&li))) {
+            for (k = 0; (ln = listNext(&li)); k++) {
                 redisSortOperation *sop = ln->value;
-                robj *val = lookupKeyByPattern(c->db,sop->pattern,
+                robj *val = sortPatternLookup(c->db,getpatterns+k,
                     vector[j].obj);
 
                 if (sop->type == REDIS_SORT_GET) {
@@ -489,7 +640,7 @@ void sortCommand(redisClient *c) {
             }
         }
     } else {
-        robj *sobj = createZiplistObject();
+        robj *sobj = createListpackObject();
 
         /* STORE option specified, set the sorting result as a List object */
         for (j = start; j <= end; j++) {
@@ -500,9 +651,9 @@ void sortCommand(redisClient *c) {
                 listTypePush(sobj,vector[j].obj,REDIS_TAIL);
             } else {
                 listRewind(operations,&li);
-                while((ln = listNext(&li))) {
+                for (k = 0; (ln = listNext(&li)); k++) {
                     redisSortOperation *sop = ln->value;
-                    robj *val = lookupKeyByPattern(c->db,sop->pattern,
+                    robj *val = sortPatternLookup(c->db,getpatterns+k,
                         vector[j].obj);
 
                     if (sop->type == REDIS_SORT_GET) {
@@ -510,7 +661,7 @@ void sortCommand(redisClient *c) {
 
                         /* listTypePush does an incrRefCount, so we should take care
                          * care of the incremented refcount caused by either
-                         * lookupKeyByPattern or createStringObject("",0) */
+                         * sortPatternLookup or createStringObject("",0) */
                         listTypePush(sobj,val,REDIS_TAIL);
                         decrRefCount(val);
                     } else {
@@ -535,14 +686,13 @@ void sortCommand(redisClient *c) {
     }
 
     /* Cleanup */
-    if (sortval->type == REDIS_LIST || sortval->type == REDIS_SET)
-        for (j = 0; j < vectorlen; j++)
-            decrRefCount(vector[j].obj);
+    for (j = 0; j < loader.len; j++)
+        sortReleaseObject(&loader,vector+j);
+    sortVectorFree(vector);
+    if (sortby) sortPatternRelease(&bypattern);
+    for (k = 0; k < getop; k++)
+        sortPatternRelease(getpatterns+k);
+    zfree(getpatterns);
     decrRefCount(sortval);
     listRelease(operations);
-    for (j = 0; j < vectorlen; j++) {
-        if (alpha && vector[j].u.cmpobj)
-            decrRefCount(vector[j].u.cmpobj);
-    }
-    zfree(vector);
 }
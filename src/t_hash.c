@@ -35,20 +35,27 @@
  *----------------------------------------------------------------------------*/
 
 /* Check the length of a number of objects to see if we need to convert a
- * ziplist to a real hash. Note that we only check string encoded objects
- * as their string length can be queried in constant time. */
+ * listpack to a hashpack, or a hashpack to a real hash. Note that we only
+ * check string encoded objects as their string length can be queried in
+ * constant time. */
 void hashTypeTryConversion(robj *o, robj **argv, int start, int end) {
+    size_t maxlen = 0;
     int i;
 
-    if (o->encoding != REDIS_ENCODING_ZIPLIST) return;
+    if (o->encoding != REDIS_ENCODING_LISTPACK &&
+        o->encoding != REDIS_ENCODING_HASHPACK) return;
 
     for (i = start; i <= end; i++) {
-        if (argv[i]->encoding == REDIS_ENCODING_RAW &&
-            sdslen(argv[i]->ptr) > server.hash_max_ziplist_value)
-        {
-            hashTypeConvert(o, REDIS_ENCODING_HT);
-            break;
-        }
+        if (sdsEncodedObject(argv[i]) && sdslen(argv[i]->ptr) > maxlen)
+            maxlen = sdslen(argv[i]->ptr);
+    }
+
+    if (maxlen > server.hash_max_hashpack_value) {
+        hashTypeConvert(o, REDIS_ENCODING_HT);
+    } else if (o->encoding == REDIS_ENCODING_LISTPACK &&
+               maxlen > server.hash_max_ziplist_value)
+    {
+        hashTypeConvert(o, REDIS_ENCODING_HASHPACK);
     }
 }
 
@@ -60,27 +67,27 @@ void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2) {
     }
 }
 
-/* Get the value from a ziplist encoded hash, identified by field.
+/* Get the value from a listpack encoded hash, identified by field.
  * Returns -1 when the field cannot be found. */
-int hashTypeGetFromZiplist(robj *o, robj *field,
-                           unsigned char **vstr,
-                           unsigned int *vlen,
-                           long long *vll)
+int hashTypeGetFromListpack(robj *o, robj *field,
+                            unsigned char **vstr,
+                            unsigned int *vlen,
+                            long long *vll)
 {
     unsigned char *zl, *fptr = NULL, *vptr = NULL;
     int ret;
 
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
 
     field = getDecodedObject(field);
 
     zl = o->ptr;
-    fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+    fptr = lpIndex(zl, LISTPACK_HEAD);
     if (fptr != NULL) {
-        fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+        fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
         if (fptr != NULL) {
             /* Grab pointer to the value (fptr points to the field) */
-            vptr = ziplistNext(zl, fptr);
+            vptr = lpNext(zl, fptr);
             redisAssert(vptr != NULL);
         }
     }
@@ -88,7 +95,7 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
     decrRefCount(field);
 
     if (vptr != NULL) {
-        ret = ziplistGet(vptr, vstr, vlen, vll);
+        ret = lpGet(vptr, vstr, vlen, vll);
         redisAssert(ret);
         return 0;
     }
@@ -96,6 +103,26 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
     return -1;
 }
 
+/* Get the value from a hashpack encoded hash, identified by field.
+ * Returns -1 when the field cannot be found. */
+int hashTypeGetFromHashpack(robj *o, robj *field,
+                            unsigned char **vstr,
+                            unsigned int *vlen)
+{
+    uint32_t len;
+    int found;
+
+    redisAssert(o->encoding == REDIS_ENCODING_HASHPACK);
+
+    field = getDecodedObject(field);
+    found = hpFind(o->ptr, field->ptr, sdslen(field->ptr), vstr, &len);
+    decrRefCount(field);
+
+    if (!found) return -1;
+    *vlen = len;
+    return 0;
+}
+
 /* Get the value from a hash table encoded hash, identified by field.
  * Returns -1 when the field cannot be found. */
 int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
@@ -118,12 +145,12 @@ int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
 robj *hashTypeGetObject(robj *o, robj *field) {
     robj *value = NULL;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) {
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) {
             if (vstr) {
                 value = createStringObject((char*)vstr, vlen);
             } else {
@@ -131,6 +158,13 @@ robj *hashTypeGetObject(robj *o, robj *field) {
             }
         }
 
+    } else if (o->encoding == REDIS_ENCODING_HASHPACK) {
+        unsigned char *vstr;
+        unsigned int vlen;
+
+        if (hashTypeGetFromHashpack(o, field, &vstr, &vlen) == 0)
+            value = createStringObject((char*)vstr, vlen);
+
     } else if (o->encoding == REDIS_ENCODING_HT) {
         robj *aux;
 
@@ -147,12 +181,17 @@ robj *hashTypeGetObject(robj *o, robj *field) {
 /* Test if the specified field exists in the given hash. Returns 1 if the field
  * exists, and 0 when it doesn't. */
 int hashTypeExists(robj *o, robj *field) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) return 1;
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) return 1;
+    } else if (o->encoding == REDIS_ENCODING_HASHPACK) {
+        unsigned char *vstr;
+        unsigned int vlen;
+
+        if (hashTypeGetFromHashpack(o, field, &vstr, &vlen) == 0) return 1;
     } else if (o->encoding == REDIS_ENCODING_HT) {
         robj *aux;
 
@@ -170,41 +209,59 @@ int hashTypeExists(robj *o, robj *field) {
 int hashTypeSet(robj *o, robj *field, robj *value) {
     int update = 0;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr, *vptr;
 
         field = getDecodedObject(field);
         value = getDecodedObject(value);
 
         zl = o->ptr;
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        fptr = lpIndex(zl, LISTPACK_HEAD);
         if (fptr != NULL) {
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
             if (fptr != NULL) {
                 /* Grab pointer to the value (fptr points to the field) */
-                vptr = ziplistNext(zl, fptr);
+                vptr = lpNext(zl, fptr);
                 redisAssert(vptr != NULL);
                 update = 1;
 
                 /* Delete value */
-                zl = ziplistDelete(zl, &vptr);
+                zl = lpDelete(zl, &vptr);
 
                 /* Insert new value */
-                zl = ziplistInsert(zl, vptr, value->ptr, sdslen(value->ptr));
+                zl = lpInsert(zl, vptr, value->ptr, sdslen(value->ptr));
             }
         }
 
         if (!update) {
-            /* Push new field/value pair onto the tail of the ziplist */
-            zl = ziplistPush(zl, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            zl = ziplistPush(zl, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            /* Push new field/value pair onto the tail of the listpack */
+            zl = lpPush(zl, field->ptr, sdslen(field->ptr), LISTPACK_TAIL);
+            zl = lpPush(zl, value->ptr, sdslen(value->ptr), LISTPACK_TAIL);
         }
         o->ptr = zl;
         decrRefCount(field);
         decrRefCount(value);
 
-        /* Check if the ziplist needs to be converted to a hash table */
+        /* Check if the listpack needs to be converted to a hashpack */
         if (hashTypeLength(o) > server.hash_max_ziplist_entries)
+            hashTypeConvert(o, REDIS_ENCODING_HASHPACK);
+    } else if (o->encoding == REDIS_ENCODING_HASHPACK &&
+               !hpSafeToAdd(o->ptr,stringObjectLen(field),
+                            stringObjectLen(value)))
+    {
+        /* The hashpack would grow too big, the hash needs a real table. */
+        hashTypeConvert(o, REDIS_ENCODING_HT);
+        return hashTypeSet(o, field, value);
+    } else if (o->encoding == REDIS_ENCODING_HASHPACK) {
+        field = getDecodedObject(field);
+        value = getDecodedObject(value);
+        update = hpSet(o->ptr, field->ptr, sdslen(field->ptr),
+                       value->ptr, sdslen(value->ptr));
+        decrRefCount(field);
+        decrRefCount(value);
+
+        /* Check if the hashpack needs to be converted to a hash table */
+        if (hashTypeLength(o) > server.hash_max_hashpack_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
     } else if (o->encoding == REDIS_ENCODING_HT) {
         if (dictReplace(o->ptr, field, value)) { /* Insert */
@@ -224,18 +281,18 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
 int hashTypeDelete(robj *o, robj *field) {
     int deleted = 0;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr;
 
         field = getDecodedObject(field);
 
         zl = o->ptr;
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        fptr = lpIndex(zl, LISTPACK_HEAD);
         if (fptr != NULL) {
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
             if (fptr != NULL) {
-                zl = ziplistDelete(zl,&fptr);
-                zl = ziplistDelete(zl,&fptr);
+                zl = lpDelete(zl,&fptr);
+                zl = lpDelete(zl,&fptr);
                 o->ptr = zl;
                 deleted = 1;
             }
@@ -243,6 +300,11 @@ int hashTypeDelete(robj *o, robj *field) {
 
         decrRefCount(field);
 
+    } else if (o->encoding == REDIS_ENCODING_HASHPACK) {
+        field = getDecodedObject(field);
+        deleted = hpDelete(o->ptr, field->ptr, sdslen(field->ptr));
+        decrRefCount(field);
+
     } else if (o->encoding == REDIS_ENCODING_HT) {
         if (dictDelete((dict*)o->ptr, field) == REDIS_OK) {
             deleted = 1;
@@ -262,8 +324,10 @@ int hashTypeDelete(robj *o, robj *field) {
 unsigned long hashTypeLength(robj *o) {
     unsigned long length = ULONG_MAX;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        length = ziplistLen(o->ptr) / 2;
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        length = lpLength(o->ptr) / 2;
+    } else if (o->encoding == REDIS_ENCODING_HASHPACK) {
+        length = hpLength(o->ptr);
     } else if (o->encoding == REDIS_ENCODING_HT) {
         length = dictSize((dict*)o->ptr);
     } else {
@@ -278,9 +342,11 @@ hashTypeIterator *hashTypeInitIterator(robj *subject) {
     hi->subject = subject;
     hi->encoding = subject->encoding;
 
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         hi->fptr = NULL;
         hi->vptr = NULL;
+    } else if (hi->encoding == REDIS_ENCODING_HASHPACK) {
+        hi->cursor = 0;
     } else if (hi->encoding == REDIS_ENCODING_HT) {
         hi->di = dictGetIterator(subject->ptr);
     } else {
@@ -301,7 +367,7 @@ void hashTypeReleaseIterator(hashTypeIterator *hi) {
 /* Move to the next entry in the hash. Return REDIS_OK when the next entry
  * could be found and REDIS_ERR when the iterator reaches the end. */
 int hashTypeNext(hashTypeIterator *hi) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl;
         unsigned char *fptr, *vptr;
 
@@ -312,21 +378,24 @@ int hashTypeNext(hashTypeIterator *hi) {
         if (fptr == NULL) {
             /* Initialize cursor */
             redisAssert(vptr == NULL);
-            fptr = ziplistIndex(zl, 0);
+            fptr = lpIndex(zl, 0);
         } else {
             /* Advance cursor */
             redisAssert(vptr != NULL);
-            fptr = ziplistNext(zl, vptr);
+            fptr = lpNext(zl, vptr);
         }
         if (fptr == NULL) return REDIS_ERR;
 
         /* Grab pointer to the value (fptr points to the field) */
-        vptr = ziplistNext(zl, fptr);
+        vptr = lpNext(zl, fptr);
         redisAssert(vptr != NULL);
 
         /* fptr, vptr now point to the first or next pair */
         hi->fptr = fptr;
         hi->vptr = vptr;
+    } else if (hi->encoding == REDIS_ENCODING_HASHPACK) {
+        if (!hpNext(hi->subject->ptr, &hi->cursor, &hi->fptr, &hi->flen,
+                    &hi->vptr, &hi->vlen)) return REDIS_ERR;
     } else if (hi->encoding == REDIS_ENCODING_HT) {
         if ((hi->de = dictNext(hi->di)) == NULL) return REDIS_ERR;
     } else {
@@ -336,27 +405,44 @@ int hashTypeNext(hashTypeIterator *hi) {
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromZiplist`. */
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
-                                unsigned char **vstr,
-                                unsigned int *vlen,
-                                long long *vll)
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromListpack`. */
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
+                                 unsigned char **vstr,
+                                 unsigned int *vlen,
+                                 long long *vll)
 {
     int ret;
 
-    redisAssert(hi->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(hi->encoding == REDIS_ENCODING_LISTPACK);
 
     if (what & REDIS_HASH_KEY) {
-        ret = ziplistGet(hi->fptr, vstr, vlen, vll);
+        ret = lpGet(hi->fptr, vstr, vlen, vll);
         redisAssert(ret);
     } else {
-        ret = ziplistGet(hi->vptr, vstr, vlen, vll);
+        ret = lpGet(hi->vptr, vstr, vlen, vll);
         redisAssert(ret);
     }
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromHashTable`. */
+ * encoded as a hashpack. Prototype is similar to `hashTypeGetFromHashpack`. */
+void hashTypeCurrentFromHashpack(hashTypeIterator *hi, int what,
+                                 unsigned char **vstr,
+                                 unsigned int *vlen)
+{
+    redisAssert(hi->encoding == REDIS_ENCODING_HASHPACK);
+
+    if (what & REDIS_HASH_KEY) {
+        *vstr = hi->fptr;
+        *vlen = hi->flen;
+    } else {
+        *vstr = hi->vptr;
+        *vlen = hi->vlen;
+    }
+}
+
+/* Get the field or value at iterator cursor, for an iterator on a hash value
+ * encoded as a hash table. Prototype is similar to `hashTypeGetFromHashTable`. */
 void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
     redisAssert(hi->encoding == REDIS_ENCODING_HT);
 
@@ -373,18 +459,25 @@ void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what) {
     robj *dst;
 
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             dst = createStringObject((char*)vstr, vlen);
         } else {
             dst = createStringObjectFromLongLong(vll);
         }
 
+    } else if (hi->encoding == REDIS_ENCODING_HASHPACK) {
+        unsigned char *vstr;
+        unsigned int vlen;
+
+        hashTypeCurrentFromHashpack(hi, what, &vstr, &vlen);
+        dst = createStringObject((char*)vstr, vlen);
+
     } else if (hi->encoding == REDIS_ENCODING_HT) {
         hashTypeCurrentFromHashTable(hi, what, &dst);
         incrRefCount(dst);
@@ -410,49 +503,106 @@ robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key) {
     return o;
 }
 
-void hashTypeConvertZiplist(robj *o, int enc) {
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+/* Convert a listpack or hashpack encoded hash into a hash table. */
+static void hashTypeConvertToHashTable(robj *o) {
+    hashTypeIterator *hi;
+    dict *dict;
+    int ret;
 
-    if (enc == REDIS_ENCODING_ZIPLIST) {
+    hi = hashTypeInitIterator(o);
+    dict = dictCreate(&hashDictType, NULL);
+    if (o->encoding == REDIS_ENCODING_HASHPACK)
+        dictExpand(dict, hashTypeLength(o));
+
+    while (hashTypeNext(hi) != REDIS_ERR) {
+        robj *field, *value;
+
+        field = hashTypeCurrentObject(hi, REDIS_HASH_KEY);
+        field = tryObjectEncoding(field);
+        value = hashTypeCurrentObject(hi, REDIS_HASH_VALUE);
+        value = tryObjectEncoding(value);
+        ret = dictAdd(dict, field, value);
+        if (ret != DICT_OK) {
+            if (o->encoding == REDIS_ENCODING_LISTPACK)
+                redisLogHexDump(REDIS_WARNING,"listpack with dup elements dump",
+                    o->ptr,lpBytes(o->ptr));
+            redisAssert(ret == DICT_OK);
+        }
+    }
+
+    hashTypeReleaseIterator(hi);
+    if (o->encoding == REDIS_ENCODING_HASHPACK)
+        hpFree(o->ptr);
+    else
+        zfree(o->ptr);
+
+    o->encoding = REDIS_ENCODING_HT;
+    o->ptr = dict;
+}
+
+void hashTypeConvertListpack(robj *o, int enc) {
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
+
+    if (enc == REDIS_ENCODING_LISTPACK) {
         /* Nothing to do... */
 
-    } else if (enc == REDIS_ENCODING_HT) {
+    } else if (enc == REDIS_ENCODING_HASHPACK) {
         hashTypeIterator *hi;
-        dict *dict;
-        int ret;
+        hashpack *hp;
+        size_t maxlen = 0;
 
-        hi = hashTypeInitIterator(o);
-        dict = dictCreate(&hashDictType, NULL);
+        /* Go straight to a hash table if the hashpack would be too big. */
+        if (hashTypeLength(o) > server.hash_max_hashpack_entries ||
+            lpBytes(o->ptr) > HP_MAX_ARENA)
+        {
+            hashTypeConvertToHashTable(o);
+            return;
+        }
 
+        hi = hashTypeInitIterator(o);
+        hp = hpNew();
         while (hashTypeNext(hi) != REDIS_ERR) {
             robj *field, *value;
 
             field = hashTypeCurrentObject(hi, REDIS_HASH_KEY);
-            field = tryObjectEncoding(field);
             value = hashTypeCurrentObject(hi, REDIS_HASH_VALUE);
-            value = tryObjectEncoding(value);
-            ret = dictAdd(dict, field, value);
-            if (ret != DICT_OK) {
-                redisLogHexDump(REDIS_WARNING,"ziplist with dup elements dump",
-                    o->ptr,ziplistBlobLen(o->ptr));
-                redisAssert(ret == DICT_OK);
+            field = getDecodedObject(field);
+            value = getDecodedObject(value);
+            if (hpSet(hp, field->ptr, sdslen(field->ptr),
+                      value->ptr, sdslen(value->ptr)))
+            {
+                redisLogHexDump(REDIS_WARNING,"listpack with dup elements dump",
+                    o->ptr,lpBytes(o->ptr));
+                redisPanic("Duplicated field in listpack encoded hash");
             }
+            if (sdslen(field->ptr) > maxlen) maxlen = sdslen(field->ptr);
+            if (sdslen(value->ptr) > maxlen) maxlen = sdslen(value->ptr);
+            decrRefCount(field);
+            decrRefCount(value);
         }
-
         hashTypeReleaseIterator(hi);
         zfree(o->ptr);
 
-        o->encoding = REDIS_ENCODING_HT;
-        o->ptr = dict;
+        o->encoding = REDIS_ENCODING_HASHPACK;
+        o->ptr = hp;
+        if (maxlen > server.hash_max_hashpack_value)
+            hashTypeConvertToHashTable(o);
 
+    } else if (enc == REDIS_ENCODING_HT) {
+        hashTypeConvertToHashTable(o);
     } else {
         redisPanic("Unknown hash encoding");
     }
 }
 
 void hashTypeConvert(robj *o, int enc) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        hashTypeConvertZiplist(o, enc);
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        hashTypeConvertListpack(o, enc);
+    } else if (o->encoding == REDIS_ENCODING_HASHPACK) {
+        if (enc == REDIS_ENCODING_HT)
+            hashTypeConvertToHashTable(o);
+        else if (enc != REDIS_ENCODING_HASHPACK)
+            redisPanic("Not implemented");
     } else if (o->encoding == REDIS_ENCODING_HT) {
         redisPanic("Not implemented");
     } else {
@@ -594,12 +744,12 @@ static void addHashFieldToReply(redisClient *c, robj *o, robj *field) {
         return;
     }
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        ret = hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll);
+        ret = hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll);
         if (ret < 0) {
             addReply(c, shared.nullbulk);
         } else {
@@ -610,6 +760,17 @@ static void addHashFieldToReply(redisClient *c, robj *o, robj *field) {
             }
         }
 
+    } else if (o->encoding == REDIS_ENCODING_HASHPACK) {
+        unsigned char *vstr;
+        unsigned int vlen;
+
+        ret = hashTypeGetFromHashpack(o, field, &vstr, &vlen);
+        if (ret < 0) {
+            addReply(c, shared.nullbulk);
+        } else {
+            addReplyBulkCBuffer(c, vstr, vlen);
+        }
+
     } else if (o->encoding == REDIS_ENCODING_HT) {
         robj *value;
 
@@ -689,18 +850,25 @@ void hlenCommand(redisClient *c) {
 }
 
 static void addHashIteratorCursorToReply(redisClient *c, hashTypeIterator *hi, int what) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             addReplyBulkCBuffer(c, vstr, vlen);
         } else {
             addReplyBulkLongLong(c, vll);
         }
 
+    } else if (hi->encoding == REDIS_ENCODING_HASHPACK) {
+        unsigned char *vstr;
+        unsigned int vlen;
+
+        hashTypeCurrentFromHashpack(hi, what, &vstr, &vlen);
+        addReplyBulkCBuffer(c, vstr, vlen);
+
     } else if (hi->encoding == REDIS_ENCODING_HT) {
         robj *value;
 
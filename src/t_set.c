@@ -35,6 +35,22 @@
 
 void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *dstkey, int op);
 
+#define REDIS_OP_UNION 0
+#define REDIS_OP_DIFF 1
+#define REDIS_OP_INTER 2
+
+/* Sets of integers too large for an intset are stored as roaring bitmaps, as
+ * long as the bitmap does not have more than this number of containers (one
+ * for every 65536 possible integers). Adding a container is O(N) in the
+ * number of containers, so very sparse sets are better served by a dict. */
+#define SET_MAX_ROARING_CONTAINERS 4096
+
+/* Convert the roaring encoded set 'o' to a hash table if it is too sparse. */
+void setTypeCheckRoaring(robj *o) {
+    if (((roaring*)o->ptr)->len > SET_MAX_ROARING_CONTAINERS)
+        setTypeConvert(o,REDIS_ENCODING_HT);
+}
+
 /* Factory method to return a set that *can* hold "value". When the object has
  * an integer-encodable value, an intset will be returned. Otherwise a regular
  * hash table. */
@@ -56,10 +72,10 @@ int setTypeAdd(robj *subject, robj *value) {
             uint8_t success = 0;
             subject->ptr = intsetAdd(subject->ptr,llval,&success);
             if (success) {
-                /* Convert to regular set when the intset contains
+                /* Convert to a roaring bitmap when the intset contains
                  * too many entries. */
                 if (intsetLen(subject->ptr) > server.set_max_intset_entries)
-                    setTypeConvert(subject,REDIS_ENCODING_HT);
+                    setTypeConvert(subject,REDIS_ENCODING_ROARING);
                 return 1;
             }
         } else {
@@ -72,6 +88,18 @@ int setTypeAdd(robj *subject, robj *value) {
             incrRefCount(value);
             return 1;
         }
+    } else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK) {
+            if (roaringAdd(subject->ptr,llval)) {
+                setTypeCheckRoaring(subject);
+                return 1;
+            }
+        } else {
+            setTypeConvert(subject,REDIS_ENCODING_HT);
+            redisAssertWithInfo(NULL,value,dictAdd(subject->ptr,value,NULL) == DICT_OK);
+            incrRefCount(value);
+            return 1;
+        }
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -91,6 +119,9 @@ int setTypeRemove(robj *setobj, robj *value) {
             setobj->ptr = intsetRemove(setobj->ptr,llval,&success);
             if (success) return 1;
         }
+    } else if (setobj->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK)
+            return roaringRemove(setobj->ptr,llval);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -105,6 +136,9 @@ int setTypeIsMember(robj *subject, robj *value) {
         if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK) {
             return intsetFind((intset*)subject->ptr,llval);
         }
+    } else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK)
+            return roaringContains(subject->ptr,llval);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -119,6 +153,8 @@ setTypeIterator *setTypeInitIterator(robj *subject) {
         si->di = dictGetIterator(subject->ptr);
     } else if (si->encoding == REDIS_ENCODING_INTSET) {
         si->ii = 0;
+    } else if (si->encoding == REDIS_ENCODING_ROARING) {
+        roaringInitIterator(subject->ptr,&si->ri);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -137,7 +173,8 @@ void setTypeReleaseIterator(setTypeIterator *si) {
  * Since set elements can be internally be stored as redis objects or
  * simple arrays of integers, setTypeNext returns the encoding of the
  * set object you are iterating, and will populate the appropriate pointer
- * (eobj) or (llobj) accordingly.
+ * (eobj) or (llobj) accordingly. Roaring bitmaps hold integers like intsets
+ * do, so REDIS_ENCODING_INTSET is returned for them as well.
  *
  * When there are no longer elements -1 is returned.
  * Returned objects ref count is not incremented, so this function is
@@ -150,6 +187,9 @@ int setTypeNext(setTypeIterator *si, robj **objele, int64_t *llele) {
     } else if (si->encoding == REDIS_ENCODING_INTSET) {
         if (!intsetGet(si->subject->ptr,si->ii++,llele))
             return -1;
+    } else if (si->encoding == REDIS_ENCODING_ROARING) {
+        if (!roaringIteratorNext(&si->ri,llele)) return -1;
+        return REDIS_ENCODING_INTSET;
     }
     return si->encoding;
 }
@@ -188,7 +228,8 @@ robj *setTypeNextObject(setTypeIterator *si) {
  * The caller provides both pointers to be populated with the right
  * object. The return value of the function is the object->encoding
  * field of the object and is used by the caller to check if the
- * int64_t pointer or the redis object pointer was populated.
+ * int64_t pointer or the redis object pointer was populated. Like for
+ * setTypeNext(), roaring bitmaps are reported as REDIS_ENCODING_INTSET.
  *
  * When an object is returned (the set was a real set) the ref count
  * of the object is not incremented so this function can be considered
@@ -199,6 +240,9 @@ int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele) {
         *objele = dictGetKey(de);
     } else if (setobj->encoding == REDIS_ENCODING_INTSET) {
         *llele = intsetRandom(setobj->ptr);
+    } else if (setobj->encoding == REDIS_ENCODING_ROARING) {
+        *llele = roaringRandom(setobj->ptr);
+        return REDIS_ENCODING_INTSET;
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -210,26 +254,50 @@ unsigned long setTypeSize(robj *subject) {
         return dictSize((dict*)subject->ptr);
     } else if (subject->encoding == REDIS_ENCODING_INTSET) {
         return intsetLen((intset*)subject->ptr);
+    } else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        return roaringCard((roaring*)subject->ptr);
     } else {
         redisPanic("Unknown set encoding");
     }
 }
 
+/* Return a new roaring bitmap with the integers of the intset 'is'. */
+static roaring *roaringFromIntset(intset *is) {
+    roaring *r = roaringNew();
+    int64_t intele;
+    uint32_t j;
+
+    for (j = 0; intsetGet(is,j,&intele); j++) roaringAdd(r,intele);
+    roaringOptimize(r);
+    return r;
+}
+
 /* Convert the set to specified encoding. The resulting dict (when converting
  * to a hash table) is presized to hold the number of elements in the original
- * set. */
+ * set. Intsets can be converted to roaring bitmaps, and both of them to hash
+ * tables. */
 void setTypeConvert(robj *setobj, int enc) {
     setTypeIterator *si;
     redisAssertWithInfo(NULL,setobj,setobj->type == REDIS_SET &&
-                             setobj->encoding == REDIS_ENCODING_INTSET);
+                             (setobj->encoding == REDIS_ENCODING_INTSET ||
+                              setobj->encoding == REDIS_ENCODING_ROARING));
+
+    if (enc == REDIS_ENCODING_ROARING &&
+        setobj->encoding == REDIS_ENCODING_INTSET)
+    {
+        roaring *r = roaringFromIntset(setobj->ptr);
 
-    if (enc == REDIS_ENCODING_HT) {
+        zfree(setobj->ptr);
+        setobj->ptr = r;
+        setobj->encoding = REDIS_ENCODING_ROARING;
+        setTypeCheckRoaring(setobj);
+    } else if (enc == REDIS_ENCODING_HT) {
         int64_t intele;
         dict *d = dictCreate(&setDictType,NULL);
         robj *element;
 
         /* Presize the dict to avoid rehashing */
-        dictExpand(d,intsetLen(setobj->ptr));
+        dictExpand(d,setTypeSize(setobj));
 
         /* To add the elements we extract integers and create redis objects */
         si = setTypeInitIterator(setobj);
@@ -239,8 +307,11 @@ void setTypeConvert(robj *setobj, int enc) {
         }
         setTypeReleaseIterator(si);
 
+        if (setobj->encoding == REDIS_ENCODING_ROARING)
+            roaringFree(setobj->ptr);
+        else
+            zfree(setobj->ptr);
         setobj->encoding = REDIS_ENCODING_HT;
-        zfree(setobj->ptr);
         setobj->ptr = d;
     } else {
         redisPanic("Unsupported set conversion");
@@ -388,7 +459,10 @@ void spopCommand(redisClient *c) {
     encoding = setTypeRandomElement(set,&ele,&llele);
     if (encoding == REDIS_ENCODING_INTSET) {
         ele = createStringObjectFromLongLong(llele);
-        set->ptr = intsetRemove(set->ptr,llele,NULL);
+        if (set->encoding == REDIS_ENCODING_ROARING)
+            roaringRemove(set->ptr,llele);
+        else
+            set->ptr = intsetRemove(set->ptr,llele,NULL);
     } else {
         incrRefCount(ele);
         setTypeRemove(set,ele);
@@ -495,7 +569,7 @@ void srandmemberWithCountCommand(redisClient *c) {
 
             if (encoding == REDIS_ENCODING_INTSET) {
                 retval = dictAdd(d,createStringObjectFromLongLong(llele),NULL);
-            } else if (ele->encoding == REDIS_ENCODING_RAW) {
+            } else if (sdsEncodedObject(ele)) {
                 retval = dictAdd(d,dupStringObject(ele),NULL);
             } else if (ele->encoding == REDIS_ENCODING_INT) {
                 retval = dictAdd(d,
@@ -527,7 +601,7 @@ void srandmemberWithCountCommand(redisClient *c) {
             encoding = setTypeRandomElement(set,&ele,&llele);
             if (encoding == REDIS_ENCODING_INTSET) {
                 ele = createStringObjectFromLongLong(llele);
-            } else if (ele->encoding == REDIS_ENCODING_RAW) {
+            } else if (sdsEncodedObject(ele)) {
                 ele = dupStringObject(ele);
             } else if (ele->encoding == REDIS_ENCODING_INT) {
                 ele = createStringObjectFromLongLong((long)ele->ptr);
@@ -592,6 +666,75 @@ int qsortCompareSetsByRevCardinality(const void *s1, const void *s2) {
     return  (o2 ? setTypeSize(o2) : 0) - (o1 ? setTypeSize(o1) : 0);
 }
 
+/* Return 1 if all the non NULL sets of 'sets' are intset encoded. */
+int setTypeAllIntsets(robj **sets, unsigned long setnum) {
+    unsigned long j;
+
+    for (j = 0; j < setnum; j++)
+        if (sets[j] && sets[j]->encoding != REDIS_ENCODING_INTSET) return 0;
+    return 1;
+}
+
+/* Return 1 if all the non NULL sets of 'sets' only hold integers, that is
+ * they are intset or roaring encoded. */
+int setTypeAllIntegers(robj **sets, unsigned long setnum) {
+    unsigned long j;
+
+    for (j = 0; j < setnum; j++)
+        if (sets[j] && sets[j]->encoding != REDIS_ENCODING_INTSET &&
+            sets[j]->encoding != REDIS_ENCODING_ROARING) return 0;
+    return 1;
+}
+
+/* Wrap the intset 'is', the result of an operation between intsets, into a
+ * new set object, converting it if it has too many entries. */
+robj *setTypeCreateFromIntset(intset *is) {
+    robj *o = createObject(REDIS_SET,is);
+
+    o->encoding = REDIS_ENCODING_INTSET;
+    if (intsetLen(is) > server.set_max_intset_entries)
+        setTypeConvert(o,REDIS_ENCODING_ROARING);
+    return o;
+}
+
+/* Wrap the roaring bitmap 'r', the result of an operation between sets of
+ * integers, into a new set object, using an intset if it is small enough. */
+robj *setTypeCreateFromRoaring(roaring *r) {
+    robj *o;
+
+    if (roaringCard(r) <= server.set_max_intset_entries) {
+        roaringIterator it;
+        intset *is = intsetNew();
+        int64_t intele;
+
+        roaringInitIterator(r,&it);
+        while (roaringIteratorNext(&it,&intele))
+            is = intsetAdd(is,intele,NULL);
+        roaringFree(r);
+        return setTypeCreateFromIntset(is);
+    }
+    o = createObject(REDIS_SET,r);
+    o->encoding = REDIS_ENCODING_ROARING;
+    setTypeCheckRoaring(o);
+    return o;
+}
+
+/* Return the integers of the intset or roaring encoded set 'o' as a roaring
+ * bitmap. Intsets are converted to a temporary bitmap, that must be released
+ * with setTypeReleaseRoaring(). */
+static roaring *setTypeGetRoaring(robj *o) {
+    if (o->encoding == REDIS_ENCODING_ROARING) return o->ptr;
+    return roaringFromIntset(o->ptr);
+}
+
+static void setTypeReleaseRoaring(robj *o, roaring *r) {
+    if (o->encoding != REDIS_ENCODING_ROARING) roaringFree(r);
+}
+
+/* Compute the union, intersection or difference of the integer sets 'sets'
+ * operating on roaring bitmaps. Non existing sets are treated as empty. */
+static roaring *setTypeRoaringOp(robj **sets, unsigned long setnum, int op);
+
 void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum, robj *dstkey) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
     setTypeIterator *si;
@@ -641,67 +784,110 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
         dstset = createIntsetObject();
     }
 
-    /* Iterate all the elements of the first (smallest) set, and test
-     * the element against all the other sets, if at least one set does
-     * not include the element it is discarded */
-    si = setTypeInitIterator(sets[0]);
-    while((encoding = setTypeNext(si,&eleobj,&intobj)) != -1) {
-        for (j = 1; j < setnum; j++) {
-            if (sets[j] == sets[0]) continue;
-            if (encoding == REDIS_ENCODING_INTSET) {
-                /* intset with intset is simple... and fast */
-                if (sets[j]->encoding == REDIS_ENCODING_INTSET &&
-                    !intsetFind((intset*)sets[j]->ptr,intobj))
-                {
-                    break;
-                /* in order to compare an integer with an object we
-                 * have to use the generic function, creating an object
-                 * for this */
-                } else if (sets[j]->encoding == REDIS_ENCODING_HT) {
-                    eleobj = createStringObjectFromLongLong(intobj);
-                    if (!setTypeIsMember(sets[j],eleobj)) {
+    if (setTypeAllIntsets(sets,setnum)) {
+        /* When all the sets are intsets they are intersected two at a
+         * time, starting from the smallest, merging the sorted arrays of
+         * integers instead of looking up every element. */
+        intset *is = intsetIntersect(sets[0]->ptr,sets[setnum > 1]->ptr);
+
+        for (j = 2; j < setnum && intsetLen(is) > 0; j++) {
+            intset *tmp = intsetIntersect(is,sets[j]->ptr);
+            zfree(is);
+            is = tmp;
+        }
+        if (dstkey) {
+            decrRefCount(dstset);
+            dstset = setTypeCreateFromIntset(is);
+        } else {
+            for (j = 0; intsetGet(is,j,&intobj); j++)
+                addReplyBulkLongLong(c,intobj);
+            cardinality = intsetLen(is);
+            zfree(is);
+        }
+    } else if (setTypeAllIntegers(sets,setnum)) {
+        /* Intsets and roaring bitmaps: intersect the bitmaps container
+         * by container. */
+        roaring *r = setTypeRoaringOp(sets,setnum,REDIS_OP_INTER);
+
+        if (dstkey) {
+            decrRefCount(dstset);
+            dstset = setTypeCreateFromRoaring(r);
+        } else {
+            roaringIterator it;
+
+            roaringInitIterator(r,&it);
+            while (roaringIteratorNext(&it,&intobj))
+                addReplyBulkLongLong(c,intobj);
+            cardinality = roaringCard(r);
+            roaringFree(r);
+        }
+    } else {
+        /* Iterate all the elements of the first (smallest) set, and test
+         * the element against all the other sets, if at least one set does
+         * not include the element it is discarded */
+        si = setTypeInitIterator(sets[0]);
+        while((encoding = setTypeNext(si,&eleobj,&intobj)) != -1) {
+            for (j = 1; j < setnum; j++) {
+                if (sets[j] == sets[0]) continue;
+                if (encoding == REDIS_ENCODING_INTSET) {
+                    /* intset with intset is simple... and fast */
+                    if (sets[j]->encoding == REDIS_ENCODING_INTSET &&
+                        !intsetFind((intset*)sets[j]->ptr,intobj))
+                    {
+                        break;
+                    } else if (sets[j]->encoding == REDIS_ENCODING_ROARING &&
+                        !roaringContains((roaring*)sets[j]->ptr,intobj))
+                    {
+                        break;
+                    /* in order to compare an integer with an object we
+                     * have to use the generic function, creating an object
+                     * for this */
+                    } else if (sets[j]->encoding == REDIS_ENCODING_HT) {
+                        eleobj = createStringObjectFromLongLong(intobj);
+                        if (!setTypeIsMember(sets[j],eleobj)) {
+                            decrRefCount(eleobj);
+                            break;
+                        }
                         decrRefCount(eleobj);
+                    }
+                } else if (encoding == REDIS_ENCODING_HT) {
+                    /* Optimization... if the source object is integer
+                     * encoded AND the target set is an intset, we can get
+                     * a much faster path. */
+                    if (eleobj->encoding == REDIS_ENCODING_INT &&
+                        sets[j]->encoding == REDIS_ENCODING_INTSET &&
+                        !intsetFind((intset*)sets[j]->ptr,(long)eleobj->ptr))
+                    {
+                        break;
+                    /* else... object to object check is easy as we use the
+                     * type agnostic API here. */
+                    } else if (!setTypeIsMember(sets[j],eleobj)) {
                         break;
                     }
-                    decrRefCount(eleobj);
-                }
-            } else if (encoding == REDIS_ENCODING_HT) {
-                /* Optimization... if the source object is integer
-                 * encoded AND the target set is an intset, we can get
-                 * a much faster path. */
-                if (eleobj->encoding == REDIS_ENCODING_INT &&
-                    sets[j]->encoding == REDIS_ENCODING_INTSET &&
-                    !intsetFind((intset*)sets[j]->ptr,(long)eleobj->ptr))
-                {
-                    break;
-                /* else... object to object check is easy as we use the
-                 * type agnostic API here. */
-                } else if (!setTypeIsMember(sets[j],eleobj)) {
-                    break;
                 }
             }
-        }
 
-        /* Only take action when all sets contain the member */
-        if (j == setnum) {
-            if (!dstkey) {
-                if (encoding == REDIS_ENCODING_HT)
-                    addReplyBulk(c,eleobj);
-                else
-                    addReplyBulkLongLong(c,intobj);
-                cardinality++;
-            } else {
-                if (encoding == REDIS_ENCODING_INTSET) {
-                    eleobj = createStringObjectFromLongLong(intobj);
-                    setTypeAdd(dstset,eleobj);
-                    decrRefCount(eleobj);
+            /* Only take action when all sets contain the member */
+            if (j == setnum) {
+                if (!dstkey) {
+                    if (encoding == REDIS_ENCODING_HT)
+                        addReplyBulk(c,eleobj);
+                    else
+                        addReplyBulkLongLong(c,intobj);
+                    cardinality++;
                 } else {
-                    setTypeAdd(dstset,eleobj);
+                    if (encoding == REDIS_ENCODING_INTSET) {
+                        eleobj = createStringObjectFromLongLong(intobj);
+                        setTypeAdd(dstset,eleobj);
+                        decrRefCount(eleobj);
+                    } else {
+                        setTypeAdd(dstset,eleobj);
+                    }
                 }
             }
         }
+        setTypeReleaseIterator(si);
     }
-    setTypeReleaseIterator(si);
 
     if (dstkey) {
         /* Store the resulting set into the target, if the intersection
@@ -735,10 +921,6 @@ void sinterstoreCommand(redisClient *c) {
     sinterGenericCommand(c,c->argv+2,c->argc-2,c->argv[1]);
 }
 
-#define REDIS_OP_UNION 0
-#define REDIS_OP_DIFF 1
-#define REDIS_OP_INTER 2
-
 void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *dstkey, int op) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
     setTypeIterator *si;
@@ -799,7 +981,31 @@ void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *
      * this set object will be the resulting object to set into the target key*/
     dstset = createIntsetObject();
 
-    if (op == REDIS_OP_UNION) {
+    if (op == REDIS_OP_UNION && setTypeAllIntsets(sets,setnum)) {
+        /* Union of intsets only: merge the sorted arrays of integers two
+         * at a time instead of adding every element. */
+        intset *is = intsetNew();
+
+        for (j = 0; j < setnum; j++) {
+            intset *tmp;
+
+            if (!sets[j]) continue; /* non existing keys are like empty sets */
+            tmp = intsetUnion(is,sets[j]->ptr);
+            zfree(is);
+            is = tmp;
+        }
+        decrRefCount(dstset);
+        dstset = setTypeCreateFromIntset(is);
+        cardinality = setTypeSize(dstset);
+    } else if ((op == REDIS_OP_UNION || sets[0]) &&
+               setTypeAllIntegers(sets,setnum))
+    {
+        /* Intsets and roaring bitmaps: merge or subtract the bitmaps
+         * container by container. */
+        decrRefCount(dstset);
+        dstset = setTypeCreateFromRoaring(setTypeRoaringOp(sets,setnum,op));
+        cardinality = setTypeSize(dstset);
+    } else if (op == REDIS_OP_UNION) {
         /* Union is trivial, just add every element of every set to the
          * temporary set. */
         for (j = 0; j < setnum; j++) {
@@ -897,6 +1103,34 @@ void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *
     zfree(sets);
 }
 
+static roaring *setTypeRoaringOp(robj **sets, unsigned long setnum, int op) {
+    roaring *acc = NULL, *r, *tmp;
+    unsigned long j;
+
+    for (j = 0; j < setnum; j++) {
+        if (!sets[j]) {
+            /* Union and difference skip empty sets, the intersection is
+             * empty as well. */
+            if (op != REDIS_OP_INTER) continue;
+            if (acc) roaringFree(acc);
+            return roaringNew();
+        }
+        r = setTypeGetRoaring(sets[j]);
+        if (acc == NULL) {
+            acc = (r == sets[j]->ptr) ? roaringDup(r) : r;
+            continue;
+        }
+        if (op == REDIS_OP_UNION) tmp = roaringOr(acc,r);
+        else if (op == REDIS_OP_INTER) tmp = roaringAnd(acc,r);
+        else tmp = roaringAndNot(acc,r);
+        setTypeReleaseRoaring(sets[j],r);
+        roaringFree(acc);
+        acc = tmp;
+        if (op != REDIS_OP_UNION && roaringCard(acc) == 0) break;
+    }
+    return acc ? acc : roaringNew();
+}
+
 void sunionCommand(redisClient *c) {
     sunionDiffGenericCommand(c,c->argv+1,c->argc-1,NULL,REDIS_OP_UNION);
 }
@@ -816,7 +816,15 @@ unsigned int ziplistCompare(unsigned char *p, unsigned char *sstr, unsigned int
 }
 
 /* Find pointer to the entry equal to the specified entry. Skip 'skip' entries
- * between every comparison. Returns NULL when the field could not be found. */
+ * between every comparison. Returns NULL when the field could not be found.
+ *
+ * Entries with a one byte prevlen and a 6 bit string length, that is with a
+ * two bytes header, are by far the most common ones in the small hashes and
+ * sorted sets this is used for, so they are decoded inline without going
+ * through the generic macros, as are the integer entries that are skipped.
+ * Entries of the same length are compared by their last byte before calling
+ * memcmp(): fields like "user:1000" tend to share their prefix, so this
+ * filters out most of the candidates. */
 unsigned char *ziplistFind(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip) {
     int skipcnt = 0;
     unsigned char vencoding = 0;
@@ -826,6 +834,29 @@ unsigned char *ziplistFind(unsigned char *p, unsigned char *vstr, unsigned int v
         unsigned int prevlensize, encoding, lensize, len;
         unsigned char *q;
 
+        if (p[0] < ZIP_BIGLEN && p[1] < ZIP_STR_14B) {
+            len = p[1];
+            q = p + 2;
+            if (skipcnt == 0) {
+                if (len == vlen &&
+                    (len == 0 || (q[len-1] == vstr[len-1] &&
+                                  memcmp(q, vstr, len) == 0)))
+                {
+                    return p;
+                }
+                skipcnt = skip;
+            } else {
+                skipcnt--;
+            }
+            p = q + len;
+            continue;
+        } else if (skipcnt != 0 && p[0] < ZIP_BIGLEN && p[1] >= ZIP_STR_MASK) {
+            /* Skipped integer entry, only its size is needed. */
+            skipcnt--;
+            p += 2 + zipIntSize(p[1]);
+            continue;
+        }
+
         ZIP_DECODE_PREVLENSIZE(p, prevlensize);
         ZIP_DECODE_LENGTH(p + prevlensize, encoding, lensize, len);
         q = p + prevlensize + lensize;
@@ -1534,3 +1565,111 @@ int main(int argc, char **argv) {
 }
 
 #endif
+
+#ifdef ZIPLIST_BENCHMARK_MAIN
+/* ziplistFind() microbenchmark on hash shaped ziplists (field, value pairs)
+ * of different sizes, compared with the generic entry by entry scan that
+ * ziplistFind() used before:
+ *
+ * cc -O2 -DZIPLIST_BENCHMARK_MAIN -o ziplist-benchmark ziplist.c zmalloc.c \
+ *    util.c sha1.c sds.c
+ */
+#include <sys/time.h>
+
+#define ZIPLIST_BENCH_LOOKUPS 2000000
+
+void _redisAssert(char *estr, char *file, int line) {
+    fprintf(stderr,"ASSERTION FAILED %s:%d '%s'\n",file,line,estr);
+}
+
+static long long zipBenchUstime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+/* The generic scan, decoding every entry with the macros. */
+static unsigned char *zipBenchGenericFind(unsigned char *p,
+        unsigned char *vstr, unsigned int vlen, unsigned int skip) {
+    int skipcnt = 0;
+    unsigned char vencoding = 0;
+    long long vll = 0;
+
+    while (p[0] != ZIP_END) {
+        unsigned int prevlensize, encoding, lensize, len;
+        unsigned char *q;
+
+        ZIP_DECODE_PREVLENSIZE(p, prevlensize);
+        ZIP_DECODE_LENGTH(p + prevlensize, encoding, lensize, len);
+        q = p + prevlensize + lensize;
+        if (skipcnt == 0) {
+            if (ZIP_IS_STR(encoding)) {
+                if (len == vlen && memcmp(q, vstr, vlen) == 0) return p;
+            } else {
+                if (vencoding == 0 &&
+                    !zipTryEncoding(vstr, vlen, &vll, &vencoding))
+                    vencoding = UCHAR_MAX;
+                if (vencoding != UCHAR_MAX &&
+                    zipLoadInteger(q, encoding) == vll) return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = q + len;
+    }
+    return NULL;
+}
+
+typedef unsigned char *(*zipBenchFindFn)(unsigned char *, unsigned char *,
+                                         unsigned int, unsigned int);
+
+/* Return the ns per lookup of 'fields' fields, and as many missing ones. */
+static double zipBenchRun(zipBenchFindFn find, unsigned char *zl,
+                          int fields) {
+    char buf[32];
+    int j, len, found = 0, expected = 0;
+    long long start = zipBenchUstime();
+
+    for (j = 0; j < ZIPLIST_BENCH_LOOKUPS; j++) {
+        int id = j % (fields*2);
+
+        len = snprintf(buf,sizeof(buf),"field:%d",id);
+        if (find(ziplistIndex(zl,0),(unsigned char*)buf,len,1)) found++;
+        if (id < fields) expected++;
+    }
+    if (found != expected) {
+        printf("Wrong number of hits: %d\n", found);
+        exit(1);
+    }
+    return (double)(zipBenchUstime()-start)*1000/ZIPLIST_BENCH_LOOKUPS;
+}
+
+int main(void) {
+    int sizes[] = {16, 128, 512}, j, k;
+
+    printf("ziplistFind(), ns per lookup (50%% hits):\n");
+    printf("  fields  values    generic  ziplistFind\n");
+    for (j = 0; j < 3; j++) {
+        for (k = 0; k < 2; k++) {
+            unsigned char *zl = ziplistNew();
+            char buf[32];
+            int i, len;
+
+            for (i = 0; i < sizes[j]; i++) {
+                len = snprintf(buf,sizeof(buf),"field:%d",i);
+                zl = ziplistPush(zl,(unsigned char*)buf,len,ZIPLIST_TAIL);
+                len = snprintf(buf,sizeof(buf),k ? "%d" : "value:%d",i*1000);
+                zl = ziplistPush(zl,(unsigned char*)buf,len,ZIPLIST_TAIL);
+            }
+            printf("  %6d  %-7s %8.1f   %8.1f\n", sizes[j],
+                k ? "integer" : "string",
+                zipBenchRun(zipBenchGenericFind,zl,sizes[j]),
+                zipBenchRun(ziplistFind,zl,sizes[j]));
+            zfree(zl);
+        }
+    }
+    return 0;
+}
+#endif
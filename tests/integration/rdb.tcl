@@ -21,6 +21,12 @@ start_server [list overrides [list "dir" $server_path "dbfilename" "encodings.rd
 "zset","zset","a","1","b","2","c","3","aa","10","bb","20","cc","30","aaa","100","bbb","200","ccc","300","aaaa","1000","cccc","123456789","bbbb","5000000000",
 "zset_zipped","zset","a","1","b","2","c","3",
 }
+
+  test "RDB encoding loading test: old ziplists are converted to listpacks" {
+    list [r object encoding list_zipped] \
+         [r object encoding hash_zipped] \
+         [r object encoding zset_zipped]
+  } {listpack listpack listpack}
 }
 
 set server_path [tmpdir "server.rdb-startup-test"]
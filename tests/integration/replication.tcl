@@ -177,3 +177,37 @@ foreach dl {no yes} {
         }
     }
 }
+
+start_server {tags {"repl"} overrides {io-threads 4 io-threads-do-reads yes}} {
+    set master [srv 0 client]
+    set master_host [srv 0 host]
+    set master_port [srv 0 port]
+    start_server {} {
+        set slave [srv 0 client]
+
+        test {Slaves of a master using I/O threads get the same dataset} {
+            $slave slaveof $master_host $master_port
+            wait_for_condition 50 100 {
+                [lindex [$slave role] 3] eq {connected}
+            } else {
+                fail "Replication not started."
+            }
+
+            set loads {}
+            for {set j 0} {$j < 12} {incr j} {
+                lappend loads [start_write_load $master_host $master_port 3]
+            }
+            after 2000
+            foreach load $loads {stop_write_load $load}
+
+            wait_for_condition 500 100 {
+                [$master dbsize] == [$slave dbsize] &&
+                [$master debug digest] eq [$slave debug digest]
+            } else {
+                fail "Different dataset between master and slave."
+            }
+            assert {[$master dbsize] > 0}
+            assert {[status $master io_threaded_writes_processed] > 0}
+        }
+    }
+}
@@ -46,8 +46,12 @@ set ::all_tests {
     unit/obuf-limits
     unit/dump
     unit/bitops
+    unit/bitfield
     unit/memefficiency
     unit/hyperloglog
+    unit/lazyfree
+    unit/sortedtable
+    unit/keyspace-open
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
@@ -77,10 +77,10 @@ start_server {tags {"aofrw"}} {
     }
 
     foreach d {string int} {
-        foreach e {ziplist linkedlist} {
+        foreach e {listpack quicklist} {
             test "AOF rewrite of list with $e encoding, $d data" {
                 r flushall
-                if {$e eq {ziplist}} {set len 10} else {set len 1000}
+                if {$e eq {listpack}} {set len 10} else {set len 1000}
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -102,39 +102,41 @@ start_server {tags {"aofrw"}} {
         }
     }
 
-    foreach d {string int} {
-        foreach e {intset hashtable} {
-            test "AOF rewrite of set with $e encoding, $d data" {
-                r flushall
-                if {$e eq {intset}} {set len 10} else {set len 1000}
-                for {set j 0} {$j < $len} {incr j} {
-                    if {$d eq {string}} {
-                        set data [randstring 0 16 alpha]
-                    } else {
-                        set data [randomInt 4000000000]
-                    }
-                    r sadd key $data
-                }
-                if {$d ne {string}} {
-                    assert_equal [r object encoding key] $e
-                }
-                set d1 [r debug digest]
-                r bgrewriteaof
-                waitForBgrewriteaof r
-                r debug loadaof
-                set d2 [r debug digest]
-                if {$d1 ne $d2} {
-                    error "assertion:$d1 is not equal to $d2"
+    foreach {d e} {string intset string hashtable int intset int roaring} {
+        test "AOF rewrite of set with $e encoding, $d data" {
+            r flushall
+            if {$e eq {intset}} {set len 10} else {set len 1000}
+            for {set j 0} {$j < $len} {incr j} {
+                if {$d eq {string}} {
+                    set data [randstring 0 16 alpha]
+                } else {
+                    set data [randomInt 4000000000]
                 }
+                r sadd key $data
+            }
+            if {$d ne {string}} {
+                assert_equal [r object encoding key] $e
+            }
+            set d1 [r debug digest]
+            r bgrewriteaof
+            waitForBgrewriteaof r
+            r debug loadaof
+            set d2 [r debug digest]
+            if {$d1 ne $d2} {
+                error "assertion:$d1 is not equal to $d2"
             }
         }
     }
 
     foreach d {string int} {
-        foreach e {ziplist hashtable} {
+        foreach e {listpack hashpack hashtable} {
             test "AOF rewrite of hash with $e encoding, $d data" {
                 r flushall
-                if {$e eq {ziplist}} {set len 10} else {set len 1000}
+                switch $e {
+                    listpack {set len 10}
+                    hashpack {set len 1000}
+                    hashtable {set len 10000}
+                }
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -157,10 +159,10 @@ start_server {tags {"aofrw"}} {
     }
 
     foreach d {string int} {
-        foreach e {ziplist skiplist} {
+        foreach e {listpack skiplist} {
             test "AOF rewrite of zset with $e encoding, $d data" {
                 r flushall
-                if {$e eq {ziplist}} {set len 10} else {set len 1000}
+                if {$e eq {listpack}} {set len 10} else {set len 1000}
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -676,6 +676,37 @@ start_server {tags {"basic"}} {
         assert_equal "1234\0002" [r get mykey]
     }
 
+    test "Short strings are embstr encoded, long strings raw encoded" {
+        r set mykey [string repeat x 44]
+        assert_encoding embstr mykey
+        r set mykey [string repeat x 45]
+        assert_encoding raw mykey
+        r set mykey ""
+        assert_encoding embstr mykey
+        assert_equal "" [r get mykey]
+    }
+
+    test "SETRANGE and APPEND against embstr-encoded key" {
+        r set mykey foo
+        assert_encoding embstr mykey
+        assert_equal 3 [r setrange mykey 0 ""]
+        assert_encoding embstr mykey
+        assert_equal 7 [r setrange mykey 4 bar]
+        assert_encoding raw mykey
+        assert_equal "foo\000bar" [r get mykey]
+
+        r set mykey foo
+        assert_equal 6 [r append mykey bar]
+        assert_encoding raw mykey
+        assert_equal foobar [r get mykey]
+
+        r set mykey foo
+        r set other [r get mykey]
+        r append mykey bar
+        assert_equal foo [r get other]
+        assert_encoding embstr other
+    }
+
     test "SETRANGE against key with wrong type" {
         r del mykey
         r lpush mykey "foo"
@@ -0,0 +1,247 @@
+start_server {tags {"bitops"}} {
+    test {BITFIELD signed SET and GET basics} {
+        r del bits
+        set results {}
+        lappend results [r bitfield bits set i8 0 -100]
+        lappend results [r bitfield bits set i8 0 101]
+        lappend results [r bitfield bits get i8 0]
+        set results
+    } {0 -100 101}
+
+    test {BITFIELD unsigned SET and GET basics} {
+        r del bits
+        set results {}
+        lappend results [r bitfield bits set u8 0 255]
+        lappend results [r bitfield bits set u8 0 100]
+        lappend results [r bitfield bits get u8 0]
+        set results
+    } {0 255 100}
+
+    test {BITFIELD #<idx> form} {
+        r del bits
+        set results {}
+        r bitfield bits set u8 #0 65
+        r bitfield bits set u8 #1 66
+        r bitfield bits set u8 #2 67
+        r get bits
+    } {ABC}
+
+    test {BITFIELD basic INCRBY form} {
+        r del bits
+        set results {}
+        r bitfield bits set u8 #0 10
+        lappend results [r bitfield bits incrby u8 #0 100]
+        lappend results [r bitfield bits incrby u8 #0 100]
+        set results
+    } {110 210}
+
+    test {BITFIELD chaining of multiple commands} {
+        r del bits
+        set results {}
+        r bitfield bits set u8 #0 10
+        lappend results [r bitfield bits incrby u8 #0 100 incrby u8 #0 100]
+        set results
+    } {{110 210}}
+
+    test {BITFIELD unsigned overflow wrap} {
+        r del bits
+        set results {}
+        r bitfield bits set u8 #0 100
+        lappend results [r bitfield bits overflow wrap incrby u8 #0 257]
+        lappend results [r bitfield bits get u8 #0]
+        lappend results [r bitfield bits overflow wrap incrby u8 #0 255]
+        lappend results [r bitfield bits get u8 #0]
+    } {101 101 100 100}
+
+    test {BITFIELD unsigned overflow sat} {
+        r del bits
+        set results {}
+        r bitfield bits set u8 #0 100
+        lappend results [r bitfield bits overflow sat incrby u8 #0 257]
+        lappend results [r bitfield bits get u8 #0]
+        lappend results [r bitfield bits overflow sat incrby u8 #0 -255]
+        lappend results [r bitfield bits get u8 #0]
+    } {255 255 0 0}
+
+    test {BITFIELD signed overflow wrap} {
+        r del bits
+        set results {}
+        r bitfield bits set i8 #0 100
+        lappend results [r bitfield bits overflow wrap incrby i8 #0 257]
+        lappend results [r bitfield bits get i8 #0]
+        lappend results [r bitfield bits overflow wrap incrby i8 #0 255]
+        lappend results [r bitfield bits get i8 #0]
+    } {101 101 100 100}
+
+    test {BITFIELD signed overflow sat} {
+        r del bits
+        set results {}
+        r bitfield bits set u8 #0 100
+        lappend results [r bitfield bits overflow sat incrby i8 #0 257]
+        lappend results [r bitfield bits get i8 #0]
+        lappend results [r bitfield bits overflow sat incrby i8 #0 -255]
+        lappend results [r bitfield bits get i8 #0]
+    } {127 127 -128 -128}
+
+    test {BITFIELD overflow fail leaves the value untouched} {
+        r del bits
+        r bitfield bits set u8 #0 250
+        set results [r bitfield bits overflow fail incrby u8 #0 10 \
+                                          get u8 #0 \
+                                          overflow wrap incrby u8 #0 10]
+        lappend results [r get bits]
+    } [list {} 250 4 "\x04"]
+
+    test {BITFIELD i64 and u63 limits} {
+        r del bits
+        set results {}
+        lappend results [r bitfield bits set i64 0 -9223372036854775808]
+        lappend results [r bitfield bits get i64 0]
+        lappend results [r bitfield bits overflow sat incrby i64 0 -1]
+        lappend results [r bitfield bits overflow wrap incrby i64 0 -1]
+        lappend results [r bitfield bits set u63 64 9223372036854775807]
+        lappend results [r bitfield bits get u63 64]
+        lappend results [r bitfield bits overflow wrap incrby u63 64 1]
+    } {0 -9223372036854775808 -9223372036854775808 9223372036854775807 0 9223372036854775807 0}
+
+    test {BITFIELD values span bytes at unaligned offsets} {
+        r del bits
+        r bitfield bits set u12 3 4095
+        assert_equal [r bitfield bits get u12 3 get u1 2 get u1 15] {4095 0 0}
+        assert_equal [r bitcount bits] 12
+        r bitfield bits set i5 13 -1
+        r bitfield bits get u20 0
+    } {131068}
+
+    test {BITFIELD GET reads missing keys and integer encoded strings} {
+        r del bits
+        assert_equal [r bitfield bits get u8 0 get i16 100] {0 0}
+        assert_equal [r exists bits] 0
+        r set bits 1
+        assert_equal [r object encoding bits] int
+        r bitfield bits get u8 0 get u8 8
+    } {49 0}
+
+    test {BITFIELD writes to integer encoded strings} {
+        r set bits 1
+        r bitfield bits set u8 8 50
+        r get bits
+    } {12}
+
+    test {BITFIELD with only FAIL overflows still creates the key} {
+        r del bits
+        assert_equal [r bitfield bits overflow fail set u2 0 7] {{}}
+        r strlen bits
+    } {1}
+
+    test {BITFIELD syntax and argument errors} {
+        r del bits
+        catch {r bitfield bits get u8} e
+        assert_match {*syntax*} $e
+        catch {r bitfield bits foo u8 0} e
+        assert_match {*syntax*} $e
+        catch {r bitfield bits get u64 0} e
+        assert_match {*Invalid bitfield type*} $e
+        catch {r bitfield bits get i65 0} e
+        assert_match {*Invalid bitfield type*} $e
+        catch {r bitfield bits get i0 0} e
+        assert_match {*Invalid bitfield type*} $e
+        catch {r bitfield bits get x8 0} e
+        assert_match {*Invalid bitfield type*} $e
+        catch {r bitfield bits get u8 -1} e
+        assert_match {*out of range*} $e
+        catch {r bitfield bits get u8 #-1} e
+        assert_match {*out of range*} $e
+        catch {r bitfield bits get u8 4294967289} e
+        assert_match {*out of range*} $e
+        catch {r bitfield bits set u8 0 foo} e
+        assert_match {*not an integer*} $e
+        catch {r bitfield bits overflow foo get u8 0} e
+        assert_match {*Invalid OVERFLOW*} $e
+        # Nothing was executed, even if the error follows valid writes.
+        catch {r bitfield bits set u8 0 1 get u8 foo} e
+        assert_match {*out of range*} $e
+        r exists bits
+    } {0}
+
+    test {BITFIELD against wrong type} {
+        r del bits
+        r lpush bits a
+        catch {r bitfield bits get u8 0} e
+        assert_match {*WRONGTYPE*} $e
+        catch {r bitfield bits set u8 0 1} e
+        set e
+    } {*WRONGTYPE*}
+
+    test {BITFIELD overflow detection fuzzing} {
+        for {set j 0} {$j < 1000} {incr j} {
+            set bits [expr {[randomInt 64]+1}]
+            set sign [randomInt 2]
+            if {$bits == 64} {set sign 1}
+            if {$sign} {
+                set min [expr {-(2**($bits-1))}]
+                set max [expr {2**($bits-1)-1}]
+                set type "i$bits"
+            } else {
+                set min 0
+                set max [expr {2**$bits-1}]
+                set type "u$bits"
+            }
+            set range [expr {$max-$min+1}]
+            set value [expr {$min+[randomInt 1000000]%$range}]
+            set incr [expr {[randomInt 2] ? $max-$value+[randomInt 3]-1 :
+                                            $min-$value-[randomInt 3]+1}]
+            if {$incr > 9223372036854775807} {
+                set incr 9223372036854775807
+            }
+            if {$incr < -9223372036854775808} {
+                set incr -9223372036854775808
+            }
+            set offset [randomInt 200]
+            set owtype [lindex {wrap sat fail} [randomInt 3]]
+
+            r del bits
+            r bitfield bits set $type $offset $value
+            set res [lindex [r bitfield bits overflow $owtype \
+                                              incrby $type $offset $incr] 0]
+
+            set sum [expr {$value+$incr}]
+            if {$sum >= $min && $sum <= $max} {
+                set expected $sum
+            } elseif {$owtype eq {fail}} {
+                set expected {}
+                set sum $value
+            } elseif {$owtype eq {sat}} {
+                set expected [expr {$sum > $max ? $max : $min}]
+            } else {
+                set expected [expr {($sum-$min)%$range+$min}]
+            }
+            if {$expected ne {}} {set sum $expected}
+            if {$res ne $expected ||
+                [r bitfield bits get $type $offset] != $sum} {
+                fail "$type at $offset: $value incrby $incr ($owtype) -> $res, expected $expected"
+            }
+        }
+    }
+
+    test {BITFIELD agrees with SETBIT and GETBIT} {
+        for {set j 0} {$j < 200} {incr j} {
+            r del bits
+            set bits [expr {[randomInt 64]+1}]
+            set type [expr {$bits == 64 ? "i64" : "u$bits"}]
+            set offset [randomInt 100]
+            set value [expr {[randomInt 2147483647]*[randomInt 2147483647]}]
+            set value [expr {$value % (2**($bits-($bits == 64)))}]
+            set binary {}
+            for {set k [expr {$bits-1}]} {$k >= 0} {incr k -1} {
+                append binary [expr {($value >> $k) & 1}]
+            }
+            for {set k 0} {$k < $bits} {incr k} {
+                r setbit bits [expr {$offset+$k}] [string index $binary $k]
+            }
+            assert_equal $value [r bitfield bits get $type $offset]
+            r bitfield bits set $type $offset 0
+            assert_equal 0 [r bitcount bits]
+        }
+    }
+}
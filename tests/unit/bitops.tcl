@@ -338,4 +338,52 @@ start_server {tags {"bitops"}} {
             }
         }
     }
+
+    # The tests above use the SIMD kernels when the CPU supports them, here
+    # the results are compared with the ones of the portable code, using
+    # strings long enough to be processed by the SIMD loops.
+    test {BITCOUNT, BITPOS and BITOP SIMD and scalar code agree} {
+        r flushall
+        for {set i 0} {$i < 50} {incr i} {
+            set len [randomInt 5000]
+            set fill [lindex [list "\x00" "\xff" ""] [randomInt 3]]
+            if {$fill eq {}} {
+                set str [randstring $len $len binary]
+            } else {
+                # Long runs of zeros or ones with a single flipped bit.
+                set str [string repeat $fill $len]
+            }
+            r set str $str
+            if {$len && $fill ne {}} {
+                r setbit str [randomInt [expr {$len*8}]] [expr {$fill eq "\x00"}]
+            }
+            set start [randomInt [expr {$len+1}]]
+            set end [expr {$start+[randomInt [expr {$len+1}]]}]
+            set veckeys {}
+            set numvec [expr {[randomInt 20]+1}]
+            for {set j 0} {$j < $numvec} {incr j} {
+                set l [expr {$len-[randomInt 200]}]
+                if {$l < 0} {set l 0}
+                r set vector_$j [randstring $l $l binary]
+                lappend veckeys vector_$j
+            }
+            set res {}
+            foreach simd {0 1} {
+                r debug set-bitops-simd $simd
+                set out {}
+                lappend out [r bitcount str] [r bitcount str $start $end]
+                lappend out [r bitpos str 0] [r bitpos str 1]
+                lappend out [r bitpos str 0 $start $end] [r bitpos str 1 $start]
+                foreach op {and or xor} {
+                    r bitop $op target {*}$veckeys
+                    lappend out [r get target]
+                }
+                r bitop not target vector_0
+                lappend out [r get target]
+                lappend res $out
+            }
+            assert_equal [lindex $res 0] [lindex $res 1]
+        }
+        r debug set-bitops-simd 1
+    } {OK}
 }
@@ -151,6 +151,79 @@ start_server {tags {"hll"}} {
         }
     }
 
+    test {PFCOUNT multiple keys cached cardinality is invalidated by writes} {
+        r del hll1 hll2 hll3
+        r pfadd hll1 a b c
+        r pfadd hll2 c d e
+        assert_equal 5 [r pfcount hll1 hll2]
+        assert_equal 5 [r pfcount hll1 hll2]
+        assert_equal 3 [r pfcount hll1 hll3]
+        r pfadd hll1 f
+        assert_equal 6 [r pfcount hll1 hll2]
+        r pfadd hll3 g
+        assert_equal 5 [r pfcount hll1 hll3]
+        r del hll2
+        assert_equal 4 [r pfcount hll1 hll2]
+        r rename hll3 hll2
+        assert_equal 5 [r pfcount hll1 hll2]
+        r set hll2 foo
+        catch {r pfcount hll1 hll2} e
+        assert_match {*WRONGTYPE*} $e
+        r del hll2
+        r select 10
+        r pfadd hll2 x y
+        r select 9
+        assert_equal 4 [r pfcount hll1 hll2]
+        r flushall
+        r pfcount hll1 hll2
+    } {0}
+
+    test {PFCOUNT multiple keys with expires is not cached} {
+        r del hll1 hll2
+        r pfadd hll1 a b c
+        r pfadd hll2 c d e
+        r debug set-active-expire 0
+        r pexpire hll2 100
+        assert_equal 5 [r pfcount hll1 hll2]
+        after 200
+        assert_equal 3 [r pfcount hll1 hll2]
+        r debug set-active-expire 1
+    } {OK}
+
+    test {PFCOUNT multiple keys cached cardinality survives DEBUG RELOAD} {
+        r del hll1 hll2
+        r pfadd hll1 a b c
+        r pfadd hll2 c d e
+        assert_equal 5 [r pfcount hll1 hll2]
+        r debug reload
+        r pfadd hll2 f
+        r pfcount hll1 hll2
+    } {6}
+
+    test {PFMERGE of dense HLLs sets every register to the max} {
+        r del hll hll1 hll2 hll3 hll4
+        for {set j 1} {$j <= 3} {incr j} {
+            set elements {}
+            for {set x 0} {$x < 20000} {incr x} {lappend elements "$j-$x"}
+            r pfadd hll$j {*}$elements
+            assert {[r pfdebug encoding hll$j] eq {dense}}
+        }
+        # A sparse source is merged as well.
+        r pfadd hll4 a b c
+        r pfmerge hll hll1 hll2 hll3 hll4
+        set regs {}
+        for {set j 1} {$j <= 4} {incr j} {
+            lappend regs [r pfdebug getreg hll$j]
+        }
+        set max {}
+        foreach r1 [lindex $regs 0] r2 [lindex $regs 1] \
+                r3 [lindex $regs 2] r4 [lindex $regs 3] {
+            lappend max [expr {max($r1,$r2,$r3,$r4)}]
+        }
+        assert_equal $max [r pfdebug getreg hll]
+        assert_equal [r pfcount hll] [r pfcount hll1 hll2 hll3 hll4]
+    }
+
     test {PFDEBUG GETREG returns the HyperLogLog raw registers} {
         r del hll
         r pfadd hll 1 2 3
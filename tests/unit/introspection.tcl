@@ -57,3 +57,32 @@ start_server {tags {"introspection"}} {
         }
     }
 }
+
+start_server {tags {"introspection"} overrides {io-threads 4}} {
+    test {CONFIG GET io-threads} {
+        r config get io-threads
+    } {io-threads 4}
+
+    test {Threaded I/O serves many pipelining clients correctly} {
+        set clients {}
+        for {set j 0} {$j < 16} {incr j} {
+            set rd [redis_deferring_client]
+            for {set i 0} {$i < 100} {incr i} {
+                $rd set key:$j:$i val:$j:$i
+                $rd get key:$j:$i
+            }
+            lappend clients $rd
+        }
+        set j 0
+        foreach rd $clients {
+            for {set i 0} {$i < 100} {incr i} {
+                assert_equal OK [$rd read]
+                assert_equal val:$j:$i [$rd read]
+            }
+            $rd close
+            incr j
+        }
+        assert_equal 1600 [r dbsize]
+        assert_match {*io_threads:4*} [r info threads]
+    }
+}
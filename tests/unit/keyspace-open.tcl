@@ -0,0 +1,115 @@
+start_server {tags {"keyspace-open"} overrides {keyspace-open-addressing yes}} {
+    test "Open addressing keyspace: CONFIG GET" {
+        assert_equal {keyspace-open-addressing yes} \
+            [r config get keyspace-open-addressing]
+    }
+
+    test "Open addressing keyspace: SET, GET and DEL across resizes" {
+        r flushdb
+        for {set i 0} {$i < 20000} {incr i} {
+            r set key:$i $i
+        }
+        assert_equal 20000 [r dbsize]
+        for {set i 0} {$i < 20000} {incr i 2} {
+            assert_equal 1 [r del key:$i]
+        }
+        assert_equal 10000 [r dbsize]
+        set err {}
+        for {set i 0} {$i < 20000} {incr i} {
+            set v [r get key:$i]
+            if {$i % 2 == 0 && $v ne {}} {set err "key:$i still there"}
+            if {$i % 2 == 1 && $v ne $i} {set err "key:$i is '$v'"}
+        }
+        assert_equal {} $err
+        # Reuse the DELETED slots.
+        for {set i 0} {$i < 20000} {incr i 2} {
+            r set key:$i $i
+        }
+        assert_equal 20000 [r dbsize]
+        assert_equal 19998 [r get key:19998]
+    }
+
+    test "Open addressing keyspace: SCAN returns every key" {
+        r flushdb
+        r debug populate 5000
+        for {set i 0} {$i < 5000} {incr i 3} {
+            r del key:$i
+        }
+        set cur 0
+        set keys {}
+        while 1 {
+            set res [r scan $cur count 7]
+            set cur [lindex $res 0]
+            lappend keys {*}[lindex $res 1]
+            if {$cur == 0} break
+        }
+        set keys [lsort -unique $keys]
+        assert_equal [r dbsize] [llength $keys]
+        assert_equal [lsort [r keys *]] $keys
+    }
+
+    test "Open addressing keyspace: SCAN while the table grows" {
+        r flushdb
+        r debug populate 1000
+        set cur 0
+        set keys {}
+        set j 0
+        while 1 {
+            set res [r scan $cur count 20]
+            set cur [lindex $res 0]
+            lappend keys {*}[lindex $res 1]
+            for {set i 0} {$i < 5} {incr i} {
+                r set new:$j:$i x
+            }
+            incr j
+            if {$cur == 0} break
+        }
+        set keys [lsort -unique $keys]
+        set missing 0
+        for {set i 0} {$i < 1000} {incr i} {
+            if {[lsearch -sorted $keys key:$i] == -1} {incr missing}
+        }
+        assert_equal 0 $missing
+    }
+
+    test "Open addressing keyspace: RANDOMKEY and expires" {
+        r flushdb
+        for {set i 0} {$i < 100} {incr i} {
+            r set key:$i $i
+            r expire key:$i 100
+        }
+        r set persistent x
+        for {set i 0} {$i < 50} {incr i} {
+            assert {[r exists [r randomkey]]}
+        }
+        set ttl [r ttl key:10]
+        assert {$ttl > 90 && $ttl <= 100}
+        r persist key:10
+        assert_equal -1 [r ttl key:10]
+        r pexpire key:20 1
+        after 10
+        assert_equal 0 [r exists key:20]
+        assert_equal 100 [r dbsize]
+    }
+
+    test "Open addressing keyspace: DEBUG RELOAD" {
+        r flushdb
+        r debug populate 10000
+        r expire key:1 1000
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal 10000 [r dbsize]
+        set ttl [r ttl key:1]
+        assert {$ttl > 900 && $ttl <= 1000}
+    }
+
+    test "Open addressing keyspace: FLUSHALL ASYNC then new writes" {
+        r debug populate 10000
+        r flushall async
+        assert_equal 0 [r dbsize]
+        r set foo bar
+        assert_equal bar [r get foo]
+        assert_equal {foo} [r keys *]
+    }
+}
@@ -0,0 +1,140 @@
+start_server {tags {"lazyfree"}} {
+    test "UNLINK can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args "member:$i"
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        assert {[r unlink myset] == 1}
+        assert {[r exists myset] == 0}
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by UNLINK"
+        }
+        assert {[s used_memory] < $peak_mem}
+        assert {[s used_memory] < $orig_mem + 1000000}
+        assert {[s lazyfreed_objects] >= 1}
+    }
+
+    test "UNLINK of small and missing keys works like DEL" {
+        r set foo bar
+        r rpush mylist a b c
+        assert {[r unlink foo mylist nokey] == 2}
+        assert {[r exists foo] == 0}
+        assert {[r exists mylist] == 0}
+    }
+
+    test "UNLINK removes the expire of the key" {
+        r del myset
+        for {set i 0} {$i < 1000} {incr i} {
+            r sadd myset "member:$i"
+        }
+        r expire myset 100
+        assert {[r unlink myset] == 1}
+        r sadd myset a
+        assert {[r ttl myset] == -1}
+    }
+
+    test "UNLINK doesn't affect the elements shared with other keys" {
+        r del set1 set2 dst
+        for {set i 0} {$i < 1000} {incr i} {
+            r sadd set1 $i "member:$i"
+            r sadd set2 [expr {$i*2}]
+        }
+        r sunionstore dst set1 set2
+        set card [r scard dst]
+        set digest [r debug digest]
+        r unlink set1 set2
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by UNLINK"
+        }
+        assert {[r scard dst] == $card}
+        assert {[r sismember dst "member:999"] == 1}
+        assert {[r sismember dst 1998] == 1}
+        r debug reload
+        assert {[r scard dst] == $card}
+    }
+
+    test "FLUSHDB ASYNC can reclaim memory in background" {
+        r flushall
+        set orig_mem [s used_memory]
+        r select 9
+        for {set i 0} {$i < 1000} {incr i} {
+            r set key:$i $i
+            r expire key:$i 100
+        }
+        for {set i 0} {$i < 1000} {incr i} {
+            r zadd bigzset $i member:$i
+        }
+        assert {[r dbsize] == 1001}
+        r flushdb async
+        assert {[r dbsize] == 0}
+        assert {[r ttl key:1] == -2}
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by FLUSHDB ASYNC"
+        }
+        assert {[s used_memory] < $orig_mem + 1000000}
+        r set key:1 foo
+        assert {[r get key:1] eq {foo}}
+    }
+
+    test "FLUSHALL ASYNC empties all the databases" {
+        r select 9
+        r set foo bar
+        r select 10
+        r set foo bar
+        r flushall async
+        assert {[r dbsize] == 0}
+        r select 9
+        assert {[r dbsize] == 0}
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by FLUSHALL ASYNC"
+        }
+    }
+
+    test "FLUSHALL and FLUSHDB reject unknown arguments" {
+        catch {r flushall sync} e
+        assert_match {*syntax*} $e
+        catch {r flushdb async async} e
+        assert_match {*syntax*} $e
+    }
+}
+
+start_server [list tags {"lazyfree"} overrides [list module [pwd]/modules/libsortedtable.so]] {
+    test "FLUSHALL ASYNC releases module type values" {
+        set orig_mem [s used_memory]
+        r hcreate scores game asc score desc
+        for {set i 0} {$i < 100} {incr i} {
+            for {set j 0} {$j < 100} {incr j} {
+                r hadd t:$i scores game g$j score $j
+            }
+        }
+        for {set i 0} {$i < 1000} {incr i} {
+            r zadd bigzset $i member:$i
+        }
+        assert {[r type t:0] eq {table}}
+        r flushall async
+        assert {[r dbsize] == 0}
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by FLUSHALL ASYNC"
+        }
+        assert {[s used_memory] < $orig_mem + 1000000}
+        assert {[r hadd t:0 scores game g1 score 1] == 1}
+        assert {[r hcount t:0 scores] == 1}
+        r flushdb async
+        assert {[r exists t:0] == 0}
+        r ping
+    } {PONG}
+}
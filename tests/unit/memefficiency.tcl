@@ -30,3 +30,45 @@ start_server {tags {"memefficiency"}} {
         }
     }
 }
+
+start_server {tags {"memefficiency"}} {
+    test "Memory efficiency of long lists of small elements" {
+        r flushall
+        set base_mem [s used_memory]
+        for {set j 0} {$j < 100000} {incr j 100} {
+            set args {}
+            for {set i $j} {$i < $j+100} {incr i} {lappend args $i}
+            r rpush biglist {*}$args
+        }
+        set used [expr {[s used_memory]-$base_mem}]
+        # A linked list node plus an object costs more than 40 bytes per
+        # element, packing them in listpacks should take way less than that.
+        assert {[expr {double($used)/100000}] < 16}
+    }
+}
+
+start_server {tags {"memefficiency"}} {
+    test "Memory usage per key of small keys" {
+        r flushall
+        set base_mem [s used_memory]
+        r debug populate 100000
+        set used [expr {[s used_memory]-$base_mem}]
+        # Table slot, entry with its embedded key, value object and value
+        # string: a separate allocation for the key would take this over
+        # 120 bytes.
+        assert {[expr {double($used)/100000}] < 115}
+    }
+
+    test "Memory usage per key of integer values" {
+        r flushall
+        set base_mem [s used_memory]
+        for {set j 100000} {$j < 120000} {incr j} {
+            r set k$j $j
+        }
+        set used [expr {[s used_memory]-$base_mem}]
+        assert_encoding int k100000
+        # The integer is stored in the value object: keeping the EMBSTR
+        # allocation it was parsed into would cost 16 bytes more per key.
+        assert {[expr {double($used)/20000}] < 85}
+    }
+}
@@ -100,6 +100,35 @@ start_server {tags {"protocol"}} {
     unset c
 }
 
+start_server {tags {"protocol"} overrides {io-threads 4 io-threads-do-reads yes}} {
+    test "Protocol errors found by the I/O threads are replied" {
+        set sockets {}
+        for {set j 0} {$j < 32} {incr j} {
+            set s [socket [srv 0 host] [srv 0 port]]
+            fconfigure $s -translation binary
+            lappend sockets $s
+        }
+        # Make all the requests pending in the same event loop iteration.
+        set rd [redis_deferring_client]
+        $rd debug sleep 0.5
+        foreach s $sockets {
+            puts -nonewline $s "*3\r\n\$3\r\nSET\r\n\$1\r\nx\r\nfooz\r\n"
+        }
+        foreach s $sockets {flush $s}
+        $rd read
+        $rd close
+        set replies {}
+        foreach s $sockets {
+            lappend replies [gets $s]
+            assert_equal {} [read $s]
+            close $s
+        }
+        assert_equal 32 [llength [lsearch -all $replies "*expected '$', got 'f'*"]]
+        assert {[s io_threaded_reads_processed] > 0}
+        r ping
+    } {PONG}
+}
+
 start_server {tags {"regression"}} {
     test "Regression for a crash with blocking ops and pipelining" {
         set rd [redis_deferring_client]
@@ -53,18 +53,19 @@ start_server {tags {"scan"}} {
         assert_equal 100 [llength $keys]
     }
 
-    foreach enc {intset hashtable} {
+    foreach enc {intset roaring hashtable} {
         test "SSCAN with encoding $enc" {
             # Create the Set
             r del set
-            if {$enc eq {intset}} {
-                set prefix ""
-            } else {
+            if {$enc eq {hashtable}} {
                 set prefix "ele:"
+            } else {
+                set prefix ""
             }
+            if {$enc eq {roaring}} {set count 1000} else {set count 100}
             set elements {}
-            for {set j 0} {$j < 100} {incr j} {
-                lappend elements ${prefix}${j}
+            for {set j 0} {$j < $count} {incr j} {
+                lappend elements ${prefix}[expr {$j*97-$count*10}]
             }
             r sadd set {*}$elements
 
@@ -83,18 +84,18 @@ start_server {tags {"scan"}} {
             }
 
             set keys [lsort -unique $keys]
-            assert_equal 100 [llength $keys]
+            assert_equal $count [llength $keys]
         }
     }
 
-    foreach enc {ziplist hashtable} {
+    foreach enc {listpack hashpack hashtable} {
         test "HSCAN with encoding $enc" {
             # Create the Hash
             r del hash
-            if {$enc eq {ziplist}} {
-                set count 30
-            } else {
-                set count 1000
+            switch $enc {
+                listpack {set count 30}
+                hashpack {set count 1000}
+                hashtable {set count 10000}
             }
             set elements {}
             for {set j 0} {$j < $count} {incr j} {
@@ -127,11 +128,11 @@ start_server {tags {"scan"}} {
         }
     }
 
-    foreach enc {ziplist skiplist} {
+    foreach enc {listpack skiplist} {
         test "ZSCAN with encoding $enc" {
             # Create the Sorted Set
             r del zset
-            if {$enc eq {ziplist}} {
+            if {$enc eq {listpack}} {
                 set count 30
             } else {
                 set count 1000
@@ -220,6 +221,43 @@ start_server {tags {"scan"}} {
         lsort -unique [lindex $res 1]
     } {1 10 foo foobar}
 
+    test "HSCAN of a hashpack returns a few elements per call" {
+        r del hash
+        for {set j 0} {$j < 1000} {incr j} {
+            r hset hash key:$j $j
+        }
+        assert_encoding hashpack hash
+        set res [r hscan hash 0 COUNT 10]
+        assert {[lindex $res 0] != 0}
+        assert {[llength [lindex $res 1]] < 100}
+
+        # Fields added and removed during the iteration, growing and
+        # shrinking the index, don't make it miss the other fields.
+        set cur 0
+        set keys {}
+        set j 1000
+        while 1 {
+            set res [r hscan hash $cur COUNT 10]
+            set cur [lindex $res 0]
+            foreach {k v} [lindex $res 1] {lappend keys $k}
+            if {$cur == 0} break
+            if {$j < 2000} {
+                for {set i 0} {$i < 50} {incr i; incr j} {
+                    r hset hash key:$j $j
+                }
+            } else {
+                for {set i 1000} {$i < 2000} {incr i} {
+                    r hdel hash key:$i
+                }
+            }
+        }
+        assert_encoding hashpack hash
+        set keys [lsort -unique $keys]
+        for {set j 0} {$j < 1000} {incr j} {
+            assert {[lsearch -exact -sorted $keys key:$j] != -1}
+        }
+    }
+
     test "ZSCAN with PATTERN" {
         r del mykey
         r zadd mykey 1 foo 2 fab 3 fiz 10 foobar
@@ -36,12 +36,12 @@ start_server {
     }
 
     foreach {num cmd enc title} {
-        16 lpush ziplist "Ziplist"
-        1000 lpush linkedlist "Linked list"
-        10000 lpush linkedlist "Big Linked list"
+        16 lpush listpack "Listpack"
+        1000 lpush quicklist "Quicklist"
+        10000 lpush quicklist "Big Quicklist"
         16 sadd intset "Intset"
-        1000 sadd hashtable "Hash table"
-        10000 sadd hashtable "Big Hash table"
+        1000 sadd roaring "Roaring bitmap"
+        10000 sadd roaring "Big roaring bitmap"
     } {
         set result [create_random_dataset $num $cmd]
         assert_encoding $enc tosort
@@ -85,14 +85,14 @@ start_server {
         r sort tosort BY weight_* store sort-res
         assert_equal $result [r lrange sort-res 0 -1]
         assert_equal 16 [r llen sort-res]
-        assert_encoding ziplist sort-res
+        assert_encoding listpack sort-res
     }
 
     test "SORT BY hash field STORE" {
         r sort tosort BY wobj_*->weight store sort-res
         assert_equal $result [r lrange sort-res 0 -1]
         assert_equal 16 [r llen sort-res]
-        assert_encoding ziplist sort-res
+        assert_encoding listpack sort-res
     }
 
     test "SORT DESC" {
@@ -238,6 +238,55 @@ start_server {
         r sort mylist by num get x:*->
     } {100}
 
+    test "SORT with LIMIT complains about bad doubles outside of the range" {
+        r del myset
+        r sadd myset 1 2 3 4 5 6 7 8 9 10 foo
+        set e {}
+        catch {r sort myset LIMIT 0 1} e
+        set e
+    } {*ERR*double*}
+
+    test "SORT with LIMIT agrees with the full SORT" {
+        r del tosort
+        for {set i 0} {$i < 500} {incr i} {
+            r set w_$i [expr {($i*7919)%500}]
+            r set v_$i "val_$i"
+        }
+        foreach {type cmd} {list rpush set sadd zset zadd} {
+            r del tosort
+            for {set i 0} {$i < 500} {incr i} {
+                if {$type eq {zset}} {
+                    r zadd tosort [randomInt 100] $i
+                } else {
+                    r $cmd tosort $i
+                }
+            }
+            for {set j 0} {$j < 100} {incr j} {
+                set opts {}
+                if {[randomInt 2]} {lappend opts BY w_*}
+                if {[randomInt 2]} {lappend opts DESC}
+                if {[randomInt 2] && [lsearch $opts BY] == -1} {
+                    lappend opts ALPHA
+                }
+                if {[randomInt 2]} {lappend opts GET # GET v_*}
+                set start [randomInt 520]
+                set count [expr {[randomInt 4] ? [randomInt 30] : -1}]
+                set full [r sort tosort {*}$opts]
+                set per [expr {[lsearch $opts GET] == -1 ? 1 : 2}]
+                if {$count < 0} {
+                    set expected [lrange $full [expr {$start*$per}] end]
+                } else {
+                    set expected [lrange $full [expr {$start*$per}] \
+                        [expr {($start+$count)*$per-1}]]
+                }
+                assert_equal $expected \
+                    [r sort tosort {*}$opts LIMIT $start $count]
+                r sort tosort {*}$opts LIMIT $start $count STORE dst
+                assert_equal $expected [r lrange dst 0 -1]
+            }
+        }
+    }
+
     tags {"slow"} {
         set num 100
         set res [create_random_dataset $num lpush]
@@ -0,0 +1,222 @@
+start_server [list tags {"sortedtable"} overrides [list module [pwd]/modules/libsortedtable.so]] {
+    test {HCREATE declares a table and is idempotent} {
+        assert_equal OK [r hcreate scores game asc score desc]
+        assert_equal OK [r hcreate scores game asc score desc]
+        catch {r hcreate scores game asc} e
+        set e
+    } {ERR*different key*}
+
+    test {HCREATE syntax errors} {
+        catch {r hcreate bad a up} e1
+        catch {r hcreate bad a asc a desc} e2
+        list $e1 $e2
+    } {{ERR syntax error} {ERR duplicate column 'a'}}
+
+    test {HADD creates a table key and replaces rows with the same key} {
+        r del t
+        assert_equal 1 [r hadd t scores game g1 score 10 user alice]
+        assert_equal 1 [r hadd t scores game g1 score 20 user bob]
+        assert_equal 0 [r hadd t scores score 20 game g1 user carol]
+        list [r type t] [r object encoding t] [r hcount t scores]
+    } {table rbtree 2}
+
+    test {HADD errors} {
+        catch {r hadd t nosuchtable a 1} e1
+        catch {r hadd t scores game g1 user dave} e2
+        catch {r hadd t scores game g1 score 1 game g2} e3
+        r set str foo
+        catch {r hadd str scores game g1 score 1} e4
+        r hcreate other game asc
+        catch {r hadd t other game g1} e5
+        list $e1 $e2 $e3 $e4 $e5
+    } {{ERR no such table 'nosuchtable'} {ERR missing value for key column 'score'} {ERR duplicate field 'game'} {WRONGTYPE*} {ERR key is not a 'other' table}}
+
+    test {HRANGE returns rows in key order, ASC and DESC columns} {
+        r del t
+        r hadd t scores game g2 score 5 user a
+        r hadd t scores game g1 score 5 user b
+        r hadd t scores game g1 score 100 user c
+        r hadd t scores game g1 score 9 user d
+        r hadd t scores game g1 score -1.5 user e
+        set users {}
+        foreach row [r hrange t scores] {
+            lappend users [dict get $row user]
+        }
+        set users
+    } {c d b e a}
+
+    test {HRANGE rows list key columns first} {
+        r hrange t scores game g2
+    } {{game g2 score 5 user a}}
+
+    test {HRANGE with key prefix and LIMIT} {
+        set res {}
+        foreach row [r hrange t scores game g1 limit 1 2] {
+            lappend res [dict get $row score]
+        }
+        lappend res [llength [r hrange t scores game g1 limit 0 -1]]
+        lappend res [llength [r hrange t scores game g1 limit -1 2]]
+        lappend res [llength [r hrange t scores game g3]]
+        lappend res [llength [r hrange nokey scores]]
+    } {9 5 4 0 0 0}
+
+    test {HRANGE rejects non key columns and holes in the key} {
+        catch {r hrange t scores user a} e1
+        catch {r hrange t scores score 5} e2
+        list $e1 $e2
+    } {{ERR 'user' is not a key column of table 'scores'} {ERR missing value for key column 'game'}}
+
+    test {HRANK and HCOUNT} {
+        list [r hrank t scores game g1 score 100] \
+             [r hrank t scores game g1 score -1.5] \
+             [r hrank t scores game g2 score 5] \
+             [r hrank t scores game g2 score 6] \
+             [r hcount t scores] \
+             [r hcount t scores game g1] \
+             [r hcount t scores game g1 score 9] \
+             [r hcount t scores game g0]
+    } {0 3 4 {} 5 4 1 0}
+
+    test {Strings sort after numbers and binary safe} {
+        r del s
+        r hcreate strs k asc
+        r hadd s strs k "b"
+        r hadd s strs k "a\x00b"
+        r hadd s strs k "a"
+        r hadd s strs k "10"
+        r hadd s strs k "9"
+        r hadd s strs k "a\x00"
+        set res {}
+        foreach row [r hrange s strs] {
+            lappend res [dict get $row k]
+        }
+        set res
+    } [list 9 10 a "a\x00" "a\x00b" b]
+
+    test {Different spellings of the same number are different keys} {
+        r del s
+        foreach k {16 0x10 1 1.0 1.5 1.50 -0 0 1e1 10 9007199254740993} {
+            r hadd s strs k $k
+        }
+        set res {}
+        foreach row [r hrange s strs] {
+            lappend res [dict get $row k]
+        }
+        list [r hcount s strs] $res
+    } {11 {0 1 1.5 10 16 -0 0x10 1.0 1.50 1e1 9007199254740993}}
+
+    test {HREM removes rows by key prefix and deletes empty keys} {
+        assert_equal 1 [r hrem t scores game g1 score 9]
+        assert_equal 0 [r hrem t scores game g1 score 9]
+        assert_equal 3 [r hrem t scores game g1]
+        assert_equal 1 [r hcount t scores]
+        assert_equal 1 [r hrem t scores game g2]
+        r exists t
+    } {0}
+
+    test {HRANK/HCOUNT are consistent with a sorted model after random changes} {
+        r del t
+        r hcreate pairs a asc b desc
+        array set model {}
+        for {set i 0} {$i < 2000} {incr i} {
+            set a [randomInt 20]
+            set b [randomInt 50]
+            if {[randomInt 3] == 0} {
+                r hrem t pairs a $a b $b
+                unset -nocomplain model($a,$b)
+            } else {
+                r hadd t pairs a $a b $b
+                set model($a,$b) [list $a $b]
+            }
+        }
+        set sorted {}
+        foreach {k v} [array get model] {lappend sorted $v}
+        set sorted [lsort -command {apply {{x y} {
+            if {[lindex $x 0] != [lindex $y 0]} {
+                return [expr {[lindex $x 0] - [lindex $y 0]}]
+            }
+            return [expr {[lindex $y 1] - [lindex $x 1]}]
+        }}} $sorted]
+        assert_equal [llength $sorted] [r hcount t pairs]
+        set rank 0
+        foreach pair $sorted {
+            lassign $pair a b
+            assert_equal $rank [r hrank t pairs a $a b $b]
+            incr rank
+        }
+        for {set a 0} {$a < 20} {incr a} {
+            set expected 0
+            foreach pair $sorted {
+                if {[lindex $pair 0] == $a} {incr expected}
+            }
+            assert_equal $expected [r hcount t pairs a $a]
+        }
+    }
+
+    test {HRANGE LIMIT selects rows by rank} {
+        set len [llength $sorted]
+        for {set i 0} {$i < 100} {incr i} {
+            set offset [randomInt [expr {$len+2}]]
+            set rows [r hrange t pairs limit $offset 1]
+            if {$offset >= $len} {
+                assert_equal {} $rows
+            } else {
+                lassign [lindex $sorted $offset] a b
+                assert_equal [list a $a b $b] [lindex $rows 0]
+            }
+        }
+        set a [lindex $sorted 0 0]
+        set count [r hcount t pairs a $a]
+        assert_equal {} [r hrange t pairs a $a limit $count 1]
+    }
+
+    test {Tables report their type, encoding and memory usage} {
+        assert_equal table [r type t]
+        assert_equal rbtree [r object encoding t]
+        assert_match {*encoding:rbtree*memory:*} [r debug object t]
+    }
+
+    test {DUMP / RESTORE of a table preserves rows and order} {
+        set rows [r hrange t pairs]
+        set digest [r debug digest]
+        set dump [r dump t]
+        r del t
+        r restore t 0 $dump
+        assert_equal $rows [r hrange t pairs]
+        assert_equal $digest [r debug digest]
+        assert_equal [r hcount t pairs] [llength $sorted]
+    }
+
+    test {DEBUG RELOAD preserves tables} {
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal $rows [r hrange t pairs]
+        lassign [lindex $sorted end] a b
+        assert_equal [expr {[llength $sorted]-1}] [r hrank t pairs a $a b $b]
+    }
+
+    test {Loading tables from RDB doesn't leak memory} {
+        r flushall
+        for {set i 0} {$i < 200} {incr i} {
+            r hadd t:$i scores game g1 score $i
+        }
+        r debug reload
+        set mem [s used_memory]
+        for {set i 0} {$i < 10} {incr i} {
+            r debug reload
+        }
+        assert {[s used_memory] < $mem + 10000}
+        r flushall
+    }
+
+    test {AOF rewrite of a table can be loaded back} {
+        r hadd t2 scores game g1 score 7 user "with spaces"
+        set digest [r debug digest]
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal $digest [r debug digest]
+        r hrange t2 scores
+    } {{game g1 score 7 user {with spaces}}}
+}
@@ -14,8 +14,8 @@ start_server {tags {"hash"}} {
         list [r hlen smallhash]
     } {8}
 
-    test {Is the small hash encoded with a ziplist?} {
-        assert_encoding ziplist smallhash
+    test {Is the small hash encoded with a listpack?} {
+        assert_encoding listpack smallhash
     }
 
     test {HSET/HLEN - Big hash creation} {
@@ -33,8 +33,8 @@ start_server {tags {"hash"}} {
         list [r hlen bighash]
     } {1024}
 
-    test {Is the big hash encoded with a ziplist?} {
-        assert_encoding hashtable bighash
+    test {Is the big hash encoded with a hashpack?} {
+        assert_encoding hashpack bighash
     }
 
     test {HGET against the small hash} {
@@ -66,6 +66,24 @@ start_server {tags {"hash"}} {
         set _ $rv
     } {{} {}}
 
+    test {HGET against a listpack with mixed entry encodings} {
+        r del mixedhash
+        set origvalue [lindex [r config get hash-max-ziplist-value] 1]
+        r config set hash-max-ziplist-value 300
+        # Long entries have a two bytes length, and make the next entry
+        # use five bytes to store its prevlen.
+        set long [string repeat x 300]
+        r hmset mixedhash a 1 b 70000 c $long 12 d $long e 5000000000 f \
+            "" empty 99 ""
+        assert_encoding listpack mixedhash
+        set rv {}
+        foreach f [list a b c 12 $long 5000000000 "" 99 1 70000 xx 13] {
+            lappend rv [r hget mixedhash $f]
+        }
+        r config set hash-max-ziplist-value $origvalue
+        assert_equal [list 1 70000 $long d e f empty "" {} {} {} {}] $rv
+    }
+
     test {HSET in update and insert mode} {
         set rv {}
         set k [lindex [array names smallhash *] 0]
@@ -252,9 +270,14 @@ start_server {tags {"hash"}} {
         lappend rv [r hexists bighash nokey]
     } {1 0 1 0}
 
-    test {Is a ziplist encoded Hash promoted on big payload?} {
+    test {Is a listpack encoded Hash promoted to hashpack on big payload?} {
         r hset smallhash foo [string repeat a 1024]
         r debug object smallhash
+    } {*hashpack*}
+
+    test {Is a hashpack encoded Hash promoted on big payload?} {
+        r hset smallhash foo [string repeat a 1025]
+        r debug object smallhash
     } {*hashtable*}
 
     test {HINCRBY against non existing database key} {
@@ -390,7 +413,7 @@ start_server {tags {"hash"}} {
         lappend rv [string match "ERR*not*float*" $bigerr]
     } {1 1}
 
-    test {Hash ziplist regression test for large keys} {
+    test {Hash listpack regression test for large keys} {
         r hset hash kkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkk a
         r hset hash kkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkk b
         r hget hash kkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkk
@@ -457,14 +480,81 @@ start_server {tags {"hash"}} {
         }
     }
 
-    test {Stress test the hash ziplist -> hashtable encoding conversion} {
+    test {Stress test the hash listpack -> hashpack -> hashtable encoding conversion} {
         r config set hash-max-ziplist-entries 32
+        r config set hash-max-hashpack-entries 64
         for {set j 0} {$j < 100} {incr j} {
             r del myhash
-            for {set i 0} {$i < 64} {incr i} {
-                r hset myhash [randomValue] [randomValue]
+            for {set i 0} {$i < 48} {incr i} {
+                r hset myhash $i [randomValue]
+            }
+            assert {[r object encoding myhash] eq {hashpack}}
+            for {set i 48} {$i < 96} {incr i} {
+                r hset myhash $i [randomValue]
             }
             assert {[r object encoding myhash] eq {hashtable}}
         }
+        r config set hash-max-ziplist-entries 512
+        r config set hash-max-hashpack-entries 8192
+    }
+
+    test {Hashpack fuzzing with HSET, HDEL, HINCRBY and DEBUG RELOAD} {
+        r del hash
+        catch {unset hash}
+        array set hash {}
+        for {set j 0} {$j < 5000} {incr j} {
+            set field [randomInt 2000]
+            randpath {
+                set value [randstring 0 [randomInt 300] alpha]
+                r hset hash $field $value
+                set hash($field) $value
+            } {
+                r hdel hash $field
+                unset -nocomplain hash($field)
+            } {
+                if {![info exists hash($field)] ||
+                    [string is integer -strict $hash($field)]} {
+                    set hash($field) [r hincrby hash $field 3]
+                }
+            }
+        }
+        assert_encoding hashpack hash
+        assert_equal [array size hash] [r hlen hash]
+        foreach {k v} [array get hash] {
+            assert_equal $v [r hget hash $k]
+        }
+        assert_equal [lsort [array get hash]] [lsort [r hgetall hash]]
+        r debug reload
+        assert_encoding hashpack hash
+        assert_equal [lsort [array get hash]] [lsort [r hgetall hash]]
     }
+
+    test {Hashpack compaction after deleting most of the fields} {
+        r del hash
+        for {set j 0} {$j < 1000} {incr j} {
+            r hset hash field:$j [string repeat x 100]
+        }
+        for {set j 0} {$j < 990} {incr j} {
+            r hdel hash field:$j
+        }
+        assert_encoding hashpack hash
+        set res {}
+        for {set j 985} {$j < 1000} {incr j} {
+            lappend res [r hexists hash field:$j]
+        }
+        lappend res [r hlen hash]
+    } {0 0 0 0 0 1 1 1 1 1 1 1 1 1 1 10}
+
+    test {Hashpack is converted to hash table when growing too big} {
+        r config set hash-max-hashpack-entries 600
+        r del hash
+        for {set j 0} {$j < 600} {incr j} {
+            r hset hash field:$j $j
+        }
+        assert_encoding hashpack hash
+        r hset hash field:600 600
+        assert_encoding hashtable hash
+        r config set hash-max-hashpack-entries 8192
+        list [r hlen hash] [r hget hash field:0] [r hget hash field:600]
+    } {601 0 600}
 }
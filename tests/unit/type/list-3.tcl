@@ -1,5 +1,5 @@
 start_server {
-    tags {list ziplist}
+    tags {list listpack}
     overrides {
         "list-max-ziplist-value" 200000
         "list-max-ziplist-entries" 256
@@ -15,7 +15,7 @@ start_server {
     }
 
     tags {slow} {
-        test {ziplist implementation: value encoding and backlink} {
+        test {listpack implementation: value encoding and backlink} {
             if {$::accurate} {set iterations 100} else {set iterations 10}
             for {set j 0} {$j < $iterations} {incr j} {
                 r del l
@@ -52,7 +52,7 @@ start_server {
             }
         }
 
-        test {ziplist implementation: encoding stress testing} {
+        test {listpack implementation: encoding stress testing} {
             for {set j 0} {$j < 200} {incr j} {
                 r del l
                 set l {}
@@ -77,3 +77,116 @@ start_server {
         }
     }
 }
+
+start_server {
+    tags {list quicklist}
+    overrides {
+        "list-max-ziplist-size" 4
+        "list-compress-depth" 1
+    }
+} {
+    test {Quicklist: nodes are split and compressed} {
+        r del l
+        for {set i 0} {$i < 100} {incr i} {
+            r rpush l [string repeat "compressible$i" 10]
+        }
+        assert_encoding quicklist l
+        set info [r debug object l]
+        assert_match {*ql_nodes:25 *} $info
+        assert {![string match {*ql_compressed:0 *} $info]}
+        assert_equal [string repeat "compressible50" 10] [r lindex l 50]
+        assert_equal [string repeat "compressible0" 10] [r lindex l 0]
+        assert_equal [string repeat "compressible99" 10] [r lindex l -1]
+    }
+
+    tags {slow} {
+        test {Quicklist: random operations against a Tcl model} {
+            if {$::accurate} {set iterations 50} else {set iterations 10}
+            for {set j 0} {$j < $iterations} {incr j} {
+                r del l
+                set l {}
+                for {set i 0} {$i < 300} {incr i} {
+                    set v [randomValue]
+                    set len [llength $l]
+                    randpath {
+                        r rpush l $v
+                        lappend l $v
+                    } {
+                        r lpush l $v
+                        set l [linsert $l 0 $v]
+                    } {
+                        if {$len} {
+                            set idx [randomInt $len]
+                            r lset l $idx $v
+                            lset l $idx $v
+                        }
+                    } {
+                        if {$len} {
+                            set pivot [lindex $l [randomInt $len]]
+                            r linsert l before $pivot $v
+                            set l [linsert $l [lsearch -exact $l $pivot] $v]
+                        }
+                    } {
+                        if {$len} {
+                            set e [lindex $l [randomInt $len]]
+                            set removed [r lrem l 1 $e]
+                            assert_equal 1 $removed
+                            set idx [lsearch -exact $l $e]
+                            set l [lreplace $l $idx $idx]
+                        }
+                    } {
+                        if {$len > 20 && [randomInt 10] == 0} {
+                            set start [randomInt 5]
+                            set end [expr {$len-1-[randomInt 5]}]
+                            r ltrim l $start $end
+                            set l [lrange $l $start $end]
+                        }
+                    } {
+                        if {$len} {
+                            assert_equal [lindex $l 0] [r lpop l]
+                            set l [lrange $l 1 end]
+                        }
+                    }
+                }
+                assert_equal [llength $l] [r llen l]
+                assert_equal $l [r lrange l 0 -1]
+                set start [randomInt [expr {[llength $l]+1}]]
+                assert_equal [lrange $l $start end] [r lrange l $start -1]
+                assert_equal [lrange $l end-$start end] [r lrange l -[expr {$start+1}] -1]
+            }
+        }
+    }
+
+    test {Quicklist: DEBUG RELOAD and AOF rewrite preserve compressed lists} {
+        r del l
+        set l {}
+        for {set i 0} {$i < 1000} {incr i} {
+            set v [randomValue]
+            r rpush l $v
+            lappend l $v
+        }
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_encoding quicklist l
+        assert_equal $l [r lrange l 0 -1]
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal $digest [r debug digest]
+        assert_equal $l [r lrange l 0 -1]
+    }
+
+    test {Quicklist: CONFIG SET of list-max-ziplist-size and list-compress-depth} {
+        r config set list-max-ziplist-size -1
+        r config set list-compress-depth 2
+        assert_equal {list-max-ziplist-size -1} [r config get list-max-ziplist-size]
+        assert_equal {list-compress-depth 2} [r config get list-compress-depth]
+        catch {r config set list-max-ziplist-size 0} e
+        assert_match {ERR*} $e
+        catch {r config set list-max-ziplist-size -6} e
+        assert_match {ERR*} $e
+        r config set list-max-ziplist-size 4
+        r config set list-compress-depth 1
+    }
+}
@@ -7,59 +7,59 @@ start_server {
 } {
     source "tests/unit/type/list-common.tcl"
 
-    test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - ziplist} {
+    test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - listpack} {
         # first lpush then rpush
-        assert_equal 1 [r lpush myziplist1 a]
-        assert_equal 2 [r rpush myziplist1 b]
-        assert_equal 3 [r rpush myziplist1 c]
-        assert_equal 3 [r llen myziplist1]
-        assert_equal a [r lindex myziplist1 0]
-        assert_equal b [r lindex myziplist1 1]
-        assert_equal c [r lindex myziplist1 2]
-        assert_equal {} [r lindex myziplist2 3]
-        assert_equal c [r rpop myziplist1]
-        assert_equal a [r lpop myziplist1]
-        assert_encoding ziplist myziplist1
+        assert_equal 1 [r lpush mylistpack1 a]
+        assert_equal 2 [r rpush mylistpack1 b]
+        assert_equal 3 [r rpush mylistpack1 c]
+        assert_equal 3 [r llen mylistpack1]
+        assert_equal a [r lindex mylistpack1 0]
+        assert_equal b [r lindex mylistpack1 1]
+        assert_equal c [r lindex mylistpack1 2]
+        assert_equal {} [r lindex mylistpack2 3]
+        assert_equal c [r rpop mylistpack1]
+        assert_equal a [r lpop mylistpack1]
+        assert_encoding listpack mylistpack1
 
         # first rpush then lpush
-        assert_equal 1 [r rpush myziplist2 a]
-        assert_equal 2 [r lpush myziplist2 b]
-        assert_equal 3 [r lpush myziplist2 c]
-        assert_equal 3 [r llen myziplist2]
-        assert_equal c [r lindex myziplist2 0]
-        assert_equal b [r lindex myziplist2 1]
-        assert_equal a [r lindex myziplist2 2]
-        assert_equal {} [r lindex myziplist2 3]
-        assert_equal a [r rpop myziplist2]
-        assert_equal c [r lpop myziplist2]
-        assert_encoding ziplist myziplist2
+        assert_equal 1 [r rpush mylistpack2 a]
+        assert_equal 2 [r lpush mylistpack2 b]
+        assert_equal 3 [r lpush mylistpack2 c]
+        assert_equal 3 [r llen mylistpack2]
+        assert_equal c [r lindex mylistpack2 0]
+        assert_equal b [r lindex mylistpack2 1]
+        assert_equal a [r lindex mylistpack2 2]
+        assert_equal {} [r lindex mylistpack2 3]
+        assert_equal a [r rpop mylistpack2]
+        assert_equal c [r lpop mylistpack2]
+        assert_encoding listpack mylistpack2
     }
 
     test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - regular list} {
         # first lpush then rpush
-        assert_equal 1 [r lpush mylist1 $largevalue(linkedlist)]
-        assert_encoding linkedlist mylist1
+        assert_equal 1 [r lpush mylist1 $largevalue(quicklist)]
+        assert_encoding quicklist mylist1
         assert_equal 2 [r rpush mylist1 b]
         assert_equal 3 [r rpush mylist1 c]
         assert_equal 3 [r llen mylist1]
-        assert_equal $largevalue(linkedlist) [r lindex mylist1 0]
+        assert_equal $largevalue(quicklist) [r lindex mylist1 0]
         assert_equal b [r lindex mylist1 1]
         assert_equal c [r lindex mylist1 2]
         assert_equal {} [r lindex mylist1 3]
         assert_equal c [r rpop mylist1]
-        assert_equal $largevalue(linkedlist) [r lpop mylist1]
+        assert_equal $largevalue(quicklist) [r lpop mylist1]
 
         # first rpush then lpush
-        assert_equal 1 [r rpush mylist2 $largevalue(linkedlist)]
-        assert_encoding linkedlist mylist2
+        assert_equal 1 [r rpush mylist2 $largevalue(quicklist)]
+        assert_encoding quicklist mylist2
         assert_equal 2 [r lpush mylist2 b]
         assert_equal 3 [r lpush mylist2 c]
         assert_equal 3 [r llen mylist2]
         assert_equal c [r lindex mylist2 0]
         assert_equal b [r lindex mylist2 1]
-        assert_equal $largevalue(linkedlist) [r lindex mylist2 2]
+        assert_equal $largevalue(quicklist) [r lindex mylist2 2]
         assert_equal {} [r lindex mylist2 3]
-        assert_equal $largevalue(linkedlist) [r rpop mylist2]
+        assert_equal $largevalue(quicklist) [r rpop mylist2]
         assert_equal c [r lpop mylist2]
     }
 
@@ -74,10 +74,10 @@ start_server {
         assert_equal {d c b a 0 1 2 3} [r lrange mylist 0 -1]
     }
 
-    test {DEL a list - ziplist} {
-        assert_equal 1 [r del myziplist2]
-        assert_equal 0 [r exists myziplist2]
-        assert_equal 0 [r llen myziplist2]
+    test {DEL a list - listpack} {
+        assert_equal 1 [r del mylistpack2]
+        assert_equal 0 [r exists mylistpack2]
+        assert_equal 0 [r llen mylistpack2]
     }
 
     test {DEL a list - regular list} {
@@ -86,16 +86,16 @@ start_server {
         assert_equal 0 [r llen mylist2]
     }
 
-    proc create_ziplist {key entries} {
+    proc create_listpack {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding ziplist $key
+        assert_encoding listpack $key
     }
 
-    proc create_linkedlist {key entries} {
+    proc create_quicklist {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding linkedlist $key
+        assert_encoding quicklist $key
     }
 
     foreach {type large} [array get largevalue] {
@@ -547,55 +547,55 @@ start_server {
         set e
     } {*ERR*syntax*error*}
 
-    test {LPUSHX, RPUSHX convert from ziplist to list} {
-        set large $largevalue(linkedlist)
+    test {LPUSHX, RPUSHX convert from listpack to list} {
+        set large $largevalue(quicklist)
 
         # convert when a large value is pushed
-        create_ziplist xlist a
+        create_listpack xlist a
         assert_equal 2 [r rpushx xlist $large]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist a
+        assert_encoding quicklist xlist
+        create_listpack xlist a
         assert_equal 2 [r lpushx xlist $large]
-        assert_encoding linkedlist xlist
+        assert_encoding quicklist xlist
 
         # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
+        create_listpack xlist [lrepeat 256 a]
         assert_equal 257 [r rpushx xlist b]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
+        assert_encoding quicklist xlist
+        create_listpack xlist [lrepeat 256 a]
         assert_equal 257 [r lpushx xlist b]
-        assert_encoding linkedlist xlist
+        assert_encoding quicklist xlist
     }
 
-    test {LINSERT convert from ziplist to list} {
-        set large $largevalue(linkedlist)
+    test {LINSERT convert from listpack to list} {
+        set large $largevalue(quicklist)
 
         # convert when a large value is inserted
-        create_ziplist xlist a
+        create_listpack xlist a
         assert_equal 2 [r linsert xlist before a $large]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist a
+        assert_encoding quicklist xlist
+        create_listpack xlist a
         assert_equal 2 [r linsert xlist after a $large]
-        assert_encoding linkedlist xlist
+        assert_encoding quicklist xlist
 
         # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
+        create_listpack xlist [lrepeat 256 a]
         assert_equal 257 [r linsert xlist before a a]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
+        assert_encoding quicklist xlist
+        create_listpack xlist [lrepeat 256 a]
         assert_equal 257 [r linsert xlist after a a]
-        assert_encoding linkedlist xlist
+        assert_encoding quicklist xlist
 
         # don't convert when the value could not be inserted
-        create_ziplist xlist [lrepeat 256 a]
+        create_listpack xlist [lrepeat 256 a]
         assert_equal -1 [r linsert xlist before foo a]
-        assert_encoding ziplist xlist
-        create_ziplist xlist [lrepeat 256 a]
+        assert_encoding listpack xlist
+        create_listpack xlist [lrepeat 256 a]
         assert_equal -1 [r linsert xlist after foo a]
-        assert_encoding ziplist xlist
+        assert_encoding listpack xlist
     }
 
-    foreach {type num} {ziplist 250 linkedlist 500} {
+    foreach {type num} {listpack 250 quicklist 500} {
         proc check_numbered_list_consistency {key} {
             set len [r llen $key]
             for {set i 0} {$i < $len} {incr i} {
@@ -669,7 +669,7 @@ start_server {
             assert_equal c [r rpoplpush mylist1 mylist2]
             assert_equal "a $large" [r lrange mylist1 0 -1]
             assert_equal "c d" [r lrange mylist2 0 -1]
-            assert_encoding ziplist mylist2
+            assert_encoding listpack mylist2
         }
 
         test "RPOPLPUSH with the same list as src and dst - $type" {
@@ -690,8 +690,8 @@ start_server {
 
                 # When we rpoplpush'ed a large value, dstlist should be
                 # converted to the same encoding as srclist.
-                if {$type eq "linkedlist"} {
-                    assert_encoding linkedlist dstlist
+                if {$type eq "quicklist"} {
+                    assert_encoding quicklist dstlist
                 }
             }
         }
@@ -713,7 +713,7 @@ start_server {
     }
 
     test {RPOPLPUSH against non list dst key} {
-        create_ziplist srclist {a b c d}
+        create_listpack srclist {a b c d}
         r set dstlist x
         assert_error WRONGTYPE* {r rpoplpush srclist dstlist}
         assert_type string dstlist
@@ -745,7 +745,7 @@ start_server {
         assert_error WRONGTYPE* {r rpop notalist}
     }
 
-    foreach {type num} {ziplist 250 linkedlist 500} {
+    foreach {type num} {listpack 250 quicklist 500} {
         test "Mass RPOP/LPOP - $type" {
             r del mylist
             set sum1 0
@@ -56,7 +56,7 @@ start_server {
         for {set i 0} {$i < 512} {incr i} { r sadd myset $i }
         assert_encoding intset myset
         assert_equal 1 [r sadd myset 512]
-        assert_encoding hashtable myset
+        assert_encoding roaring myset
     }
 
     test {Variadic SADD} {
@@ -72,15 +72,88 @@ start_server {
         for {set i 0} {$i < 1280} {incr i} { r sadd mylargeintset $i }
         for {set i 0} {$i <  256} {incr i} { r sadd myhashset [format "i%03d" $i] }
         assert_encoding intset myintset
-        assert_encoding hashtable mylargeintset
+        assert_encoding roaring mylargeintset
         assert_encoding hashtable myhashset
 
         r debug reload
         assert_encoding intset myintset
-        assert_encoding hashtable mylargeintset
+        assert_encoding roaring mylargeintset
         assert_encoding hashtable myhashset
     }
 
+    test "Roaring sets: SADD, SREM, SISMEMBER and SCARD" {
+        r del myset
+        unset -nocomplain s
+        array set s {}
+        for {set j 0} {$j < 5000} {incr j} {
+            randpath {
+                set ele [randomInt 10000]
+            } {
+                set ele [expr {100000+[randomInt 300]}]
+            } {
+                set ele [randomSignedInt 4294967296]
+            } {
+                set ele [expr {-9223372036854775807+[randomInt 100]}]
+            }
+            if {[randomInt 4] == 0} {
+                assert_equal [info exists s($ele)] [r srem myset $ele]
+                unset -nocomplain s($ele)
+            } else {
+                assert_equal [expr {![info exists s($ele)]}] [r sadd myset $ele]
+                set s($ele) 1
+            }
+        }
+        assert_encoding roaring myset
+        assert_equal [array size s] [r scard myset]
+        foreach ele [array names s] {
+            assert_equal 1 [r sismember myset $ele]
+        }
+        assert_equal 0 [r sismember myset foo]
+        assert_equal 0 [r sismember myset 1.5]
+        assert_equal [lsort [array names s]] [lsort [r smembers myset]]
+    }
+
+    test "Roaring sets: SADD a non-integer converts to hashtable" {
+        r del myset
+        for {set i 0} {$i < 1000} {incr i} { r sadd myset [expr {$i*3}] }
+        assert_encoding roaring myset
+        assert_equal 1 [r sadd myset a]
+        assert_encoding hashtable myset
+        assert_equal 1001 [r scard myset]
+        assert_equal 1 [r sismember myset 2997]
+    }
+
+    test "Roaring sets: too sparse sets are converted to hashtable" {
+        r del myset
+        for {set i 0} {$i < 5000} {incr i} { r sadd myset [expr {$i*65536}] }
+        assert_encoding hashtable myset
+        assert_equal 5000 [r scard myset]
+    }
+
+    test "Roaring sets: dense, sparse and full ranges after DEBUG RELOAD" {
+        r del myset
+        # Runs of consecutive integers, a dense random range, scattered
+        # integers and negative numbers.
+        set runs {}
+        set dense {}
+        for {set i 0} {$i < 3000} {incr i} {
+            if {$i % 100 < 90} {lappend runs $i}
+        }
+        for {set i 0} {$i < 70000} {incr i 3} { lappend dense [expr {200000+$i}] }
+        r sadd myset {*}$runs
+        r sadd myset {*}$dense
+        for {set i 0} {$i < 300} {incr i} {
+            r sadd myset [randomSignedInt 10000000000]
+        }
+        r sadd myset -9223372036854775808 9223372036854775807
+        set before [lsort [r smembers myset]]
+        set card [r scard myset]
+        r debug reload
+        assert_encoding roaring myset
+        assert_equal $card [r scard myset]
+        assert_equal $before [lsort [r smembers myset]]
+    }
+
     test {SREM basics - regular set} {
         create_set myset {foo bar ciao}
         assert_encoding hashtable myset
@@ -111,7 +184,11 @@ start_server {
         r srem myset 1 2 3 4 5 6 7 8
     } {3}
 
-    foreach {type} {hashtable intset} {
+    foreach {type} {hashtable intset roaring} {
+        # Roaring bitmaps are used for integer sets too large for an intset.
+        if {$type eq "roaring"} {
+            r config set set-max-intset-entries 1
+        }
         for {set i 1} {$i <= 5} {incr i} {
             r del [format "set%d" $i]
         }
@@ -205,6 +282,7 @@ start_server {
             }
             assert_equal {1 2 3 4} [lsort [r smembers setres]]
         }
+        r config set set-max-intset-entries 512
     }
 
     test "SDIFF with first set empty" {
@@ -246,6 +324,119 @@ start_server {
         }
     }
 
+    test "SINTER and SUNION fuzzing with intsets of mixed encodings" {
+        set ranges {100 100000 10000000000}
+        for {set j 0} {$j < 100} {incr j} {
+            unset -nocomplain inter union
+            array set union {}
+            set args {}
+            set num_sets [expr {[randomInt 4]+1}]
+            for {set i 0} {$i < $num_sets} {incr i} {
+                set range [lindex $ranges [randomInt 3]]
+                unset -nocomplain cur
+                array set cur {}
+                r del set_$i
+                lappend args set_$i
+                for {set k [expr {[randomInt 300]+1}]} {$k > 0} {incr k -1} {
+                    set ele [expr {[randomInt 200]-100}]
+                    if {[randomInt 2]} {
+                        set ele [expr {$range-[randomInt [expr {$range*2}]]}]
+                    }
+                    r sadd set_$i $ele
+                    set cur($ele) x
+                    set union($ele) x
+                }
+                assert_encoding intset set_$i
+                if {$i == 0} {
+                    array set inter [array get cur]
+                } else {
+                    foreach ele [array names inter] {
+                        if {![info exists cur($ele)]} {unset inter($ele)}
+                    }
+                }
+            }
+            assert_equal [lsort [array names inter]] [lsort [r sinter {*}$args]]
+            assert_equal [lsort [array names union]] [lsort [r sunion {*}$args]]
+            r sinterstore setres {*}$args
+            assert_equal [lsort [array names inter]] [lsort [r smembers setres]]
+            r sunionstore setres {*}$args
+            assert_equal [lsort [array names union]] [lsort [r smembers setres]]
+        }
+    }
+
+    test "SUNIONSTORE of intsets converts a too large result" {
+        r del set1 set2 setres
+        r config set set-max-intset-entries 10
+        r sadd set1 1 2 3 4 5 6
+        r sadd set2 4 5 6 7 8 9 10 11 12
+        assert_equal 12 [r sunionstore setres set1 set2]
+        assert_encoding roaring setres
+        assert_equal 3 [r sinterstore setres set1 set2]
+        assert_encoding intset setres
+        r config set set-max-intset-entries 512
+    } {OK}
+
+    test "SINTER, SUNION and SDIFF fuzzing with roaring bitmaps" {
+        r config set set-max-intset-entries 16
+        for {set j 0} {$j < 50} {incr j} {
+            unset -nocomplain cur
+            set args {}
+            set num_sets [expr {[randomInt 4]+1}]
+            for {set i 0} {$i < $num_sets} {incr i} {
+                r del set_$i
+                lappend args set_$i
+                set base [expr {[randomInt 3]*65536-65536}]
+                for {set k [randomInt 300]} {$k > 0} {incr k -1} {
+                    randpath {
+                        set ele [expr {$base+[randomInt 400]}]
+                    } {
+                        set ele [randomSignedInt 200000]
+                    }
+                    r sadd set_$i $ele
+                }
+                if {[randomInt 10] == 0} {r sadd set_$i foo}
+                set cur($i) [r smembers set_$i]
+            }
+            lappend args nokey
+
+            # Compute the expected results from the members of every set.
+            unset -nocomplain union diff
+            array set union {}
+            array set diff {}
+            foreach ele $cur(0) {set diff($ele) x}
+            for {set i 0} {$i < $num_sets} {incr i} {
+                foreach ele $cur($i) {
+                    set union($ele) x
+                    if {$i} {unset -nocomplain diff($ele)}
+                }
+            }
+            assert_equal [lsort [array names union]] [lsort [r sunion {*}$args]]
+            assert_equal [lsort [array names diff]] [lsort [r sdiff {*}$args]]
+            assert_equal {} [r sinter {*}$args]
+            set args [lrange $args 0 end-1]
+            set res [lsort [r sinter {*}$args]]
+            foreach ele $res {
+                for {set i 0} {$i < $num_sets} {incr i} {
+                    assert {[lsearch -exact $cur($i) $ele] != -1}
+                }
+            }
+            foreach ele $cur(0) {
+                if {[lsearch -exact $res $ele] != -1} continue
+                set inall 1
+                for {set i 1} {$i < $num_sets} {incr i} {
+                    if {[lsearch -exact $cur($i) $ele] == -1} {set inall 0}
+                }
+                assert_equal 0 $inall
+            }
+            foreach op {sinterstore sunionstore sdiffstore} \
+                     cmd {sinter sunion sdiff} {
+                r $op setres {*}$args
+                assert_equal [lsort [r $cmd {*}$args]] [lsort [r smembers setres]]
+            }
+        }
+        r config set set-max-intset-entries 512
+    } {OK}
+
     test "SINTER against non-set should throw error" {
         r set key1 x
         assert_error "WRONGTYPE*" {r sinter key1 noset}
@@ -304,6 +495,43 @@ start_server {
         }
     }
 
+    test "SPOP and SRANDMEMBER - roaring" {
+        r del myset
+        for {set i 0} {$i < 1000} {incr i} { r sadd myset [expr {$i-500}] }
+        assert_encoding roaring myset
+        for {set i 0} {$i < 100} {incr i} {
+            set ele [r srandmember myset]
+            assert {$ele >= -500 && $ele < 500}
+        }
+        unset -nocomplain popped
+        array set popped {}
+        for {set i 0} {$i < 1000} {incr i} {
+            set popped([r spop myset]) 1
+        }
+        assert_equal 1000 [array size popped]
+        assert_equal 0 [r exists myset]
+    }
+
+    test "SRANDMEMBER distribution - roaring with uneven containers" {
+        # The first 1000 integers share a container, the last one has its
+        # own: it should be returned once every 1001 calls, not half of them.
+        r del myset
+        for {set i 1} {$i <= 1000} {incr i} { r sadd myset $i }
+        r sadd myset 10000000000
+        assert_encoding roaring myset
+        set outliers 0
+        set low 0
+        foreach ele [r srandmember myset -10000] {
+            if {$ele == 10000000000} {
+                incr outliers
+            } elseif {$ele <= 500} {
+                incr low
+            }
+        }
+        assert {$outliers < 50}
+        assert {$low > 4500 && $low < 5500}
+    }
+
     test "SRANDMEMBER with <count> against non existing key" {
         r srandmember nonexisting_key 100
     } {}
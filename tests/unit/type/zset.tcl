@@ -7,7 +7,7 @@ start_server {tags {"zset"}} {
     }
 
     proc basics {encoding} {
-        if {$encoding == "ziplist"} {
+        if {$encoding == "listpack"} {
             r config set zset-max-ziplist-entries 128
             r config set zset-max-ziplist-value 64
         } elseif {$encoding == "skiplist"} {
@@ -564,7 +564,7 @@ start_server {tags {"zset"}} {
         }
     }
 
-    basics ziplist
+    basics listpack
     basics skiplist
 
     test {ZINTERSTORE regression with two sets, intset+hashtable} {
@@ -580,7 +580,7 @@ start_server {tags {"zset"}} {
         r zrange out 0 -1 withscores
     } {neginf 0}
 
-    test {ZINTERSTORE #516 regression, mixed sets and ziplist zsets} {
+    test {ZINTERSTORE #516 regression, mixed sets and listpack zsets} {
         r sadd one 100 101 102 103
         r sadd two 100 200 201 202
         r zadd three 1 500 1 501 1 502 1 503 1 100
@@ -611,7 +611,7 @@ start_server {tags {"zset"}} {
     }
 
     proc stressers {encoding} {
-        if {$encoding == "ziplist"} {
+        if {$encoding == "listpack"} {
             # Little extra to allow proper fuzzing in the sorting stresser
             r config set zset-max-ziplist-entries 256
             r config set zset-max-ziplist-value 64
@@ -935,10 +935,43 @@ start_server {tags {"zset"}} {
             }
             assert_equal {} $err
         }
+
+        test "ZSETs score ranges with many repeated scores - $encoding" {
+            r del myzset
+            catch {unset model}
+            array set model {}
+            for {set k 0} {$k < 2000} {incr k} {
+                set ele [randomInt $elements]
+                if {[expr rand()] < .3} {
+                    r zrem myzset $ele
+                    unset -nocomplain model($ele)
+                } else {
+                    set score [randomInt 10]
+                    r zadd myzset $score $ele
+                    set model($ele) $score
+                }
+            }
+            assert_encoding $encoding myzset
+            for {set score 0} {$score < 10} {incr score} {
+                set expected {}
+                foreach {ele s} [array get model] {
+                    if {$s == $score} {lappend expected $ele}
+                }
+                set expected [lsort $expected]
+                assert_equal $expected [r zrangebyscore myzset $score $score]
+                assert_equal [llength $expected] [r zcount myzset $score $score]
+                assert_equal [llength $expected] \
+                    [r zcount myzset $score ([expr {$score+1}]]
+                foreach ele $expected {
+                    assert_equal $ele [lindex [r zrange myzset \
+                        [r zrank myzset $ele] [r zrank myzset $ele]] 0]
+                }
+            }
+        }
     }
 
     tags {"slow"} {
-        stressers ziplist
+        stressers listpack
         stressers skiplist
     }
 }